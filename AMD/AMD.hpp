@@ -22,6 +22,8 @@
 
 #include "Exception.hpp"
 
+#include "GradMode.hpp"
+
 #include "ScalarMatrixFunc.hpp"
 
 #include "MatrixMatrixFunc.hpp"
@@ -42,4 +44,33 @@
 
 #include "SymbolicOptimizer.hpp"
 
+#include "ComputationGraph.hpp"
+
+#include "IncrementalEvaluator.hpp"
+
+#include "Gradients.hpp"
+
+#include "ThreadBudget.hpp"
+#include "ThreadPool.hpp"
+
+#include "GraphWorkspace.hpp"
+
+#include "SharedEvaluator.hpp"
+#include "BatchEvaluator.hpp"
+#include "AsyncEvaluator.hpp"
+#include "MultiRootEvaluator.hpp"
+
+#include "TangentEvaluator.hpp"
+#include "Jacobian.hpp"
+#include "TaylorEvaluator.hpp"
+
+#include "HessianVector.hpp"
+#include "SparseHessian.hpp"
+#include "PatternGradient.hpp"
+#include "MemoryPlan.hpp"
+#include "CheckpointEvaluator.hpp"
+#include "Autotuner.hpp"
+#include "GraphFile.hpp"
+#include "KernelGenerator.hpp"
+
 #endif /** AMD_HPP */
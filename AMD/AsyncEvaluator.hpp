@@ -0,0 +1,230 @@
+#ifndef AMD_ASYNC_EVALUATOR_HPP
+#define AMD_ASYNC_EVALUATOR_HPP
+
+/**
+ * @file AsyncEvaluator.hpp
+ *
+ * @brief This file defines an evaluator that computes trace/logdet of a
+ * recorded objective and its gradients asynchronously. The calling thread
+ * only queues the work on an executor (a ThreadPool or any function that
+ * runs tasks) and gets a std::future or a completion callback back. The
+ * sweeps report their progress after each node and check a
+ * CancellationToken between nodes, so an evaluation whose deadline has
+ * passed can be abandoned part of the way through.
+ *
+ * \code
+ * AMD::ThreadPool pool(4);
+ * AMD::AsyncEvaluator<MT, ST> async(graph, pool);
+ * AMD::CancellationToken token;
+ * std::future<AMD::EvaluationResult<MT, ST> > result =
+ *   async.evaluate(point, true, token);
+ * if (result.wait_for(deadline) != std::future_status::ready) token.cancel();
+ * \endcode
+ */
+
+#include <vector>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <exception>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "SharedEvaluator.hpp"
+#include "ThreadPool.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief A flag shared by the copies of a token; cancel() on any copy
+   * stops the evaluations that were given one of them.
+   */
+  class CancellationToken {
+    public:
+    CancellationToken() : flag(new std::atomic<bool>(false)) {}
+
+    /**
+     * @brief Ask the evaluations using this token to stop.
+     */
+    void cancel() const { flag->store(true); }
+
+    /**
+     * @brief Has cancel() been called?
+     */
+    bool isCancelled() const { return flag->load(); }
+
+    private:
+    boost::shared_ptr<std::atomic<bool> > flag; /**< the shared flag */
+  };
+
+  /**
+   * @brief The outcome of one asynchronous evaluation.
+   */
+  template <class MT, class ST>
+  struct EvaluationResult {
+    ST value; /**< trace/logdet of the root */
+    std::vector<MT> gradient; /**< by variable index; empty if not asked */
+
+    EvaluationResult() : value(ST(0)) {}
+  };
+
+  /**
+   * @brief Evaluate one graph asynchronously.
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class AsyncEvaluator {
+    public:
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphWorkspace<MT, ST> WorkspaceType;
+    typedef SharedEvaluator<MT, ST> SharedType;
+    typedef EvaluationResult<MT, ST> ResultType;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MT> BindingType;
+    typedef std::function<void()> TaskType;
+    /** Runs a task, now or later, on any thread */
+    typedef std::function<void(const TaskType&)> ExecutorType;
+    /** Called as progress(done, total) after each node of the sweeps */
+    typedef std::function<void(int, int)> ProgressType;
+    /** Called once with the result, or with the exception that stopped it */
+    typedef std::function<void(const ResultType&, std::exception_ptr)>
+      CompletionType;
+
+    /**
+     * @brief Create an evaluator that runs on the workers of a pool.
+     *
+     * @param[in] graph The graph to evaluate; it must have a scalar root.
+     * @param[in] pool  The workers to use; must outlive the evaluations.
+     */
+    AsyncEvaluator(const GraphType& graph, ThreadPool& pool) :
+      shared(new SharedType(graph)),
+      executor(std::bind(&ThreadPool::submit, &pool, std::placeholders::_1))
+    {}
+
+    /**
+     * @brief Create an evaluator that runs on any executor.
+     *
+     * @param[in] graph    The graph to evaluate; it must have a scalar root.
+     * @param[in] executor Called with each task to run.
+     */
+    AsyncEvaluator(const GraphType& graph, const ExecutorType& executor) :
+      shared(new SharedType(graph)),
+      executor(executor) {}
+
+    /**
+     * @brief Get the graph that is evaluated.
+     */
+    const GraphType& getGraph() const { return shared->getGraph(); }
+
+    /**
+     * @brief Queue an evaluation and call done when it has finished, was
+     * cancelled (with an AMD_CANCELLED exception) or failed. The binding is
+     * copied, so the caller does not have to keep it alive. done and
+     * progress are called on the thread that runs the task, and must not
+     * throw.
+     *
+     * @param[in] binding      binding[v] is the value of variable v.
+     * @param[in] withGradient Compute the gradient too.
+     * @param[in] done         Called with the result.
+     * @param[in] token        Checked between the nodes of the sweeps.
+     * @param[in] progress     If set, called after each node.
+     */
+    void evaluate(const BindingType& binding,
+                  bool withGradient,
+                  const CompletionType& done,
+                  const CancellationToken& token = CancellationToken(),
+                  const ProgressType& progress = ProgressType()) {
+      const boost::shared_ptr<const SharedType> evaluator = shared;
+      const boost::shared_ptr<const BindingType> point(
+                                                  new BindingType(binding));
+      executor([evaluator, point, withGradient, done, token, progress]() {
+        ResultType result;
+        std::exception_ptr error;
+        try {
+          if (token.isCancelled()) {
+            throw exception_generic_impl("AMD::AsyncEvaluator::evaluate",
+                                         "The evaluation was cancelled",
+                                         AMD_CANCELLED);
+          }
+          evaluator->checkBinding(*point);
+
+          const GraphType& graph = evaluator->getGraph();
+          Monitor monitor(token,
+                          progress,
+                          graph.size() * (withGradient ? 2 : 1));
+          WorkspaceType ws;
+          result.value = evaluator->evaluateChecked(*point,
+                                                    ws,
+                                                    withGradient ?
+                                                      &result.gradient : NULL,
+                                                    &monitor);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        done(result, error);
+      });
+    }
+
+    /**
+     * @brief Queue an evaluation and get its result as a future. The future
+     * rethrows the exception that stopped the evaluation, if any.
+     *
+     * @param[in] binding      binding[v] is the value of variable v.
+     * @param[in] withGradient Compute the gradient too.
+     * @param[in] token        Checked between the nodes of the sweeps.
+     * @param[in] progress     If set, called after each node.
+     */
+    std::future<ResultType> evaluate(
+                  const BindingType& binding,
+                  bool withGradient,
+                  const CancellationToken& token = CancellationToken(),
+                  const ProgressType& progress = ProgressType()) {
+      const boost::shared_ptr<std::promise<ResultType> > promise(
+                                              new std::promise<ResultType>());
+      std::future<ResultType> future = promise->get_future();
+      evaluate(binding,
+               withGradient,
+               [promise](const ResultType& result, std::exception_ptr error) {
+                 if (error) promise->set_exception(error);
+                 else promise->set_value(result);
+               },
+               token,
+               progress);
+      return future;
+    }
+
+    private:
+    AsyncEvaluator(const AsyncEvaluator&);
+    AsyncEvaluator& operator=(const AsyncEvaluator&);
+
+    /** Reports the progress and stops the sweeps once cancelled */
+    struct Monitor : public SweepMonitor {
+      Monitor(const CancellationToken& token,
+              const ProgressType& progress,
+              int total) :
+        token(token), progress(progress), done(0), total(total) {}
+
+      bool nodeDone(int /*node*/) {
+        ++done;
+        if (progress) progress(done, total);
+        return !token.isCancelled();
+      }
+
+      const CancellationToken& token;
+      const ProgressType& progress;
+      int done;
+      const int total;
+    };
+
+    /** Shared with the queued tasks, which may outlive the evaluator */
+    boost::shared_ptr<const SharedType> shared;
+    ExecutorType executor; /**< runs the tasks */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_ASYNC_EVALUATOR_HPP */
@@ -0,0 +1,524 @@
+#ifndef AMD_AUTOTUNER_HPP
+#define AMD_AUTOTUNER_HPP
+
+/**
+ * @file Autotuner.hpp
+ *
+ * @brief This file defines an evaluator that times the alternatives of the
+ * choices that depend on the sizes and on the machine, picks the fastest,
+ * and remembers the choice for each shape in a TuningProfile. The profile
+ * can be saved to a file and loaded by later runs, which then skip the
+ * timing. Two choices are tuned:
+ *   - the association of products: (A*B)*C or A*(B*C), for every product
+ *     whose inner product is not used anywhere else, timed with
+ *     MatrixAdaptor_t::multiply; the graph is rewritten accordingly;
+ *   - the kernel of inverses (InverseKernels_t), e.g. an LU inverse or a
+ *     Cholesky solve with the identity for dense Eigen matrices.
+ * Both are timed on the values of the first evaluation.
+ *
+ * \code
+ * AMD::TuningProfile profile;
+ * profile.load("amd.profile"); // false on the first run
+ * AMD::TunedEvaluator<MT, ST> tuned(graph, profile);
+ * ST f = tuned.evaluate(point, &gradient);
+ * profile.save("amd.profile");
+ * \endcode
+ */
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief The choices made for each shape, as (key, choice) strings. The
+   * file format is one "key = choice" pair per line; lines starting with #
+   * are comments.
+   */
+  class TuningProfile {
+    public:
+    typedef std::map<std::string, std::string> ChoiceMap;
+
+    /**
+     * @brief Look up the choice for a key.
+     * @return true if there is one.
+     */
+    bool find(const std::string& key, std::string& choice) const {
+      ChoiceMap::const_iterator it = choices.find(key);
+      if (choices.end() == it) return false;
+      choice = it->second;
+      return true;
+    }
+
+    /**
+     * @brief Set the choice for a key.
+     */
+    void set(const std::string& key, const std::string& choice) {
+      choices[key] = choice;
+    }
+
+    /**
+     * @brief Get the number of choices.
+     */
+    int size() const { return choices.size(); }
+
+    /**
+     * @brief Get all the choices.
+     */
+    const ChoiceMap& getChoices() const { return choices; }
+
+    /**
+     * @brief Add the choices in a file to this profile.
+     * @return false if the file cannot be opened.
+     */
+    bool load(const std::string& path) {
+      std::ifstream in(path.c_str());
+      if (!in) return false;
+
+      std::string line;
+      while (std::getline(in, line)) {
+        if (line.empty() || '#' == line[0]) continue;
+        const std::string::size_type equals = line.find(" = ");
+        if (std::string::npos == equals) {
+          throw exception_generic_impl("AMD::TuningProfile::load",
+                                       "Malformed line in the profile",
+                                       AMD_INVALID_ARGUMENTS);
+        }
+        set(line.substr(0, equals), line.substr(equals + 3));
+      }
+      return true;
+    }
+
+    /**
+     * @brief Write the choices to a file.
+     */
+    void save(const std::string& path) const {
+      std::ofstream out(path.c_str());
+      out << "# AMD tuning profile" << std::endl;
+      ChoiceMap::const_iterator it = choices.begin();
+      for (; it != choices.end(); ++it) {
+        out << it->first << " = " << it->second << std::endl;
+      }
+      if (!out) {
+        throw exception_generic_impl("AMD::TuningProfile::save",
+                                     "Could not write the profile",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+    }
+
+    private:
+    ChoiceMap choices; /**< choice by key */
+  };
+
+  /**
+   * @brief The ways to compute an inverse. Kernel 0 must work for every
+   * input; the others may decline an input by returning false.
+   */
+  template <class MT>
+  struct InverseKernels_t {
+    static int size() { return 1; }
+
+    static const char* name(int /*kernel*/) { return "inv"; }
+
+    static bool apply(int /*kernel*/, const MT& A, MT& B) {
+      MatrixAdaptor_t<MT>::inv(A, B);
+      return true;
+    }
+  };
+
+#if AMD_HAVE_EIGEN==1
+
+  /**
+   * @brief Dense Eigen matrices: an LU inverse, or a Cholesky solve with the
+   * identity for symmetric positive definite matrices.
+   */
+  template <class T>
+  struct InverseKernels_t<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> > {
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+
+    static int size() { return 2; }
+
+    static const char* name(int kernel) { return (0 == kernel) ? "lu" : "llt"; }
+
+    static bool apply(int kernel, const MatrixType& A, MatrixType& B) {
+      if (0 == kernel) {
+        B = A.partialPivLu().inverse();
+        return true;
+      }
+      /** LLT only reads the lower triangle */
+      if (!A.isApprox(A.transpose())) return false;
+      Eigen::LLT<MatrixType> llt(A);
+      if (Eigen::Success != llt.info()) return false;
+      B = llt.solve(MatrixType::Identity(A.rows(), A.cols()));
+      return true;
+    }
+  };
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+  /**
+   * @brief Evaluate a graph with the choices of a TuningProfile, timing the
+   * choices that are not in the profile yet on the first evaluation.
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class TunedEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef InverseKernels_t<MT> InverseKernelsType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+    typedef GraphWorkspace<MT, ST> WorkspaceType;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MT> BindingType;
+
+    /**
+     * @brief Create an evaluator; nothing is timed until evaluate().
+     *
+     * @param[in]     graph   The graph to evaluate; it must have a scalar
+     *                        root.
+     * @param[in,out] profile The choices; the ones that are timed are added.
+     *                        It must outlive the evaluator.
+     * @param[in]     repeats How many times each alternative is timed.
+     */
+    TunedEvaluator(const GraphType& graph,
+                   TuningProfile& profile,
+                   int repeats = 3) :
+      original(graph),
+      profile(profile),
+      repeats((0 < repeats) ? repeats : 1),
+      tuned(false),
+      rewrites(0),
+      timed(0) {
+      AMD_START_TRY_BLOCK()
+
+      if (kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::TunedEvaluator",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, TunedEvaluator)
+    }
+
+    /**
+     * @brief Evaluate the function (and optionally its gradients). The first
+     * call tunes the graph.
+     *
+     * @param[in]  binding  binding[v] is the value of variable v; empty to
+     *                      use the values of the leaves.
+     * @param[out] gradient If not NULL, (*gradient)[v] is the gradient
+     *                      with respect to variable v.
+     * @return trace/logdet of the root.
+     */
+    ST evaluate(const BindingType& binding = BindingType(),
+                BindingType* gradient = NULL) {
+      ST value = ST(0);
+      AMD_START_TRY_BLOCK()
+
+      std::vector<const MT*> variables(binding.size());
+      for (size_t v=0; v<binding.size(); ++v) variables[v] = &binding[v];
+      if (!variables.empty() &&
+          static_cast<int>(variables.size()) != original.numVariables()) {
+        throw exception_generic_impl("AMD::TunedEvaluator::evaluate",
+                                     "Need one value per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+
+      if (false == tuned) tune(variables);
+      forward(variables);
+      value = rootValue<MT, ST>(graph.rootOp(), *ws.values[graph.root()]);
+
+      if (NULL != gradient) {
+        reverseSweep(graph, ws);
+        gradient->resize(graph.numVariables());
+        for (int v=0; v<graph.numVariables(); ++v) {
+          MatrixAdaptorType::copy((*gradient)[v],
+                                  ws.adjoints[graph.variable(v)]);
+        }
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, TunedEvaluator::evaluate)
+      return value;
+    }
+
+    /**
+     * @brief Get the rewritten graph (the original one before evaluate()).
+     */
+    const GraphType& getGraph() const { return tuned ? graph : original; }
+
+    /**
+     * @brief Get the number of products that were re-associated.
+     */
+    int numRewrites() const { return rewrites; }
+
+    /**
+     * @brief Get the number of choices that had to be timed because they
+     * were not in the profile.
+     */
+    int numTimed() const { return timed; }
+
+    private:
+    TunedEvaluator(const TunedEvaluator&);
+    TunedEvaluator& operator=(const TunedEvaluator&);
+
+    typedef std::chrono::steady_clock ClockType;
+
+    /** Key of the association of (A*B)*C, where A is m x k, B is k x l and
+        C is l x n */
+    static std::string timesKey(int m, int k, int l, int n) {
+      std::ostringstream key;
+      key << "times " << m << " " << k << " " << l << " " << n;
+      return key.str();
+    }
+
+    static std::string invKey(int n) {
+      std::ostringstream key;
+      key << "inv " << n;
+      return key.str();
+    }
+
+    /** Time the products of one association; the result is kept */
+    double timeProducts(const MT& first, const MT& second, const MT& third,
+                        bool leftFirst, MT& inner) const {
+      double best = 0.0;
+      for (int r=0; r<repeats; ++r) {
+        MT outer;
+        const ClockType::time_point start = ClockType::now();
+        if (leftFirst) {
+          MatrixAdaptorType::multiply(first, second, inner);
+          MatrixAdaptorType::multiply(inner, third, outer);
+        } else {
+          MatrixAdaptorType::multiply(second, third, inner);
+          MatrixAdaptorType::multiply(first, inner, outer);
+        }
+        const double time =
+          std::chrono::duration<double>(ClockType::now() - start).count();
+        if (0 == r || time < best) best = time;
+      }
+      return best;
+    }
+
+    /**
+     * @brief Decide whether (A*B)*C should be computed as A*(B*C).
+     *
+     * @param[out] inner If timed, B*C (when the answer is yes).
+     */
+    bool preferRight(const MT& A, const MT& B, const MT& C, MT& inner) {
+      const std::string key = timesKey(MatrixAdaptorType::getNumRows(A),
+                                       MatrixAdaptorType::getNumCols(A),
+                                       MatrixAdaptorType::getNumCols(B),
+                                       MatrixAdaptorType::getNumCols(C));
+      std::string choice;
+      if (!profile.find(key, choice)) {
+        MT leftInner;
+        const double leftTime = timeProducts(A, B, C, true, leftInner);
+        const double rightTime = timeProducts(A, B, C, false, inner);
+        choice = (rightTime < leftTime) ? "right" : "left";
+        profile.set(key, choice);
+        ++timed;
+      } else if ("right" == choice) {
+        MatrixAdaptorType::multiply(B, C, inner);
+      }
+      return "right" == choice;
+    }
+
+    /**
+     * @brief Rewrite the products and re-sort the nodes.
+     */
+    void tune(const std::vector<const MT*>& variables) {
+      WorkspaceType initial;
+      forwardSweep(original, variables, initial);
+
+      std::vector<NodeType> nodes;
+      std::vector<const MT*> values(initial.values);
+      std::vector<int> uses(original.size());
+      for (int i=0; i<original.size(); ++i) {
+        nodes.push_back(original.node(i));
+        uses[i] = original.parents(i).size();
+      }
+      std::deque<MT> created; /**< values of the new nodes */
+
+      for (int i=0; i<original.size(); ++i) {
+        if (TIMES != nodes[i].opNum) continue;
+        const int left = nodes[i].left;
+        const int right = nodes[i].right;
+
+        if (TIMES == nodes[left].opNum && 1 == uses[left]) {
+          /** (A*B)*C -> A*(B*C) */
+          const int a = nodes[left].left;
+          const int b = nodes[left].right;
+          created.push_back(MT());
+          if (!preferRight(*values[a], *values[b], *values[right],
+                           created.back())) {
+            created.pop_back();
+            continue;
+          }
+          nodes.push_back(product(nodes, b, right));
+          values.push_back(&created.back());
+          uses.push_back(1);
+          uses[left] = 0;
+          nodes[i].left = a;
+          nodes[i].right = nodes.size() - 1;
+          ++rewrites;
+        } else if (TIMES == nodes[right].opNum && 1 == uses[right]) {
+          /** A*(B*C) -> (A*B)*C, i.e. the mirror image */
+          const int b = nodes[right].left;
+          const int c = nodes[right].right;
+          MT inner;
+          if (preferRight(*values[left], *values[b], *values[c], inner)) {
+            continue;
+          }
+          created.push_back(MT());
+          MatrixAdaptorType::multiply(*values[left], *values[b],
+                                      created.back());
+          nodes.push_back(product(nodes, left, b));
+          values.push_back(&created.back());
+          uses.push_back(1);
+          uses[right] = 0;
+          nodes[i].left = nodes.size() - 1;
+          nodes[i].right = c;
+          ++rewrites;
+        }
+      }
+
+      /** Re-sort the nodes that are still used in post-order */
+      std::vector<int> order(nodes.size(), -1);
+      std::vector<NodeType> sorted;
+      place(original.root(), nodes, order, sorted);
+      graph = GraphType(sorted, original.rootOp());
+
+      /** Time the inverses on the values of the rewritten graph */
+      inverseKernel.assign(graph.size(), 0);
+      ws.values.resize(graph.size());
+      ws.buffers.resize(graph.size());
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+        evaluateNode(variables, i);
+        if (INV == node.opNum) {
+          inverseKernel[i] = chooseInverse(*ws.values[node.left]);
+        }
+      }
+      tuned = true;
+    }
+
+    static NodeType product(const std::vector<NodeType>& nodes,
+                            int left,
+                            int right) {
+      NodeType node;
+      node.opNum = TIMES;
+      node.left = left;
+      node.right = right;
+      node.numRows = nodes[left].numRows;
+      node.numCols = nodes[right].numCols;
+      node.isConst = nodes[left].isConst && nodes[right].isConst;
+      return node;
+    }
+
+    static int place(int i,
+                     const std::vector<NodeType>& nodes,
+                     std::vector<int>& order,
+                     std::vector<NodeType>& sorted) {
+      if (-1 != order[i]) return order[i];
+      NodeType node = nodes[i];
+      if (-1 != node.left) node.left = place(node.left, nodes, order, sorted);
+      if (-1 != node.right) {
+        node.right = place(node.right, nodes, order, sorted);
+      }
+      order[i] = sorted.size();
+      sorted.push_back(node);
+      return order[i];
+    }
+
+    /** Time the inverse kernels on A and return the fastest that works */
+    int chooseInverse(const MT& A) {
+      if (1 == InverseKernelsType::size()) return 0;
+
+      const std::string key = invKey(MatrixAdaptorType::getNumRows(A));
+      std::string choice;
+      if (profile.find(key, choice)) {
+        for (int k=0; k<InverseKernelsType::size(); ++k) {
+          if (choice == InverseKernelsType::name(k)) return k;
+        }
+      }
+
+      int best = 0;
+      double bestTime = 0.0;
+      for (int k=0; k<InverseKernelsType::size(); ++k) {
+        for (int r=0; r<repeats; ++r) {
+          MT result;
+          const ClockType::time_point start = ClockType::now();
+          if (!InverseKernelsType::apply(k, A, result)) break;
+          const double time =
+            std::chrono::duration<double>(ClockType::now() - start).count();
+          if ((0 == k && 0 == r) || time < bestTime) {
+            best = k;
+            bestTime = time;
+          }
+        }
+      }
+      profile.set(key, InverseKernelsType::name(best));
+      ++timed;
+      return best;
+    }
+
+    void evaluateNode(const std::vector<const MT*>& variables, int i) {
+      const NodeType& node = graph.node(i);
+      if (node.isLeaf()) {
+        const MT* bound = (-1 == node.varIndex || variables.empty()) ?
+                          NULL : variables[node.varIndex];
+        ws.values[i] = (NULL == bound) ? node.matrixPtr.get() : bound;
+        return;
+      }
+
+      if (INV == node.opNum && 0 != inverseKernel[i]) {
+        /** Fall back on kernel 0 for inputs the tuned kernel declines */
+        if (!InverseKernelsType::apply(inverseKernel[i],
+                                       *ws.values[node.left],
+                                       ws.buffers[i])) {
+          InverseKernelsType::apply(0, *ws.values[node.left], ws.buffers[i]);
+        }
+      } else if (INV == node.opNum) {
+        InverseKernelsType::apply(0, *ws.values[node.left], ws.buffers[i]);
+      } else {
+        forwardNode(node,
+                    ws.values[node.left],
+                    (-1 == node.right) ? NULL : ws.values[node.right],
+                    ws.buffers[i]);
+      }
+      ws.values[i] = &ws.buffers[i];
+    }
+
+    void forward(const std::vector<const MT*>& variables) {
+      ws.values.resize(graph.size());
+      ws.buffers.resize(graph.size());
+      for (int i=0; i<graph.size(); ++i) evaluateNode(variables, i);
+    }
+
+    const GraphType original; /**< the graph as recorded */
+    TuningProfile& profile; /**< the choices */
+    const int repeats; /**< timings of each alternative */
+    bool tuned; /**< has the graph been tuned yet */
+    GraphType graph; /**< the rewritten graph */
+    std::vector<int> inverseKernel; /**< kernel of each INV node */
+    WorkspaceType ws; /**< values and adjoints */
+    int rewrites; /**< number of re-associated products */
+    int timed; /**< number of choices that were timed */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_AUTOTUNER_HPP */
@@ -0,0 +1,110 @@
+#ifndef AMD_BATCH_EVALUATOR_HPP
+#define AMD_BATCH_EVALUATOR_HPP
+
+/**
+ * @file BatchEvaluator.hpp
+ *
+ * @brief This file defines an evaluator that computes trace/logdet of one
+ * ComputationGraph and its gradients for many independent bindings of the
+ * variables (eg., multi-start optimization or one model per user). The graph
+ * is recorded and analyzed once; the bindings are distributed over the
+ * workers of a ThreadPool, which share one SharedEvaluator and each keep
+ * their own GraphWorkspace.
+ */
+
+#include <vector>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "SharedEvaluator.hpp"
+#include "ThreadPool.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Evaluate one graph over many bindings of its variables.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(fA*fX, AMD::kTraceRoot);
+   * AMD::ThreadPool pool;
+   * AMD::BatchEvaluator<MT, ST> batch(graph, pool);
+   * std::vector<std::vector<MT> > bindings(N, std::vector<MT>(1)); // X_k
+   * std::vector<double> f;
+   * std::vector<std::vector<MT> > grads;
+   * batch.evaluate(bindings, f, &grads);
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class BatchEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphWorkspace<MT, ST> WorkspaceType;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MT> BindingType;
+
+    /**
+     * @brief Create an evaluator.
+     *
+     * @param[in] graph The graph to evaluate; it must have a scalar root.
+     * @param[in] pool  The workers to use; must outlive the evaluator.
+     */
+    BatchEvaluator(const GraphType& graph, ThreadPool& pool) :
+      shared(graph),
+      pool(pool),
+      workspaces(pool.size()) {}
+
+    /**
+     * @brief Get the graph that is evaluated.
+     */
+    const GraphType& getGraph() const { return shared.getGraph(); }
+
+    /**
+     * @brief Evaluate the function (and optionally its gradients) for each
+     * binding of the variables.
+     *
+     * @param[in]  bindings  bindings[k][v] is the value of variable v in
+     *                       instance k (see ComputationGraph::variable()).
+     * @param[out] values    values[k] is the function value of instance k.
+     * @param[out] gradients If not NULL, (*gradients)[k][v] is the gradient
+     *                       with respect to variable v in instance k.
+     */
+    void evaluate(const std::vector<BindingType>& bindings,
+                  std::vector<ST>& values,
+                  std::vector<BindingType>* gradients = NULL) {
+      AMD_START_TRY_BLOCK()
+
+      for (size_t k=0; k<bindings.size(); ++k) {
+        shared.checkBinding(bindings[k]);
+      }
+
+      values.resize(bindings.size());
+      if (NULL != gradients) gradients->resize(bindings.size());
+
+      pool.parallelFor(bindings.size(), [&](int k, int slot) {
+        values[k] = shared.evaluateChecked(bindings[k],
+                                           workspaces[slot],
+                                           (NULL == gradients) ?
+                                             NULL : &(*gradients)[k]);
+      });
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, BatchEvaluator::evaluate)
+    }
+
+    private:
+    BatchEvaluator(const BatchEvaluator&);
+    BatchEvaluator& operator=(const BatchEvaluator&);
+
+    SharedEvaluator<MT, ST> shared; /**< the graph and the sweeps */
+    ThreadPool& pool; /**< the workers */
+    std::vector<WorkspaceType> workspaces; /**< one per worker */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_BATCH_EVALUATOR_HPP */
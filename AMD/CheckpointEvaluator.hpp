@@ -0,0 +1,385 @@
+#ifndef AMD_CHECKPOINT_EVALUATOR_HPP
+#define AMD_CHECKPOINT_EVALUATOR_HPP
+
+/**
+ * @file CheckpointEvaluator.hpp
+ *
+ * @brief This file defines gradient evaluation of a ComputationGraph under a
+ * memory budget. The topological order of the graph is cut into segments.
+ * Only the values that are live across a cut (the checkpoints) and the
+ * values of the last segment are kept by the forward sweep. The reverse
+ * sweep then goes through the segments from the last to the first, each
+ * time recomputing the values of the segment from the checkpoints, running
+ * the reverse steps of the segment, and dropping the values again. More
+ * segments need less memory; every segment but the last is recomputed once,
+ * so the extra work is at most one forward sweep.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Evaluate the gradient of a graph with a trace/logdet root within
+   * a memory budget, recomputing forward values as needed.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(f, AMD::kTraceRoot);
+   * AMD::CheckpointEvaluator<MT, ST> eval(graph, 1UL << 30);
+   * ST value = eval.evaluate();
+   * std::cout << eval.peakBytes() << " instead of " << eval.storeAllBytes()
+   *           << " for " << eval.recomputeOverhead() << " extra forward work";
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class CheckpointEvaluator {
+    public:
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    /**
+     * @brief Choose the segments for a memory budget. The fewest segments
+     * whose planned peak fits the budget are used; if no number of segments
+     * fits, the one with the smallest peak is used.
+     *
+     * @param[in] graph       A graph whose root is kTraceRoot or kLogdetRoot.
+     * @param[in] budgetBytes The memory budget, counting matrices as dense.
+     */
+    CheckpointEvaluator(const GraphType& graph, std::size_t budgetBytes) :
+      graph(graph),
+      values(graph.size(), NULL),
+      buffers(graph.size()),
+      adjoints(graph.size()),
+      hasAdjoint(graph.size(), false) {
+      AMD_START_TRY_BLOCK()
+
+      if (kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::CheckpointEvaluator",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+
+      analyze();
+      plan(budgetBytes);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, CheckpointEvaluator)
+    }
+
+    /**
+     * @brief Run the forward sweep and the segmented reverse sweep.
+     *
+     * @return trace/logdet of the root.
+     */
+    ST evaluate() {
+      ST result = ST(0);
+      AMD_START_TRY_BLOCK()
+
+      result = forward();
+      reverse();
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, CheckpointEvaluator::evaluate)
+      return result;
+    }
+
+    /**
+     * @brief Get the gradient of variable v after evaluate().
+     */
+    const MT& gradient(int v) const {
+      const int i = graph.variable(v);
+      if (false == hasAdjoint[i]) {
+        throw exception_generic_impl("AMD::CheckpointEvaluator::gradient",
+                                     "The gradient has not been computed",
+                                     AMD_INVALID_OPERATION);
+      }
+      return adjoints[i];
+    }
+
+    /**
+     * @brief Get the number of segments.
+     */
+    int numSegments() const { return segmentStarts.size(); }
+
+    /**
+     * @brief Get the number of values kept as checkpoints.
+     */
+    int numCheckpoints() const {
+      return std::count(isCheckpoint.begin(), isCheckpoint.end(), true);
+    }
+
+    /**
+     * @brief Get the planned peak memory of values and adjoints, counting
+     * matrices as dense. Temporaries inside the kernels are not included.
+     */
+    std::size_t peakBytes() const { return peakBytesVal; }
+
+    /**
+     * @brief Get the memory needed to keep every value, counted the same
+     * way as peakBytes().
+     */
+    std::size_t storeAllBytes() const { return allValueBytes + adjointBytes; }
+
+    /**
+     * @brief Get the work of the recomputations relative to the forward
+     * sweep (0 when nothing is recomputed), estimated from the shapes.
+     */
+    double recomputeOverhead() const {
+      return (0.0 == forwardFlops) ? 0.0 : recomputeFlops/forwardFlops;
+    }
+
+    private:
+    CheckpointEvaluator(const CheckpointEvaluator&);
+    CheckpointEvaluator& operator=(const CheckpointEvaluator&);
+
+    static std::size_t denseBytes(const NodeType& node) {
+      return static_cast<std::size_t>(node.numRows)*node.numCols*sizeof(ST);
+    }
+
+    double flops(int i) const {
+      const NodeType& node = graph.node(i);
+      const double size = static_cast<double>(node.numRows)*node.numCols;
+      if (TIMES == node.opNum) return 2.0*size*graph.node(node.left).numCols;
+      if (INV == node.opNum) return size*node.numRows;
+      return size;
+    }
+
+    /**
+     * @brief Find the last node that reads each value (a reverse step only
+     * reads the values that the forward step of the same node read) and the
+     * peak memory of the adjoints.
+     */
+    void analyze() {
+      const int n = graph.size();
+      lastUser.resize(n);
+      allValueBytes = 0;
+      forwardFlops = 0.0;
+      for (int i=0; i<n; ++i) lastUser[i] = i;
+
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        if (node.isLeaf()) continue;
+        allValueBytes += denseBytes(node);
+        forwardFlops += flops(i);
+
+        const int children[2] = {node.left, node.right};
+        for (int side=0; side<2; ++side) {
+          if (-1 == children[side]) continue;
+          lastUser[children[side]] = i;
+        }
+      }
+
+      /** Adjoint i is live from its first parent in the reverse sweep (the
+          one with the largest index) down to its own step */
+      std::vector<std::size_t> born(n, 0), dies(n, 0);
+      std::size_t partialBytes = 0;
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        if (node.isConst) continue;
+        int first = i;
+        for (size_t p=0; p<graph.parents(i).size(); ++p) {
+          first = std::max(first, graph.parents(i)[p].first);
+        }
+        born[first] += denseBytes(node);
+        dies[node.isLeaf() ? 0 : i] += denseBytes(node);
+        if (i != graph.root()) partialBytes = std::max(partialBytes,
+                                                       denseBytes(node));
+      }
+      adjointBytes = 0;
+      std::size_t live = 0;
+      for (int p=n-1; p>=0; --p) {
+        live += born[p];
+        adjointBytes = std::max(adjointBytes, live);
+        live -= dies[p];
+      }
+      adjointBytes += partialBytes;
+    }
+
+    /**
+     * @brief Cut the graph into numSegments segments of about the same
+     * memory and compute the resulting peak and recomputation.
+     */
+    std::size_t segment(int numSegments, std::vector<int>& starts,
+                        std::vector<bool>& checkpoints, double& recompute) {
+      const int n = graph.size();
+      const std::size_t target = allValueBytes/numSegments + 1;
+      starts.assign(1, 0);
+      std::size_t bytes = 0;
+      for (int i=0; i<n; ++i) {
+        if (graph.node(i).isLeaf()) continue;
+        const std::size_t nodeBytes = denseBytes(graph.node(i));
+        if (0 < bytes && target < bytes + nodeBytes) {
+          starts.push_back(i);
+          bytes = 0;
+        }
+        bytes += nodeBytes;
+      }
+
+      /** A value is a checkpoint if a cut falls after it and at or before
+          its last user */
+      checkpoints.assign(n, false);
+      std::size_t checkpointBytes = 0;
+      for (int i=0; i<n; ++i) {
+        if (graph.node(i).isLeaf()) continue;
+        std::vector<int>::const_iterator cut =
+          std::upper_bound(starts.begin(), starts.end(), i);
+        if (cut != starts.end() && *cut <= lastUser[i]) {
+          checkpoints[i] = true;
+          checkpointBytes += denseBytes(graph.node(i));
+        }
+      }
+
+      std::size_t segmentBytes = 0;
+      recompute = 0.0;
+      for (size_t s=0; s<starts.size(); ++s) {
+        const int end = (s+1 == starts.size()) ? n : starts[s+1];
+        std::size_t sum = 0;
+        for (int i=starts[s]; i<end; ++i) {
+          if (graph.node(i).isLeaf() || checkpoints[i]) continue;
+          sum += denseBytes(graph.node(i));
+          if (s+1 != starts.size()) recompute += flops(i);
+        }
+        segmentBytes = std::max(segmentBytes, sum);
+      }
+
+      return checkpointBytes + segmentBytes + adjointBytes;
+    }
+
+    void plan(std::size_t budgetBytes) {
+      std::vector<int> starts;
+      std::vector<bool> checkpoints;
+      double recompute;
+      peakBytesVal = 0;
+
+      int numInternal = 0;
+      for (int i=0; i<graph.size(); ++i) {
+        if (!graph.node(i).isLeaf()) ++numInternal;
+      }
+
+      for (int k=1; k<=std::max(numInternal, 1); ++k) {
+        const std::size_t peak = segment(k, starts, checkpoints, recompute);
+        if (1 == k || peak < peakBytesVal) {
+          peakBytesVal = peak;
+          segmentStarts = starts;
+          isCheckpoint = checkpoints;
+          recomputeFlops = recompute;
+        }
+        if (peak <= budgetBytes) break;
+      }
+    }
+
+    void computeNode(int i) {
+      const NodeType& node = graph.node(i);
+      forwardNode(node,
+                  values[node.left],
+                  (-1 == node.right) ? NULL : values[node.right],
+                  buffers[i]);
+      values[i] = &buffers[i];
+    }
+
+    void release(int i) {
+      buffers[i] = MT();
+      values[i] = NULL;
+    }
+
+    ST forward() {
+      const int n = graph.size();
+      const int lastStart = segmentStarts.back();
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        if (node.isLeaf()) {
+          values[i] = node.matrixPtr.get();
+          continue;
+        }
+        computeNode(i);
+
+        /** Drop the values before the last segment that are neither
+            checkpoints nor needed by the rest of the forward sweep */
+        const int children[2] = {node.left, node.right};
+        for (int side=0; side<2; ++side) {
+          const int child = children[side];
+          if (-1 == child || graph.node(child).isLeaf() ||
+              isCheckpoint[child] || child >= lastStart ||
+              lastUser[child] != i || NULL == values[child]) continue;
+          release(child);
+        }
+      }
+      return rootValue<MT, ST>(graph.rootOp(), *values[graph.root()]);
+    }
+
+    void reverse() {
+      const int root = graph.root();
+      hasAdjoint.assign(graph.size(), false);
+      rootAdjoint<MT, ST>(graph.rootOp(), *values[root], adjoints[root]);
+      hasAdjoint[root] = true;
+
+      for (int s=numSegments()-1; s>=0; --s) {
+        const int start = segmentStarts[s];
+        const int end = (s+1 == numSegments()) ? graph.size() :
+                                                 segmentStarts[s+1];
+        for (int i=start; i<end; ++i) {
+          if (!graph.node(i).isLeaf() && NULL == values[i]) computeNode(i);
+        }
+
+        for (int i=end-1; i>=start; --i) reverseStep(i);
+
+        for (int i=start; i<end; ++i) {
+          if (!graph.node(i).isLeaf()) release(i);
+        }
+      }
+    }
+
+    void reverseStep(int i) {
+      const NodeType& node = graph.node(i);
+      if (node.isConst || node.isLeaf() || false == hasAdjoint[i]) return;
+
+      for (int side=0; side<2; ++side) {
+        const int child = (0 == side) ? node.left : node.right;
+        if (-1 == child || graph.node(child).isConst) continue;
+
+        partialAdjoint(node,
+                       side,
+                       *values[i],
+                       values[node.left],
+                       (-1 == node.right) ? NULL : values[node.right],
+                       adjoints[i],
+                       partial);
+        if (hasAdjoint[child]) {
+          MatrixAdaptorType::add(adjoints[child], partial, adjoints[child]);
+        } else {
+          /** Take over the buffer instead of copying it */
+          std::swap(adjoints[child], partial);
+          hasAdjoint[child] = true;
+        }
+      }
+      adjoints[i] = MT();
+    }
+
+    GraphType graph; /**< the graph */
+    std::vector<int> lastUser; /**< last node that reads each value */
+    std::vector<int> segmentStarts; /**< first node of each segment */
+    std::vector<bool> isCheckpoint; /**< values kept across segments */
+    std::size_t allValueBytes; /**< all the values of internal nodes */
+    std::size_t adjointBytes; /**< peak of the adjoints */
+    std::size_t peakBytesVal; /**< planned peak */
+    double forwardFlops; /**< estimated work of a forward sweep */
+    double recomputeFlops; /**< estimated work of the recomputations */
+    std::vector<const MT*> values; /**< value of each node, NULL if dropped */
+    std::vector<MT> buffers; /**< storage for the values */
+    std::vector<MT> adjoints; /**< adjoint of each node */
+    std::vector<bool> hasAdjoint; /**< has the adjoint been set yet */
+    MT partial; /**< scratch space for one partial adjoint */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_CHECKPOINT_EVALUATOR_HPP */
@@ -0,0 +1,481 @@
+#ifndef AMD_COMPUTATION_GRAPH_HPP
+#define AMD_COMPUTATION_GRAPH_HPP
+
+/**
+ * @file ComputationGraph.hpp
+ *
+ * @brief This file defines a linearized view of a recorded MatrixMatrixFunc
+ * tree and the numeric rules that are used to sweep over it. The operators
+ * on MatrixMatrixFunc make copies of their operands, so a recorded tree
+ * contains one copy of a subexpression for each time it is used. All the
+ * copies share the matrix computed by the operator, and ComputationGraph
+ * uses this to merge them back into a single node. The nodes are stored in
+ * topological order (children before parents, root last), which is the order
+ * of the forward sweep; the reverse sweep visits them backwards.
+ *
+ * The graph only holds on to the values of the leaves (which are shared with
+ * the recorded tree); the values of the internal nodes are recomputed by the
+ * evaluators that use the graph.
+ */
+
+#include <map>
+#include <vector>
+#include <utility>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "MatrixMatrixFunc.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief A node of the ComputationGraph.
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  struct GraphNode {
+    OpType opNum; /**< enum for the operator used at this node */
+    int left; /**< index of the left child, -1 if there is none */
+    int right; /**< index of the right child, -1 if there is none */
+    int numRows; /**< number of rows in the matrix of this node */
+    int numCols; /**< number of cols in the matrix of this node */
+    bool isConst; /**< does this node depend on a variable? */
+    MatrixType mType; /**< structure tag of the recorded node (kZero...) */
+    int varIndex; /**< index into the variables of the graph, -1 if none */
+    ST scalar; /**< the (constant) scalar of MTIMESS/STIMESM */
+    boost::shared_ptr<MT> matrixPtr; /**< the value of a leaf node */
+    boost::shared_ptr<unsigned long> versionPtr; /**< version of a leaf */
+
+    GraphNode() : opNum(NONE),
+      left(-1),
+      right(-1),
+      numRows(0),
+      numCols(0),
+      isConst(true),
+      mType(kGeneral),
+      varIndex(-1),
+      scalar(),
+      matrixPtr(),
+      versionPtr() { }
+
+    /**
+     * @brief Check if this is a leaf node (CONST or VAR).
+     */
+    bool isLeaf() const { return (-1 == left && -1 == right); }
+
+    /**
+     * @brief Get the version of the value of a leaf node. Leaves that do
+     * not track their version are reported as never having changed.
+     */
+    unsigned long version() const { return versionPtr ? *versionPtr : 0; }
+  };
+
+  /**
+   * @brief Linearized view of a recorded MatrixMatrixFunc tree. Nodes that
+   * share the same recorded matrix are merged, so the result is a DAG.
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class ComputationGraph {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef MatrixMatrixFunc<MT, ST> MMF;
+    typedef GraphNode<MT, ST> NodeType;
+    typedef std::pair<int, int> EdgeType; /**< (parent, 0:left/1:right) */
+
+    /**
+     * @brief Create an empty graph.
+     */
+    ComputationGraph() : rootOpType(kMatrixRoot) { }
+
+    /**
+     * @brief Linearize the tree rooted at root.
+     *
+     * @param[in] root   The root of the recorded tree.
+     * @param[in] rootOp The scalar function that is applied to the root.
+     */
+    ComputationGraph(const MMF& root, RootOpType rootOp = kMatrixRoot) :
+      rootOpType(rootOp) {
+      AMD_START_TRY_BLOCK()
+
+      std::map<const MT*, int> seen;
+      outputList.push_back(insert(root, seen));
+
+      if (kMatrixRoot != rootOpType &&
+          nodes.back().numRows != nodes.back().numCols) {
+        throw exception_generic_impl(
+          "AMD::ComputationGraph",
+          "scalar function (trace/logdet) called on non-square matrix",
+          AMD_INVALID_ARGUMENTS);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, ComputationGraph)
+    }
+
+    /**
+     * @brief Linearize several trees into one graph. Subexpressions that the
+     * trees share are merged like the copies within one tree, so each is
+     * evaluated once. The root of the graph is the last node; output(k) is
+     * the node of the k'th tree.
+     *
+     * @param[in] roots The roots of the recorded trees.
+     */
+    ComputationGraph(const std::vector<const MMF*>& roots) :
+      rootOpType(kMatrixRoot) {
+      AMD_START_TRY_BLOCK()
+
+      if (roots.empty()) {
+        throw exception_generic_impl("AMD::ComputationGraph",
+                                     "Need at least one root",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      std::map<const MT*, int> seen;
+      for (size_t k=0; k<roots.size(); ++k) {
+        outputList.push_back(insert(*roots[k], seen));
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, ComputationGraph)
+    }
+
+    /**
+     * @brief Create a graph from nodes in topological order, e.g. nodes
+     * of another graph that has been rewritten. The leaves keep their
+     * varIndex, which must number the variables from 0 without gaps.
+     *
+     * @param[in] nodeList The nodes; children come before their parents
+     *                     and the root is last.
+     * @param[in] rootOp   The scalar function that is applied to the root.
+     */
+    ComputationGraph(const std::vector<NodeType>& nodeList,
+                     RootOpType rootOp) :
+      nodes(nodeList),
+      parentList(nodeList.size()),
+      outputList(1, static_cast<int>(nodeList.size()) - 1),
+      rootOpType(rootOp) {
+      AMD_START_TRY_BLOCK()
+
+      for (int i=0; i<size(); ++i) {
+        const NodeType& node = nodes[i];
+        if (node.left >= i || node.right >= i ||
+            (node.isLeaf() && NULL == node.matrixPtr.get())) {
+          throw exception_generic_impl("AMD::ComputationGraph",
+                                       "Nodes are not in topological order",
+                                       AMD_INVALID_ARGUMENTS);
+        }
+        if (-1 != node.left) parentList[node.left].push_back(EdgeType(i,0));
+        if (-1 != node.right) parentList[node.right].push_back(EdgeType(i,1));
+        if (-1 == node.varIndex) continue;
+        if (node.varIndex >= static_cast<int>(variableList.size())) {
+          variableList.resize(node.varIndex + 1, -1);
+        }
+        variableList[node.varIndex] = i;
+      }
+      for (int v=0; v<numVariables(); ++v) {
+        if (-1 == variableList[v]) {
+          throw exception_generic_impl("AMD::ComputationGraph",
+                                       "Variables are not numbered densely",
+                                       AMD_INVALID_ARGUMENTS);
+        }
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, ComputationGraph)
+    }
+
+    /**
+     * @brief Get the number of nodes in the graph.
+     */
+    int size() const { return nodes.size(); }
+
+    /**
+     * @brief Get the index of the root, which is always the last node.
+     */
+    int root() const { return nodes.size() - 1; }
+
+    /**
+     * @brief Get the number of trees that the graph was made from.
+     */
+    int numOutputs() const { return outputList.size(); }
+
+    /**
+     * @brief Get the index of the root of the k'th tree that the graph was
+     * made from; there is only one unless it was made from several roots.
+     * @param[in] k Index of the tree.
+     */
+    int output(int k) const { return outputList[k]; }
+
+    /**
+     * @brief Get the function that is applied to the root.
+     */
+    RootOpType rootOp() const { return rootOpType; }
+
+    /**
+     * @brief Get a node of the graph.
+     * @param[in] i Index of the node.
+     */
+    const NodeType& node(int i) const { return nodes[i]; }
+
+    /**
+     * @brief Get the (parent, side) pairs of the edges that end in node i.
+     * @param[in] i Index of the node.
+     */
+    const std::vector<EdgeType>& parents(int i) const { return parentList[i]; }
+
+    /**
+     * @brief Get the number of distinct variable (VAR) leaves.
+     */
+    int numVariables() const { return variableList.size(); }
+
+    /**
+     * @brief Get the index of the node of the v'th variable.
+     * @param[in] v Index of the variable.
+     */
+    int variable(int v) const { return variableList[v]; }
+
+    /**
+     * @brief Find the variable that a VAR leaf (or any copy of it) refers to.
+     * @param[in] leaf The leaf that was used to record the tree.
+     * @return The index of the variable, -1 if leaf is not a variable of the
+     *         graph.
+     */
+    int variableIndex(const MMF& leaf) const {
+      for (int v=0; v<numVariables(); ++v) {
+        if (nodes[variableList[v]].matrixPtr == leaf.matrixPtr) return v;
+      }
+      return -1;
+    }
+
+    private:
+    /**
+     * @brief Add the tree rooted at mmf in post-order and return its index.
+     */
+    int insert(const MMF& mmf, std::map<const MT*, int>& seen) {
+      typename std::map<const MT*, int>::const_iterator found =
+        seen.find(mmf.matrixPtr.get());
+      if (seen.end() != found) return found->second;
+
+      NodeType node;
+      node.opNum = mmf.opNum;
+      node.numRows = mmf.getNumRows();
+      node.numCols = mmf.getNumCols();
+      node.isConst = mmf.isConst;
+      node.mType = mmf.mType;
+      if (NULL != mmf.leftChild) node.left = insert(*mmf.leftChild, seen);
+      if (NULL != mmf.rightChild) node.right = insert(*mmf.rightChild, seen);
+
+      if (NULL != mmf.scalarChild) {
+        if (false == mmf.scalarChild->isConst) {
+          throw exception_generic_impl(
+            "AMD::ComputationGraph::insert",
+            "Scalar children that depend on a variable are not supported",
+            AMD_INVALID_OPERATION);
+        }
+        node.scalar = mmf.scalarChild->functionVal;
+      }
+
+      if (node.isLeaf()) {
+        if (CONST != node.opNum && VAR != node.opNum) {
+          throw exception_generic_impl("AMD::ComputationGraph::insert",
+                                       "Leaf node is not CONST or VAR",
+                                       AMD_INVALID_OPERATION);
+        }
+        node.matrixPtr = mmf.matrixPtr;
+        node.versionPtr = mmf.versionPtr;
+        if (VAR == node.opNum) {
+          node.varIndex = variableList.size();
+          variableList.push_back(nodes.size());
+        }
+      }
+
+      const int index = nodes.size();
+      nodes.push_back(node);
+      parentList.push_back(std::vector<EdgeType>());
+      if (-1 != node.left) parentList[node.left].push_back(EdgeType(index,0));
+      if (-1 != node.right) parentList[node.right].push_back(EdgeType(index,1));
+      seen[mmf.matrixPtr.get()] = index;
+
+      return index;
+    }
+
+    std::vector<NodeType> nodes; /**< nodes in topological order */
+    std::vector<std::vector<EdgeType> > parentList; /**< incoming edges */
+    std::vector<int> variableList; /**< node index of each variable */
+    std::vector<int> outputList; /**< node index of the root of each tree */
+    RootOpType rootOpType; /**< function applied to the root */
+  };
+
+  /**
+   * @brief Compute the value of an internal node from the values of its
+   * children.
+   *
+   * @param[in]  node   The node to be evaluated.
+   * @param[in]  left   Value of the left child.
+   * @param[in]  right  Value of the right child (NULL for unary operators).
+   * @param[out] result Overwritten with the value of the node.
+   */
+  template <class MT, class ST>
+  void forwardNode(const GraphNode<MT, ST>& node,
+                   const MT* left,
+                   const MT* right,
+                   MT& result) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    switch (node.opNum) {
+      case PLUS: MatrixAdaptorType::add(*left, *right, result); break;
+      case MINUS: MatrixAdaptorType::minus(*left, *right, result); break;
+      case NEGATION: MatrixAdaptorType::negation(*left, result); break;
+      case TIMES: MatrixAdaptorType::multiply(*left, *right, result); break;
+      case MTIMESS:
+      case STIMESM:
+        MatrixAdaptorType::multiply(*left, node.scalar, result); break;
+      case ELEWISE:
+        MatrixAdaptorType::elementwiseProduct(*left, *right, result); break;
+      case TRANSPOSE: MatrixAdaptorType::transpose(*left, result); break;
+      case INV: MatrixAdaptorType::inv(*left, result); break;
+      case DIAG: MatrixAdaptorType::diag(*left, result); break;
+      default:
+        throw exception_generic_impl("AMD::forwardNode",
+                                     "Node is not an internal node",
+                                     AMD_INVALID_OPERATION);
+    }
+  }
+
+  /**
+   * @brief Compute the part of the adjoint of a child that comes from one of
+   * its parents. The adjoint of a node X is the derivative of the (scalar)
+   * function with respect to X, and has the same shape as X.
+   *
+   * @param[in]  node    The parent node.
+   * @param[in]  side    0 for the left child, 1 for the right child.
+   * @param[in]  value   Value of the parent node.
+   * @param[in]  left    Value of the left child.
+   * @param[in]  right   Value of the right child (NULL for unary operators).
+   * @param[in]  adjoint Adjoint of the parent node.
+   * @param[out] result  Overwritten with the adjoint of the child.
+   */
+  template <class MT, class ST>
+  void partialAdjoint(const GraphNode<MT, ST>& node,
+                      int side,
+                      const MT& value,
+                      const MT* left,
+                      const MT* right,
+                      const MT& adjoint,
+                      MT& result) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    switch (node.opNum) {
+      case PLUS: MatrixAdaptorType::copy(result, adjoint); break;
+      case MINUS:
+        if (0 == side) MatrixAdaptorType::copy(result, adjoint);
+        else MatrixAdaptorType::negation(adjoint, result);
+        break;
+      case NEGATION: MatrixAdaptorType::negation(adjoint, result); break;
+      case TIMES: {
+        /** d(L*R) gives adjoint*R^T for L and L^T*adjoint for R */
+        MT trans;
+        if (0 == side) {
+          MatrixAdaptorType::transpose(*right, trans);
+          MatrixAdaptorType::multiply(adjoint, trans, result);
+        } else {
+          MatrixAdaptorType::transpose(*left, trans);
+          MatrixAdaptorType::multiply(trans, adjoint, result);
+        }
+      }
+        break;
+      case MTIMESS:
+      case STIMESM:
+        MatrixAdaptorType::multiply(adjoint, node.scalar, result); break;
+      case ELEWISE:
+        MatrixAdaptorType::elementwiseProduct(adjoint,
+                                              (0 == side) ? *right : *left,
+                                              result);
+        break;
+      case TRANSPOSE: MatrixAdaptorType::transpose(adjoint, result); break;
+      case INV: {
+        /** d(inv(L)) gives -inv(L)^T*adjoint*inv(L)^T */
+        MT trans, tmp1, tmp2;
+        MatrixAdaptorType::transpose(value, trans);
+        MatrixAdaptorType::multiply(trans, adjoint, tmp1);
+        MatrixAdaptorType::multiply(tmp1, trans, tmp2);
+        MatrixAdaptorType::negation(tmp2, result);
+      }
+        break;
+      case DIAG: MatrixAdaptorType::diag(adjoint, result); break;
+      default:
+        throw exception_generic_impl("AMD::partialAdjoint",
+                                     "Node is not an internal node",
+                                     AMD_INVALID_OPERATION);
+    }
+  }
+
+  /**
+   * @brief Check if the partial adjoint that flows from a parent to one of
+   * its children uses the value of the left child, the right child or the
+   * parent itself. This is used to decide which partial adjoints are stale
+   * when values change.
+   *
+   * @param[in] opNum Operator of the parent.
+   * @param[in] side  0 for the left child, 1 for the right child.
+   * @param[in] which 0 for the left child, 1 for the right child and 2 for
+   *                  the parent.
+   */
+  inline bool partialAdjointUses(OpType opNum, int side, int which) {
+    switch (opNum) {
+      case TIMES:
+      case ELEWISE: return (which == 1 - side);
+      case INV: return (2 == which);
+      default: return false;
+    }
+  }
+
+  /**
+   * @brief Compute the scalar function at the root of the graph.
+   *
+   * @param[in] rootOp The scalar function (kTraceRoot or kLogdetRoot).
+   * @param[in] value  Value of the root node.
+   * @return trace(value) or logdet(value).
+   */
+  template <class MT, class ST>
+  ST rootValue(RootOpType rootOp, const MT& value) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    if (kTraceRoot == rootOp) return MatrixAdaptorType::trace(value);
+    else if (kLogdetRoot == rootOp) return MatrixAdaptorType::logdet(value);
+
+    throw exception_generic_impl("AMD::rootValue",
+                                 "The root of the graph is matrix valued",
+                                 AMD_INVALID_OPERATION);
+  }
+
+  /**
+   * @brief Compute the adjoint that seeds the reverse sweep for a scalar
+   * function at the root: the identity for trace and inv(value)^T for logdet.
+   *
+   * @param[in]  rootOp The scalar function (kTraceRoot or kLogdetRoot).
+   * @param[in]  value  Value of the root node.
+   * @param[out] result Overwritten with the seed.
+   */
+  template <class MT, class ST>
+  void rootAdjoint(RootOpType rootOp, const MT& value, MT& result) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    if (kTraceRoot == rootOp) {
+      result = MatrixAdaptorType::eye(MatrixAdaptorType::getNumRows(value));
+    } else if (kLogdetRoot == rootOp) {
+      MT valueInv;
+      MatrixAdaptorType::inv(value, valueInv);
+      MatrixAdaptorType::transpose(valueInv, result);
+    } else {
+      throw exception_generic_impl("AMD::rootAdjoint",
+                                   "The root of the graph is matrix valued",
+                                   AMD_INVALID_OPERATION);
+    }
+  }
+
+} /** namespace AMD */
+
+#endif /** AMD_COMPUTATION_GRAPH_HPP */
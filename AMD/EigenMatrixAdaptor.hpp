@@ -6,6 +6,7 @@
 #include <Eigen/Sparse>
 
 #include "MatrixAdaptor.hpp"
+#include "MatrixPool.hpp"
 
 namespace AMD {
 
@@ -33,12 +34,12 @@ struct EigenMatrixAdaptorBase {
 
   static boost::shared_ptr<matrix_type> defaultConstructMatrix 
                 (int m, int n, std::string name="") {
-    return boost::shared_ptr<matrix_type>(new matrix_type(m, n));
+    return AllocationPolicy_t<matrix_type>::construct(m, n);
   }
 
   static boost::shared_ptr<matrix_type> copyConstructMatrix 
                         (const matrix_type& original) {
-    return boost::shared_ptr<matrix_type>(new matrix_type(original));
+    return AllocationPolicy_t<matrix_type>::copy(original);
   }
 
   static int getNumRows (const matrix_type& A) { return A.rows(); }
@@ -61,14 +62,14 @@ struct EigenMatrixAdaptorBase {
                          matrix_type& B) { B = A.transpose(); }
 
   static void negation (const matrix_type& A,
-                        matrix_type& B) { B = A * -1.0; }
+                        matrix_type& B) { B = -A; }
 
-  static double logdet(const matrix_type& A) {
+  static value_type logdet(const matrix_type& A) {
     matrix_type A_shdw = matrix_type(A);
     typename eigen_llt_t<matrix_type>::LLTType cholesky_A_shdw(A_shdw);
     A_shdw = cholesky_A_shdw.matrixL();
  
-    double log_trace = 0.0;
+    value_type log_trace = 0.0;
     for (int i=0; i<A_shdw.rows(); ++i)log_trace+=log(A_shdw.diagonal()[i]);
 
     return 2.0*log_trace;
@@ -204,7 +205,7 @@ struct MatrixAdaptor_t<Eigen::SparseMatrix<T> > :
    * @return Trace of A
    */
   static value_type trace(const matrix_type& A) { 
-    double trace_val = 0.0;
+    value_type trace_val = 0.0;
     for (int i=0; i<A.rows(); ++i) trace_val+=A.diagonal()[i];
     return trace_val;
   }
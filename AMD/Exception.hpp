@@ -29,6 +29,9 @@ namespace {
     AMD_INVALID_OPERATION, /**< Invalid operation */
     AMD_NOMEM, /**< Malloc failed */
     AMD_INVALID_ARGUMENTS, /**< The arguments are mismatched */
+    AMD_CANCELLED, /**< The computation was cancelled */
+    AMD_IO_ERROR, /**< A file could not be created, read or mapped */
+    AMD_COMPILE_ERROR, /**< A generated kernel could not be built or loaded */
     /** ADD OTHER ERROR CODES HERE */
     AMD_SUCCESS = 0, /**< The function succeeded */
     AMD_INVALID_SHARED_PTR, /**< Shared pointer is not valid anymore */
@@ -0,0 +1,70 @@
+#ifndef AMD_GRAD_MODE_HPP
+#define AMD_GRAD_MODE_HPP
+
+/**
+ * @file GradMode.hpp
+ *
+ * @brief This file defines the switch that controls whether the operators on
+ * MatrixMatrixFunc record the computational tree. When recording is turned
+ * off (no-grad mode), the operators only compute the values, no child nodes
+ * are created and trace/logdet do not trigger the reverse mode sweep. This is
+ * useful for evaluations that only need function values, such as the ones in
+ * a line search or a validation pass.
+ */
+
+namespace AMD {
+
+  /**
+   * @brief Per-thread flag that indicates whether the computational tree
+   * should be recorded. Recording is turned on by default.
+   */
+  struct GradMode {
+    /**
+     * @brief Check if the operators record the computational tree.
+     * @return true if the computational tree is recorded.
+     */
+    static bool isEnabled() { return enabledFlag(); }
+
+    /**
+     * @brief Turn the recording of the computational tree on or off for the
+     * calling thread. Prefer NoGradGuard, which restores the previous setting.
+     * @param[in] enabled Whether the computational tree should be recorded.
+     */
+    static void setEnabled(bool enabled) { enabledFlag() = enabled; }
+
+    private:
+    static bool& enabledFlag() {
+      static thread_local bool enabled = true;
+      return enabled;
+    }
+  };
+
+  /**
+   * @brief Scoped guard that turns on no-grad mode for the lifetime of the
+   * object and restores the previous mode when it goes out of scope.
+   *
+   * \code
+   * {
+   *   AMD::NoGradGuard noGrad;
+   *   double f = AMD::logdet(fA + fX).functionVal; // no tree, no derivative
+   * }
+   * \endcode
+   */
+  class NoGradGuard {
+    public:
+    NoGradGuard() : previous(GradMode::isEnabled()) {
+      GradMode::setEnabled(false);
+    }
+
+    ~NoGradGuard() { GradMode::setEnabled(previous); }
+
+    private:
+    NoGradGuard(const NoGradGuard&);
+    NoGradGuard& operator=(const NoGradGuard&);
+
+    bool previous; /**< Mode that was in effect when the guard was created */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_GRAD_MODE_HPP */
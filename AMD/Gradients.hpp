@@ -0,0 +1,64 @@
+#ifndef AMD_GRADIENTS_HPP
+#define AMD_GRADIENTS_HPP
+
+/**
+ * @file Gradients.hpp
+ *
+ * @brief This file defines functions that compute the gradient of trace or
+ * logdet of a recorded MatrixMatrixFunc with respect to each variable
+ * separately. trace() and logdet() add the gradients of all VAR leaves into
+ * one matrix (which requires all of them to have the same shape); these
+ * functions return one gradient per VAR leaf from a single reverse sweep.
+ */
+
+#include "MatrixMatrixFunc.hpp"
+#include "ComputationGraph.hpp"
+#include "IncrementalEvaluator.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Compute trace(root) and its gradient with respect to each variable.
+   *
+   * \code
+   * MMF fX(X, false), fY(Y, false);
+   * std::map<boost::shared_ptr<MT>, MT> grads;
+   * double f = AMD::traceGradients(fX*fY + fA, grads);
+   * // grads[fX.matrixPtr] is Y^T, grads[fY.matrixPtr] is X^T
+   * \endcode
+   *
+   * @param[in]  root   The recorded matrix function.
+   * @param[out] result The gradient of each variable, keyed by the matrixPtr
+   *                    of its VAR leaf.
+   * @return trace(root).
+   */
+  template <class MT, class ST>
+  ST traceGradients(const MatrixMatrixFunc<MT, ST>& root,
+                    std::map<boost::shared_ptr<MT>, MT>& result) {
+    ComputationGraph<MT, ST> graph(root, kTraceRoot);
+    IncrementalEvaluator<MT, ST> eval(graph);
+    eval.gradients(result);
+    return eval.functionValue();
+  }
+
+  /**
+   * @brief Compute logdet(root) and its gradient with respect to each
+   * variable.
+   *
+   * @param[in]  root   The recorded matrix function.
+   * @param[out] result The gradient of each variable, keyed by the matrixPtr
+   *                    of its VAR leaf.
+   * @return logdet(root).
+   */
+  template <class MT, class ST>
+  ST logdetGradients(const MatrixMatrixFunc<MT, ST>& root,
+                     std::map<boost::shared_ptr<MT>, MT>& result) {
+    ComputationGraph<MT, ST> graph(root, kLogdetRoot);
+    IncrementalEvaluator<MT, ST> eval(graph);
+    eval.gradients(result);
+    return eval.functionValue();
+  }
+
+} /** namespace AMD */
+
+#endif /** AMD_GRADIENTS_HPP */
@@ -0,0 +1,384 @@
+#ifndef AMD_GRAPH_FILE_HPP
+#define AMD_GRAPH_FILE_HPP
+
+/**
+ * @file GraphFile.hpp
+ *
+ * @brief This file defines a compact binary format for a ComputationGraph,
+ * so that a process can map a recorded objective instead of recording it
+ * again and deep-copying it. The file holds
+ *   - a GraphFileHeader: a magic string, the format version, a byte order
+ *     tag, the size of a scalar, the number of nodes and the root operator;
+ *   - one GraphFileNode per node, in the topological order of the graph:
+ *     the operator, the children, the shape, the structure tag, the
+ *     constant scalar and where the value of a leaf is, if it is embedded;
+ *   - the values of the embedded leaves, column-major, each one starting on
+ *     a 64 byte boundary.
+ * loadGraph() maps the file read-only and returns a graph of MappedMatrix
+ * leaves: the embedded values are used in place, without being parsed or
+ * copied, and the mapping lives as long as any of those leaves. The values
+ * of variables are never embedded; their leaves are zeros to be bound at
+ * evaluation. The operators are stored by their OpType value, so changing
+ * that enum requires a new version.
+ *
+ * \code
+ * AMD::saveGraph(AMD::logdet(fS + fX*transpose(fX)), "objective.amd");
+ * // In each worker:
+ * AMD::ComputationGraph<AMD::MappedMatrix<double>, double> graph =
+ *   AMD::loadGraph<double>("objective.amd");
+ * AMD::SharedEvaluator<AMD::MappedMatrix<double>, double> eval(graph);
+ * \endcode
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "boost/shared_ptr.hpp"
+#include "AMD/config.h"
+#include "MatrixAdaptor.hpp"
+#include "ScalarMatrixFunc.hpp"
+#include "ComputationGraph.hpp"
+#include "Exception.hpp"
+
+#if AMD_HAVE_EIGEN==1 && AMD_HAVE_SYS_MMAN_H==1
+  #include <stdint.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <Eigen/Dense>
+  #include "MappedMatrix.hpp"
+#endif
+
+namespace AMD {
+
+#if AMD_HAVE_EIGEN==1 && AMD_HAVE_SYS_MMAN_H==1
+
+  /** The version of the format that saveGraph() writes */
+  const uint32_t kGraphFileVersion = 1;
+
+  /**
+   * @brief The start of a graph file.
+   */
+  struct GraphFileHeader {
+    char magic[8]; /**< "AMDGRAPH" */
+    uint32_t version; /**< kGraphFileVersion */
+    uint32_t byteOrder; /**< 0x01020304 in the byte order of the writer */
+    uint32_t scalarSize; /**< bytes per entry of a matrix */
+    uint32_t numNodes; /**< number of GraphFileNode records */
+    int32_t rootOp; /**< RootOpType of the graph */
+    uint32_t reserved; /**< zero */
+    uint64_t fileSize; /**< bytes of the whole file */
+  };
+
+  /**
+   * @brief One node of a graph file.
+   */
+  struct GraphFileNode {
+    int32_t opNum; /**< OpType of the node */
+    int32_t left; /**< index of the left child, -1 if there is none */
+    int32_t right; /**< index of the right child, -1 if there is none */
+    int32_t numRows; /**< rows of the value */
+    int32_t numCols; /**< columns of the value */
+    int32_t varIndex; /**< index of the variable, -1 if none */
+    uint32_t flags; /**< kGraphFileConst | kGraphFileEmbedded */
+    uint32_t structure; /**< MatrixType tag of the node */
+    double scalar; /**< the scalar of MTIMESS/STIMESM */
+    uint64_t dataOffset; /**< where the value of an embedded leaf starts */
+  };
+
+  /** Flags of a GraphFileNode */
+  enum {
+    kGraphFileConst = 1, /**< the node does not depend on a variable */
+    kGraphFileEmbedded = 2 /**< the value of the leaf is in the file */
+  };
+
+  /** The alignment of embedded values */
+  const uint64_t kGraphFileAlignment = 64;
+
+  /**
+   * @brief Write a graph of dense Eigen matrices to a file.
+   *
+   * @param[in] graph          The graph.
+   * @param[in] path           The file; it is overwritten.
+   * @param[in] embedConstants Embed the values of the constant leaves; if
+   *                           false, they have to be given to loadGraph().
+   */
+  template <class MT, class ST>
+  void saveGraph(const ComputationGraph<MT, ST>& graph,
+                 const std::string& path,
+                 bool embedConstants = true) {
+    typedef Eigen::Matrix<ST, Eigen::Dynamic, 1> ColumnType;
+    AMD_START_TRY_BLOCK()
+
+    const uint64_t align = kGraphFileAlignment;
+    std::vector<GraphFileNode> records(graph.size());
+    uint64_t offset = sizeof(GraphFileHeader) +
+                      graph.size()*sizeof(GraphFileNode);
+    for (int i=0; i<graph.size(); ++i) {
+      const GraphNode<MT, ST>& node = graph.node(i);
+      GraphFileNode& record = records[i];
+      std::memset(&record, 0, sizeof(record));
+      record.opNum = node.opNum;
+      record.left = node.left;
+      record.right = node.right;
+      record.numRows = node.numRows;
+      record.numCols = node.numCols;
+      record.varIndex = node.varIndex;
+      record.flags = node.isConst ? kGraphFileConst : 0;
+      record.structure = node.mType;
+      record.scalar = static_cast<double>(node.scalar);
+      if (node.isLeaf() && node.isConst && embedConstants) {
+        offset = (offset + align - 1)/align*align;
+        record.flags |= kGraphFileEmbedded;
+        record.dataOffset = offset;
+        offset += static_cast<uint64_t>(node.numRows)*node.numCols*sizeof(ST);
+      }
+    }
+
+    GraphFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "AMDGRAPH", 8);
+    header.version = kGraphFileVersion;
+    header.byteOrder = 0x01020304;
+    header.scalarSize = sizeof(ST);
+    header.numNodes = graph.size();
+    header.rootOp = graph.rootOp();
+    header.fileSize = offset;
+
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!records.empty()) {
+      file.write(reinterpret_cast<const char*>(&records[0]),
+                 records.size()*sizeof(GraphFileNode));
+    }
+    for (int i=0; file && i<graph.size(); ++i) {
+      if (0 == (records[i].flags & kGraphFileEmbedded)) continue;
+      const MT& value = *graph.node(i).matrixPtr;
+      file.seekp(records[i].dataOffset);
+      for (int j=0; file && j<records[i].numCols; ++j) {
+        const ColumnType column = value.col(j);
+        file.write(reinterpret_cast<const char*>(column.data()),
+                   column.size()*sizeof(ST));
+      }
+    }
+    /** Pad to the full size, in case the last leaf is empty */
+    if (file && static_cast<uint64_t>(file.tellp()) < offset) {
+      file.seekp(offset - 1);
+      file.put('\0');
+    }
+    file.close();
+    if (!file) {
+      throw exception_generic_impl("AMD::saveGraph",
+                                   "Could not write the file",
+                                   AMD_IO_ERROR);
+    }
+
+    AMD_END_TRY_BLOCK()
+    AMD_CATCH_AND_RETHROW(AMD, saveGraph)
+  }
+
+  /**
+   * @brief Write the graph of trace/logdet of a recorded function.
+   *
+   * @param[in] function       A function made by trace() or logdet().
+   * @param[in] path           The file; it is overwritten.
+   * @param[in] embedConstants See above.
+   */
+  template <class MT, class ST>
+  void saveGraph(const ScalarMatrixFunc<MT, ST>& function,
+                 const std::string& path,
+                 bool embedConstants = true) {
+    if (!function.argumentFuncVal) {
+      throw exception_generic_impl("AMD::saveGraph",
+                                   "Function is not trace or logdet",
+                                   AMD_INVALID_OPERATION);
+    }
+    saveGraph(ComputationGraph<MT, ST>(*function.argumentFuncVal,
+                                       function.argumentOp),
+              path,
+              embedConstants);
+  }
+
+  /**
+   * @brief A graph file mapped read-only; it is unmapped when the last
+   * leaf that borrows from it is gone.
+   */
+  class GraphFileMapping {
+    public:
+    GraphFileMapping(const std::string& path) : base(NULL), bytes(0) {
+      const int fd = open(path.c_str(), O_RDONLY);
+      if (0 > fd) {
+        throw exception_generic_impl("AMD::loadGraph",
+                                     "Could not open the file",
+                                     AMD_IO_ERROR);
+      }
+      struct stat info;
+      if (0 != fstat(fd, &info)) {
+        close(fd);
+        throw exception_generic_impl("AMD::loadGraph",
+                                     "Could not read the size of the file",
+                                     AMD_IO_ERROR);
+      }
+      bytes = info.st_size;
+      void* address = (0 == bytes) ? NULL :
+                      mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (MAP_FAILED == address) {
+        throw exception_generic_impl("AMD::loadGraph",
+                                     "Could not map the file",
+                                     AMD_IO_ERROR);
+      }
+      base = static_cast<const char*>(address);
+    }
+
+    ~GraphFileMapping() {
+      if (NULL != base) munmap(const_cast<char*>(base), bytes);
+    }
+
+    const char* data() const { return base; }
+    uint64_t size() const { return bytes; }
+
+    private:
+    GraphFileMapping(const GraphFileMapping&);
+    GraphFileMapping& operator=(const GraphFileMapping&);
+
+    const char* base; /**< where the file is mapped */
+    uint64_t bytes; /**< bytes of the file */
+  };
+
+  /**
+   * @brief Deletes a leaf and keeps the mapping it borrows from alive.
+   */
+  struct GraphFileLeafDeleter {
+    boost::shared_ptr<GraphFileMapping> mapping;
+
+    template <class MT>
+    void operator()(MT* leaf) const { delete leaf; }
+  };
+
+  /**
+   * @brief Report a malformed graph file.
+   */
+  inline void graphFileError(const char* message) {
+    throw exception_generic_impl("AMD::loadGraph", message, AMD_IO_ERROR);
+  }
+
+  /**
+   * @brief Map a graph file written by saveGraph().
+   *
+   * @param[in] path      The file.
+   * @param[in] constants The values of the constant leaves that are not
+   *                      embedded, in the order of the nodes.
+   * @return The graph; embedded leaves borrow the mapped values.
+   */
+  template <class T>
+  ComputationGraph<MappedMatrix<T>, T>
+  loadGraph(const std::string& path,
+            const std::vector<MappedMatrix<T> >& constants =
+              std::vector<MappedMatrix<T> >()) {
+    typedef MappedMatrix<T> MT;
+    typedef GraphNode<MT, T> NodeType;
+    std::vector<NodeType> nodes;
+    RootOpType rootOp = kMatrixRoot;
+    AMD_START_TRY_BLOCK()
+
+    boost::shared_ptr<GraphFileMapping> mapping(new GraphFileMapping(path));
+    const char* base = mapping->data();
+    const uint64_t size = mapping->size();
+
+    if (size < sizeof(GraphFileHeader)) graphFileError("The file is too short");
+    GraphFileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (0 != std::memcmp(header.magic, "AMDGRAPH", 8)) {
+      graphFileError("The file is not a graph file");
+    }
+    if (kGraphFileVersion != header.version) {
+      graphFileError("Unsupported version of the graph file");
+    }
+    if (0x01020304 != header.byteOrder || sizeof(T) != header.scalarSize) {
+      graphFileError("The byte order or the scalar type does not match");
+    }
+    if (size != header.fileSize ||
+        size < sizeof(header) + header.numNodes*sizeof(GraphFileNode)) {
+      graphFileError("The file is truncated");
+    }
+    if (kMatrixRoot > header.rootOp || kLogdetRoot < header.rootOp) {
+      graphFileError("Invalid root operator");
+    }
+    rootOp = static_cast<RootOpType>(header.rootOp);
+
+    GraphFileLeafDeleter deleter;
+    deleter.mapping = mapping;
+    const GraphFileNode* records =
+      reinterpret_cast<const GraphFileNode*>(base + sizeof(header));
+    size_t constant = 0;
+    nodes.resize(header.numNodes);
+    for (uint32_t i=0; i<header.numNodes; ++i) {
+      GraphFileNode record;
+      std::memcpy(&record, records + i, sizeof(record));
+      /** The children have to come first, as many as the operator takes */
+      const bool binary = (PLUS == record.opNum || MINUS == record.opNum ||
+                           TIMES == record.opNum || ELEWISE == record.opNum);
+      const bool leaf = (CONST == record.opNum || VAR == record.opNum);
+      const int32_t index = i;
+      if (CONST > record.opNum || DIAG < record.opNum ||
+          0 > record.numRows || 0 > record.numCols ||
+          kTranspose < record.structure ||
+          (leaf ? -1 != record.left : (0 > record.left ||
+                                       index <= record.left)) ||
+          (binary ? (0 > record.right || index <= record.right) :
+                    -1 != record.right)) {
+        graphFileError("Invalid node");
+      }
+
+      NodeType& node = nodes[i];
+      node.opNum = static_cast<OpType>(record.opNum);
+      node.left = record.left;
+      node.right = record.right;
+      node.numRows = record.numRows;
+      node.numCols = record.numCols;
+      node.isConst = (0 != (record.flags & kGraphFileConst));
+      node.mType = static_cast<MatrixType>(record.structure);
+      node.varIndex = record.varIndex;
+      node.scalar = static_cast<T>(record.scalar);
+      if (!node.isLeaf()) continue;
+
+      const uint64_t bytes = static_cast<uint64_t>(node.numRows)*
+                             node.numCols*sizeof(T);
+      if (record.flags & kGraphFileEmbedded) {
+        if (record.dataOffset % kGraphFileAlignment ||
+            record.dataOffset > size || bytes > size - record.dataOffset) {
+          graphFileError("Invalid offset of a leaf");
+        }
+        node.matrixPtr = boost::shared_ptr<MT>(
+          new MT(reinterpret_cast<const T*>(base + record.dataOffset),
+                 node.numRows, node.numCols),
+          deleter);
+      } else if (node.isConst) {
+        if (constants.size() <= constant ||
+            constants[constant].rows() != node.numRows ||
+            constants[constant].cols() != node.numCols) {
+          throw exception_generic_impl("AMD::loadGraph",
+                                       "A constant is missing or has the "
+                                       "wrong dimensions",
+                                       AMD_INVALID_ARGUMENTS);
+        }
+        node.matrixPtr = boost::shared_ptr<MT>(new MT(constants[constant++]));
+      } else {
+        node.matrixPtr = boost::shared_ptr<MT>(
+          new MT(MT::PlainType::Zero(node.numRows, node.numCols)));
+      }
+    }
+
+    AMD_END_TRY_BLOCK()
+    AMD_CATCH_AND_RETHROW(AMD, loadGraph)
+    return ComputationGraph<MT, T>(nodes, rootOp);
+  }
+
+#endif /** AMD_HAVE_EIGEN==1 && AMD_HAVE_SYS_MMAN_H==1 */
+
+} /** namespace AMD */
+
+#endif /** AMD_GRAPH_FILE_HPP */
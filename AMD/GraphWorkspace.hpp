@@ -0,0 +1,192 @@
+#ifndef AMD_GRAPH_WORKSPACE_HPP
+#define AMD_GRAPH_WORKSPACE_HPP
+
+/**
+ * @file GraphWorkspace.hpp
+ *
+ * @brief This file defines the per-evaluation state of a full sweep over a
+ * ComputationGraph. The graph itself is never written to during a sweep, so
+ * any number of sweeps over the same graph can run at the same time as long
+ * as each one has its own GraphWorkspace. Reusing a workspace for several
+ * evaluations of the same graph also reuses its buffers. A SweepMonitor
+ * can watch the progress of a sweep and stop it between two nodes.
+ */
+
+#include <vector>
+#include <algorithm>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Values and adjoints of the nodes of a graph for one evaluation.
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  struct GraphWorkspace {
+    std::vector<const MT*> values; /**< value of each node */
+    std::vector<MT> buffers; /**< storage for the values of internal nodes */
+    std::vector<MT> adjoints; /**< adjoint of each node */
+    std::vector<bool> hasAdjoint; /**< has the adjoint been set yet */
+    MT partial; /**< scratch space for one partial adjoint */
+  };
+
+  /**
+   * @brief Watches a sweep; it is told about each node as soon as the node
+   * is done.
+   */
+  struct SweepMonitor {
+    virtual ~SweepMonitor() {}
+
+    /**
+     * @brief Called after each node of a sweep.
+     *
+     * @param[in] node The node that is done.
+     * @return false to stop the sweep.
+     */
+    virtual bool nodeDone(int node) = 0;
+  };
+
+  /**
+   * @brief Compute the values of all the nodes of a graph.
+   *
+   * @param[in]     graph     The graph to evaluate.
+   * @param[in]     variables Value of each variable (by variable index); an
+   *                          empty vector or a NULL entry means that the
+   *                          value of the VAR leaf itself is used.
+   * @param[in,out] ws        The workspace for this evaluation.
+   * @param[in]     monitor   If not NULL, told about every node.
+   * @return false if the monitor stopped the sweep.
+   */
+  template <class MT, class ST>
+  bool forwardSweep(const ComputationGraph<MT, ST>& graph,
+                    const std::vector<const MT*>& variables,
+                    GraphWorkspace<MT, ST>& ws,
+                    SweepMonitor* monitor = NULL) {
+    const int n = graph.size();
+    ws.values.resize(n);
+    ws.buffers.resize(n);
+
+    for (int i=0; i<n; ++i) {
+      const GraphNode<MT, ST>& node = graph.node(i);
+      if (node.isLeaf()) {
+        const MT* bound = (-1 == node.varIndex || variables.empty()) ?
+                          NULL : variables[node.varIndex];
+        ws.values[i] = (NULL == bound) ? node.matrixPtr.get() : bound;
+      } else {
+        forwardNode(node,
+                    ws.values[node.left],
+                    (-1 == node.right) ? NULL : ws.values[node.right],
+                    ws.buffers[i]);
+        ws.values[i] = &ws.buffers[i];
+      }
+      if (NULL != monitor && false == monitor->nodeDone(i)) return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Propagate the adjoint of the root, which has been set already,
+   * to all the non-constant nodes of a graph.
+   */
+  template <class MT, class ST>
+  bool propagateAdjoints(const ComputationGraph<MT, ST>& graph,
+                         GraphWorkspace<MT, ST>& ws,
+                         SweepMonitor* monitor) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    for (int i=graph.root(); i>=0; --i) {
+      const GraphNode<MT, ST>& node = graph.node(i);
+      const bool propagate = !node.isConst && !node.isLeaf() &&
+                             ws.hasAdjoint[i];
+
+      for (int side=0; propagate && side<2; ++side) {
+        const int child = (0 == side) ? node.left : node.right;
+        if (-1 == child || graph.node(child).isConst) continue;
+
+        partialAdjoint(node,
+                       side,
+                       *ws.values[i],
+                       ws.values[node.left],
+                       (-1 == node.right) ? NULL : ws.values[node.right],
+                       ws.adjoints[i],
+                       ws.partial);
+        if (ws.hasAdjoint[child]) {
+          MatrixAdaptorType::add(ws.adjoints[child],
+                                 ws.partial,
+                                 ws.adjoints[child]);
+        } else {
+          /** Take over the buffer instead of copying it */
+          std::swap(ws.adjoints[child], ws.partial);
+          ws.hasAdjoint[child] = true;
+        }
+      }
+      if (NULL != monitor && false == monitor->nodeDone(i)) return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Compute the adjoints of all the non-constant nodes of a graph
+   * with a scalar root. forwardSweep() has to be called first.
+   *
+   * @param[in]     graph   The graph to evaluate.
+   * @param[in,out] ws      The workspace of the forward sweep.
+   * @param[in]     monitor If not NULL, told about every node.
+   * @return false if the monitor stopped the sweep.
+   */
+  template <class MT, class ST>
+  bool reverseSweep(const ComputationGraph<MT, ST>& graph,
+                    GraphWorkspace<MT, ST>& ws,
+                    SweepMonitor* monitor = NULL) {
+    const int root = graph.root();
+    ws.adjoints.resize(graph.size());
+    ws.hasAdjoint.assign(graph.size(), false);
+
+    rootAdjoint<MT, ST>(graph.rootOp(), *ws.values[root], ws.adjoints[root]);
+    ws.hasAdjoint[root] = true;
+    return propagateAdjoints(graph, ws, monitor);
+  }
+
+  /**
+   * @brief Compute the adjoints of all the non-constant nodes of a graph
+   * for a given adjoint of its root, which may be matrix valued: the
+   * adjoint of a variable is then the vector-Jacobian product of the seed
+   * with the Jacobian of the root with respect to that variable, i.e. the
+   * gradient of trace(seed^T*root). forwardSweep() has to be called first.
+   *
+   * @param[in]     graph   The graph to evaluate.
+   * @param[in,out] ws      The workspace of the forward sweep.
+   * @param[in]     seed    The adjoint of the root; it has its shape.
+   * @param[in]     monitor If not NULL, told about every node.
+   * @return false if the monitor stopped the sweep.
+   */
+  template <class MT, class ST>
+  bool seededReverseSweep(const ComputationGraph<MT, ST>& graph,
+                          GraphWorkspace<MT, ST>& ws,
+                          const MT& seed,
+                          SweepMonitor* monitor = NULL) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    const int root = graph.root();
+    if (MatrixAdaptorType::getNumRows(seed) != graph.node(root).numRows ||
+        MatrixAdaptorType::getNumCols(seed) != graph.node(root).numCols) {
+      throw exception_generic_impl("AMD::seededReverseSweep",
+                                   "The seed does not match the root",
+                                   AMD_MISMATCHED_DIMENSIONS);
+    }
+    ws.adjoints.resize(graph.size());
+    ws.hasAdjoint.assign(graph.size(), false);
+
+    MatrixAdaptorType::copy(ws.adjoints[root], seed);
+    ws.hasAdjoint[root] = true;
+    return propagateAdjoints(graph, ws, monitor);
+  }
+
+} /** namespace AMD */
+
+#endif /** AMD_GRAPH_WORKSPACE_HPP */
@@ -0,0 +1,358 @@
+#ifndef AMD_HESSIAN_VECTOR_HPP
+#define AMD_HESSIAN_VECTOR_HPP
+
+/**
+ * @file HessianVector.hpp
+ *
+ * @brief This file defines matrix-free Hessian-vector products for trace and
+ * logdet of a ComputationGraph. The product H[V] is the derivative of the
+ * gradient along V. It is computed by forward-over-reverse differentiation:
+ * a forward sweep computes the values and their tangents along V, and the
+ * reverse sweep propagates the adjoints together with their tangents. The
+ * tangent of the adjoint of a variable is H[V]. The cost is a small constant
+ * times the cost of one gradient, and no derivative-of-derivative tree is
+ * recorded (unlike differentiating ScalarMatrixFunc::derivativeFuncVal).
+ */
+
+#include <vector>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "TangentEvaluator.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Add term to result, or take it over if result has no value yet.
+   */
+  template <class MT>
+  void accumulate(MT& result, bool& hasResult, MT& term) {
+    if (hasResult) MatrixAdaptor_t<MT>::add(result, term, result);
+    else {
+      std::swap(result, term);
+      hasResult = true;
+    }
+  }
+
+  /**
+   * @brief Compute the tangent of the partial adjoint that flows from a
+   * parent to one of its children (see partialAdjoint()). A NULL tangent
+   * stands for a zero tangent.
+   *
+   * @param[in]  node     The parent node.
+   * @param[in]  side     0 for the left child, 1 for the right child.
+   * @param[in]  value    Value of the parent node.
+   * @param[in]  left     Value of the left child.
+   * @param[in]  right    Value of the right child (NULL if unary).
+   * @param[in]  adjoint  Adjoint of the parent node.
+   * @param[in]  dValue   Tangent of the value of the parent, or NULL.
+   * @param[in]  dLeft    Tangent of the value of the left child, or NULL.
+   * @param[in]  dRight   Tangent of the value of the right child, or NULL.
+   * @param[in]  dAdjoint Tangent of the adjoint of the parent, or NULL.
+   * @param[out] result   Overwritten with the tangent of the partial adjoint.
+   * @return false if the tangent is zero (result is not set).
+   */
+  template <class MT, class ST>
+  bool tangentPartialAdjoint(const GraphNode<MT, ST>& node,
+                             int side,
+                             const MT& value,
+                             const MT* left,
+                             const MT* right,
+                             const MT& adjoint,
+                             const MT* dValue,
+                             const MT* dLeft,
+                             const MT* dRight,
+                             const MT* dAdjoint,
+                             MT& result) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    bool hasResult = false;
+    MT term, trans, tmp;
+
+    switch (node.opNum) {
+      case PLUS:
+      case MINUS:
+      case NEGATION:
+      case MTIMESS:
+      case STIMESM:
+      case TRANSPOSE:
+      case DIAG:
+        /** These are linear in the adjoint and don't use any values */
+        if (NULL == dAdjoint) return false;
+        partialAdjoint(node, side, value, left, right, *dAdjoint, result);
+        return true;
+      case TIMES:
+        /** left: dA*R^T + A*dR^T, right: dL^T*A + L^T*dA */
+        if (NULL != dAdjoint) {
+          partialAdjoint(node, side, value, left, right, *dAdjoint, term);
+          accumulate(result, hasResult, term);
+        }
+        if (0 == side && NULL != dRight) {
+          MatrixAdaptorType::transpose(*dRight, trans);
+          MatrixAdaptorType::multiply(adjoint, trans, term);
+          accumulate(result, hasResult, term);
+        }
+        if (1 == side && NULL != dLeft) {
+          MatrixAdaptorType::transpose(*dLeft, trans);
+          MatrixAdaptorType::multiply(trans, adjoint, term);
+          accumulate(result, hasResult, term);
+        }
+        return hasResult;
+      case ELEWISE: {
+        /** left: dA.*R + A.*dR, right: dA.*L + A.*dL */
+        if (NULL != dAdjoint) {
+          partialAdjoint(node, side, value, left, right, *dAdjoint, term);
+          accumulate(result, hasResult, term);
+        }
+        const MT* dOther = (0 == side) ? dRight : dLeft;
+        if (NULL != dOther) {
+          MatrixAdaptorType::elementwiseProduct(adjoint, *dOther, term);
+          accumulate(result, hasResult, term);
+        }
+        return hasResult;
+      }
+      case INV: {
+        /** d(-C^T*A*C^T) = -(dC^T*A*C^T + C^T*dA*C^T + C^T*A*dC^T) */
+        if (NULL != dAdjoint) {
+          partialAdjoint(node, side, value, left, right, *dAdjoint, term);
+          accumulate(result, hasResult, term);
+        }
+        if (NULL != dValue) {
+          MT dTrans;
+          MatrixAdaptorType::transpose(value, trans);
+          MatrixAdaptorType::transpose(*dValue, dTrans);
+          MatrixAdaptorType::multiply(dTrans, adjoint, tmp);
+          MatrixAdaptorType::multiply(tmp, trans, term);
+          MatrixAdaptorType::negation(term, tmp);
+          accumulate(result, hasResult, tmp);
+          MatrixAdaptorType::multiply(trans, adjoint, tmp);
+          MatrixAdaptorType::multiply(tmp, dTrans, term);
+          MatrixAdaptorType::negation(term, tmp);
+          accumulate(result, hasResult, tmp);
+        }
+        return hasResult;
+      }
+      default:
+        throw exception_generic_impl("AMD::tangentPartialAdjoint",
+                                     "Node is not an internal node",
+                                     AMD_INVALID_OPERATION);
+    }
+  }
+
+  /**
+   * @brief Compute Hessian-vector products of trace/logdet of a graph.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(fA*fX*fX, AMD::kTraceRoot);
+   * AMD::HessianVectorEvaluator<MT, ST> hessian(graph);
+   * std::vector<MT> V(1, dX), HV;
+   * hessian.apply(V, HV); // HV[0] is the Hessian applied to dX
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class HessianVectorEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+
+    /**
+     * @brief Create an evaluator.
+     * @param[in] graph The graph; it must have a scalar root.
+     */
+    HessianVectorEvaluator(const GraphType& graph) :
+      graph(graph),
+      tangents(graph.size()),
+      hasTangent(graph.size(), false),
+      adjoints(graph.size()),
+      hasAdjoint(graph.size(), false),
+      dAdjoints(graph.size()),
+      hasDAdjoint(graph.size(), false) {
+      AMD_START_TRY_BLOCK()
+
+      if (kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::HessianVectorEvaluator",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, HessianVectorEvaluator)
+    }
+
+    /**
+     * @brief Get the graph.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Compute the Hessian applied to a direction.
+     *
+     * @param[in]  direction direction[v] is the direction of variable v.
+     * @param[out] result    result[v] is the derivative of the gradient of
+     *                       variable v along the direction.
+     */
+    void apply(const std::vector<MT>& direction, std::vector<MT>& result) {
+      AMD_START_TRY_BLOCK()
+
+      if (static_cast<int>(direction.size()) != graph.numVariables()) {
+        throw exception_generic_impl("AMD::HessianVectorEvaluator::apply",
+                                     "Need one direction per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+
+      forward(direction);
+      reverse();
+
+      result.resize(graph.numVariables());
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const int i = graph.variable(v);
+        if (hasDAdjoint[i]) MatrixAdaptorType::copy(result[v], dAdjoints[i]);
+        else result[v] = MatrixAdaptorType::zeros(graph.node(i).numRows,
+                                                  graph.node(i).numCols);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, HessianVectorEvaluator::apply)
+    }
+
+    /**
+     * @brief Get trace/logdet of the root computed by the last apply().
+     */
+    ST functionValue() const {
+      return rootValue<MT, ST>(graph.rootOp(), *ws.values[graph.root()]);
+    }
+
+    /**
+     * @brief Get the gradient of variable v computed by the last apply().
+     */
+    const MT& gradient(int v) const { return adjoints[graph.variable(v)]; }
+
+    private:
+    void forward(const std::vector<MT>& direction) {
+      forwardSweep(graph, std::vector<const MT*>(), ws);
+
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+        hasTangent[i] = (false == node.isConst);
+        if (node.isConst) continue;
+
+        if (node.isLeaf()) {
+          tangents[i].resize(1);
+          MatrixAdaptorType::copy(tangents[i][0], direction[node.varIndex]);
+          continue;
+        }
+
+        tangentNode(node,
+                    *ws.values[i],
+                    ws.values[node.left],
+                    (-1 == node.right) ? NULL : ws.values[node.right],
+                    hasTangent[node.left] ? &tangents[node.left] : NULL,
+                    (-1 != node.right && hasTangent[node.right]) ?
+                      &tangents[node.right] : NULL,
+                    tangents[i]);
+      }
+    }
+
+    const MT* tangentOf(int i) const {
+      return (-1 != i && hasTangent[i]) ? &tangents[i][0] : NULL;
+    }
+
+    void reverse() {
+      const int root = graph.root();
+      hasAdjoint.assign(graph.size(), false);
+      hasDAdjoint.assign(graph.size(), false);
+
+      const MT& rootVal = *ws.values[root];
+      rootAdjoint<MT, ST>(graph.rootOp(), rootVal, adjoints[root]);
+      hasAdjoint[root] = true;
+      if (kLogdetRoot == graph.rootOp() && hasTangent[root]) {
+        /** d(inv(F)^T) = -(inv(F)*dF*inv(F))^T */
+        MT valueInv, tmp1, tmp2;
+        MatrixAdaptorType::inv(rootVal, valueInv);
+        MatrixAdaptorType::multiply(valueInv, tangents[root][0], tmp1);
+        MatrixAdaptorType::multiply(tmp1, valueInv, tmp2);
+        MatrixAdaptorType::transpose(tmp2, tmp1);
+        MatrixAdaptorType::negation(tmp1, dAdjoints[root]);
+        hasDAdjoint[root] = true;
+      }
+
+      MT partial, dPartial;
+      for (int i=root; i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        if (node.isConst || node.isLeaf() || false == hasAdjoint[i]) continue;
+
+        const MT* right = (-1 == node.right) ? NULL : ws.values[node.right];
+        for (int side=0; side<2; ++side) {
+          const int child = (0 == side) ? node.left : node.right;
+          if (-1 == child || graph.node(child).isConst) continue;
+
+          partialAdjoint(node, side, *ws.values[i], ws.values[node.left],
+                         right, adjoints[i], partial);
+          bool has = hasAdjoint[child];
+          accumulate(adjoints[child], has, partial);
+          hasAdjoint[child] = has;
+
+          if (tangentPartialAdjoint(node, side, *ws.values[i],
+                                    ws.values[node.left], right, adjoints[i],
+                                    tangentOf(i), tangentOf(node.left),
+                                    tangentOf(node.right),
+                                    hasDAdjoint[i] ? &dAdjoints[i] : NULL,
+                                    dPartial)) {
+            has = hasDAdjoint[child];
+            accumulate(dAdjoints[child], has, dPartial);
+            hasDAdjoint[child] = has;
+          }
+        }
+      }
+    }
+
+    GraphType graph; /**< the graph */
+    GraphWorkspace<MT, ST> ws; /**< values of the nodes */
+    std::vector<std::vector<MT> > tangents; /**< tangent of each value */
+    std::vector<bool> hasTangent; /**< false for constant nodes */
+    std::vector<MT> adjoints; /**< adjoint of each node */
+    std::vector<bool> hasAdjoint; /**< has the adjoint been set */
+    std::vector<MT> dAdjoints; /**< tangent of each adjoint */
+    std::vector<bool> hasDAdjoint; /**< false if the tangent is zero */
+  };
+
+  /**
+   * @brief Compute the Hessian-vector product of trace/logdet of a recorded
+   * matrix function, with all variables moving along V. This is what
+   * ScalarMatrixFunc::hessianVectorProduct() calls.
+   *
+   * @param[in]  argument The matrix function.
+   * @param[in]  rootOp   kTraceRoot or kLogdetRoot.
+   * @param[in]  V        The direction, with the shape of the variable.
+   * @param[out] result   Overwritten with the sum of H[V] over the variables.
+   */
+  template <class MT, class ST>
+  void hessianVectorProduct(const MatrixMatrixFunc<MT, ST>& argument,
+                            RootOpType rootOp,
+                            const MT& V,
+                            MT& result) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    ComputationGraph<MT, ST> graph(argument, rootOp);
+    if (0 == graph.numVariables()) {
+      result = MatrixAdaptorType::zeros(MatrixAdaptorType::getNumRows(V),
+                                        MatrixAdaptorType::getNumCols(V));
+      return;
+    }
+
+    HessianVectorEvaluator<MT, ST> hessian(graph);
+    std::vector<MT> products;
+    hessian.apply(std::vector<MT>(graph.numVariables(), V), products);
+    MatrixAdaptorType::copy(result, products[0]);
+    for (size_t v=1; v<products.size(); ++v) {
+      MatrixAdaptorType::add(result, products[v], result);
+    }
+  }
+
+} /** namespace AMD */
+
+#endif /** AMD_HESSIAN_VECTOR_HPP */
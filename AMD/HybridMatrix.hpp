@@ -0,0 +1,484 @@
+#ifndef AMD_HYBRID_MATRIX_HPP
+#define AMD_HYBRID_MATRIX_HPP
+
+/**
+ * @file HybridMatrix.hpp
+ *
+ * @brief This file defines HybridMatrix, an Eigen matrix that is stored
+ * either densely or sparsely, and its MatrixAdaptor_t. A MatrixMatrixFunc
+ * has a single matrix type, so this is how one graph mixes sparse data
+ * matrices with dense variables: every node holds a HybridMatrix, and the
+ * kernels pick the representation of each result from the representations
+ * of its operands:
+ *   - S+S, S-S, S*S, -S, S^T, S.*X, X.*S and diag(X) are sparse;
+ *   - everything that involves a dense operand otherwise is dense, so
+ *     sparse x dense products run as SpMM and give dense results;
+ *   - inv(S) is dense (a sparse LU solve with the dense identity), since
+ *     inverses of sparse matrices are dense in general;
+ *   - eye() is dense, so the adjoints of the graph evaluators, which are
+ *     seeded with it, stay dense even when all the constants are sparse;
+ *     zeros() is sparse.
+ *
+ * Sums and products of sparse matrices fill in, so these rules are refined
+ * at runtime by the DensityThreshold: before a sparse-sparse sum or product
+ * the density of the result is estimated from the densities of the operands
+ * (as if their patterns were random), and when it is above the threshold
+ * the result is computed densely (as a dense sum or an SpMM) right away;
+ * otherwise it is computed sparsely, and its measured density is checked
+ * against the threshold again. So every node of a graph picks its own
+ * representation, and a conversion to dense happens only where it pays.
+ * Dense results are never made sparse, as that would need a scan of every
+ * entry.
+ *
+ * \code
+ * typedef AMD::HybridMatrix<double> MT;
+ * AMD::MatrixMatrixFunc<MT, double> fS(MT(S), true);   // S is sparse
+ * AMD::MatrixMatrixFunc<MT, double> fX(MT(X), false);  // X is dense
+ * AMD::ScalarMatrixFunc<MT, double> f = AMD::logdet(fS + transpose(fX)*fX);
+ * \endcode
+ */
+
+#include <ostream>
+#include <cmath>
+#include <atomic>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseLU>
+#include "MatrixAdaptor.hpp"
+#include "MatrixPool.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief The density above which the HybridMatrix kernels store the
+   * results of sparse sums and products densely. It is shared by all the
+   * threads; 1.0 turns the selection off, and 0.0 makes every sum and
+   * product of sparse matrices dense.
+   */
+  class DensityThreshold {
+    public:
+    /**
+     * @brief Get the threshold (0.1 by default).
+     */
+    static double get() { return value().load(); }
+
+    /**
+     * @brief Set the threshold, which has to be in [0,1].
+     */
+    static void set(double threshold) {
+      if (!(0.0 <= threshold && 1.0 >= threshold)) {
+        throw exception_generic_impl("AMD::DensityThreshold::set",
+                                     "The threshold has to be in [0,1]",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      value().store(threshold);
+    }
+
+    private:
+    static std::atomic<double>& value() {
+      static std::atomic<double> threshold(0.1);
+      return threshold;
+    }
+  };
+
+  /**
+   * @brief A matrix of T that is either dense or sparse.
+   */
+  template <class T>
+  class HybridMatrix {
+    public:
+    typedef T value_type;
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> DenseType;
+    typedef Eigen::SparseMatrix<T> SparseType;
+
+    /**
+     * @brief An empty dense matrix.
+     */
+    HybridMatrix() : sparse(false) {}
+
+    /**
+     * @brief A dense rows x cols matrix with unspecified contents.
+     */
+    HybridMatrix(int rows, int cols) :
+      denseValue(rows, cols), sparse(false) {}
+
+    /**
+     * @brief A dense matrix with the value of a dense Eigen expression.
+     */
+    template <class Derived>
+    HybridMatrix(const Eigen::MatrixBase<Derived>& other) :
+      denseValue(other), sparse(false) {}
+
+    /**
+     * @brief A sparse matrix with the value of a sparse Eigen expression.
+     */
+    template <class Derived>
+    HybridMatrix(const Eigen::SparseMatrixBase<Derived>& other) :
+      sparseValue(other), sparse(true) {}
+
+    /**
+     * @brief Is the matrix stored sparsely?
+     */
+    bool isSparse() const { return sparse; }
+
+    int rows() const {
+      return sparse ? sparseValue.rows() : denseValue.rows();
+    }
+
+    int cols() const {
+      return sparse ? sparseValue.cols() : denseValue.cols();
+    }
+
+    /**
+     * @brief Get the fraction of the entries that are stored.
+     */
+    double density() const {
+      if (!sparse) return 1.0;
+      const double size = static_cast<double>(rows())*cols();
+      return (0.0 == size) ? 0.0 : sparseValue.nonZeros()/size;
+    }
+
+    /**
+     * @brief Get the dense storage; the matrix has to be dense.
+     */
+    const DenseType& getDense() const {
+      if (sparse) {
+        throw exception_generic_impl("AMD::HybridMatrix::getDense",
+                                     "The matrix is sparse",
+                                     AMD_INVALID_OPERATION);
+      }
+      return denseValue;
+    }
+
+    /**
+     * @brief Get the sparse storage; the matrix has to be sparse.
+     */
+    const SparseType& getSparse() const {
+      if (!sparse) {
+        throw exception_generic_impl("AMD::HybridMatrix::getSparse",
+                                     "The matrix is dense",
+                                     AMD_INVALID_OPERATION);
+      }
+      return sparseValue;
+    }
+
+    /**
+     * @brief Get the value as a dense matrix (a copy).
+     */
+    DenseType toDense() const {
+      return sparse ? DenseType(sparseValue) : denseValue;
+    }
+
+    /**
+     * @brief Set a dense value. The expression may use the storage of this
+     * matrix.
+     */
+    template <class Derived>
+    void setDense(const Eigen::EigenBase<Derived>& value) {
+      denseValue = value.derived();
+      sparse = false;
+      SparseType().swap(sparseValue);
+    }
+
+    /**
+     * @brief Set a sparse value. Unlike setDense(), the expression must not
+     * use the storage of this matrix; evaluate it into a SparseType first.
+     */
+    template <class Derived>
+    void setSparse(const Eigen::SparseMatrixBase<Derived>& value) {
+      sparseValue = value.derived();
+      sparse = true;
+      denseValue.resize(0, 0);
+    }
+
+    /**
+     * @brief Store the matrix densely if it is sparse and denser than
+     * the threshold.
+     */
+    void densifyAbove(double threshold) {
+      if (sparse && density() > threshold) setDense(sparseValue);
+    }
+
+    private:
+    DenseType denseValue; /**< the value of a dense matrix */
+    SparseType sparseValue; /**< the value of a sparse matrix */
+    bool sparse; /**< which of the two holds the value */
+  };
+
+  /**
+   * @brief Hybrid matrices change shape and representation, so they are
+   * never pooled.
+   */
+  template <class T>
+  struct AllocationPolicy_t<HybridMatrix<T> > :
+    public HeapAllocationPolicy<HybridMatrix<T> > {};
+
+  template <typename T>
+  struct MatrixAdaptor_t<HybridMatrix<T> > {
+    typedef T value_type;
+    typedef HybridMatrix<T> matrix_type;
+    typedef typename matrix_type::DenseType dense_type;
+    typedef typename matrix_type::SparseType sparse_type;
+
+    static boost::shared_ptr<matrix_type> defaultConstructMatrix
+                  (int m, int n, std::string name="") {
+      return AllocationPolicy_t<matrix_type>::construct(m, n);
+    }
+
+    static boost::shared_ptr<matrix_type> copyConstructMatrix
+                          (const matrix_type& original) {
+      return AllocationPolicy_t<matrix_type>::copy(original);
+    }
+
+    /**
+     * 1.
+     * @brief Get the number of rows.
+     */
+    static int getNumRows (const matrix_type& A) { return A.rows(); }
+
+    /**
+     * 2.
+     * @brief Get the number of columns.
+     */
+    static int getNumCols (const matrix_type& A) { return A.cols(); }
+
+    /**
+     * @brief The expected density of the sum of A and B.
+     */
+    static double sumDensity (const matrix_type& A,
+                              const matrix_type& B) {
+      const double a = A.density();
+      const double b = B.density();
+      return a + b - a*b;
+    }
+
+    /**
+     * @brief The expected density of the product of A and B: an entry is
+     * zero if none of the A.cols() pairs it sums is a pair of non-zeros.
+     */
+    static double productDensity (const matrix_type& A,
+                                  const matrix_type& B) {
+      const double ab = A.density()*B.density();
+      return 1.0 - std::pow(1.0 - ab, A.cols());
+    }
+
+    /**
+     * 3.
+     * @brief C = A + B; sparse if both are sparse, and the sum is not
+     * denser than the DensityThreshold.
+     */
+    static void add (const matrix_type& A,
+                     const matrix_type& B,
+                     matrix_type& C) {
+      const double threshold = DensityThreshold::get();
+      if (A.isSparse() && B.isSparse() && sumDensity(A, B) > threshold) {
+        C.setDense(A.toDense() + B.getSparse());
+      } else if (A.isSparse() && B.isSparse()) {
+        C.setSparse(sparse_type(A.getSparse() + B.getSparse()));
+        C.densifyAbove(threshold);
+      } else if (A.isSparse()) {
+        C.setDense(A.getSparse() + B.getDense());
+      } else if (B.isSparse()) {
+        C.setDense(A.getDense() + B.getSparse());
+      } else {
+        C.setDense(A.getDense() + B.getDense());
+      }
+    }
+
+    /**
+     * 4.
+     * @brief C = A - B; sparse if both are sparse, and the difference is
+     * not denser than the DensityThreshold.
+     */
+    static void minus (const matrix_type& A,
+                       const matrix_type& B,
+                       matrix_type& C) {
+      const double threshold = DensityThreshold::get();
+      if (A.isSparse() && B.isSparse() && sumDensity(A, B) > threshold) {
+        C.setDense(A.toDense() - B.getSparse());
+      } else if (A.isSparse() && B.isSparse()) {
+        C.setSparse(sparse_type(A.getSparse() - B.getSparse()));
+        C.densifyAbove(threshold);
+      } else if (A.isSparse()) {
+        C.setDense(A.getSparse() - B.getDense());
+      } else if (B.isSparse()) {
+        C.setDense(A.getDense() - B.getSparse());
+      } else {
+        C.setDense(A.getDense() - B.getDense());
+      }
+    }
+
+    /**
+     * 5.
+     * @brief C = A * B; sparse if both are sparse, and the product is not
+     * denser than the DensityThreshold. SpMM if one is sparse.
+     */
+    static void multiply (const matrix_type& A,
+                          const matrix_type& B,
+                          matrix_type& C) {
+      const double threshold = DensityThreshold::get();
+      if (A.isSparse() && B.isSparse() && productDensity(A, B) > threshold) {
+        C.setDense(dense_type(A.getSparse() * B.toDense()));
+      } else if (A.isSparse() && B.isSparse()) {
+        C.setSparse(sparse_type(A.getSparse() * B.getSparse()));
+        C.densifyAbove(threshold);
+      } else if (A.isSparse()) {
+        C.setDense(dense_type(A.getSparse() * B.getDense()));
+      } else if (B.isSparse()) {
+        C.setDense(dense_type(A.getDense() * B.getSparse()));
+      } else {
+        C.setDense(dense_type(A.getDense() * B.getDense()));
+      }
+    }
+
+    /**
+     * 6.
+     * @brief B = A^T, in the representation of A.
+     */
+    static void transpose (const matrix_type& A,
+                           matrix_type& B) {
+      if (A.isSparse()) B.setSparse(sparse_type(A.getSparse().transpose()));
+      else B.setDense(dense_type(A.getDense().transpose()));
+    }
+
+    /**
+     * 7.
+     * @brief B = -A, in the representation of A.
+     */
+    static void negation (const matrix_type& A,
+                          matrix_type& B) {
+      if (A.isSparse()) B.setSparse(sparse_type(-A.getSparse()));
+      else B.setDense(-A.getDense());
+    }
+
+    /**
+     * 8.
+     * @brief B = inv(A), which is always dense.
+     */
+    static void inv (const matrix_type& A,
+                     matrix_type& B) {
+      if (!A.isSparse()) {
+        B.setDense(dense_type(A.getDense().inverse()));
+        return;
+      }
+
+      sparse_type A_shdw = A.getSparse();
+      A_shdw.makeCompressed();
+      Eigen::SparseLU<sparse_type> lu(A_shdw);
+      if (Eigen::Success != lu.info()) {
+        throw exception_generic_impl("AMD::MatrixAdaptor_t::inv",
+                                     "The sparse matrix is singular",
+                                     AMD_INVALID_OPERATION);
+      }
+      B.setDense(dense_type(lu.solve(dense_type::Identity(A.rows(),
+                                                          A.cols()))));
+    }
+
+    /**
+     * 9.
+     * @brief Compute the trace of a matrix.
+     */
+    static value_type trace (const matrix_type& A) {
+      if (!A.isSparse()) return A.getDense().trace();
+      value_type trace_val = 0.0;
+      for (int i=0; i<A.rows(); ++i) trace_val += A.getSparse().coeff(i,i);
+      return trace_val;
+    }
+
+    /**
+     * 10.
+     * @brief Create a (dense) identity matrix.
+     */
+    static matrix_type eye (int n) { return dense_type::Identity(n,n); }
+
+    /**
+     * 11.
+     * @brief Create a (sparse) zero matrix.
+     */
+    static matrix_type zeros (int m, int n) { return sparse_type(m,n); }
+
+    /**
+     * 12.
+     * @brief Compute the logdet of a symmetric positive definite matrix.
+     */
+    static value_type logdet (const matrix_type& A) {
+      value_type log_trace = 0.0;
+      if (A.isSparse()) {
+        Eigen::SimplicialLLT<sparse_type> cholesky(A.getSparse());
+        const sparse_type L = cholesky.matrixL();
+        for (int i=0; i<L.rows(); ++i) log_trace += log(L.coeff(i,i));
+      } else {
+        Eigen::LLT<dense_type> cholesky(A.getDense());
+        const dense_type& L = cholesky.matrixLLT();
+        for (int i=0; i<L.rows(); ++i) log_trace += log(L(i,i));
+      }
+      return 2.0*log_trace;
+    }
+
+    /**
+     * 13.
+     * @brief Copy B into A.
+     */
+    static void copy (matrix_type& A, const matrix_type& B) { A = B; }
+
+    /**
+     * 14.
+     * @brief Print a matrix.
+     */
+    static void print (const matrix_type& A,
+                       std::ostream& os=std::cout) {
+      if (A.isSparse()) os << A.getSparse();
+      else os << A.getDense();
+    }
+
+    /**
+     * 15.
+     * @brief B is the (sparse) diagonal of A.
+     */
+    static void diag (const matrix_type& A,
+                      matrix_type& B) {
+      const int n = A.rows();
+      sparse_type D(n, n);
+      D.reserve(Eigen::VectorXi::Constant(n, 1));
+      for (int i=0; i<n; ++i) {
+        D.insert(i,i) = A.isSparse() ? A.getSparse().coeff(i,i) :
+                                       A.getDense()(i,i);
+      }
+      D.makeCompressed();
+      B.setSparse(D);
+    }
+
+    /**
+     * 16.
+     * @brief C = A .* B; sparse if either is sparse.
+     */
+    static void elementwiseProduct (const matrix_type& A,
+                                    const matrix_type& B,
+                                    matrix_type& C) {
+      if (A.isSparse() && B.isSparse()) {
+        C.setSparse(sparse_type(A.getSparse().cwiseProduct(B.getSparse())));
+      } else if (A.isSparse()) {
+        C.setSparse(sparse_type(A.getSparse().cwiseProduct(B.getDense())));
+      } else if (B.isSparse()) {
+        C.setSparse(sparse_type(B.getSparse().cwiseProduct(A.getDense())));
+      } else {
+        C.setDense(A.getDense().cwiseProduct(B.getDense()));
+      }
+    }
+
+    /**
+     * 17.
+     * @brief B = a * A, in the representation of A.
+     */
+    static void multiply (const matrix_type& A,
+                          const value_type& a,
+                          matrix_type& B) {
+      if (A.isSparse()) B.setSparse(sparse_type(A.getSparse() * a));
+      else B.setDense(A.getDense() * a);
+    }
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_HYBRID_MATRIX_HPP */
@@ -0,0 +1,352 @@
+#ifndef AMD_INCREMENTAL_EVALUATOR_HPP
+#define AMD_INCREMENTAL_EVALUATOR_HPP
+
+/**
+ * @file IncrementalEvaluator.hpp
+ *
+ * @brief This file defines an evaluator that re-evaluates a ComputationGraph
+ * incrementally. Leaves carry a version that is bumped by
+ * MatrixMatrixFunc::updateValue() (or touch()). When the evaluator is asked
+ * for a value or a gradient, only the nodes that depend on a leaf whose
+ * version changed are recomputed in the forward sweep. In the reverse sweep,
+ * the adjoint that flows along an edge is cached and only recomputed when
+ * the adjoint of the parent or one of the values it uses has changed. This
+ * is useful for block-coordinate algorithms, where only one of several
+ * variables changes per step.
+ */
+
+#include <map>
+#include <vector>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Evaluate the value and the gradient of a ComputationGraph,
+   * reusing everything that has not changed since the previous evaluation.
+   *
+   * \code
+   * MMF fX1(X1, false), fX2(X2, false);
+   * AMD::ComputationGraph<MT, ST> graph(fA1*fX1 + fA2*fX2, AMD::kTraceRoot);
+   * AMD::IncrementalEvaluator<MT, ST> eval(graph);
+   * eval.gradient(G);       // full evaluation
+   * fX1.updateValue(newX1);
+   * eval.gradient(G);       // only the fA1*fX1 branch is recomputed
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class IncrementalEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef typename GraphType::NodeType NodeType;
+    typedef typename GraphType::EdgeType EdgeType;
+    typedef boost::shared_ptr<MT> MatrixPtrType;
+    typedef MatrixMatrixFunc<MT, ST> MMF;
+    /** Gradient of each variable, keyed by the matrix of its VAR leaf */
+    typedef std::map<MatrixPtrType, MT> GradientMapType;
+
+    /**
+     * @brief Create an evaluator. Nothing is computed until a value or a
+     * gradient is requested.
+     *
+     * @param[in] graph The graph to evaluate.
+     */
+    IncrementalEvaluator(const GraphType& graph) :
+      graph(graph),
+      values(graph.size()),
+      stamps(graph.size(), 0),
+      childStamps(graph.size(), std::make_pair(0UL, 0UL)),
+      computed(graph.size(), false),
+      valueChanged(graph.size(), false),
+      adjoints(graph.size()),
+      adjointChanged(graph.size(), false),
+      rootVal(),
+      rootValStamp(0),
+      rootValComputed(false),
+      numNodes(0),
+      numAdjoints(0) {
+      for (int side=0; side<2; ++side) {
+        partials[side].resize(graph.size());
+        partialChanged[side].resize(graph.size(), false);
+      }
+    }
+
+    /**
+     * @brief Get the graph that is evaluated.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Bring the values up to date and return the value of the root.
+     */
+    const MT& value() {
+      forward();
+      return *values[graph.root()];
+    }
+
+    /**
+     * @brief Bring the values up to date and return trace/logdet of the root.
+     */
+    ST functionValue() {
+      forward();
+      const int root = graph.root();
+      if (false == rootValComputed || rootValStamp != stamps[root]) {
+        rootVal = rootValue<MT, ST>(graph.rootOp(), *values[root]);
+        rootValStamp = stamps[root];
+        rootValComputed = true;
+      }
+      return rootVal;
+    }
+
+    /**
+     * @brief Bring the values and the adjoints up to date and compute the
+     * gradient of trace/logdet of the root. As with trace() and logdet(),
+     * the gradients of all the variables are added up; use gradients() to
+     * get them separately.
+     *
+     * @param[out] result Overwritten with the gradient.
+     */
+    void gradient(MT& result) {
+      AMD_START_TRY_BLOCK()
+
+      if (0 == graph.numVariables()) {
+        throw exception_generic_impl("AMD::IncrementalEvaluator::gradient",
+                                     "Function does not depend on a variable",
+                                     AMD_CONSTANT_FN);
+      }
+
+      reverse();
+
+      MatrixAdaptorType::copy(result, *adjoints[graph.variable(0)]);
+      for (int v=1; v<graph.numVariables(); ++v) {
+        const MT& adjoint = *adjoints[graph.variable(v)];
+        if (MatrixAdaptorType::getNumRows(adjoint) !=
+              MatrixAdaptorType::getNumRows(result) ||
+            MatrixAdaptorType::getNumCols(adjoint) !=
+              MatrixAdaptorType::getNumCols(result)) {
+          throw exception_generic_impl("AMD::IncrementalEvaluator::gradient",
+                                       "Variables have different dimensions",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+        MatrixAdaptorType::add(result, adjoint, result);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, IncrementalEvaluator::gradient)
+    }
+
+    /**
+     * @brief Bring the values and the adjoints up to date and compute the
+     * gradient with respect to each variable separately. One reverse sweep
+     * gives the gradients of all the variables, each with its own shape.
+     *
+     * @param[out] result The gradient of each variable, keyed by the
+     *                    matrixPtr of its VAR leaf. Existing entries for
+     *                    other matrices are left untouched.
+     */
+    void gradients(GradientMapType& result) {
+      AMD_START_TRY_BLOCK()
+
+      reverse();
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const int i = graph.variable(v);
+        MatrixAdaptorType::copy(result[graph.node(i).matrixPtr],
+                                *adjoints[i]);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, IncrementalEvaluator::gradients)
+    }
+
+    /**
+     * @brief Bring the values and the adjoints up to date and compute the
+     * gradient with respect to one variable.
+     *
+     * @param[in]  variable The VAR leaf (or a copy of it).
+     * @param[out] result   Overwritten with the gradient.
+     */
+    void gradient(const MMF& variable, MT& result) {
+      AMD_START_TRY_BLOCK()
+
+      const int v = graph.variableIndex(variable);
+      if (-1 == v) {
+        throw exception_generic_impl("AMD::IncrementalEvaluator::gradient",
+                                     "Not a variable of this graph",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+
+      reverse();
+      MatrixAdaptorType::copy(result, *adjoints[graph.variable(v)]);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, IncrementalEvaluator::gradient)
+    }
+
+    /**
+     * @brief Number of internal nodes recomputed by the last forward sweep.
+     */
+    int numNodesEvaluated() const { return numNodes; }
+
+    /**
+     * @brief Number of partial adjoints recomputed by the last reverse sweep.
+     */
+    int numAdjointsEvaluated() const { return numAdjoints; }
+
+    private:
+    IncrementalEvaluator(const IncrementalEvaluator&);
+    IncrementalEvaluator& operator=(const IncrementalEvaluator&);
+
+    /**
+     * @brief Recompute the nodes that depend on a leaf whose version changed.
+     */
+    void forward() {
+      numNodes = 0;
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+
+        if (node.isLeaf()) {
+          if (false == computed[i] || node.version() != stamps[i]) {
+            values[i] = node.matrixPtr;
+            stamps[i] = node.version();
+            computed[i] = true;
+            valueChanged[i] = true;
+          }
+          continue;
+        }
+
+        const unsigned long leftStamp = stamps[node.left];
+        const unsigned long rightStamp = (-1 == node.right) ?
+                                          0 : stamps[node.right];
+        if (true == computed[i] &&
+            leftStamp == childStamps[i].first &&
+            rightStamp == childStamps[i].second) continue;
+
+        if (!values[i]) values[i] = MatrixPtrType(new MT);
+        forwardNode(node,
+                    values[node.left].get(),
+                    (-1 == node.right) ? NULL : values[node.right].get(),
+                    *values[i]);
+        ++stamps[i];
+        childStamps[i] = std::make_pair(leftStamp, rightStamp);
+        computed[i] = true;
+        valueChanged[i] = true;
+        ++numNodes;
+      }
+    }
+
+    /**
+     * @brief Recompute the partial adjoints that are stale. A partial adjoint
+     * is stale if the adjoint of the parent changed or if one of the values
+     * that it uses changed since the previous reverse sweep.
+     */
+    void reverse() {
+      forward();
+
+      numAdjoints = 0;
+      const int root = graph.root();
+      for (int i=0; i<graph.size(); ++i) {
+        adjointChanged[i] = false;
+        partialChanged[0][i] = partialChanged[1][i] = false;
+      }
+
+      /** trace has a constant seed, logdet depends on the root value */
+      if (!adjoints[root] ||
+          (kLogdetRoot == graph.rootOp() && valueChanged[root])) {
+        if (!adjoints[root]) adjoints[root] = MatrixPtrType(new MT);
+        rootAdjoint<MT, ST>(graph.rootOp(), *values[root], *adjoints[root]);
+        adjointChanged[root] = true;
+      }
+
+      for (int i=root; i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        if (true == node.isConst) continue;
+
+        if (root != i) gatherAdjoint(i);
+        if (node.isLeaf()) continue;
+
+        for (int side=0; side<2; ++side) {
+          const int child = (0 == side) ? node.left : node.right;
+          if (-1 == child || true == graph.node(child).isConst) continue;
+
+          const bool stale = !partials[side][i] ||
+            adjointChanged[i] ||
+            (partialAdjointUses(node.opNum, side, 0) &&
+             valueChanged[node.left]) ||
+            (partialAdjointUses(node.opNum, side, 1) &&
+             valueChanged[node.right]) ||
+            (partialAdjointUses(node.opNum, side, 2) && valueChanged[i]);
+          if (false == stale) continue;
+
+          if (!partials[side][i]) partials[side][i] = MatrixPtrType(new MT);
+          partialAdjoint(node,
+                         side,
+                         *values[i],
+                         values[node.left].get(),
+                         (-1 == node.right) ? NULL : values[node.right].get(),
+                         *adjoints[i],
+                         *partials[side][i]);
+          partialChanged[side][i] = true;
+          ++numAdjoints;
+        }
+      }
+
+      /** Everything is consistent now */
+      for (int i=0; i<graph.size(); ++i) valueChanged[i] = false;
+    }
+
+    /**
+     * @brief Update the adjoint of node i from the partial adjoints of its
+     * incoming edges. With a single parent, the partial adjoint is used as
+     * is; otherwise the partial adjoints are added up.
+     */
+    void gatherAdjoint(int i) {
+      const std::vector<EdgeType>& edges = graph.parents(i);
+      bool changed = !adjoints[i];
+      for (size_t e=0; e<edges.size(); ++e) {
+        if (partialChanged[edges[e].second][edges[e].first]) changed = true;
+      }
+      if (false == changed) return;
+
+      if (1 == edges.size()) {
+        adjoints[i] = partials[edges[0].second][edges[0].first];
+      } else {
+        if (!adjoints[i]) adjoints[i] = MatrixPtrType(new MT);
+        MatrixAdaptorType::copy(*adjoints[i],
+                                *partials[edges[0].second][edges[0].first]);
+        for (size_t e=1; e<edges.size(); ++e) {
+          MatrixAdaptorType::add(*adjoints[i],
+                                 *partials[edges[e].second][edges[e].first],
+                                 *adjoints[i]);
+        }
+      }
+      adjointChanged[i] = true;
+    }
+
+    GraphType graph; /**< the graph that is evaluated */
+    std::vector<MatrixPtrType> values; /**< value of each node */
+    std::vector<unsigned long> stamps; /**< version of each value */
+    std::vector<std::pair<unsigned long, unsigned long> > childStamps; /**<
+                          versions of the children when a node was computed */
+    std::vector<bool> computed; /**< has the node been computed at all */
+    std::vector<bool> valueChanged; /**< changed since the last reverse sweep */
+    std::vector<MatrixPtrType> partials[2]; /**< adjoint along left/right edge */
+    std::vector<bool> partialChanged[2]; /**< recomputed in this sweep */
+    std::vector<MatrixPtrType> adjoints; /**< adjoint of each node */
+    std::vector<bool> adjointChanged; /**< recomputed in this sweep */
+    ST rootVal; /**< cached trace/logdet of the root */
+    unsigned long rootValStamp; /**< version of the root for rootVal */
+    bool rootValComputed; /**< is rootVal valid at all */
+    int numNodes; /**< nodes recomputed by the last forward sweep */
+    int numAdjoints; /**< partial adjoints recomputed by the last sweep */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_INCREMENTAL_EVALUATOR_HPP */
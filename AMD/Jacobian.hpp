@@ -0,0 +1,492 @@
+#ifndef AMD_JACOBIAN_HPP
+#define AMD_JACOBIAN_HPP
+
+/**
+ * @file Jacobian.hpp
+ *
+ * @brief This file defines vector-Jacobian products and Jacobians of
+ * matrix-valued functions. A reverse sweep seeded with a matrix W of the
+ * shape of the root F gives, for each variable X, the gradient of
+ * trace(W^T*F), which is vec(W)^T times the Jacobian d vec(F)/d vec(X).
+ *
+ * The Jacobian takes one such sweep per entry of F, so JacobianEvaluator
+ * runs the seeds in blocks of k. For dense Eigen matrices the k adjoints of
+ * a node are stacked into one matrix, side by side or on top of each other,
+ * so that every product of the sweep is one wide GEMM instead of k thin
+ * ones; a node switches between the two layouts when its operator needs
+ * the other one, which costs a copy. Other matrix types sweep once per
+ * seed.
+ */
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "Exception.hpp"
+
+#if AMD_HAVE_EIGEN==1
+  #include <Eigen/Dense>
+#endif
+
+namespace AMD {
+
+  /**
+   * @brief Copy the adjoints of the variables out of a workspace; variables
+   * that the sweep did not reach get zeros.
+   */
+  template <class MT, class ST>
+  void variableAdjoints(const ComputationGraph<MT, ST>& graph,
+                        const GraphWorkspace<MT, ST>& ws,
+                        std::vector<MT>& result) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    result.resize(graph.numVariables());
+    for (int v=0; v<graph.numVariables(); ++v) {
+      const int i = graph.variable(v);
+      if (ws.hasAdjoint[i]) {
+        MatrixAdaptorType::copy(result[v], ws.adjoints[i]);
+      } else {
+        result[v] = MatrixAdaptorType::zeros(graph.node(i).numRows,
+                                             graph.node(i).numCols);
+      }
+    }
+  }
+
+  /**
+   * @brief Reverse sweeps for a block of seeds. This one sweeps once per
+   * seed; matrix types that can stack the adjoints of a node specialize it.
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  struct StackedReverseSweep_t {
+    /**
+     * @brief Compute vector-Jacobian products for many seeds.
+     *
+     * @param[in]     graph     The graph; forwardSweep() was called on ws.
+     * @param[in,out] ws        The workspace of the forward sweep.
+     * @param[in]     seeds     The adjoints of the root.
+     * @param[out]    gradients gradients[s][v] is the product of seeds[s]
+     *                          with the Jacobian of variable v.
+     */
+    static void apply(const ComputationGraph<MT, ST>& graph,
+                      GraphWorkspace<MT, ST>& ws,
+                      const std::vector<MT>& seeds,
+                      std::vector<std::vector<MT> >& gradients) {
+      gradients.resize(seeds.size());
+      for (size_t s=0; s<seeds.size(); ++s) {
+        seededReverseSweep(graph, ws, seeds[s]);
+        variableAdjoints(graph, ws, gradients[s]);
+      }
+    }
+  };
+
+#if AMD_HAVE_EIGEN==1
+
+  /**
+   * @brief Stack the k adjoints of each node of a dense Eigen graph.
+   */
+  template <class T, class ST>
+  struct StackedReverseSweep_t<Eigen::Matrix<T, Eigen::Dynamic,
+                                                Eigen::Dynamic>, ST> {
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MT;
+    typedef GraphNode<MT, ST> NodeType;
+
+    /**
+     * @brief k matrices of the same shape, side by side or on top of each
+     * other.
+     */
+    struct Stack {
+      MT blocks; /**< all the matrices */
+      bool vertical; /**< are they on top of each other */
+    };
+
+    static void apply(const ComputationGraph<MT, ST>& graph,
+                      GraphWorkspace<MT, ST>& ws,
+                      const std::vector<MT>& seeds,
+                      std::vector<std::vector<MT> >& gradients) {
+      const int k = seeds.size();
+      const int root = graph.root();
+      const int rows = graph.node(root).numRows;
+      const int cols = graph.node(root).numCols;
+
+      gradients.resize(k);
+      if (0 == k) return;
+
+      std::vector<Stack> adjoints(graph.size());
+      std::vector<bool> hasAdjoint(graph.size(), false);
+      adjoints[root].blocks.resize(rows, k*cols);
+      adjoints[root].vertical = false;
+      for (int s=0; s<k; ++s) {
+        if (seeds[s].rows() != rows || seeds[s].cols() != cols) {
+          throw exception_generic_impl("AMD::StackedReverseSweep_t::apply",
+                                       "A seed does not match the root",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+        block(adjoints[root], s, rows, cols) = seeds[s];
+      }
+      hasAdjoint[root] = true;
+
+      Stack partial;
+      for (int i=root; i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        if (node.isConst || node.isLeaf() || !hasAdjoint[i]) continue;
+
+        for (int side=0; side<2; ++side) {
+          const int child = (0 == side) ? node.left : node.right;
+          if (-1 == child || graph.node(child).isConst) continue;
+
+          partialAdjoint(node,
+                         side,
+                         *ws.values[i],
+                         ws.values[node.left],
+                         (-1 == node.right) ? NULL : ws.values[node.right],
+                         k,
+                         adjoints[i],
+                         partial);
+          if (hasAdjoint[child]) {
+            setLayout(partial, adjoints[child].vertical,
+                      graph.node(child).numRows, graph.node(child).numCols,
+                      k);
+            adjoints[child].blocks += partial.blocks;
+          } else {
+            std::swap(adjoints[child], partial);
+            hasAdjoint[child] = true;
+          }
+        }
+      }
+
+      for (int s=0; s<k; ++s) gradients[s].resize(graph.numVariables());
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const int i = graph.variable(v);
+        const int m = graph.node(i).numRows;
+        const int n = graph.node(i).numCols;
+        for (int s=0; s<k; ++s) {
+          if (hasAdjoint[i]) gradients[s][v] = block(adjoints[i], s, m, n);
+          else gradients[s][v] = MT::Zero(m, n);
+        }
+      }
+    }
+
+    private:
+    /** Matrix s of a stack of rows x cols matrices */
+    static Eigen::Block<MT> block(Stack& A, int s, int rows, int cols) {
+      return A.vertical ? A.blocks.block(s*rows, 0, rows, cols) :
+                          A.blocks.block(0, s*cols, rows, cols);
+    }
+
+    /** Move the matrices of a stack side by side or on top of each other */
+    static void setLayout(Stack& A, bool vertical, int rows, int cols,
+                          int k) {
+      if (A.vertical == vertical) return;
+      Stack other;
+      other.vertical = vertical;
+      other.blocks.resize(vertical ? k*rows : rows, vertical ? cols : k*cols);
+      for (int s=0; s<k; ++s) {
+        block(other, s, rows, cols) = block(A, s, rows, cols);
+      }
+      std::swap(A, other);
+    }
+
+    /**
+     * The rules of AMD::partialAdjoint() applied to k adjoints at once. The
+     * adjoint may be moved to the layout that the operator needs.
+     */
+    static void partialAdjoint(const NodeType& node,
+                               int side,
+                               const MT& value,
+                               const MT* left,
+                               const MT* right,
+                               int k,
+                               Stack& adjoint,
+                               Stack& result) {
+      const int rows = node.numRows;
+      const int cols = node.numCols;
+
+      result.vertical = adjoint.vertical;
+      switch (node.opNum) {
+        case PLUS: result.blocks = adjoint.blocks; break;
+        case MINUS:
+          if (0 == side) result.blocks = adjoint.blocks;
+          else result.blocks = -adjoint.blocks;
+          break;
+        case NEGATION: result.blocks = -adjoint.blocks; break;
+        case TIMES:
+          /** adjoint*R^T is one GEMM with the adjoints on top of each other,
+              L^T*adjoint is one with the adjoints side by side */
+          if (0 == side) {
+            setLayout(adjoint, true, rows, cols, k);
+            result.blocks.noalias() = adjoint.blocks * right->transpose();
+            result.vertical = true;
+          } else {
+            setLayout(adjoint, false, rows, cols, k);
+            result.blocks.noalias() = left->transpose() * adjoint.blocks;
+            result.vertical = false;
+          }
+          break;
+        case MTIMESS:
+        case STIMESM: result.blocks = node.scalar * adjoint.blocks; break;
+        case ELEWISE: {
+          const MT& other = (0 == side) ? *right : *left;
+          if (adjoint.vertical) {
+            result.blocks = adjoint.blocks.cwiseProduct(other.replicate(k, 1));
+          } else {
+            result.blocks = adjoint.blocks.cwiseProduct(other.replicate(1, k));
+          }
+        }
+          break;
+        case TRANSPOSE:
+          /** The transpose of a stack is the stack of the transposes in
+              the other layout */
+          result.blocks = adjoint.blocks.transpose();
+          result.vertical = !adjoint.vertical;
+          break;
+        case INV: {
+          /** -inv(L)^T*adjoint*inv(L)^T as two GEMMs */
+          setLayout(adjoint, false, rows, cols, k);
+          Stack tmp;
+          tmp.vertical = false;
+          tmp.blocks.noalias() = value.transpose() * adjoint.blocks;
+          setLayout(tmp, true, rows, cols, k);
+          result.blocks.noalias() = -tmp.blocks * value.transpose();
+          result.vertical = true;
+        }
+          break;
+        case DIAG:
+          result.blocks.setZero(adjoint.blocks.rows(), adjoint.blocks.cols());
+          for (int s=0; s<k; ++s) {
+            block(result, s, rows, cols).diagonal() =
+              block(adjoint, s, rows, cols).diagonal();
+          }
+          break;
+        default:
+          throw exception_generic_impl("AMD::StackedReverseSweep_t",
+                                       "Node is not an internal node",
+                                       AMD_INVALID_OPERATION);
+      }
+    }
+  };
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+  /**
+   * @brief Compute vector-Jacobian products and Jacobians of the root of a
+   * graph, which may be matrix valued, at one point. The evaluator keeps
+   * the values of the last evaluate() for all the products that follow.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(fX*fA*fX);   // matrix valued
+   * AMD::JacobianEvaluator<MT, ST> eval(graph);
+   * eval.evaluate(point);
+   * std::vector<MT> vjp;
+   * eval.vjp(W, vjp);              // gradients of trace(W^T*X*A*X)
+   * std::vector<MT> jacobian;
+   * eval.jacobian(jacobian, 64);   // 64 seeds per sweep
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class JacobianEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphWorkspace<MT, ST> WorkspaceType;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MT> BindingType;
+
+    /**
+     * @brief Create an evaluator.
+     *
+     * @param[in] graph The graph; any root is used as a matrix.
+     */
+    JacobianEvaluator(const GraphType& graph) : graph(graph),
+                                                evaluated(false) {}
+
+    /**
+     * @brief Get the graph that is evaluated.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Compute the values of the graph at a point.
+     *
+     * @param[in] binding binding[v] is the value of variable v; if it is
+     *                    empty, the values of the VAR leaves are used.
+     * @return The value of the root.
+     */
+    const MT& evaluate(const BindingType& binding = BindingType()) {
+      AMD_START_TRY_BLOCK()
+
+      if (!binding.empty() &&
+          static_cast<int>(binding.size()) != graph.numVariables()) {
+        throw exception_generic_impl("AMD::JacobianEvaluator::evaluate",
+                                     "Need one value per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      for (size_t v=0; v<binding.size(); ++v) {
+        const GraphNode<MT, ST>& node = graph.node(graph.variable(v));
+        if (MatrixAdaptorType::getNumRows(binding[v]) != node.numRows ||
+            MatrixAdaptorType::getNumCols(binding[v]) != node.numCols) {
+          throw exception_generic_impl("AMD::JacobianEvaluator::evaluate",
+                                       "Dimensions of a binding don't match",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+      }
+
+      /** The workspace points into the binding, so keep a copy */
+      point = binding;
+      std::vector<const MT*> variables(point.size());
+      for (size_t v=0; v<point.size(); ++v) variables[v] = &point[v];
+      forwardSweep(graph, variables, ws);
+      evaluated = true;
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, JacobianEvaluator::evaluate)
+      return *ws.values[graph.root()];
+    }
+
+    /**
+     * @brief Compute the product of one seed with the Jacobian of each
+     * variable, at the last point that was evaluated (the VAR leaves if
+     * none was).
+     *
+     * @param[in]  seed     The adjoint of the root; it has its shape.
+     * @param[out] gradient gradient[v] is the gradient of trace(seed^T*root)
+     *                      with respect to variable v.
+     */
+    void vjp(const MT& seed, BindingType& gradient) {
+      AMD_START_TRY_BLOCK()
+
+      if (!evaluated) evaluate();
+      seededReverseSweep(graph, ws, seed);
+      variableAdjoints(graph, ws, gradient);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, JacobianEvaluator::vjp)
+    }
+
+    /**
+     * @brief Compute the products of a block of seeds with the Jacobians in
+     * one stacked reverse sweep (one sweep per seed for matrix types that do
+     * not stack).
+     *
+     * @param[in]  seeds     The adjoints of the root.
+     * @param[out] gradients gradients[s][v] is the product of seeds[s] with
+     *                       the Jacobian of variable v.
+     */
+    void vjp(const std::vector<MT>& seeds,
+             std::vector<BindingType>& gradients) {
+      AMD_START_TRY_BLOCK()
+
+      if (!evaluated) evaluate();
+      StackedReverseSweep_t<MT, ST>::apply(graph, ws, seeds, gradients);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, JacobianEvaluator::vjp)
+    }
+
+#if AMD_HAVE_EIGEN==1
+
+    /**
+     * @brief Compute the Jacobian of vec(root) with respect to vec(X) for
+     * each variable X (vec stacks the columns). This sweeps once for each
+     * entry of the root, blockSize seeds at a time, and needs dense Eigen
+     * matrices.
+     *
+     * @param[out] result    result[v] has one row per entry of the root
+     *                       and one column per entry of variable v.
+     * @param[in]  blockSize Seeds per sweep; 0 for all of them at once.
+     *                       Very wide stacks fall out of cache, so a few
+     *                       dozen seeds per sweep are usually fastest.
+     */
+    void jacobian(BindingType& result, int blockSize = 32) {
+      AMD_START_TRY_BLOCK()
+
+      if (!evaluated) evaluate();
+      const GraphNode<MT, ST>& root = graph.node(graph.root());
+      const int total = root.numRows*root.numCols;
+      if (0 >= blockSize || blockSize > total) blockSize = total;
+
+      result.resize(graph.numVariables());
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const GraphNode<MT, ST>& node = graph.node(graph.variable(v));
+        result[v].resize(total, node.numRows*node.numCols);
+      }
+
+      std::vector<MT> seeds;
+      std::vector<BindingType> gradients;
+      for (int first=0; first<total; first+=blockSize) {
+        const int k = std::min(blockSize, total - first);
+        seeds.resize(k);
+        for (int s=0; s<k; ++s) {
+          seeds[s] = MT::Zero(root.numRows, root.numCols);
+          seeds[s]((first+s) % root.numRows, (first+s) / root.numRows) = 1;
+        }
+        vjp(seeds, gradients);
+        for (int s=0; s<k; ++s) {
+          for (int v=0; v<graph.numVariables(); ++v) {
+            const MT& g = gradients[s][v];
+            result[v].row(first+s) = Eigen::Map<const MT>(g.data(), 1,
+                                                          g.size());
+          }
+        }
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, JacobianEvaluator::jacobian)
+    }
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+    private:
+    JacobianEvaluator(const JacobianEvaluator&);
+    JacobianEvaluator& operator=(const JacobianEvaluator&);
+
+    const GraphType graph; /**< the graph that is evaluated */
+    BindingType point; /**< the point of the last evaluate() */
+    WorkspaceType ws; /**< the values at that point */
+    bool evaluated; /**< has evaluate() been called */
+  };
+
+  /**
+   * @brief Compute the product of a seed with the Jacobian of a recorded
+   * matrix function with respect to each variable.
+   *
+   * \code
+   * MMF fX(X, false), fY(Y, false);
+   * std::map<boost::shared_ptr<MT>, MT> vjp;
+   * AMD::vectorJacobianProduct(fX*fY, W, vjp);
+   * // vjp[fX.matrixPtr] is W*Y^T, vjp[fY.matrixPtr] is X^T*W
+   * \endcode
+   *
+   * @param[in]  root   The recorded matrix function.
+   * @param[in]  seed   The adjoint of the root; it has its shape.
+   * @param[out] result The gradient of trace(seed^T*root) with respect to
+   *                    each variable, keyed by the matrixPtr of its VAR leaf.
+   */
+  template <class MT, class ST>
+  void vectorJacobianProduct(const MatrixMatrixFunc<MT, ST>& root,
+                             const MT& seed,
+                             std::map<boost::shared_ptr<MT>, MT>& result) {
+    const ComputationGraph<MT, ST> graph(root);
+    GraphWorkspace<MT, ST> ws;
+    forwardSweep(graph, std::vector<const MT*>(), ws);
+    seededReverseSweep(graph, ws, seed);
+
+    std::vector<MT> gradient;
+    variableAdjoints(graph, ws, gradient);
+    result.clear();
+    for (int v=0; v<graph.numVariables(); ++v) {
+      result[graph.node(graph.variable(v)).matrixPtr] = gradient[v];
+    }
+  }
+
+} /** namespace AMD */
+
+#endif /** AMD_JACOBIAN_HPP */
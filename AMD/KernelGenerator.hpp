@@ -0,0 +1,967 @@
+#ifndef AMD_KERNEL_GENERATOR_HPP
+#define AMD_KERNEL_GENERATOR_HPP
+
+/**
+ * @file KernelGenerator.hpp
+ *
+ * @brief This file defines an ahead-of-time code generator for recorded
+ * objectives. The evaluators walk a ComputationGraph at run time: every node
+ * goes through the operator switch of forwardNode()/partialAdjoint(), every
+ * value lives in a heap-allocated matrix of run-time size and every partial
+ * adjoint is formed before it is added. For a graph that is evaluated many
+ * times with the same shapes, KernelGenerator instead writes a standalone
+ * C++ function against Eigen with
+ *   - one straight-line statement per node, for the value and then for the
+ *     gradient, with no operator dispatch;
+ *   - fixed-size Eigen matrices for the nodes with at most
+ *     kKernelFixedSize entries, so that small products are unrolled;
+ *   - the structure tags of the leaves propagated through the graph: zero
+ *     and identity constants are never stored, products with an identity
+ *     and sums with a zero reuse the other operand, and nothing flows back
+ *     through a node that is known to be zero;
+ *   - the constant subexpressions folded at generation time into the
+ *     constants of the kernel;
+ *   - the partial adjoints added straight into the adjoint of each child,
+ *     and the gradients written straight into the caller's memory.
+ * The kernel has C linkage:
+ *
+ * \code
+ * extern "C" double name(const double* const* variables,
+ *                        const double* const* constants,
+ *                        double* const* gradients);
+ * \endcode
+ *
+ * where variables[v] and gradients[v] are the column-major values and
+ * gradients of variable v, constants[k] is the value of constant(k) and the
+ * gradients are skipped if gradients is NULL.
+ *
+ * CompiledKernel builds the source with the compiler of KernelSettings,
+ * loads it with dlopen() and evaluates it like SharedEvaluator does.
+ *
+ * \code
+ * AMD::CompiledKernel<Eigen::MatrixXd, double> kernel(
+ *   AMD::logdet(fS + fX*transpose(fX)));
+ * double value = kernel.evaluate(point, &gradient);
+ * \endcode
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+#include <limits>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <utility>
+#include "boost/shared_ptr.hpp"
+#include "AMD/config.h"
+#include "MatrixAdaptor.hpp"
+#include "ScalarMatrixFunc.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "Exception.hpp"
+
+#if AMD_HAVE_EIGEN==1
+  #include <Eigen/Dense>
+#endif
+
+#if AMD_HAVE_EIGEN==1 && AMD_HAVE_DLFCN_H==1
+  #include <mutex>
+  #include <unistd.h>
+  #include <dlfcn.h>
+#endif
+
+namespace AMD {
+
+#if AMD_HAVE_EIGEN==1
+
+  /** Nodes with at most this many entries get fixed-size Eigen matrices */
+  const int kKernelFixedSize = 16;
+
+  /**
+   * @brief The name of a scalar type in the generated source.
+   */
+  template <class ST> struct KernelScalar_t;
+
+  template <> struct KernelScalar_t<double> {
+    static const char* name() { return "double"; }
+  };
+
+  template <> struct KernelScalar_t<float> {
+    static const char* name() { return "float"; }
+  };
+
+  /**
+   * @brief Generate the C++ source of the value and gradient of a graph
+   * with a scalar root.
+   *
+   * @tparam MT A plain (column-major, contiguous) Eigen matrix type.
+   * @tparam ST Scalar type, float or double.
+   */
+  template <class MT, class ST>
+  class KernelGenerator {
+    public:
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+
+    /**
+     * @brief Analyse a graph.
+     *
+     * @param[in] graph The graph; it must have a scalar root.
+     */
+    KernelGenerator(const GraphType& graph) : graph(graph) {
+      AMD_START_TRY_BLOCK()
+
+      if (kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::KernelGenerator",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+      analyse();
+      if (rows[graph.root()] != cols[graph.root()]) {
+        throw exception_generic_impl(
+          "AMD::KernelGenerator",
+          "scalar function (trace/logdet) called on non-square matrix",
+          AMD_INVALID_ARGUMENTS);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, KernelGenerator)
+    }
+
+    /**
+     * @brief Get the graph that the kernel computes.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Get the number of constants that the kernel reads.
+     */
+    int numConstants() const { return constantList.size(); }
+
+    /**
+     * @brief Get the value to pass as constants[k] to the kernel: a constant
+     * leaf, or a folded constant subexpression.
+     */
+    const MT& constant(int k) const { return *constantList[k]; }
+
+    /**
+     * @brief Write the source of the kernel.
+     *
+     * @param[out] out  The stream the source is written to.
+     * @param[in]  name The name of the extern "C" function.
+     */
+    void generate(std::ostream& out, const std::string& name) const {
+      AMD_START_TRY_BLOCK()
+
+      const int root = graph.root();
+
+      out << "// Generated by AMD::KernelGenerator from a graph of "
+          << graph.size() << " nodes: "
+          << ((kTraceRoot == graph.rootOp()) ? "trace" : "logdet")
+          << " of a " << rows[root] << "x" << cols[root]
+          << " matrix.\n"
+          << "#include <cmath>\n"
+          << "#include <Eigen/Dense>\n\n"
+          << "namespace {\n"
+          << "  typedef " << KernelScalar_t<ST>::name() << " T;\n";
+      std::set<std::string> typedefs;
+      for (int i=0; i<graph.size(); ++i) {
+        const std::string type = typeName(i);
+        if (false == typedefs.insert(type).second) continue;
+        out << "  typedef Eigen::Matrix<T, ";
+        if (type == "MX") out << "Eigen::Dynamic, Eigen::Dynamic";
+        else out << rows[i] << ", " << cols[i];
+        out << "> " << type << ";\n";
+      }
+      const std::string indent(name.size() + 14, ' ');
+      out << "}\n\n"
+          << "extern \"C\" T " << name << "(const T* const* variables,\n"
+          << indent << "const T* const* constants,\n"
+          << indent << "T* const* gradients) {\n";
+
+      /** The values */
+      for (int i=0; i<graph.size(); ++i) {
+        if (needed[i]) forwardStatement(i, out);
+      }
+      const std::string rootValue = value(root);
+      const std::string rootType = typeName(root);
+      if (kTraceRoot == graph.rootOp()) {
+        out << "  const T value = (" << rootValue << ").trace();\n";
+      } else {
+        out << "  const Eigen::LLT<" << rootType << "> llt(" << rootValue
+            << ");\n"
+            << "  const T value = "
+            << "T(2)*llt.matrixLLT().diagonal().array().log().sum();\n";
+      }
+      out << "  if (0 == gradients) return value;\n\n";
+
+      /** The adjoints, from the root down */
+      std::vector<std::vector<Contribution> > contributions(graph.size());
+      const int seeded = aliases[root];
+      if (kGeneral == tags[root] && false == graph.node(seeded).isConst) {
+        if (kTraceRoot == graph.rootOp()) {
+          contributions[seeded].push_back(Contribution::identity());
+        } else {
+          out << "  const " << rootType << " seed = llt.solve(" << rootType
+              << "::Identity" << shape(root) << ").transpose();\n";
+          contributions[seeded].push_back(Contribution::name("seed"));
+        }
+      }
+      for (int i=root; i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        if (!needed[i] || node.isConst || node.isLeaf()) continue;
+        Contribution adjoint;
+        if (!materialize(i, contributions[i], adjoint, out)) continue;
+        reverseStatements(i, adjoint, contributions);
+      }
+
+      /** The gradients, written in place */
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const int i = graph.variable(v);
+        std::ostringstream target;
+        target << "g" << v;
+        out << "  Eigen::Map<" << typeName(i) << "> " << target.str()
+            << "(gradients[" << v << "], " << rows[i] << ", " << cols[i]
+            << ");\n";
+        if (contributions[i].empty()) {
+          out << "  " << target.str() << ".setZero();\n";
+        } else {
+          accumulate(target.str(), contributions[i], out);
+        }
+      }
+      out << "  return value;\n"
+          << "}\n";
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, KernelGenerator::generate)
+    }
+
+    /**
+     * @brief Get the source of the kernel as a string.
+     */
+    std::string generate(const std::string& name) const {
+      std::ostringstream out;
+      generate(out, name);
+      return out.str();
+    }
+
+    private:
+    /**
+     * One term of the adjoint of a node: an expression, the name of a
+     * matrix that is used as it is, or the identity.
+     */
+    struct Contribution {
+      std::string expr; /**< the expression; empty for the identity */
+      bool isProduct; /**< can be assigned with noalias() */
+      bool isName; /**< expr names a matrix of the right shape */
+
+      static Contribution identity() {
+        Contribution result;
+        result.isProduct = false;
+        result.isName = false;
+        return result;
+      }
+
+      static Contribution name(const std::string& expr) {
+        Contribution result;
+        result.expr = expr;
+        result.isProduct = false;
+        result.isName = true;
+        return result;
+      }
+
+      static Contribution expression(const std::string& expr,
+                                     bool isProduct) {
+        Contribution result;
+        result.expr = expr;
+        result.isProduct = isProduct;
+        result.isName = false;
+        return result;
+      }
+
+      bool isIdentity() const { return expr.empty(); }
+    };
+
+    /**
+     * Propagate the structure tags from the leaves, decide which node each
+     * node reuses and which values the kernel computes, and fold the
+     * constant subexpressions.
+     */
+    void analyse() {
+      const int n = graph.size();
+      tags.assign(n, kGeneral);
+      aliases.resize(n);
+      rows.resize(n);
+      cols.resize(n);
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        aliases[i] = i;
+        setShape(i);
+        if (node.isLeaf()) {
+          const bool square = (node.numRows == node.numCols);
+          if (node.isConst && (kZero == node.mType ||
+                               (kIdentity == node.mType && square))) {
+            tags[i] = node.mType;
+          }
+          continue;
+        }
+
+        const MatrixType left = tags[node.left];
+        const MatrixType right = (-1 == node.right) ? kGeneral :
+                                                      tags[node.right];
+        switch (node.opNum) {
+          case PLUS:
+            if (kZero == left) alias(i, node.right);
+            else if (kZero == right) alias(i, node.left);
+            break;
+          case MINUS:
+            if (kZero == right) alias(i, node.left);
+            break;
+          case TIMES:
+            if (kZero == left || kZero == right) tags[i] = kZero;
+            else if (kIdentity == left) alias(i, node.right);
+            else if (kIdentity == right) alias(i, node.left);
+            break;
+          case ELEWISE:
+            if (kZero == left || kZero == right) tags[i] = kZero;
+            else if (kIdentity == left && kIdentity == right) {
+              tags[i] = kIdentity;
+            }
+            break;
+          case NEGATION:
+          case MTIMESS:
+          case STIMESM:
+            if (kZero == left) tags[i] = kZero;
+            break;
+          case TRANSPOSE:
+          case DIAG:
+            tags[i] = left;
+            break;
+          case INV:
+            if (kIdentity == left) tags[i] = kIdentity;
+            break;
+          default:
+            throw exception_generic_impl("AMD::KernelGenerator",
+                                         "Node is not an internal node",
+                                         AMD_INVALID_OPERATION);
+        }
+      }
+
+      needed.assign(n, false);
+      markNeeded(graph.root());
+
+      /** Fold the constant subexpressions that the kernel reads */
+      GraphWorkspace<MT, ST> ws;
+      bool swept = false;
+      constantIndex.assign(n, -1);
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        if (!needed[i] || !node.isConst) continue;
+        constantIndex[i] = constantList.size();
+        if (node.isLeaf()) {
+          constantList.push_back(node.matrixPtr);
+        } else {
+          if (!swept) swept = forwardSweep(graph, std::vector<const MT*>(), ws);
+          constantList.push_back(boost::shared_ptr<MT>(new MT(*ws.values[i])));
+        }
+      }
+    }
+
+    /**
+     * The shape of node i from its operator; the recorded shape of a
+     * unary node is the one of its operand, even for a transpose.
+     */
+    void setShape(int i) {
+      const NodeType& node = graph.node(i);
+      if (node.isLeaf()) {
+        rows[i] = node.numRows;
+        cols[i] = node.numCols;
+      } else if (TRANSPOSE == node.opNum) {
+        rows[i] = cols[node.left];
+        cols[i] = rows[node.left];
+      } else if (TIMES == node.opNum) {
+        rows[i] = rows[node.left];
+        cols[i] = cols[node.right];
+      } else {
+        rows[i] = rows[node.left];
+        cols[i] = cols[node.left];
+      }
+    }
+
+    /** Node i has the value of node j */
+    void alias(int i, int j) {
+      aliases[i] = aliases[j];
+      tags[i] = tags[j];
+    }
+
+    /** Mark the nodes whose values the value of node i is computed from */
+    void markNeeded(int i) {
+      const int j = aliases[i];
+      if (kGeneral != tags[i] || needed[j]) return;
+      needed[j] = true;
+      const NodeType& node = graph.node(j);
+      if (node.isConst || node.isLeaf()) return;
+      markNeeded(node.left);
+      if (-1 != node.right) markNeeded(node.right);
+    }
+
+    /** The type of a matrix of the given shape in the generated source */
+    static std::string typeName(int rows, int cols) {
+      if (0 == rows || 0 == cols || rows*cols > kKernelFixedSize) return "MX";
+      std::ostringstream result;
+      result << "M" << rows << "x" << cols;
+      return result.str();
+    }
+
+    std::string typeName(int i) const {
+      return typeName(rows[i], cols[i]);
+    }
+
+    /** The shape of node i as constructor arguments */
+    std::string shape(int i) const {
+      std::ostringstream result;
+      result << "(" << rows[i] << ", " << cols[i] << ")";
+      return result.str();
+    }
+
+    /** An expression for the value of node i */
+    std::string value(int i) const {
+      if (kZero == tags[i]) return typeName(i) + "::Zero" + shape(i);
+      if (kIdentity == tags[i]) return typeName(i) + "::Identity" + shape(i);
+      std::ostringstream result;
+      result << "n" << aliases[i];
+      return result.str();
+    }
+
+    /** A scalar of the graph as a literal */
+    static std::string literal(ST scalar) {
+      std::ostringstream result;
+      result << "T(" << std::setprecision(std::numeric_limits<ST>::digits10 + 2)
+             << scalar << ")";
+      return result.str();
+    }
+
+    /** The statement that computes the value of node i */
+    void forwardStatement(int i, std::ostream& out) const {
+      const NodeType& node = graph.node(i);
+      const std::string type = typeName(i);
+      std::ostringstream name;
+      name << "n" << i;
+
+      if (node.isConst || node.isLeaf()) {
+        out << "  const Eigen::Map<const " << type << "> " << name.str() << "(";
+        if (node.isConst) out << "constants[" << constantIndex[i] << "]";
+        else out << "variables[" << node.varIndex << "]";
+        out << ", " << node.numRows << ", " << node.numCols << ");\n";
+        return;
+      }
+
+      const std::string a = value(node.left);
+      const std::string b = (-1 == node.right) ? "" : value(node.right);
+      const MatrixType left = tags[node.left];
+      const MatrixType right = (-1 == node.right) ? kGeneral :
+                                                    tags[node.right];
+      std::string expr;
+      std::string diagonalUpdate;
+      switch (node.opNum) {
+        case PLUS:
+          if (kIdentity == left) { expr = b; diagonalUpdate = "+="; }
+          else if (kIdentity == right) { expr = a; diagonalUpdate = "+="; }
+          else expr = a + " + " + b;
+          break;
+        case MINUS:
+          if (kZero == left) expr = "-" + b;
+          else if (kIdentity == left) { expr = "-" + b; diagonalUpdate = "+="; }
+          else if (kIdentity == right) { expr = a; diagonalUpdate = "-="; }
+          else expr = a + " - " + b;
+          break;
+        case NEGATION: expr = "-" + a; break;
+        case TIMES: expr = a + " * " + b; break;
+        case MTIMESS:
+        case STIMESM: expr = a + " * " + literal(node.scalar); break;
+        case ELEWISE:
+          if (kIdentity == left) expr = b + ".diagonal().asDiagonal()";
+          else if (kIdentity == right) expr = a + ".diagonal().asDiagonal()";
+          else expr = a + ".cwiseProduct(" + b + ")";
+          break;
+        case TRANSPOSE: expr = a + ".transpose()"; break;
+        case INV: expr = a + ".inverse()"; break;
+        case DIAG: expr = a + ".diagonal().asDiagonal()"; break;
+        default:
+          throw exception_generic_impl("AMD::KernelGenerator::generate",
+                                       "Node is not an internal node",
+                                       AMD_INVALID_OPERATION);
+      }
+
+      if (diagonalUpdate.empty()) {
+        out << "  const " << type << " " << name.str() << " = " << expr
+            << ";\n";
+      } else {
+        out << "  " << type << " " << name.str() << " = " << expr << ";\n"
+            << "  " << name.str() << ".diagonal().array() " << diagonalUpdate
+            << " T(1);\n";
+      }
+    }
+
+    /**
+     * Turn the contributions to the adjoint of node i into one term: the
+     * identity or a name are used as they are, anything else is added up
+     * into a new matrix. Returns false if node i has no adjoint.
+     */
+    bool materialize(int i,
+                     const std::vector<Contribution>& terms,
+                     Contribution& adjoint,
+                     std::ostream& out) const {
+      if (terms.empty()) return false;
+      if (1 == terms.size() && (terms[0].isIdentity() || terms[0].isName)) {
+        adjoint = terms[0];
+        return true;
+      }
+      std::ostringstream name;
+      name << "a" << i;
+      const std::string type = typeName(i);
+      if (1 == terms.size()) {
+        out << "  const " << type << " " << name.str() << " = "
+            << terms[0].expr << ";\n";
+      } else {
+        /** setIdentity() needs the size of a dynamic matrix */
+        out << "  " << type << " " << name.str()
+            << ((type == "MX") ? shape(i) : "") << ";\n";
+        accumulate(name.str(), terms, out);
+      }
+      adjoint = Contribution::name(name.str());
+      return true;
+    }
+
+    /** Write the sum of the contributions into a matrix */
+    void accumulate(const std::string& target,
+                    const std::vector<Contribution>& terms,
+                    std::ostream& out) const {
+      for (size_t k=0; k<terms.size(); ++k) {
+        const Contribution& term = terms[k];
+        out << "  " << target;
+        if (term.isIdentity()) {
+          out << ((0 == k) ? ".setIdentity();\n" :
+                             ".diagonal().array() += T(1);\n");
+          continue;
+        }
+        if (term.isProduct) out << ".noalias()";
+        out << ((0 == k) ? " = " : " += ") << term.expr << ";\n";
+      }
+    }
+
+    /** Add a term to the adjoint of a child, unless it has none */
+    void contribute(int child,
+                    const Contribution& term,
+                    std::vector<std::vector<Contribution> >& terms) const {
+      if (kGeneral != tags[child]) return;
+      const int j = aliases[child];
+      if (graph.node(j).isConst) return;
+      terms[j].push_back(term);
+    }
+
+    /** The partial adjoints that node i passes to its children */
+    void reverseStatements(int i,
+                           const Contribution& adjoint,
+                           std::vector<std::vector<Contribution> >& terms)
+                           const {
+      const NodeType& node = graph.node(i);
+      const std::string identity = typeName(i) + "::Identity" + shape(i);
+      const std::string adj = adjoint.isIdentity() ? identity : adjoint.expr;
+      const Contribution negated =
+        Contribution::expression("-" + adj, false);
+      const std::string a = value(node.left);
+      const std::string b = (-1 == node.right) ? "" : value(node.right);
+      const MatrixType left = tags[node.left];
+      const MatrixType right = (-1 == node.right) ? kGeneral :
+                                                    tags[node.right];
+      std::ostringstream name;
+      name << "n" << i;
+
+      switch (node.opNum) {
+        case PLUS:
+          contribute(node.left, adjoint, terms);
+          contribute(node.right, adjoint, terms);
+          break;
+        case MINUS:
+          contribute(node.left, adjoint, terms);
+          contribute(node.right, negated, terms);
+          break;
+        case NEGATION: contribute(node.left, negated, terms); break;
+        case TIMES:
+          /** d(L*R) gives adjoint*R^T for L and L^T*adjoint for R */
+          contribute(node.left,
+                     adjoint.isIdentity() ?
+                       Contribution::expression(b + ".transpose()", false) :
+                       Contribution::expression(adj + " * " + b +
+                                                ".transpose()", true),
+                     terms);
+          contribute(node.right,
+                     adjoint.isIdentity() ?
+                       Contribution::expression(a + ".transpose()", false) :
+                       Contribution::expression(a + ".transpose() * " + adj,
+                                                true),
+                     terms);
+          break;
+        case MTIMESS:
+        case STIMESM:
+          contribute(node.left,
+                     Contribution::expression(adj + " * " +
+                                              literal(node.scalar), false),
+                     terms);
+          break;
+        case ELEWISE:
+          if (kIdentity == left || kIdentity == right) {
+            contribute((kIdentity == left) ? node.right : node.left,
+                       adjoint.isIdentity() ? adjoint :
+                         Contribution::expression(typeName(i) + "(" + adj +
+                                                  ".diagonal().asDiagonal())",
+                                                  false),
+                       terms);
+          } else {
+            contribute(node.left,
+                       Contribution::expression(adj + ".cwiseProduct(" + b +
+                                                ")", false),
+                       terms);
+            contribute(node.right,
+                       Contribution::expression(adj + ".cwiseProduct(" + a +
+                                                ")", false),
+                       terms);
+          }
+          break;
+        case TRANSPOSE:
+          contribute(node.left,
+                     adjoint.isIdentity() ? adjoint :
+                       Contribution::expression(adj + ".transpose()", false),
+                     terms);
+          break;
+        case INV: {
+          /** d(inv(L)) gives -inv(L)^T*adjoint*inv(L)^T */
+          const std::string trans = name.str() + ".transpose()";
+          contribute(node.left,
+                     Contribution::expression(
+                       adjoint.isIdentity() ?
+                         "-(" + trans + " * " + trans + ")" :
+                         "-(" + trans + " * " + adj + " * " + trans + ")",
+                       true),
+                     terms);
+        }
+          break;
+        case DIAG:
+          contribute(node.left,
+                     adjoint.isIdentity() ? adjoint :
+                       Contribution::expression(
+                         typeName(i) + "(" + adj + ".diagonal().asDiagonal())",
+                         false),
+                     terms);
+          break;
+        default:
+          throw exception_generic_impl("AMD::KernelGenerator::generate",
+                                       "Node is not an internal node",
+                                       AMD_INVALID_OPERATION);
+      }
+    }
+
+    GraphType graph; /**< the graph; it keeps the constant leaves alive */
+    std::vector<int> rows; /**< number of rows of each node */
+    std::vector<int> cols; /**< number of cols of each node */
+    std::vector<MatrixType> tags; /**< kZero, kIdentity or kGeneral */
+    std::vector<int> aliases; /**< the node whose value each node has */
+    std::vector<bool> needed; /**< is the value computed by the kernel */
+    std::vector<int> constantIndex; /**< index into the constants, or -1 */
+    /** the leaves and folded subexpressions passed as constants */
+    std::vector<boost::shared_ptr<MT> > constantList;
+  };
+
+#endif /** AMD_HAVE_EIGEN */
+
+#if AMD_HAVE_EIGEN==1 && AMD_HAVE_DLFCN_H==1
+
+  /**
+   * @brief Process-wide settings of the kernels built by CompiledKernel.
+   */
+  class KernelSettings {
+    public:
+    /**
+     * @brief Get the compiler (the one this library was configured with).
+     */
+    static std::string compiler() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      return data().compiler;
+    }
+
+    static void setCompiler(const std::string& compiler) {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      data().compiler = compiler;
+    }
+
+    /**
+     * @brief Get the flags that the kernels are built with; they have to
+     * build a shared library.
+     */
+    static std::string flags() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      return data().flags;
+    }
+
+    static void setFlags(const std::string& flags) {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      data().flags = flags;
+    }
+
+    /**
+     * @brief Get the directory of the Eigen headers (the one this library
+     * was configured with).
+     */
+    static std::string includeDirectory() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      return data().includeDirectory;
+    }
+
+    static void setIncludeDirectory(const std::string& directory) {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      data().includeDirectory = directory;
+    }
+
+    /**
+     * @brief Get the directory where the kernels are built ($TMPDIR, or
+     * /tmp).
+     */
+    static std::string scratchDirectory() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      return data().scratchDirectory;
+    }
+
+    static void setScratchDirectory(const std::string& directory) {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      data().scratchDirectory = directory;
+    }
+
+    /**
+     * @brief Get a file name that no other kernel of this process uses.
+     */
+    static std::string scratchFile() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      std::ostringstream result;
+      result << data().scratchDirectory << "/amd-kernel-"
+             << static_cast<long>(getpid()) << "-" << data().numFiles++;
+      return result.str();
+    }
+
+    private:
+    struct Data {
+      Data() : compiler(AMD_KERNEL_COMPILER),
+               flags("-O3 -DNDEBUG -std=c++11 -shared -fPIC"),
+               includeDirectory(AMD_KERNEL_INCLUDE_DIR),
+               numFiles(0) {
+        const char* tmp = getenv("TMPDIR");
+        scratchDirectory = (NULL == tmp) ? "/tmp" : tmp;
+      }
+
+      std::mutex mutex;
+      std::string compiler;
+      std::string flags;
+      std::string includeDirectory;
+      std::string scratchDirectory;
+      long numFiles;
+    };
+
+    static Data& data() {
+      static Data settings;
+      return settings;
+    }
+  };
+
+  /**
+   * @brief A kernel of KernelGenerator, built with the local compiler and
+   * loaded into the process.
+   *
+   * @tparam MT A plain (column-major, contiguous) Eigen matrix type.
+   * @tparam ST Scalar type, float or double.
+   */
+  template <class MT, class ST>
+  class CompiledKernel {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef ScalarMatrixFunc<MT, ST> SMF;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MT> BindingType;
+    /** The signature of the generated function */
+    typedef ST (*FunctionType)(const ST* const*, const ST* const*, ST* const*);
+
+    /**
+     * @brief Generate, build and load the kernel of a graph.
+     *
+     * @param[in] graph The graph; it must have a scalar root.
+     */
+    CompiledKernel(const GraphType& graph) :
+      generator(graph), handle(NULL), function(NULL) {
+      AMD_START_TRY_BLOCK()
+
+      build();
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, CompiledKernel)
+    }
+
+    /**
+     * @brief Generate, build and load the kernel of a function made by
+     * trace() or logdet().
+     */
+    CompiledKernel(const SMF& objective) :
+      generator(graphOf(objective)), handle(NULL), function(NULL) {
+      AMD_START_TRY_BLOCK()
+
+      build();
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, CompiledKernel)
+    }
+
+    ~CompiledKernel() { if (NULL != handle) dlclose(handle); }
+
+    /**
+     * @brief Get the graph that the kernel computes.
+     */
+    const GraphType& getGraph() const { return generator.getGraph(); }
+
+    /**
+     * @brief Get the source the kernel was built from.
+     */
+    const std::string& getSource() const { return source; }
+
+    /**
+     * @brief Evaluate the kernel and, optionally, its gradient. Like
+     * SharedEvaluator, this is const and can be called from many threads.
+     *
+     * @param[in]  binding  binding[v] is the value of variable v; if it is
+     *                      empty, the values of the VAR leaves are used.
+     * @param[out] gradient If not NULL, gradient[v] is overwritten with the
+     *                      gradient with respect to variable v.
+     * @return The value of the function.
+     */
+    ST evaluate(const BindingType& binding,
+                BindingType* gradient = NULL) const {
+      ST value = ST(0);
+      AMD_START_TRY_BLOCK()
+
+      const GraphType& graph = getGraph();
+      const int n = graph.numVariables();
+      if (!binding.empty() && static_cast<int>(binding.size()) != n) {
+        throw exception_generic_impl("AMD::CompiledKernel::evaluate",
+                                     "Need one value per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      std::vector<const ST*> variables(n);
+      std::vector<ST*> gradients(n);
+      if (NULL != gradient) gradient->resize(n);
+      for (int v=0; v<n; ++v) {
+        const GraphNode<MT, ST>& node = graph.node(graph.variable(v));
+        const MT& bound = binding.empty() ? *node.matrixPtr : binding[v];
+        if (MatrixAdaptorType::getNumRows(bound) != node.numRows ||
+            MatrixAdaptorType::getNumCols(bound) != node.numCols) {
+          throw exception_generic_impl("AMD::CompiledKernel::evaluate",
+                                       "Dimensions of a binding don't match",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+        variables[v] = bound.data();
+        if (NULL != gradient) {
+          (*gradient)[v].resize(node.numRows, node.numCols);
+          gradients[v] = (*gradient)[v].data();
+        }
+      }
+      value = function(variables.empty() ? NULL : &variables[0],
+                       constants.empty() ? NULL : &constants[0],
+                       (NULL == gradient || gradients.empty()) ? NULL :
+                                                                 &gradients[0]);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, CompiledKernel::evaluate)
+      return value;
+    }
+
+    private:
+    CompiledKernel(const CompiledKernel&);
+    CompiledKernel& operator=(const CompiledKernel&);
+
+    static GraphType graphOf(const SMF& objective) {
+      if (!objective.argumentFuncVal) {
+        throw exception_generic_impl("AMD::CompiledKernel",
+                                     "Function is not trace or logdet",
+                                     AMD_INVALID_OPERATION);
+      }
+      return GraphType(*objective.argumentFuncVal, objective.argumentOp);
+    }
+
+    /** Write the source, build it into a shared library and load it */
+    void build() {
+      const char* name = "amd_kernel";
+      source = generator.generate(name);
+      const std::string base = KernelSettings::scratchFile();
+      const std::string sourceFile = base + ".cpp";
+      const std::string libraryFile = base + ".so";
+      const std::string logFile = base + ".log";
+      {
+        std::ofstream file(sourceFile.c_str());
+        file << source;
+        if (!file) {
+          throw exception_generic_impl("AMD::CompiledKernel",
+                                       "Could not write the source",
+                                       AMD_IO_ERROR);
+        }
+      }
+
+      std::string command = KernelSettings::compiler() + " " +
+                            KernelSettings::flags();
+      const std::string include = KernelSettings::includeDirectory();
+      if (!include.empty()) command += " -I\"" + include + "\"";
+      command += " -o \"" + libraryFile + "\" \"" + sourceFile + "\" > \"" +
+                 logFile + "\" 2>&1";
+      const int status = system(command.c_str());
+      std::remove(sourceFile.c_str());
+      std::remove(logFile.c_str());
+      if (0 != status) {
+        std::remove(libraryFile.c_str());
+        throw exception_generic_impl("AMD::CompiledKernel",
+                                     "Could not compile the kernel",
+                                     AMD_COMPILE_ERROR);
+      }
+
+      /** The library stays mapped after its file is gone */
+      handle = dlopen(libraryFile.c_str(), RTLD_NOW | RTLD_LOCAL);
+      std::remove(libraryFile.c_str());
+      if (NULL == handle) {
+        throw exception_generic_impl("AMD::CompiledKernel",
+                                     "Could not load the kernel",
+                                     AMD_COMPILE_ERROR);
+      }
+      function = reinterpret_cast<FunctionType>(dlsym(handle, name));
+      if (NULL == function) {
+        dlclose(handle);
+        handle = NULL;
+        throw exception_generic_impl("AMD::CompiledKernel",
+                                     "Could not find the kernel",
+                                     AMD_COMPILE_ERROR);
+      }
+
+      for (int k=0; k<generator.numConstants(); ++k) {
+        constants.push_back(generator.constant(k).data());
+      }
+    }
+
+    KernelGenerator<MT, ST> generator; /**< the graph and its constants */
+    std::string source; /**< the generated source */
+    void* handle; /**< the loaded library */
+    FunctionType function; /**< the kernel */
+    std::vector<const ST*> constants; /**< the constants of the kernel */
+  };
+
+#endif /** AMD_HAVE_EIGEN && AMD_HAVE_DLFCN_H */
+
+} /** namespace AMD */
+
+#endif /** AMD_KERNEL_GENERATOR_HPP */
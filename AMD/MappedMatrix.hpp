@@ -0,0 +1,278 @@
+#ifndef AMD_MAPPED_MATRIX_HPP
+#define AMD_MAPPED_MATRIX_HPP
+
+/**
+ * @file MappedMatrix.hpp
+ *
+ * @brief This file defines MappedMatrix, a dense Eigen matrix that either
+ * owns its storage or borrows memory owned by the caller (a pointer with
+ * dimensions and a leading dimension, or an Eigen::Map), and its
+ * MatrixAdaptor_t. Use it as the matrix type when the data matrices live in
+ * memory-mapped files or in another library's storage: a borrowed matrix is
+ * wrapped without a copy, copies of it are views of the same memory, and
+ * assigning to it detaches it into storage of its own. Nothing in the library
+ * can therefore write to borrowed memory.
+ *
+ * \code
+ * typedef AMD::MappedMatrix<double> MT;
+ * MT A(mappedData, n, n, leadingDimension); // no copy
+ * AMD::MatrixMatrixFunc<MT, double> fA(A, true), fX(X, false);
+ * AMD::ScalarMatrixFunc<MT, double> f = AMD::trace(fA*fX);
+ * \endcode
+ */
+
+#include <new>
+#include <Eigen/Dense>
+#include "MatrixAdaptor.hpp"
+#include "MatrixPool.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  template <class T>
+  class MappedMatrix :
+    public Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>,
+                      Eigen::Unaligned,
+                      Eigen::OuterStride<> > {
+    public:
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> PlainType;
+    typedef Eigen::Map<PlainType, Eigen::Unaligned, Eigen::OuterStride<> >
+      BaseType;
+
+    /**
+     * @brief An empty matrix.
+     */
+    MappedMatrix() : BaseType(NULL, 0, 0, Eigen::OuterStride<>(0)),
+                     borrowed(false) {}
+
+    /**
+     * @brief An owned rows x cols matrix with unspecified contents.
+     */
+    MappedMatrix(int rows, int cols) :
+      BaseType(NULL, 0, 0, Eigen::OuterStride<>(0)),
+      storage(rows, cols),
+      borrowed(false) {
+      remap();
+    }
+
+    /**
+     * @brief Borrow column-major memory owned by the caller. The memory has
+     * to outlive every copy of this matrix.
+     *
+     * @param[in] data        The first entry.
+     * @param[in] rows        Number of rows.
+     * @param[in] cols        Number of columns.
+     * @param[in] outerStride Distance between the columns (>= rows), or
+     *                        -1 for rows.
+     */
+    MappedMatrix(const T* data, int rows, int cols, int outerStride=-1) :
+      BaseType(const_cast<T*>(data), rows, cols,
+               Eigen::OuterStride<>((-1 == outerStride) ? rows : outerStride)),
+      borrowed(true) {
+      if ((-1 != outerStride && outerStride < rows) || 0 > rows || 0 > cols) {
+        throw exception_generic_impl("AMD::MappedMatrix",
+                                     "Invalid dimensions or stride",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+    }
+
+    /**
+     * @brief Borrow the memory of an Eigen::Map with unit inner stride.
+     */
+    template <class PlainObject, int Options, class StrideType>
+    MappedMatrix(const Eigen::Map<PlainObject, Options, StrideType>& map) :
+      BaseType(const_cast<T*>(map.data()), map.rows(), map.cols(),
+               Eigen::OuterStride<>(map.outerStride())),
+      borrowed(true) {
+      if (1 != map.innerStride()) {
+        throw exception_generic_impl("AMD::MappedMatrix",
+                                     "The inner stride has to be one",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+    }
+
+    /**
+     * @brief An owned matrix with the value of an Eigen expression.
+     */
+    template <class Derived>
+    MappedMatrix(const Eigen::EigenBase<Derived>& other) :
+      BaseType(NULL, 0, 0, Eigen::OuterStride<>(0)),
+      storage(other),
+      borrowed(false) {
+      remap();
+    }
+
+    /**
+     * @brief A copy of a borrowed matrix borrows the same memory; a copy of
+     * an owned matrix owns a copy of the values.
+     */
+    MappedMatrix(const MappedMatrix& other) :
+      BaseType(NULL, 0, 0, Eigen::OuterStride<>(0)),
+      borrowed(other.borrowed) {
+      if (borrowed) view(other.data(), other.rows(), other.cols(),
+                         other.outerStride());
+      else {
+        storage = other.storage;
+        remap();
+      }
+    }
+
+    MappedMatrix(MappedMatrix&& other) :
+      BaseType(NULL, 0, 0, Eigen::OuterStride<>(0)),
+      borrowed(other.borrowed) {
+      if (borrowed) view(other.data(), other.rows(), other.cols(),
+                         other.outerStride());
+      else {
+        storage.swap(other.storage);
+        remap();
+        other.remap();
+      }
+    }
+
+    MappedMatrix& operator=(const MappedMatrix& other) {
+      if (this != &other) {
+        if (other.borrowed) {
+          storage.resize(0, 0);
+          borrowed = true;
+          view(other.data(), other.rows(), other.cols(), other.outerStride());
+        } else assign(other);
+      }
+      return *this;
+    }
+
+    MappedMatrix& operator=(MappedMatrix&& other) {
+      if (this != &other) {
+        if (other.borrowed) return (*this = static_cast<const MappedMatrix&>
+                                                                  (other));
+        storage.swap(other.storage);
+        borrowed = false;
+        remap();
+        other.remap();
+      }
+      return *this;
+    }
+
+    /**
+     * @brief Assign an Eigen expression. A borrowed matrix, or one of
+     * another shape, gets new storage of its own first.
+     */
+    template <class Derived>
+    MappedMatrix& operator=(const Eigen::DenseBase<Derived>& other) {
+      assign(other.derived());
+      return *this;
+    }
+
+    /**
+     * @brief Is the memory owned by the caller?
+     */
+    bool isBorrowed() const { return borrowed; }
+
+    /**
+     * @brief Get the matrix as a plain Eigen matrix (a copy).
+     */
+    PlainType toPlain() const { return PlainType(*this); }
+
+    private:
+    template <class Expression>
+    void assign(const Expression& other) {
+      if (!borrowed && storage.rows() == other.rows() &&
+                       storage.cols() == other.cols()) {
+        BaseType::operator=(other);
+      } else {
+        /** Evaluate before releasing the old storage, which other may use */
+        PlainType value(other);
+        storage.swap(value);
+        borrowed = false;
+        remap();
+      }
+    }
+
+    void view(const T* data, int rows, int cols, int outerStride) {
+      new (static_cast<BaseType*>(this))
+        BaseType(const_cast<T*>(data), rows, cols,
+                 Eigen::OuterStride<>(outerStride));
+    }
+
+    void remap() {
+      view(storage.data(), storage.rows(), storage.cols(), storage.rows());
+    }
+
+    PlainType storage; /**< the values of an owned matrix */
+    bool borrowed; /**< is the memory owned by the caller */
+  };
+
+  /** Use Eigen::LLT on a plain copy */
+  template <typename T>
+  struct eigen_llt_t <MappedMatrix<T> > {
+    typedef typename MappedMatrix<T>::PlainType MatrixType;
+    typedef Eigen::LLT<MatrixType> LLTType;
+  };
+
+  /**
+   * @brief Copies of borrowed matrices have to stay views, so they are never
+   * pooled.
+   */
+  template <class T>
+  struct AllocationPolicy_t<MappedMatrix<T> > :
+    public HeapAllocationPolicy<MappedMatrix<T> > {};
+
+  template <typename T>
+  struct MatrixAdaptor_t<MappedMatrix<T> > :
+  public EigenMatrixAdaptorBase<T, MappedMatrix<T> > {
+    typedef T value_type;
+    typedef MappedMatrix<T> matrix_type;
+    typedef EigenMatrixAdaptorBase<value_type, matrix_type> base_type;
+    typedef typename matrix_type::PlainType plain_type;
+
+    using base_type::defaultConstructMatrix;
+    using base_type::copyConstructMatrix;
+    using base_type::getNumRows;
+    using base_type::getNumCols;
+    using base_type::add;
+    using base_type::minus;
+    using base_type::multiply;
+    using base_type::transpose;
+    using base_type::negation;
+    using base_type::logdet;
+    using base_type::copy;
+    using base_type::print;
+    using base_type::elementwiseProduct;
+
+    /**
+     * 8.
+     * @brief Compute the inverse of a matrix.
+     */
+    static void inv(const matrix_type& A,
+                    matrix_type& B) { B = A.inverse(); }
+
+    /**
+     * 9.
+     * @brief Compute the trace of a matrix.
+     */
+    static value_type trace(const matrix_type& A) { return A.trace(); }
+
+    /**
+     * 10.
+     * @brief Create an identity matrix of the requested size.
+     */
+    static matrix_type eye(int n) { return plain_type::Identity(n,n); }
+
+    /**
+     * 11.
+     * @brief Create an zero matrix of the requested size.
+     */
+    static matrix_type zeros(int m, int n) { return plain_type::Zero(m,n); }
+
+    /**
+     * 15.
+     * @brief Extract the diagonal elements of a matrix.
+     */
+    static void diag(const matrix_type& A,
+                     matrix_type& B) {
+      B = plain_type(A.diagonal().asDiagonal());
+    }
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_MAPPED_MATRIX_HPP */
@@ -183,6 +183,12 @@ struct MatrixAdaptor_t {
 
 #if AMD_HAVE_EIGEN==1
   #include "EigenMatrixAdaptor.hpp"
+  #include "MappedMatrix.hpp"
+  #include "MixedPrecisionMatrix.hpp"
+  #include "HybridMatrix.hpp"
+  #if AMD_HAVE_SYS_MMAN_H==1
+    #include "TiledMatrix.hpp"
+  #endif
 #endif
 
 #if AMD_HAVE_ELEMENTAL==1
@@ -15,6 +15,7 @@
 #include <cstdio>
 #include "boost/shared_ptr.hpp"
 #include "utility.hpp"
+#include "GradMode.hpp"
 #include "ScalarMatrixFunc.hpp"
 #include "MatrixAdaptor.hpp"
 
@@ -64,6 +65,9 @@ namespace AMD {
     MatrixMatrixFunc* leftChild; /**< optional left child */
     MatrixMatrixFunc* rightChild; /**< optional right child */
     ScalarMatrixFunc<MT, ST>* scalarChild; /**< scalar func * matrix func. */
+    boost::shared_ptr<unsigned long> versionPtr; /**< Leaves only: bumped each
+                                                      time the value changes,
+                                                      shared by all copies */
 
     /**
      * @brief This is an empty constructor that initializes all values to
@@ -78,11 +82,13 @@ namespace AMD {
       numCols(0),
       leftChild(NULL),
       rightChild(NULL),
-      scalarChild(NULL) { }
+      scalarChild(NULL),
+      versionPtr() { }
 
     /**
      * @brief Makes an expensive copy of matrix -- avoid this constructor
-     * if your matrices are large.
+     * if your matrices are large. A borrowed MappedMatrix is not copied; the
+     * leaf becomes another view of the caller's memory.
      */
     MatrixMatrixFunc(const MT& matrix, 
                      bool isConst = true, 
@@ -96,7 +102,8 @@ namespace AMD {
       numCols(0),
       leftChild(NULL),
       rightChild(NULL),
-      scalarChild(NULL) {
+      scalarChild(NULL),
+      versionPtr() {
       setVariableType(isConst);
     }
 
@@ -121,7 +128,8 @@ namespace AMD {
       numCols(0),
       leftChild(NULL),
       rightChild(NULL),
-      scalarChild(NULL) {
+      scalarChild(NULL),
+      versionPtr() {
       setVariableType(isConst);
     }
 
@@ -152,6 +160,9 @@ namespace AMD {
       numRows = MatrixAdaptorType::getNumRows(*(matrixPtr));
       numCols = MatrixAdaptorType::getNumCols(*(matrixPtr));
 
+      // Every leaf starts out with its own version counter
+      versionPtr = boost::shared_ptr<unsigned long>(new unsigned long(0));
+
       // If is constant, call the callbackfunction for constant.
       if (isConst) {
         callBackFunc = constOp < MT, ST > ;
@@ -165,6 +176,53 @@ namespace AMD {
       AMD_CATCH_AND_RETHROW(AMD, isVariable)
     }
 
+    /**
+     * @brief Overwrite the value of a leaf node and bump its version. The
+     * matrix is shared with every copy of this leaf, so the change is seen
+     * by every tree this leaf was recorded into. The values of the internal
+     * nodes of those trees are NOT recomputed; use an evaluator that tracks
+     * versions (see IncrementalEvaluator.hpp) or record the tree again.
+     *
+     * @param[in] value The new value, which must have the same dimensions.
+     */
+    void updateValue(const MT& value) {
+      AMD_START_TRY_BLOCK()
+
+      if (NULL != leftChild || NULL != rightChild)
+        throw exception_generic_impl("AMD::updateValue",
+                                     "Node is not a leaf node",
+                                     AMD_INTERNAL_NODE);
+      if (MatrixAdaptorType::getNumRows(value) != numRows ||
+          MatrixAdaptorType::getNumCols(value) != numCols)
+        throw exception_generic_impl("AMD::updateValue",
+                                     "Dimensions of the new value don't match",
+                                     AMD_MISMATCHED_DIMENSIONS);
+
+      MatrixAdaptorType::copy(*matrixPtr, value);
+      touch();
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, updateValue)
+    }
+
+    /**
+     * @brief Bump the version of a leaf node whose matrix was modified in
+     * place through matrixPtr.
+     */
+    void touch() {
+      if (!versionPtr) {
+        throw exception_generic_impl("AMD::touch",
+                                     "Node does not track its version",
+                                     AMD_INTERNAL_NODE);
+      }
+      ++(*versionPtr);
+    }
+
+    /**
+     * @brief Get the version of a leaf node (0 for nodes without a version).
+     */
+    unsigned long version() const { return versionPtr ? *versionPtr : 0; }
+
     /**
      * @brief Reset the entire computational tree.
      */
@@ -199,6 +257,7 @@ namespace AMD {
       callBackFunc = other.callBackFunc;
       numRows = other.getNumRows();
       numCols = other.getNumCols();
+      versionPtr = other.versionPtr;
       leftChild = NULL;
       rightChild = NULL;
       scalarChild = NULL;
@@ -234,6 +293,23 @@ namespace AMD {
       }
     }
 
+    /**
+     * @brief Turn this node into a constant leaf that only holds a value. 
+     * This is what the operators create in no-grad mode (see GradMode.hpp),
+     * where no child nodes are recorded.
+     *
+     * @param[in] resultPtr Pointer to the matrix associated to this node.
+     */
+    void valueOnlySet(boost::shared_ptr<MT> resultPtr) {
+      matrixPtr = resultPtr;
+      opNum = CONST;
+      callBackFunc = constOp < MT, ST > ;
+      isConst = true;
+      numRows = MatrixAdaptorType::getNumRows(*matrixPtr);
+      numCols = MatrixAdaptorType::getNumCols(*matrixPtr);
+      versionPtr = boost::shared_ptr<unsigned long>(new unsigned long(0));
+    }
+
     /**
      * @brief Create a node with matrix binary operation.
      *
@@ -249,6 +325,8 @@ namespace AMD {
                   const MatrixMatrixFunc<MT, ST> &lhs,
                   const MatrixMatrixFunc<MT, ST> &rhs) {
 
+      if (false == GradMode::isEnabled()) { valueOnlySet(resultPtr); return; }
+
       matrixPtr = resultPtr;
       opNum = operatorNum;
       callBackFunc = cbf;
@@ -274,6 +352,8 @@ namespace AMD {
       OpType _opNum,
       CallBackFuncType cbf,
       const MatrixMatrixFunc<MT, ST> &lhs) {
+      if (false == GradMode::isEnabled()) { valueOnlySet(resultPtr); return; }
+
       numRows = lhs.getNumRows();
       numCols = lhs.getNumCols();
       matrixPtr = resultPtr;
@@ -38,6 +38,16 @@ namespace AMD {
     DIAG
   };
 
+  /**
+   * @enum Enum type for the scalar function that is applied to a matrix
+   * function (trace/logdet, eg., at the root of a ComputationGraph).
+   */
+  enum RootOpType {
+    kMatrixRoot, //no scalar function, the matrix function itself
+    kTraceRoot, //trace of the matrix function
+    kLogdetRoot //logdet of the matrix function
+  };
+
   /* enum type for possible status of a matrix. The first one is a progenerate
    * case, whereas the rest are degenerate ones*/
   enum MatrixType {
@@ -568,6 +578,8 @@ namespace AMD {
     currentLeftMMF->deepCopy(*currentMMF);
     MatrixAdaptorType::negation((*current), (*currentRight));
     currentRightMMF->deepCopy(-(*currentMMF));
+    /** currentRight is -current, so it is not the identity anymore */
+    identityCurrentFlag = false;
     if (transposeFlag) {
       transposeFlag = 3; // both currentLeft and currentRight should inherit transpose
     }
@@ -641,6 +653,8 @@ namespace AMD {
 
     MatrixAdaptorType::negation((*current), (*currentLeft));
     currentLeftMMF->deepCopy(-(*currentMMF));
+    /** currentLeft is -current, so it is not the identity anymore */
+    identityCurrentFlag = false;
     if (transposeFlag) transposeFlag = 3;
 
     AMD_END_TRY_BLOCK()
@@ -668,7 +682,8 @@ namespace AMD {
     if (NEGATION != lhs.opNum) {
       MT lhsNegation;
       MatrixAdaptorType::negation(*(lhs.matrixPtr), lhsNegation);
-      boost::shared_ptr<MT> negationPtr(new MT(lhsNegation));
+      boost::shared_ptr<MT> negationPtr =
+        MatrixAdaptorType::copyConstructMatrix(lhsNegation);
       result.unaryOpSet(negationPtr, NEGATION, negationOp<MT, ST>, lhs);
     } else {
       unaryOpStandardCheck(lhs, NEGATION);
@@ -796,7 +811,8 @@ namespace AMD {
 
     MT lhsTimesRhs;
     MatrixAdaptorType::multiply(*(lhs.matrixPtr), *(rhs.matrixPtr), lhsTimesRhs);
-    boost::shared_ptr<MT> timesPtr(new MT((lhsTimesRhs)));
+    boost::shared_ptr<MT> timesPtr =
+        MatrixAdaptorType::copyConstructMatrix(lhsTimesRhs);
 
     // Initialize new node with time operator.
     result.binOpSet(timesPtr, TIMES, timesOp<MT, ST>, lhs, rhs);
@@ -929,14 +945,17 @@ namespace AMD {
       // matrix times scalar
       MatrixAdaptorType::multiply(*(lhs.matrixPtr), (rhs.functionVal),
         lhsTimesRhs);
-      boost::shared_ptr<MT> mtimesPtr(new MT((lhsTimesRhs)));
+      boost::shared_ptr<MT> mtimesPtr =
+        MatrixAdaptorType::copyConstructMatrix(lhsTimesRhs);
       // Initialize new node with mtimes operator.
       // This is a unary op
       result.unaryOpSet(mtimesPtr, MTIMESS, mtimesOp<MT, ST>, lhs);
 
       // the pointer points to scalar function.
-      result.scalarChild = new ScalarMatrixFunc < MT, ST > ;
-      *result.scalarChild = rhs;
+      if (MTIMESS == result.opNum) {
+        result.scalarChild = new ScalarMatrixFunc < MT, ST > ;
+        *result.scalarChild = rhs;
+      }
       }
       else {
         binaryOpStandardCheck(lhs, rhs, MTIMESS, false/*don't check const*/);
@@ -1073,14 +1092,17 @@ namespace AMD {
       MatrixAdaptorType::multiply(*(rhs.matrixPtr),
         (lhs.functionVal),
         lhsTimesRhs);
-      boost::shared_ptr<MT> stimesmPtr(new MT((lhsTimesRhs)));
+      boost::shared_ptr<MT> stimesmPtr =
+        MatrixAdaptorType::copyConstructMatrix(lhsTimesRhs);
 
       // Initialize new node with mtimes operator.  This is a unary op
       result.unaryOpSet(stimesmPtr, STIMESM, stimesmOp<MT, ST>, rhs);
 
       // the pointer points to scalar function.
-      result.scalarChild = new ScalarMatrixFunc < MT, ST > ;
-      *result.scalarChild = lhs;
+      if (STIMESM == result.opNum) {
+        result.scalarChild = new ScalarMatrixFunc < MT, ST > ;
+        *result.scalarChild = lhs;
+      }
       }
       else {
         binaryOpStandardCheck(rhs, lhs, STIMESM, false/*don't check const*/);
@@ -1197,7 +1219,8 @@ namespace AMD {
     MatrixAdaptorType::elementwiseProduct(*(lhs.matrixPtr),
       *(rhs.matrixPtr),
       lcrcEwisePdt);
-    boost::shared_ptr<MT> elewisePtr(new MT(lcrcEwisePdt));
+    boost::shared_ptr<MT> elewisePtr =
+        MatrixAdaptorType::copyConstructMatrix(lcrcEwisePdt);
     result.binOpSet(elewisePtr, ELEWISE, elementwiseOp<MT, ST>, lhs, rhs);
 
     AMD_END_TRY_BLOCK()
@@ -1266,7 +1289,8 @@ namespace AMD {
       if (TRANSPOSE != lhs.opNum) {
       MT lhsTrans;
       MatrixAdaptorType::transpose(*(lhs.matrixPtr), lhsTrans);
-      boost::shared_ptr<MT> transposePtr(new MT(lhsTrans));
+      boost::shared_ptr<MT> transposePtr =
+        MatrixAdaptorType::copyConstructMatrix(lhsTrans);
       result.unaryOpSet(transposePtr, TRANSPOSE, transposeOp<MT, ST>, lhs);
       }
       else {
@@ -1328,7 +1352,8 @@ namespace AMD {
       if (DIAG != lhs.opNum) {
       MT lhsDiag;
       MatrixAdaptorType::diag(*(lhs.matrixPtr), lhsDiag);
-      boost::shared_ptr<MT> diagPtr(new MT(lhsDiag));
+      boost::shared_ptr<MT> diagPtr =
+        MatrixAdaptorType::copyConstructMatrix(lhsDiag);
       result.unaryOpSet(diagPtr, DIAG, diagOp<MT, ST>, lhs);
       }
       else {
@@ -1431,7 +1456,8 @@ namespace AMD {
       if (INV != lhs.opNum) {
       MT lhsInv;
       MatrixAdaptorType::inv(*lhs.matrixPtr, lhsInv);
-      boost::shared_ptr<MT> invPtr(new MT(lhsInv));
+      boost::shared_ptr<MT> invPtr =
+        MatrixAdaptorType::copyConstructMatrix(lhsInv);
       // Initialize the node. 
       result.unaryOpSet(invPtr, INV, invOp<MT, ST>, lhs);
       }
@@ -1449,7 +1475,8 @@ namespace AMD {
   /**
    * @brief Create the root node for a Scalar-Matrix function trace.
    * Once creating this node, the calculation of derivatives through
-   * the computational tree (gradienVec) will be trigged.
+   * the computational tree (gradienVec) will be trigged. In no-grad mode,
+   * only the function value is computed.
    *
    * @tparam MT Matrix type
    * @tparam ST Scalar type
@@ -1464,6 +1491,12 @@ namespace AMD {
     AMD_START_TRY_BLOCK()
     scalarOpDiffStandardCheck(lhs);
 
+    /** In no-grad mode, only the function value is computed */
+    if (false == GradMode::isEnabled()) {
+      result.initWithValue(MatrixAdaptorType::trace(*lhs.matrixPtr));
+      return(result);
+    }
+
     const int n = MatrixAdaptorType::getNumRows(*lhs.matrixPtr);
     boost::shared_ptr<MT> initPtr(new MT);
     boost::shared_ptr<MT> resPtr(new MT);
@@ -1503,6 +1536,7 @@ namespace AMD {
       result.initWithVariable(MatrixAdaptorType::trace(*lhs.matrixPtr),
                                                        *resPtr);
     }
+    result.setArgument(lhs, kTraceRoot);
 
     AMD_END_TRY_BLOCK()
     AMD_CATCH_AND_RETHROW(AMD, trace)
@@ -1513,7 +1547,7 @@ namespace AMD {
   /**
    * @brief Create the root node for Scalar-Matrix function logdet. Once
    * creating this node, the calculation of derivative along the computational
-   * tree is triggered.
+   * tree is triggered. In no-grad mode, only the function value is computed.
    *
    * @tparam MT Matrix type
    * @tparam ST Scalar type
@@ -1528,6 +1562,12 @@ namespace AMD {
     AMD_START_TRY_BLOCK()
       scalarOpDiffStandardCheck(lhs);
 
+    /** In no-grad mode, only the function value is computed */
+    if (false == GradMode::isEnabled()) {
+      result.initWithValue(MatrixAdaptorType::logdet(*lhs.matrixPtr));
+      return(result);
+    }
+
     //const int n = MatrixAdaptorType::getNumRows(*(lhs.matrixPtr)); /*unused*/
     boost::shared_ptr<MT> initPtr(new MT);
     boost::shared_ptr<MT> resPtr(new MT);
@@ -1544,7 +1584,9 @@ namespace AMD {
     }
     if (INV == lhs.opNum) { // logdet(X^{-1)) == - logdet(X)
       // logdet for MMF 
-      return(-logdet((*lhs.leftChild)));
+      result = -logdet((*lhs.leftChild));
+      result.setArgument(lhs, kLogdetRoot);
+      return(result);
     }
 
     // The starting point for logdet is a inverse matrix.
@@ -1565,6 +1607,7 @@ namespace AMD {
       result.initWithVariable(MatrixAdaptorType::logdet(*lhs.matrixPtr),
         *resPtr);
     }
+    result.setArgument(lhs, kLogdetRoot);
 
     AMD_END_TRY_BLOCK()
       AMD_CATCH_AND_RETHROW(AMD, logdet)
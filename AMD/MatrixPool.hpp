@@ -0,0 +1,264 @@
+#ifndef AMD_MATRIX_POOL_HPP
+#define AMD_MATRIX_POOL_HPP
+
+/**
+ * @file MatrixPool.hpp
+ *
+ * @brief This file defines the allocation policies behind
+ * MatrixAdaptor_t::defaultConstructMatrix and copyConstructMatrix. The
+ * default policy allocates a new matrix every time. The pool policy keeps
+ * released matrices in a thread-local free list keyed by their shape (and,
+ * since there is one pool per matrix type, by their type) and hands them out
+ * again, so repeated evaluations of the same expressions stop going through
+ * malloc/free (and mmap/munmap for large matrices) on every iteration.
+ *
+ * The policy of a matrix type is chosen by specializing AllocationPolicy_t,
+ * or for all types at once by building with USE_MATRIX_POOL, which also
+ * makes Eigen align its storage to 64 bytes (EIGEN_MAX_ALIGN_BYTES=64).
+ *
+ * \code
+ * namespace AMD {
+ *   template <> struct AllocationPolicy_t<Eigen::MatrixXd> :
+ *     public PoolAllocationPolicy<Eigen::MatrixXd> {};
+ * }
+ * \endcode
+ */
+
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+#include "boost/shared_ptr.hpp"
+#include "AMD/config.h"
+
+#if AMD_HAVE_SYS_MMAN_H==1
+  #include <sys/mman.h>
+  #include <stdint.h>
+#endif
+
+namespace AMD {
+
+  /**
+   * @brief Ask the kernel to back a large matrix with huge pages. This is
+   * only a hint, and matrix types whose storage is not known are left alone.
+   */
+  template <class MT>
+  void adviseHugePages(MT& /*A*/) {}
+
+#if AMD_HAVE_EIGEN==1
+
+  template <class T>
+  void adviseHugePages(Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& A) {
+#if AMD_HAVE_SYS_MMAN_H==1 && defined(MADV_HUGEPAGE)
+    /** madvise() only takes whole pages, so advise the huge pages that lie
+        entirely inside the storage */
+    const uintptr_t hugePage = 2UL << 20;
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(A.data());
+    const uintptr_t end = begin + A.size()*sizeof(T);
+    const uintptr_t first = (begin + hugePage - 1) & ~(hugePage - 1);
+    if (first + hugePage <= end) {
+      madvise(reinterpret_cast<void*>(first),
+              (end - first) & ~(hugePage - 1),
+              MADV_HUGEPAGE);
+    }
+#else
+    (void) A;
+#endif
+  }
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+  /**
+   * @brief Thread-local pool of matrices of type MT, keyed by shape.
+   *
+   * @tparam MT Matrix type; it must be constructible from (rows, cols).
+   */
+  template <class MT>
+  class MatrixPool {
+    public:
+    /**
+     * @brief Get a rows x cols matrix with unspecified contents. It goes
+     * back to the pool of the releasing thread when the last reference to
+     * it is dropped.
+     */
+    static boost::shared_ptr<MT> acquire(int rows, int cols) {
+      State& pool = state();
+      std::vector<MT*>& free = pool.free[std::make_pair(rows, cols)];
+      if (!free.empty()) {
+        MT* matrix = free.back();
+        free.pop_back();
+        ++pool.hits;
+        return boost::shared_ptr<MT>(matrix, Release());
+      }
+
+      ++pool.misses;
+      MT* matrix = new MT(rows, cols);
+      if (settings().hugePages) adviseHugePages(*matrix);
+      return boost::shared_ptr<MT>(matrix, Release());
+    }
+
+    /**
+     * @brief Get the number of acquire() calls of this thread that reused a
+     * pooled matrix.
+     */
+    static std::size_t hits() { return state().hits; }
+
+    /**
+     * @brief Get the number of acquire() calls of this thread that had to
+     * allocate a new matrix.
+     */
+    static std::size_t misses() { return state().misses; }
+
+    /**
+     * @brief Get the number of matrices in the pool of this thread.
+     */
+    static std::size_t numCached() {
+      std::size_t count = 0;
+      typename FreeListType::const_iterator it = state().free.begin();
+      for (; it != state().free.end(); ++it) count += it->second.size();
+      return count;
+    }
+
+    /**
+     * @brief Reset the counters of this thread.
+     */
+    static void resetCounters() { state().hits = state().misses = 0; }
+
+    /**
+     * @brief Free all the matrices in the pool of this thread.
+     */
+    static void clear() { state().clear(); }
+
+    /**
+     * @brief Set how many matrices of one shape a thread keeps (default 16).
+     * Matrices released beyond that are freed. This applies to all threads
+     * and should be set before they start.
+     */
+    static void setMaxCachedPerShape(std::size_t count) {
+      settings().maxCachedPerShape = count;
+    }
+
+    /**
+     * @brief Advise huge pages for newly allocated matrices (default off).
+     * This applies to all threads and should be set before they start.
+     */
+    static void setHugePages(bool enable) { settings().hugePages = enable; }
+
+    private:
+    typedef std::map<std::pair<int, int>, std::vector<MT*> > FreeListType;
+
+    struct State {
+      FreeListType free; /**< released matrices by shape */
+      std::size_t hits; /**< acquire() calls served from the pool */
+      std::size_t misses; /**< acquire() calls that allocated */
+
+      State() : hits(0), misses(0) {}
+
+      void clear() {
+        typename FreeListType::iterator it = free.begin();
+        for (; it != free.end(); ++it) {
+          for (size_t i=0; i<it->second.size(); ++i) delete it->second[i];
+        }
+        free.clear();
+      }
+
+      ~State() {
+        clear();
+        alive() = false;
+      }
+    };
+
+    struct Settings {
+      std::size_t maxCachedPerShape;
+      bool hugePages;
+    };
+
+    /** Deleter of the pooled matrices */
+    struct Release {
+      void operator()(MT* matrix) const {
+        /** Matrices released while the thread is exiting are just freed */
+        if (!alive()) {
+          delete matrix;
+          return;
+        }
+        std::vector<MT*>& free = state().free[
+          std::make_pair(static_cast<int>(matrix->rows()),
+                         static_cast<int>(matrix->cols()))];
+        if (free.size() < settings().maxCachedPerShape) free.push_back(matrix);
+        else delete matrix;
+      }
+    };
+
+    static State& state() {
+      static thread_local State pool;
+      return pool;
+    }
+
+    static bool& alive() {
+      static thread_local bool isAlive = true;
+      return isAlive;
+    }
+
+    static Settings& settings() {
+      static Settings values = { 16, false };
+      return values;
+    }
+  };
+
+  /**
+   * @brief Allocate a new matrix every time.
+   */
+  template <class MT>
+  struct HeapAllocationPolicy {
+    static boost::shared_ptr<MT> construct(int rows, int cols) {
+      return boost::shared_ptr<MT>(new MT(rows, cols));
+    }
+
+    static boost::shared_ptr<MT> copy(const MT& original) {
+      return boost::shared_ptr<MT>(new MT(original));
+    }
+  };
+
+  /**
+   * @brief Recycle matrices through MatrixPool.
+   */
+  template <class MT>
+  struct PoolAllocationPolicy {
+    static boost::shared_ptr<MT> construct(int rows, int cols) {
+      return MatrixPool<MT>::acquire(rows, cols);
+    }
+
+    static boost::shared_ptr<MT> copy(const MT& original) {
+      boost::shared_ptr<MT> result = MatrixPool<MT>::acquire(original.rows(),
+                                                             original.cols());
+      *result = original;
+      return result;
+    }
+  };
+
+  /**
+   * @brief The allocation policy of a matrix type; specialize to change it.
+   */
+  template <class MT>
+  struct AllocationPolicy_t :
+#if AMD_USE_MATRIX_POOL==1
+    public PoolAllocationPolicy<MT> {};
+#else
+    public HeapAllocationPolicy<MT> {};
+#endif
+
+#if AMD_HAVE_EIGEN==1
+
+  /**
+   * @brief The storage of a sparse matrix depends on its non-zeros rather
+   * than on its shape, so sparse matrices are never pooled.
+   */
+  template <class T>
+  struct AllocationPolicy_t<Eigen::SparseMatrix<T> > :
+    public HeapAllocationPolicy<Eigen::SparseMatrix<T> > {};
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+} /** namespace AMD */
+
+#endif /** AMD_MATRIX_POOL_HPP */
@@ -0,0 +1,395 @@
+#ifndef AMD_MEMORY_PLAN_HPP
+#define AMD_MEMORY_PLAN_HPP
+
+/**
+ * @file MemoryPlan.hpp
+ *
+ * @brief This file defines a static memory planner for the sweeps over a
+ * ComputationGraph. A GraphWorkspace keeps one buffer per internal node and
+ * one adjoint per node until it is destroyed, although only a few of them
+ * are live at any time. MemoryPlan runs a liveness analysis over the fixed
+ * schedule of the sweeps (the forward sweep in topological order followed
+ * by the reverse sweep in the opposite order) and assigns every value and
+ * every adjoint to one of a small set of reusable slots, the way a compiler
+ * allocates registers. Two matrices only share a slot if they have the same
+ * shape, so a slot is never re-allocated during a sweep. The peak memory of
+ * the plan is known before anything is evaluated.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Assignment of the values and adjoints of a graph to slots.
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class MemoryPlan {
+    public:
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+
+    /**
+     * @brief Plan the sweeps over a graph.
+     *
+     * @param[in] graph        The graph.
+     * @param[in] withGradient Plan the reverse sweep too. This needs a
+     *                         trace/logdet root.
+     */
+    MemoryPlan(const GraphType& graph, bool withGradient=true) :
+      withGradientVal(withGradient),
+      valueSlots(graph.size(), -1),
+      adjointSlots(graph.size(), -1),
+      partialBytesVal(0),
+      unplannedBytesVal(0) {
+      AMD_START_TRY_BLOCK()
+
+      if (withGradient && kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::MemoryPlan",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+
+      allocate(graph, liveRanges(graph));
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, MemoryPlan)
+    }
+
+    /**
+     * @brief Does the plan include the reverse sweep?
+     */
+    bool withGradient() const { return withGradientVal; }
+
+    /**
+     * @brief Get the number of slots.
+     */
+    int numSlots() const { return slotRows.size(); }
+
+    /**
+     * @brief Get the slot that holds the value of node i (-1 for leaves,
+     * whose values are not copied).
+     */
+    int valueSlot(int i) const { return valueSlots[i]; }
+
+    /**
+     * @brief Get the slot that holds the adjoint of node i (-1 if the node
+     * has no adjoint).
+     */
+    int adjointSlot(int i) const { return adjointSlots[i]; }
+
+    /**
+     * @brief Get the shape of slot s.
+     */
+    int numRows(int s) const { return slotRows[s]; }
+    int numCols(int s) const { return slotCols[s]; }
+
+    /**
+     * @brief Get the planned peak memory, counting every slot and the
+     * scratch space for one partial adjoint as dense matrices. Temporaries
+     * inside the kernels themselves are not included.
+     */
+    std::size_t peakBytes() const {
+      std::size_t bytes = partialBytesVal;
+      for (int s=0; s<numSlots(); ++s) bytes += denseBytes(slotRows[s],
+                                                           slotCols[s]);
+      return bytes;
+    }
+
+    /**
+     * @brief Get the memory that one buffer per value and per adjoint (as in
+     * GraphWorkspace) would need, counted the same way as peakBytes().
+     */
+    std::size_t unplannedBytes() const { return unplannedBytesVal; }
+
+    private:
+    /** Live range of a value or an adjoint, in steps of the schedule */
+    struct LiveRange {
+      int start; /**< step that writes it first */
+      int end; /**< last step that reads it */
+      int node; /**< the node */
+      bool isAdjoint; /**< adjoint or value */
+
+      bool operator<(const LiveRange& other) const {
+        if (start != other.start) return start < other.start;
+        return end < other.end;
+      }
+    };
+
+    static std::size_t denseBytes(int numRows, int numCols) {
+      return static_cast<std::size_t>(numRows)*numCols*sizeof(ST);
+    }
+
+    /**
+     * @brief Find the live ranges. Node i is computed at step i of the
+     * forward sweep and its children's partial adjoints at step 2n-1-i of
+     * the reverse sweep; the outputs stay live until step 2n.
+     */
+    std::vector<LiveRange> liveRanges(const GraphType& graph) {
+      const int n = graph.size();
+      const int root = graph.root();
+      const int lastStep = 2*n;
+      std::vector<int> valueEnd(n);
+      for (int i=0; i<n; ++i) valueEnd[i] = i;
+
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        if (node.isLeaf()) continue;
+        valueEnd[node.left] = std::max(valueEnd[node.left], i);
+        if (-1 != node.right) {
+          valueEnd[node.right] = std::max(valueEnd[node.right], i);
+        }
+        if (!withGradientVal || node.isConst) continue;
+
+        const int children[2] = {node.left, node.right};
+        const int step = reverseStep(n, i);
+        for (int side=0; side<2; ++side) {
+          if (-1 == children[side] || graph.node(children[side]).isConst) {
+            continue;
+          }
+          for (int which=0; which<3; ++which) {
+            if (!partialAdjointUses(node.opNum, side, which)) continue;
+            const int used = (2 == which) ? i : children[which];
+            valueEnd[used] = std::max(valueEnd[used], step);
+          }
+        }
+      }
+      valueEnd[root] = withGradientVal ? reverseStep(n, root) : lastStep;
+
+      std::vector<LiveRange> ranges;
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        if (node.isLeaf()) continue;
+        LiveRange range = {i, valueEnd[i], i, false};
+        ranges.push_back(range);
+        unplannedBytesVal += denseBytes(node.numRows, node.numCols);
+      }
+      if (!withGradientVal) return ranges;
+
+      for (int i=0; i<n; ++i) {
+        const NodeType& node = graph.node(i);
+        if (node.isConst) continue;
+
+        /** Written by the first parent of the reverse sweep, which is the
+            one with the largest index */
+        int start = (i == root) ? reverseStep(n, root) : lastStep;
+        for (size_t p=0; p<graph.parents(i).size(); ++p) {
+          start = std::min(start, reverseStep(n, graph.parents(i)[p].first));
+        }
+        LiveRange range = {start,
+                           node.isLeaf() ? lastStep : reverseStep(n, i),
+                           i,
+                           true};
+        ranges.push_back(range);
+        unplannedBytesVal += denseBytes(node.numRows, node.numCols);
+        if (i != root) {
+          partialBytesVal = std::max(partialBytesVal,
+                                     denseBytes(node.numRows, node.numCols));
+        }
+      }
+      unplannedBytesVal += partialBytesVal;
+      return ranges;
+    }
+
+    static int reverseStep(int n, int i) { return 2*n - 1 - i; }
+
+    /**
+     * @brief Greedily give each range, by increasing start, a slot of the
+     * same shape whose last range has ended, or a new slot.
+     */
+    void allocate(const GraphType& graph, std::vector<LiveRange> ranges) {
+      std::sort(ranges.begin(), ranges.end());
+      std::vector<int> slotEnd;
+
+      for (size_t r=0; r<ranges.size(); ++r) {
+        const NodeType& node = graph.node(ranges[r].node);
+        int slot = -1;
+        for (int s=0; s<numSlots() && -1 == slot; ++s) {
+          if (slotRows[s] == node.numRows && slotCols[s] == node.numCols &&
+              slotEnd[s] < ranges[r].start) slot = s;
+        }
+        if (-1 == slot) {
+          slot = numSlots();
+          slotRows.push_back(node.numRows);
+          slotCols.push_back(node.numCols);
+          slotEnd.push_back(0);
+        }
+        slotEnd[slot] = ranges[r].end;
+        if (ranges[r].isAdjoint) adjointSlots[ranges[r].node] = slot;
+        else valueSlots[ranges[r].node] = slot;
+      }
+    }
+
+    bool withGradientVal; /**< is the reverse sweep planned */
+    std::vector<int> valueSlots; /**< slot of the value of each node */
+    std::vector<int> adjointSlots; /**< slot of the adjoint of each node */
+    std::vector<int> slotRows; /**< number of rows of each slot */
+    std::vector<int> slotCols; /**< number of columns of each slot */
+    std::size_t partialBytesVal; /**< scratch for one partial adjoint */
+    std::size_t unplannedBytesVal; /**< one buffer per value and adjoint */
+  };
+
+  /**
+   * @brief Evaluate a graph with the memory of a MemoryPlan.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(f, AMD::kTraceRoot);
+   * AMD::PlannedEvaluator<MT, ST> eval(graph);
+   * std::cout << eval.plan().peakBytes() << std::endl;
+   * ST value = eval.evaluate();
+   * const MT& G = eval.gradient(0);
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class PlannedEvaluator {
+    public:
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+    typedef MemoryPlan<MT, ST> PlanType;
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+
+    /**
+     * @brief Plan the evaluation of a graph. Nothing is allocated until the
+     * first evaluate().
+     *
+     * @param[in] graph        The graph.
+     * @param[in] withGradient Compute the gradients too.
+     */
+    PlannedEvaluator(const GraphType& graph, bool withGradient=true) :
+      graph(graph),
+      planVal(graph, withGradient),
+      values(graph.size(), NULL),
+      hasAdjoint(graph.size(), false) {}
+
+    /**
+     * @brief Get the plan.
+     */
+    const PlanType& plan() const { return planVal; }
+
+    /**
+     * @brief Run the planned sweeps.
+     *
+     * @return trace/logdet of the root, or 0 for a matrix valued root.
+     */
+    ST evaluate() {
+      AMD_START_TRY_BLOCK()
+
+      slots.resize(planVal.numSlots());
+      forward();
+      if (planVal.withGradient()) reverse();
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, PlannedEvaluator::evaluate)
+
+      return functionValueVal;
+    }
+
+    /**
+     * @brief Get the value of the root after evaluate(). With a gradient
+     * plan the slot of the root may have been reused by the reverse sweep,
+     * so this is only available for plans without gradient.
+     */
+    const MT& value() const {
+      if (planVal.withGradient()) {
+        throw exception_generic_impl("AMD::PlannedEvaluator::value",
+                                     "The root value is not kept",
+                                     AMD_INVALID_OPERATION);
+      }
+      return *values[graph.root()];
+    }
+
+    /**
+     * @brief Get the gradient of variable v after evaluate().
+     */
+    const MT& gradient(int v) const {
+      const int i = graph.variable(v);
+      if (false == planVal.withGradient() || false == hasAdjoint[i]) {
+        throw exception_generic_impl("AMD::PlannedEvaluator::gradient",
+                                     "The gradient has not been computed",
+                                     AMD_INVALID_OPERATION);
+      }
+      return slots[planVal.adjointSlot(i)];
+    }
+
+    private:
+    PlannedEvaluator(const PlannedEvaluator&);
+    PlannedEvaluator& operator=(const PlannedEvaluator&);
+
+    void forward() {
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+        if (node.isLeaf()) {
+          values[i] = node.matrixPtr.get();
+          continue;
+        }
+
+        MT& out = slots[planVal.valueSlot(i)];
+        forwardNode(node,
+                    values[node.left],
+                    (-1 == node.right) ? NULL : values[node.right],
+                    out);
+        values[i] = &out;
+      }
+
+      const int root = graph.root();
+      functionValueVal = (kMatrixRoot == graph.rootOp()) ? ST(0) :
+                         rootValue<MT, ST>(graph.rootOp(), *values[root]);
+    }
+
+    void reverse() {
+      const int root = graph.root();
+      hasAdjoint.assign(graph.size(), false);
+      rootAdjoint<MT, ST>(graph.rootOp(), *values[root],
+                          slots[planVal.adjointSlot(root)]);
+      hasAdjoint[root] = true;
+
+      for (int i=root; i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        if (node.isConst || node.isLeaf() || false == hasAdjoint[i]) continue;
+
+        for (int side=0; side<2; ++side) {
+          const int child = (0 == side) ? node.left : node.right;
+          if (-1 == child || graph.node(child).isConst) continue;
+
+          partialAdjoint(node,
+                         side,
+                         *values[i],
+                         values[node.left],
+                         (-1 == node.right) ? NULL : values[node.right],
+                         slots[planVal.adjointSlot(i)],
+                         partial);
+          MT& adjoint = slots[planVal.adjointSlot(child)];
+          if (hasAdjoint[child]) {
+            MatrixAdaptorType::add(adjoint, partial, adjoint);
+          } else {
+            /** Take over the buffer instead of copying it */
+            std::swap(adjoint, partial);
+            hasAdjoint[child] = true;
+          }
+        }
+      }
+    }
+
+    GraphType graph; /**< the graph */
+    PlanType planVal; /**< the plan for the graph */
+    std::vector<MT> slots; /**< the planned buffers */
+    std::vector<const MT*> values; /**< value of each node */
+    std::vector<bool> hasAdjoint; /**< has the adjoint been set yet */
+    MT partial; /**< scratch space for one partial adjoint */
+    ST functionValueVal; /**< trace/logdet of the root */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_MEMORY_PLAN_HPP */
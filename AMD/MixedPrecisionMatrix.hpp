@@ -0,0 +1,139 @@
+#ifndef AMD_MIXED_PRECISION_MATRIX_HPP
+#define AMD_MIXED_PRECISION_MATRIX_HPP
+
+/**
+ * @file MixedPrecisionMatrix.hpp
+ *
+ * @brief This file defines MixedPrecisionMatrix, a dense Eigen matrix whose
+ * MatrixAdaptor_t runs the matrix products in a lower precision. The values
+ * are stored in T (double by default) and every other operation, including
+ * the factorizations behind inv() and logdet() and the trace sums, runs in
+ * T. Only the GEMMs, which dominate the cost of large graphs, round their
+ * operands to GemmT (float by default), which doubles their SIMD width and
+ * halves their memory traffic. The product is accumulated in GemmT, so the
+ * results carry GemmT rounding errors wherever products are involved.
+ *
+ * \code
+ * typedef AMD::MixedPrecisionMatrix<> MT; // double storage, float GEMMs
+ * AMD::MatrixMatrixFunc<MT, double> fA(A, true), fX(X, false);
+ * AMD::ScalarMatrixFunc<MT, double> f = AMD::logdet(fA + transpose(fX)*fX);
+ * \endcode
+ */
+
+#include <Eigen/Dense>
+#include "MatrixAdaptor.hpp"
+#include "MatrixPool.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief A plain Eigen matrix of T that tags the graph for GemmT products.
+   *
+   * @tparam T     Storage and accumulation type.
+   * @tparam GemmT Type of the matrix products.
+   */
+  template <class T = double, class GemmT = float>
+  class MixedPrecisionMatrix :
+    public Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> {
+    public:
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> PlainType;
+    typedef Eigen::Matrix<GemmT, Eigen::Dynamic, Eigen::Dynamic> GemmType;
+
+    MixedPrecisionMatrix() : PlainType() {}
+
+    MixedPrecisionMatrix(int rows, int cols) : PlainType(rows, cols) {}
+
+    /**
+     * @brief A matrix with the value of an Eigen expression.
+     */
+    template <class Derived>
+    MixedPrecisionMatrix(const Eigen::EigenBase<Derived>& other) :
+      PlainType(other.derived()) {}
+
+    template <class Derived>
+    MixedPrecisionMatrix& operator=(const Eigen::EigenBase<Derived>& other) {
+      PlainType::operator=(other.derived());
+      return *this;
+    }
+  };
+
+  /** Factorize in the storage precision */
+  template <class T, class GemmT>
+  struct eigen_llt_t <MixedPrecisionMatrix<T, GemmT> > {
+    typedef typename MixedPrecisionMatrix<T, GemmT>::PlainType MatrixType;
+    typedef Eigen::LLT<MatrixType> LLTType;
+  };
+
+  template <class T, class GemmT>
+  struct MatrixAdaptor_t<MixedPrecisionMatrix<T, GemmT> > :
+  public EigenMatrixAdaptorBase<T, MixedPrecisionMatrix<T, GemmT> > {
+    typedef T value_type;
+    typedef MixedPrecisionMatrix<T, GemmT> matrix_type;
+    typedef EigenMatrixAdaptorBase<value_type, matrix_type> base_type;
+    typedef typename matrix_type::PlainType plain_type;
+    typedef typename matrix_type::GemmType gemm_type;
+
+    using base_type::defaultConstructMatrix;
+    using base_type::copyConstructMatrix;
+    using base_type::getNumRows;
+    using base_type::getNumCols;
+    using base_type::add;
+    using base_type::minus;
+    using base_type::multiply;
+    using base_type::transpose;
+    using base_type::negation;
+    using base_type::logdet;
+    using base_type::copy;
+    using base_type::print;
+    using base_type::elementwiseProduct;
+
+    /**
+     * 5.
+     * @brief Multiply two matrices in GemmT.
+     */
+    static void multiply(const matrix_type& A,
+                         const matrix_type& B,
+                         matrix_type& C) {
+      const gemm_type product = A.template cast<GemmT>() *
+                                B.template cast<GemmT>();
+      C = product.template cast<T>();
+    }
+
+    /**
+     * 8.
+     * @brief Compute the inverse of a matrix.
+     */
+    static void inv(const matrix_type& A,
+                    matrix_type& B) { B = A.inverse(); }
+
+    /**
+     * 9.
+     * @brief Compute the trace of a matrix.
+     */
+    static value_type trace(const matrix_type& A) { return A.trace(); }
+
+    /**
+     * 10.
+     * @brief Create an identity matrix of the requested size.
+     */
+    static matrix_type eye(int n) { return plain_type::Identity(n,n); }
+
+    /**
+     * 11.
+     * @brief Create an zero matrix of the requested size.
+     */
+    static matrix_type zeros(int m, int n) { return plain_type::Zero(m,n); }
+
+    /**
+     * 15.
+     * @brief Extract the diagonal elements of a matrix.
+     */
+    static void diag(const matrix_type& A,
+                     matrix_type& B) {
+      B = plain_type(A.diagonal().asDiagonal());
+    }
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_MIXED_PRECISION_MATRIX_HPP */
@@ -0,0 +1,326 @@
+#ifndef AMD_MULTI_ROOT_EVALUATOR_HPP
+#define AMD_MULTI_ROOT_EVALUATOR_HPP
+
+/**
+ * @file MultiRootEvaluator.hpp
+ *
+ * @brief This file defines an evaluator for several scalar objectives
+ * (a data term, regularizers, constraints, ...) that share subexpressions.
+ * Each call to trace()/logdet() records and differentiates its own tree,
+ * and adding ScalarMatrixFunc objects up only adds their values, so the
+ * shared parts are computed once per objective.
+ *
+ * MultiRootEvaluator merges the arguments of all the objectives into one
+ * ComputationGraph, runs one forward sweep over it and one reverse sweep
+ * that starts with the seed of every objective at its own root. The sweep
+ * either carries a single adjoint per node, for a weighted sum of the
+ * objectives, or one adjoint per objective, for separate gradients; in the
+ * second case a node only gets the adjoints of the objectives that depend
+ * on it.
+ */
+
+#include <vector>
+#include <algorithm>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "MatrixMatrixFunc.hpp"
+#include "ScalarMatrixFunc.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Evaluate several trace/logdet objectives over one shared graph.
+   *
+   * \code
+   * std::vector<AMD::ScalarMatrixFunc<MT, ST> > objectives;
+   * objectives.push_back(AMD::logdet(fS + fX*transpose(fX)));
+   * objectives.push_back(AMD::trace(fX*fA*transpose(fX)));
+   * AMD::MultiRootEvaluator<MT, ST> eval(objectives);
+   * std::vector<ST> values;
+   * std::vector<MT> gradient;
+   * ST sum = eval.evaluate(point, weights, values, gradient);
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class MultiRootEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef MatrixMatrixFunc<MT, ST> MMF;
+    typedef ScalarMatrixFunc<MT, ST> SMF;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MT> BindingType;
+
+    /**
+     * @brief Create an evaluator for objectives made by trace() or logdet().
+     *
+     * @param[in] objectives The objectives; sums and products of them have
+     *                       no single argument and are rejected.
+     */
+    MultiRootEvaluator(const std::vector<SMF>& objectives) {
+      AMD_START_TRY_BLOCK()
+
+      std::vector<const MMF*> roots;
+      for (size_t k=0; k<objectives.size(); ++k) {
+        if (!objectives[k].argumentFuncVal) {
+          throw exception_generic_impl("AMD::MultiRootEvaluator",
+                                       "Objective is not trace or logdet",
+                                       AMD_INVALID_OPERATION);
+        }
+        roots.push_back(objectives[k].argumentFuncVal.get());
+        rootOps.push_back(objectives[k].argumentOp);
+      }
+      init(roots);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, MultiRootEvaluator)
+    }
+
+    /**
+     * @brief Create an evaluator for trace/logdet of recorded functions.
+     *
+     * @param[in] roots   The recorded matrix functions.
+     * @param[in] rootOps rootOps[k] is kTraceRoot or kLogdetRoot for roots[k].
+     */
+    MultiRootEvaluator(const std::vector<const MMF*>& roots,
+                       const std::vector<RootOpType>& rootOps) :
+      rootOps(rootOps) {
+      AMD_START_TRY_BLOCK()
+
+      if (roots.size() != rootOps.size()) {
+        throw exception_generic_impl("AMD::MultiRootEvaluator",
+                                     "Need one root operator per root",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      init(roots);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, MultiRootEvaluator)
+    }
+
+    /**
+     * @brief Get the graph of all the objectives.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Get the number of objectives.
+     */
+    int numObjectives() const { return rootOps.size(); }
+
+    /**
+     * @brief Evaluate all the objectives with one forward sweep.
+     *
+     * @param[in]  binding binding[v] is the value of variable v; if it is
+     *                     empty, the values of the VAR leaves are used.
+     * @param[out] values  values[k] is the value of objective k.
+     */
+    void evaluate(const BindingType& binding, std::vector<ST>& values) {
+      AMD_START_TRY_BLOCK()
+
+      forward(binding, values);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, MultiRootEvaluator::evaluate)
+    }
+
+    /**
+     * @brief Evaluate all the objectives and the gradient of each of them.
+     *
+     * @param[in]  binding   See above.
+     * @param[out] values    values[k] is the value of objective k.
+     * @param[out] gradients gradients[k][v] is the gradient of objective k
+     *                       with respect to variable v.
+     */
+    void evaluate(const BindingType& binding,
+                  std::vector<ST>& values,
+                  std::vector<BindingType>& gradients) {
+      AMD_START_TRY_BLOCK()
+
+      forward(binding, values);
+      const int k = numObjectives();
+      std::vector<int> channels(k);
+      for (int j=0; j<k; ++j) channels[j] = j;
+      reverse(channels, std::vector<ST>(), k);
+
+      gradients.resize(k);
+      for (int j=0; j<k; ++j) variableGradients(j, k, gradients[j]);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, MultiRootEvaluator::evaluate)
+    }
+
+    /**
+     * @brief Evaluate all the objectives and the gradient of their weighted
+     * sum, with one adjoint per node.
+     *
+     * @param[in]  binding  See above.
+     * @param[in]  weights  weights[k] is the weight of objective k.
+     * @param[out] values   values[k] is the value of objective k.
+     * @param[out] gradient gradient[v] is the gradient of the sum with
+     *                      respect to variable v.
+     * @return The weighted sum of the objectives.
+     */
+    ST evaluate(const BindingType& binding,
+                const std::vector<ST>& weights,
+                std::vector<ST>& values,
+                BindingType& gradient) {
+      ST sum = ST(0);
+      AMD_START_TRY_BLOCK()
+
+      if (static_cast<int>(weights.size()) != numObjectives()) {
+        throw exception_generic_impl("AMD::MultiRootEvaluator::evaluate",
+                                     "Need one weight per objective",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      forward(binding, values);
+      reverse(std::vector<int>(numObjectives(), 0), weights, 1);
+      variableGradients(0, 1, gradient);
+      for (int j=0; j<numObjectives(); ++j) sum = sum + weights[j]*values[j];
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, MultiRootEvaluator::evaluate)
+      return sum;
+    }
+
+    private:
+    void init(const std::vector<const MMF*>& roots) {
+      graph = GraphType(roots);
+      for (int j=0; j<numObjectives(); ++j) {
+        const NodeType& node = graph.node(graph.output(j));
+        if (kMatrixRoot == rootOps[j]) {
+          throw exception_generic_impl("AMD::MultiRootEvaluator",
+                                       "An objective is matrix valued",
+                                       AMD_INVALID_OPERATION);
+        }
+        if (node.numRows != node.numCols) {
+          throw exception_generic_impl(
+            "AMD::MultiRootEvaluator",
+            "scalar function (trace/logdet) called on non-square matrix",
+            AMD_INVALID_ARGUMENTS);
+        }
+      }
+    }
+
+    void checkBinding(const BindingType& binding) const {
+      if (binding.empty()) return;
+      if (static_cast<int>(binding.size()) != graph.numVariables()) {
+        throw exception_generic_impl("AMD::MultiRootEvaluator::evaluate",
+                                     "Need one value per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const NodeType& node = graph.node(graph.variable(v));
+        if (MatrixAdaptorType::getNumRows(binding[v]) != node.numRows ||
+            MatrixAdaptorType::getNumCols(binding[v]) != node.numCols) {
+          throw exception_generic_impl("AMD::MultiRootEvaluator::evaluate",
+                                       "Dimensions of a binding don't match",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+      }
+    }
+
+    /** The forward sweep and the value of each objective */
+    void forward(const BindingType& binding, std::vector<ST>& values) {
+      checkBinding(binding);
+      std::vector<const MT*> variables(binding.size());
+      for (size_t v=0; v<binding.size(); ++v) variables[v] = &binding[v];
+
+      forwardSweep(graph, variables, ws);
+      values.resize(numObjectives());
+      for (int j=0; j<numObjectives(); ++j) {
+        values[j] = rootValue<MT, ST>(rootOps[j], *ws.values[graph.output(j)]);
+      }
+    }
+
+    /**
+     * One reverse sweep with numChannels adjoints per node; objective j
+     * seeds channel channels[j], scaled by weights[j] if there are weights.
+     */
+    void reverse(const std::vector<int>& channels,
+                 const std::vector<ST>& weights,
+                 int numChannels) {
+      adjoints.resize(graph.size() * numChannels);
+      hasAdjoint.assign(graph.size() * numChannels, false);
+
+      MT seed;
+      for (int j=0; j<numObjectives(); ++j) {
+        const int i = graph.output(j);
+        rootAdjoint<MT, ST>(rootOps[j], *ws.values[i], seed);
+        if (!weights.empty()) {
+          MatrixAdaptorType::multiply(seed, weights[j], ws.partial);
+          std::swap(seed, ws.partial);
+        }
+        accumulate(i*numChannels + channels[j], seed);
+      }
+
+      for (int i=graph.root(); i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        if (node.isConst || node.isLeaf()) continue;
+
+        for (int c=0; c<numChannels; ++c) {
+          const int slot = i*numChannels + c;
+          if (false == hasAdjoint[slot]) continue;
+
+          for (int side=0; side<2; ++side) {
+            const int child = (0 == side) ? node.left : node.right;
+            if (-1 == child || graph.node(child).isConst) continue;
+
+            partialAdjoint(node,
+                           side,
+                           *ws.values[i],
+                           ws.values[node.left],
+                           (-1 == node.right) ? NULL : ws.values[node.right],
+                           adjoints[slot],
+                           ws.partial);
+            accumulate(child*numChannels + c, ws.partial);
+          }
+        }
+      }
+    }
+
+    /** Add a partial adjoint to a slot, taking over its buffer if empty */
+    void accumulate(int slot, MT& partial) {
+      if (hasAdjoint[slot]) {
+        MatrixAdaptorType::add(adjoints[slot], partial, adjoints[slot]);
+      } else {
+        std::swap(adjoints[slot], partial);
+        hasAdjoint[slot] = true;
+      }
+    }
+
+    /** The adjoints of the variables in one channel; zeros if unreached */
+    void variableGradients(int channel,
+                           int numChannels,
+                           BindingType& result) const {
+      result.resize(graph.numVariables());
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const int i = graph.variable(v);
+        const int slot = i*numChannels + channel;
+        if (hasAdjoint[slot]) {
+          MatrixAdaptorType::copy(result[v], adjoints[slot]);
+        } else {
+          result[v] = MatrixAdaptorType::zeros(graph.node(i).numRows,
+                                               graph.node(i).numCols);
+        }
+      }
+    }
+
+    GraphType graph; /**< the arguments of all the objectives */
+    std::vector<RootOpType> rootOps; /**< trace or logdet per objective */
+    GraphWorkspace<MT, ST> ws; /**< values of the nodes */
+    /** adjoints[i*c + j] is the adjoint of node i in channel j of c */
+    std::vector<MT> adjoints;
+    std::vector<bool> hasAdjoint; /**< has the adjoint been set yet */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_MULTI_ROOT_EVALUATOR_HPP */
@@ -0,0 +1,353 @@
+#ifndef AMD_PATTERN_GRADIENT_HPP
+#define AMD_PATTERN_GRADIENT_HPP
+
+/**
+ * @file PatternGradient.hpp
+ *
+ * @brief This file defines gradients that are only computed on a given
+ * sparsity pattern. When a variable X is a sparse matrix with a fixed
+ * pattern (a precision matrix in graphical lasso, say), only the entries of
+ * its gradient on that pattern are of any use, but a reverse sweep forms
+ * the full dense adjoint of X first: A^T for trace(A*X), for instance.
+ *
+ * PatternGradientEvaluator runs the usual reverse sweep over the internal
+ * nodes, but the partial adjoints that flow into a VAR leaf with a pattern
+ * are only evaluated at the entries (r,c) of the pattern. For products this
+ * is a sampled dense-dense matrix multiplication (SDDMM):
+ *   - L*R gives (G*R^T)(r,c) = G.row(r).R.row(c) for L,
+ *     and (L^T*G)(r,c) = L.col(r).G.col(c) for R;
+ *   - inv(L) gives -(B^T*G*B^T)(r,c) = -(B^T*G).row(r).B.row(c) with
+ *     B = inv(L);
+ * so those cost O(nnz*k) instead of O(n*n*k) for inner dimension k. The
+ * other operators read one entry of the adjoint per entry of the pattern.
+ *
+ * The adjoints of the internal nodes are still dense. This only uses Eigen
+ * matrices, since the pattern is an Eigen::SparseMatrix.
+ */
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "Exception.hpp"
+
+#if AMD_HAVE_EIGEN==1
+  #include <Eigen/Dense>
+  #include <Eigen/Sparse>
+#endif
+
+namespace AMD {
+
+#if AMD_HAVE_EIGEN==1
+
+  /**
+   * @brief Evaluate trace/logdet of a graph of dense Eigen matrices and
+   * its gradients, restricted to a sparsity pattern for some variables.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, T> graph(fS + fX, AMD::kLogdetRoot);
+   * std::map<boost::shared_ptr<MT>, Eigen::SparseMatrix<T> > patterns;
+   * patterns[fX.matrixPtr] = pattern;
+   * AMD::PatternGradientEvaluator<T> eval(graph, patterns);
+   * std::vector<Eigen::SparseMatrix<T> > gradient;
+   * T value = eval.evaluate(&gradient); // gradient[v] has the pattern
+   * \endcode
+   *
+   * @tparam T Scalar type of the matrices.
+   */
+  template <class T>
+  class PatternGradientEvaluator {
+    public:
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+    typedef Eigen::SparseMatrix<T> PatternType;
+    typedef MatrixAdaptor_t<MatrixType> MatrixAdaptorType;
+    typedef ComputationGraph<MatrixType, T> GraphType;
+    typedef GraphNode<MatrixType, T> NodeType;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MatrixType> BindingType;
+
+    /**
+     * @brief Create an evaluator.
+     *
+     * @param[in] graph    The graph to evaluate; it must have a scalar root.
+     * @param[in] patterns The pattern of each restricted variable, keyed by
+     *                     the matrixPtr of its VAR leaf; only the structure
+     *                     is used. Variables that are missing get their
+     *                     full gradient.
+     */
+    PatternGradientEvaluator(const GraphType& graph,
+                             const std::map<boost::shared_ptr<MatrixType>,
+                                            PatternType>& patterns) :
+      graph(graph),
+      patterns(graph.numVariables()),
+      restricted(graph.numVariables(), false),
+      sampled(graph.numVariables()),
+      reached(graph.numVariables(), false) {
+      AMD_START_TRY_BLOCK()
+
+      if (kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::PatternGradientEvaluator",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const NodeType& node = graph.node(graph.variable(v));
+        typename std::map<boost::shared_ptr<MatrixType>,
+                          PatternType>::const_iterator found =
+          patterns.find(node.matrixPtr);
+        if (patterns.end() == found) continue;
+
+        if (found->second.rows() != node.numRows ||
+            found->second.cols() != node.numCols) {
+          throw exception_generic_impl("AMD::PatternGradientEvaluator",
+                                       "Dimensions of a pattern don't match",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+        this->patterns[v] = found->second;
+        this->patterns[v].makeCompressed();
+        restricted[v] = true;
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, PatternGradientEvaluator)
+    }
+
+    /**
+     * @brief Get the graph that is evaluated.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Is the gradient of variable v restricted to a pattern?
+     */
+    bool hasPattern(int v) const { return restricted[v]; }
+
+    /**
+     * @brief Evaluate the function (and optionally its gradients) at the
+     * values of the VAR leaves.
+     *
+     * @param[out] gradient If not NULL, (*gradient)[v] is the gradient with
+     *                      respect to variable v: on its pattern if it has
+     *                      one, in full otherwise.
+     * @return trace/logdet of the root.
+     */
+    T evaluate(std::vector<PatternType>* gradient = NULL) {
+      return evaluate(BindingType(), gradient);
+    }
+
+    /**
+     * @brief Same as above at a given point.
+     *
+     * @param[in]  binding  binding[v] is the value of variable v; if it is
+     *                      empty, the values of the VAR leaves are used.
+     * @param[out] gradient See above.
+     */
+    T evaluate(const BindingType& binding,
+               std::vector<PatternType>* gradient = NULL) {
+      T value = T(0);
+      AMD_START_TRY_BLOCK()
+
+      checkBinding(binding);
+      std::vector<const MatrixType*> variables(binding.size());
+      for (size_t v=0; v<binding.size(); ++v) variables[v] = &binding[v];
+
+      forwardSweep(graph, variables, ws);
+      const int root = graph.root();
+      value = rootValue<MatrixType, T>(graph.rootOp(), *ws.values[root]);
+      if (NULL == gradient) return value;
+
+      sweep();
+      gradient->resize(graph.numVariables());
+      for (int v=0; v<graph.numVariables(); ++v) {
+        variableGradient(v, (*gradient)[v]);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, PatternGradientEvaluator::evaluate)
+      return value;
+    }
+
+    private:
+    void checkBinding(const BindingType& binding) const {
+      if (binding.empty()) return;
+      if (static_cast<int>(binding.size()) != graph.numVariables()) {
+        throw exception_generic_impl("AMD::PatternGradientEvaluator::evaluate",
+                                     "Need one value per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const NodeType& node = graph.node(graph.variable(v));
+        if (binding[v].rows() != node.numRows ||
+            binding[v].cols() != node.numCols) {
+          throw exception_generic_impl(
+            "AMD::PatternGradientEvaluator::evaluate",
+            "Dimensions of a binding don't match",
+            AMD_MISMATCHED_DIMENSIONS);
+        }
+      }
+    }
+
+    /** The reverse sweep; restricted leaves only get sampled adjoints */
+    void sweep() {
+      const int root = graph.root();
+      ws.adjoints.resize(graph.size());
+      ws.hasAdjoint.assign(graph.size(), false);
+      std::fill(reached.begin(), reached.end(), false);
+
+      rootAdjoint<MatrixType, T>(graph.rootOp(), *ws.values[root],
+                                 ws.adjoints[root]);
+      ws.hasAdjoint[root] = true;
+      const NodeType& rootNode = graph.node(root);
+      if (rootNode.isLeaf() && -1 != rootNode.varIndex &&
+          restricted[rootNode.varIndex]) {
+        const MatrixType& G = ws.adjoints[root];
+        sample(rootNode.varIndex, [&](int r, int c) { return G(r,c); });
+        return;
+      }
+
+      for (int i=root; i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        const bool propagate = !node.isConst && !node.isLeaf() &&
+                               ws.hasAdjoint[i];
+
+        for (int side=0; propagate && side<2; ++side) {
+          const int child = (0 == side) ? node.left : node.right;
+          if (-1 == child || graph.node(child).isConst) continue;
+
+          const NodeType& leaf = graph.node(child);
+          if (leaf.isLeaf() && restricted[leaf.varIndex]) {
+            sampledAdjoint(node, side, i, leaf.varIndex);
+            continue;
+          }
+
+          partialAdjoint(node,
+                         side,
+                         *ws.values[i],
+                         ws.values[node.left],
+                         (-1 == node.right) ? NULL : ws.values[node.right],
+                         ws.adjoints[i],
+                         ws.partial);
+          if (ws.hasAdjoint[child]) {
+            ws.adjoints[child] += ws.partial;
+          } else {
+            std::swap(ws.adjoints[child], ws.partial);
+            ws.hasAdjoint[child] = true;
+          }
+        }
+      }
+    }
+
+    /**
+     * Add entry(r,c) at each entry of the pattern of variable v to its
+     * sampled adjoint.
+     */
+    template <class Entry>
+    void sample(int v, const Entry& entry) {
+      const PatternType& pattern = patterns[v];
+      const typename PatternType::StorageIndex* outer =
+        pattern.outerIndexPtr();
+      const typename PatternType::StorageIndex* inner =
+        pattern.innerIndexPtr();
+      std::vector<T>& values = sampled[v];
+      if (false == reached[v]) values.assign(pattern.nonZeros(), T(0));
+      reached[v] = true;
+
+      for (int c=0; c<pattern.outerSize(); ++c) {
+        for (int k=outer[c]; k<outer[c+1]; ++k) values[k] += entry(inner[k], c);
+      }
+    }
+
+    /** The partial adjoint of node i for a restricted leaf on one side */
+    void sampledAdjoint(const NodeType& node, int side, int i, int v) {
+      const MatrixType& G = ws.adjoints[i];
+      const MatrixType* left = ws.values[node.left];
+      const MatrixType* right = (-1 == node.right) ? NULL :
+                                ws.values[node.right];
+
+      switch (node.opNum) {
+        case PLUS: sample(v, [&](int r, int c) { return G(r,c); }); break;
+        case MINUS:
+          if (0 == side) sample(v, [&](int r, int c) { return G(r,c); });
+          else sample(v, [&](int r, int c) { return -G(r,c); });
+          break;
+        case NEGATION: sample(v, [&](int r, int c) { return -G(r,c); });
+          break;
+        case MTIMESS:
+        case STIMESM: {
+          const T s = node.scalar;
+          sample(v, [&](int r, int c) { return s*G(r,c); });
+        }
+          break;
+        case ELEWISE: {
+          const MatrixType& other = (0 == side) ? *right : *left;
+          sample(v, [&](int r, int c) { return G(r,c)*other(r,c); });
+        }
+          break;
+        case TRANSPOSE: sample(v, [&](int r, int c) { return G(c,r); });
+          break;
+        case DIAG:
+          sample(v, [&](int r, int c) { return (r == c) ? G(r,c) : T(0); });
+          break;
+        case TIMES:
+          if (0 == side) {
+            /** G.row(r).R.row(c), with the rows turned into columns */
+            ws.partial = G.transpose();
+            const MatrixType rightT = right->transpose();
+            const MatrixType& GT = ws.partial;
+            sample(v, [&](int r, int c) {
+              return GT.col(r).dot(rightT.col(c)); });
+          } else {
+            const MatrixType& L = *left;
+            sample(v, [&](int r, int c) { return L.col(r).dot(G.col(c)); });
+          }
+          break;
+        case INV: {
+          /** -(B^T*G).row(r).B.row(c) = -(G^T*B).col(r).B^T.col(c) */
+          const MatrixType& B = *ws.values[i];
+          ws.partial.noalias() = G.transpose() * B;
+          const MatrixType BT = B.transpose();
+          const MatrixType& GTB = ws.partial;
+          sample(v, [&](int r, int c) { return -GTB.col(r).dot(BT.col(c)); });
+        }
+          break;
+        default:
+          throw exception_generic_impl("AMD::PatternGradientEvaluator",
+                                       "Node is not an internal node",
+                                       AMD_INVALID_OPERATION);
+      }
+    }
+
+    /** The gradient of variable v after a sweep */
+    void variableGradient(int v, PatternType& result) const {
+      const NodeType& node = graph.node(graph.variable(v));
+      if (restricted[v]) {
+        result = patterns[v];
+        T* values = result.valuePtr();
+        for (int k=0; k<result.nonZeros(); ++k) {
+          values[k] = reached[v] ? sampled[v][k] : T(0);
+        }
+      } else if (ws.hasAdjoint[graph.variable(v)]) {
+        result = ws.adjoints[graph.variable(v)].sparseView();
+      } else {
+        result = PatternType(node.numRows, node.numCols);
+      }
+    }
+
+    GraphType graph; /**< the graph that is evaluated */
+    std::vector<PatternType> patterns; /**< compressed pattern per variable */
+    std::vector<bool> restricted; /**< does the variable have a pattern */
+    /** sampled[v][k] is the adjoint at the k'th entry of patterns[v] */
+    std::vector<std::vector<T> > sampled;
+    std::vector<bool> reached; /**< has sampled[v] been set in this sweep */
+    GraphWorkspace<MatrixType, T> ws; /**< values and dense adjoints */
+  };
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+} /** namespace AMD */
+
+#endif /** AMD_PATTERN_GRADIENT_HPP */
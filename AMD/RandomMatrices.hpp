@@ -67,14 +67,14 @@ struct rand_psd_t<elem::DistMatrix<double> > {
 
 #if AMD_HAVE_EIGEN==1
 
-template <>
-struct rand_psd_t<Eigen::Matrix<double, 
+template <typename T>
+struct rand_psd_t<Eigen::Matrix<T, 
                                 Eigen::Dynamic, 
                                 Eigen::Dynamic> > {
-  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+  typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
   typedef boost::shared_ptr<MatrixType> MatrixPtrType;
   typedef boost::mt19937 engine_type;
-  typedef boost::uniform_01<double> uni_real_type;
+  typedef boost::uniform_01<T> uni_real_type;
   typedef boost::variate_generator<engine_type, 
                                    uni_real_type> uni_real_prng_type;
 
@@ -110,18 +110,18 @@ struct rand_psd_t<Eigen::Matrix<double,
   }
 };
 
-template <>
-struct rand_psd_t<Eigen::SparseMatrix<double> > {
-  typedef Eigen::SparseMatrix<double> SparseMatrixType;
+template <typename T>
+struct rand_psd_t<Eigen::SparseMatrix<T> > {
+  typedef Eigen::SparseMatrix<T> SparseMatrixType;
   typedef boost::shared_ptr<SparseMatrixType> SparseMatrixPtrType;
   typedef Eigen::Matrix
-         <double, Eigen::Dynamic, Eigen::Dynamic> DenseMatrixType;
+         <T, Eigen::Dynamic, Eigen::Dynamic> DenseMatrixType;
   typedef boost::shared_ptr<DenseMatrixType> DenseMatrixPtrType;
   typedef boost::mt19937 engine_type;
   typedef boost::bernoulli_distribution<double> bernoulli_real_type;
   typedef boost::variate_generator
       <engine_type, bernoulli_real_type> bernoulli_real_prng_type;
-  typedef Eigen::Triplet<double> TripletType;
+  typedef Eigen::Triplet<T> TripletType;
 
   static SparseMatrixPtrType apply(int n, int nnz, int seed=-1) {
 
@@ -20,6 +20,15 @@
 #include "Exception.hpp"
 
 namespace AMD {
+  template <class MT, class ST> class MatrixMatrixFunc;
+
+  // defined in HessianVector.hpp
+  template <class MT, class ST>
+  void hessianVectorProduct(const MatrixMatrixFunc<MT, ST>& argument,
+                            RootOpType rootOp,
+                            const MT& V,
+                            MT& result);
+
   /**
    * @brief A Scalar-Matrix Function class. This class is a mapping
    * from MatrixType class to a ScalarType class.
@@ -41,6 +50,9 @@ namespace AMD {
     MT derivativeVal;
     boost::shared_ptr<MatrixMatrixFunc<MT, ST> > derivativeFuncVal;
     bool isConst;
+    boost::shared_ptr<MatrixMatrixFunc<MT, ST> > argumentFuncVal; /**< the
+                  argument of trace/logdet, used for Hessian-vector products */
+    RootOpType argumentOp; /**< kTraceRoot or kLogdetRoot */
     /**
      * @brief Constructor for a ScalarMatrixFunc object. The default
      * setting is a variable.
@@ -49,7 +61,9 @@ namespace AMD {
       functionVal(), 
       derivativeVal(), 
       derivativeFuncVal(), 
-      isConst(false) { }
+      isConst(false),
+      argumentFuncVal(),
+      argumentOp(kMatrixRoot) { }
 
     ~ScalarMatrixFunc() { }
 
@@ -64,10 +78,13 @@ namespace AMD {
       functionVal(fVal), 
       derivativeVal(dVal), 
       derivativeFuncVal(), 
-      isConst(false) { }
+      isConst(false),
+      argumentFuncVal(),
+      argumentOp(kMatrixRoot) { }
 
     ScalarMatrixFunc(ST fVal, MT dVal, MMF dFuncVal)
-      : functionVal(fVal), derivativeVal(dVal), isConst(false)
+      : functionVal(fVal), derivativeVal(dVal), isConst(false),
+        argumentFuncVal(), argumentOp(kMatrixRoot)
     {
       boost::shared_ptr<MatrixMatrixFunc<MT, ST> >
         copy(new MatrixMatrixFunc<MT, ST>);
@@ -88,7 +105,9 @@ namespace AMD {
       functionVal(fVal), 
       derivativeVal(MatrixAdaptorType::zeros(m, n)),
       derivativeFuncVal(),
-      isConst(true){ }
+      isConst(true),
+      argumentFuncVal(),
+      argumentOp(kMatrixRoot) { }
 
     /**
      * @brief Operator overloading for "=". rhs and lhs are
@@ -109,14 +128,67 @@ namespace AMD {
       isConst = true;
     }
 
+    /**
+     * @brief Initialize with a function value only. This is what trace and
+     * logdet return in no-grad mode: there is no derivative, so neither
+     * derivativeVal nor derivativeFuncVal are set.
+     *
+     * @param[in] fVal ScalarType function value.
+     */
+    void initWithValue(ST fVal) {
+      functionVal = fVal;
+      derivativeFuncVal.reset();
+      isConst = true;
+    }
+
     ScalarMatrixFunc& operator= (const ScalarMatrixFunc &x) {
       functionVal = x.functionVal;
       derivativeVal = x.derivativeVal;
       derivativeFuncVal = x.derivativeFuncVal;
       isConst = x.isConst;
+      argumentFuncVal = x.argumentFuncVal;
+      argumentOp = x.argumentOp;
       return(*this);
     }
 
+    /**
+     * @brief Remember the argument of trace/logdet. This is done by trace()
+     * and logdet(); functions that are combined with +, -, * or / do not
+     * have a single argument.
+     *
+     * @param[in] argument The matrix function that trace/logdet is applied to.
+     * @param[in] rootOp   kTraceRoot or kLogdetRoot.
+     */
+    void setArgument(const MMF& argument, RootOpType rootOp) {
+      argumentFuncVal = boost::shared_ptr<MMF>(new MMF);
+      argumentFuncVal->deepCopy(argument);
+      argumentOp = rootOp;
+    }
+
+    /**
+     * @brief Compute the Hessian-vector product H[V], ie., the derivative of
+     * the gradient (derivativeVal) along V. This is done numerically by a
+     * forward-over-reverse sweep whose cost is a small multiple of one
+     * gradient; no derivative-of-derivative tree is built. All variables
+     * move along V, matching the convention of derivativeVal.
+     *
+     * @param[in]  V      The direction, with the shape of the variable.
+     * @param[out] result Overwritten with H[V].
+     */
+    void hessianVectorProduct(const MT& V, MT& result) const {
+      AMD_START_TRY_BLOCK()
+
+      if (!argumentFuncVal) {
+        throw exception_generic_impl("AMD::hessianVectorProduct",
+                                     "Function is not trace or logdet",
+                                     AMD_INVALID_OPERATION);
+      }
+      AMD::hessianVectorProduct(*argumentFuncVal, argumentOp, V, result);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, hessianVectorProduct)
+    }
+
     /**
      * @brief Print out function value and derivative value to output stream.
      * @param[in] os  output stream to print to, 
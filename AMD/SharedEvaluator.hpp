@@ -0,0 +1,173 @@
+#ifndef AMD_SHARED_EVALUATOR_HPP
+#define AMD_SHARED_EVALUATOR_HPP
+
+/**
+ * @file SharedEvaluator.hpp
+ *
+ * @brief This file defines an evaluator that any number of threads can use
+ * at the same time, without locks, to compute trace/logdet of one recorded
+ * objective and its gradients at different points.
+ *
+ * The state is split in two:
+ *   - ComputationGraph is the immutable structure of the objective. It is
+ *     never written to after construction, and the sweeps only read it.
+ *   - GraphWorkspace holds everything that one evaluation writes: the values
+ *     of the internal nodes, the adjoints and the scratch space.
+ * SharedEvaluator owns a graph and only has const members, so it can be
+ * shared freely; each concurrent evaluation needs a workspace of its own.
+ *
+ * The recorded MatrixMatrixFunc tree itself is not thread-safe: gradientVec()
+ * and the callbacks write into the nodes. Build the graph once, then evaluate
+ * it through a SharedEvaluator.
+ */
+
+#include <vector>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Evaluate one graph at many points concurrently.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(f, AMD::kTraceRoot);
+   * const AMD::SharedEvaluator<MT, ST> shared(graph);
+   * // In each thread:
+   * AMD::GraphWorkspace<MT, ST> ws;
+   * std::vector<MT> gradient;
+   * ST value = shared.evaluate(point, ws, &gradient);
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class SharedEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphWorkspace<MT, ST> WorkspaceType;
+    /** One value per variable of the graph, in variable order */
+    typedef std::vector<MT> BindingType;
+
+    /**
+     * @brief Create an evaluator.
+     *
+     * @param[in] graph The graph to evaluate; it must have a scalar root.
+     */
+    SharedEvaluator(const GraphType& graph) : graph(graph) {
+      AMD_START_TRY_BLOCK()
+
+      if (kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::SharedEvaluator",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, SharedEvaluator)
+    }
+
+    /**
+     * @brief Get the graph that is evaluated.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Check that a binding has one value of the right shape per
+     * variable.
+     */
+    void checkBinding(const BindingType& binding) const {
+      if (static_cast<int>(binding.size()) != graph.numVariables()) {
+        throw exception_generic_impl("AMD::SharedEvaluator::checkBinding",
+                                     "Need one value per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const GraphNode<MT, ST>& node = graph.node(graph.variable(v));
+        if (MatrixAdaptorType::getNumRows(binding[v]) != node.numRows ||
+            MatrixAdaptorType::getNumCols(binding[v]) != node.numCols) {
+          throw exception_generic_impl("AMD::SharedEvaluator::checkBinding",
+                                       "Dimensions of a binding don't match",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+      }
+    }
+
+    /**
+     * @brief Evaluate the function (and optionally its gradients) at one
+     * point. This is safe to call from many threads at once as long as no
+     * two concurrent calls use the same workspace.
+     *
+     * @param[in]     binding  binding[v] is the value of variable v.
+     * @param[in,out] ws       The workspace of this evaluation; reusing it
+     *                         across calls reuses its buffers.
+     * @param[out]    gradient If not NULL, (*gradient)[v] is the gradient
+     *                         with respect to variable v.
+     * @return trace/logdet of the root.
+     */
+    ST evaluate(const BindingType& binding,
+                WorkspaceType& ws,
+                BindingType* gradient = NULL) const {
+      ST value = ST(0);
+      AMD_START_TRY_BLOCK()
+
+      checkBinding(binding);
+      value = evaluateChecked(binding, ws, gradient);
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, SharedEvaluator::evaluate)
+      return value;
+    }
+
+    /**
+     * @brief Same as above with a workspace that lives for this call only.
+     */
+    ST evaluate(const BindingType& binding,
+                BindingType* gradient = NULL) const {
+      WorkspaceType ws;
+      return evaluate(binding, ws, gradient);
+    }
+
+    /**
+     * @brief Same as evaluate() for a binding that has been checked already.
+     * If a monitor is given, it is told about every node of the sweeps, and
+     * an AMD_CANCELLED exception is thrown if it stops one of them.
+     */
+    ST evaluateChecked(const BindingType& binding,
+                       WorkspaceType& ws,
+                       BindingType* gradient,
+                       SweepMonitor* monitor = NULL) const {
+      std::vector<const MT*> variables(binding.size());
+      for (size_t v=0; v<binding.size(); ++v) variables[v] = &binding[v];
+
+      if (false == forwardSweep(graph, variables, ws, monitor)) cancelled();
+      const ST value = rootValue<MT, ST>(graph.rootOp(),
+                                         *ws.values[graph.root()]);
+      if (NULL == gradient) return value;
+
+      if (false == reverseSweep(graph, ws, monitor)) cancelled();
+      gradient->resize(binding.size());
+      for (int v=0; v<graph.numVariables(); ++v) {
+        MatrixAdaptorType::copy((*gradient)[v],
+                                ws.adjoints[graph.variable(v)]);
+      }
+      return value;
+    }
+
+    private:
+    static void cancelled() {
+      throw exception_generic_impl("AMD::SharedEvaluator::evaluate",
+                                   "The evaluation was cancelled",
+                                   AMD_CANCELLED);
+    }
+
+    const GraphType graph; /**< the graph that is evaluated */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_SHARED_EVALUATOR_HPP */
@@ -0,0 +1,519 @@
+#ifndef AMD_SPARSE_HESSIAN_HPP
+#define AMD_SPARSE_HESSIAN_HPP
+
+/**
+ * @file SparseHessian.hpp
+ *
+ * @brief This file defines the assembly of the full Hessian of trace/logdet
+ * of a ComputationGraph. The entries of all the variables are numbered
+ * column-major, variable after variable, which gives an N x N Hessian.
+ *
+ * HessianSparsity finds a superset of the non-zeros of the Hessian from the
+ * graph alone. Every node carries, for each of its entries, the set of
+ * variable entries it depends on. Each non-linear operation couples the
+ * dependencies of the entries it multiplies (TIMES, ELEWISE), or of all its
+ * entries (INV, and the logdet at the root); linear operations only move
+ * the dependencies around. The union of these couplings is the pattern.
+ * The columns are then greedily colored so that no two columns of a color
+ * share a row, and each color costs one Hessian-vector product.
+ */
+
+#include <algorithm>
+#include <vector>
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "HessianVector.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Is entry (i,j) of a constant matrix known to be zero? By default
+   * nothing is known, which is always safe.
+   */
+  template <class MT>
+  bool entryIsZero(const MT& /*A*/, int /*i*/, int /*j*/) { return false; }
+
+#if AMD_HAVE_EIGEN==1
+
+  /**
+   * @brief Dense Eigen matrices can be inspected entry by entry.
+   */
+  template <class T>
+  bool entryIsZero(const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& A,
+                   int i,
+                   int j) {
+    return T(0) == A(i, j);
+  }
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+  template <class MT, class ST>
+  class HessianSparsity {
+    public:
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+    typedef std::vector<int> IndexListType;
+
+    /**
+     * @brief Detect the sparsity pattern and color the columns.
+     *
+     * @param[in] graph A graph whose root is kTraceRoot or kLogdetRoot.
+     */
+    HessianSparsity(const GraphType& graph) : offsets(graph.numVariables()+1) {
+      AMD_START_TRY_BLOCK()
+
+      if (kMatrixRoot == graph.rootOp()) {
+        throw exception_generic_impl("AMD::HessianSparsity",
+                                     "The root of the graph is matrix valued",
+                                     AMD_INVALID_OPERATION);
+      }
+
+      offsets[0] = 0;
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const NodeType& leaf = graph.node(graph.variable(v));
+        offsets[v+1] = offsets[v] + leaf.numRows*leaf.numCols;
+      }
+
+      rows.resize(offsets.back());
+      detect(graph);
+      color();
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, HessianSparsity)
+    }
+
+    /**
+     * @brief Get the number of rows (and columns) of the Hessian.
+     */
+    int size() const { return offsets.back(); }
+
+    /**
+     * @brief Get the index of the first entry of variable v.
+     */
+    int offset(int v) const { return offsets[v]; }
+
+    /**
+     * @brief Get the sorted column indices of the non-zeros of row r. Since
+     * the Hessian is symmetric, these are also the rows of column r.
+     */
+    const IndexListType& row(int r) const { return rows[r]; }
+
+    /**
+     * @brief Get the number of non-zeros in the pattern.
+     */
+    int nonZeros() const {
+      int count = 0;
+      for (size_t r=0; r<rows.size(); ++r) count += rows[r].size();
+      return count;
+    }
+
+    /**
+     * @brief Get the number of colors (Hessian-vector products needed).
+     */
+    int numColors() const { return numColorsVal; }
+
+    /**
+     * @brief Get the color of column c, or -1 if the column is zero.
+     */
+    int color(int c) const { return colors[c]; }
+
+    private:
+    typedef std::vector<IndexListType> DependencyType;
+
+    static void merge(const IndexListType& in, IndexListType& out) {
+      if (in.empty()) return;
+      IndexListType result;
+      result.reserve(in.size() + out.size());
+      std::set_union(out.begin(), out.end(), in.begin(), in.end(),
+                     std::back_inserter(result));
+      out.swap(result);
+    }
+
+    void couple(const IndexListType& a, const IndexListType& b) {
+      for (size_t i=0; i<a.size(); ++i) merge(b, rows[a[i]]);
+      for (size_t i=0; i<b.size(); ++i) merge(a, rows[b[i]]);
+    }
+
+    /**
+     * @brief Is entry e of node i possibly non-zero?
+     */
+    bool nonZero(int i, int e) const {
+      return nonZeros_[i].empty() || nonZeros_[i][e];
+    }
+
+    /**
+     * @brief Is entry e of node i needed by the root?
+     */
+    bool isUsed(int i, int e) const { return used[i].empty() || used[i][e]; }
+
+    /**
+     * @brief Find, from the root down, the entries of each node that the
+     * root needs. The trace only needs the diagonal, so a product whose
+     * off-diagonal entries are dropped couples fewer entries.
+     */
+    void markUsed(const GraphType& graph) {
+      used.assign(graph.size(), std::vector<char>());
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+        if (!node.isConst) used[i].assign(node.numRows*node.numCols, 0);
+      }
+
+      const int root = graph.root();
+      const int size = graph.node(root).numRows;
+      if (kTraceRoot == graph.rootOp()) {
+        for (int r=0; r<size; ++r) used[root][r+r*size] = 1;
+      } else {
+        used[root].assign(used[root].size(), 1);
+      }
+
+      for (int i=root; i>=0; --i) {
+        const NodeType& node = graph.node(i);
+        if (node.isConst || node.isLeaf()) continue;
+        const int m = node.numRows;
+        const int n = node.numCols;
+        const std::vector<char>& mine = used[i];
+        std::vector<char> dummy;
+        std::vector<char>& L = graph.node(node.left).isConst ?
+                                 dummy : used[node.left];
+        std::vector<char>& R = (-1 == node.right ||
+                                graph.node(node.right).isConst) ?
+                                 dummy : used[node.right];
+
+        switch (node.opNum) {
+          case PLUS:
+          case MINUS:
+          case ELEWISE:
+            for (int e=0; e<m*n; ++e) {
+              if (!mine[e]) continue;
+              if (!L.empty()) L[e] = 1;
+              if (!R.empty()) R[e] = 1;
+            }
+            break;
+
+          case NEGATION:
+          case MTIMESS:
+          case STIMESM:
+            for (int e=0; e<m*n; ++e) if (mine[e]) L[e] = 1;
+            break;
+
+          case TRANSPOSE:
+            for (int c=0; c<n; ++c) for (int r=0; r<m; ++r) {
+              if (mine[r+c*m]) L[c+r*n] = 1;
+            }
+            break;
+
+          case DIAG:
+            for (int r=0; r<m; ++r) if (mine[r+r*m]) L[r+r*m] = 1;
+            break;
+
+          case TIMES:
+            {
+              const int p = graph.node(node.left).numCols;
+              for (int c=0; c<n; ++c) for (int r=0; r<m; ++r) {
+                if (!mine[r+c*m]) continue;
+                for (int k=0; k<p; ++k) {
+                  if (!L.empty()) L[r+k*m] = 1;
+                  if (!R.empty()) R[k+c*p] = 1;
+                }
+              }
+            }
+            break;
+
+          case INV:
+            for (int e=0; e<m*n; ++e) {
+              if (mine[e]) {
+                L.assign(L.size(), 1);
+                break;
+              }
+            }
+            break;
+
+          default:
+            break;
+        }
+      }
+
+      /** An empty mask means that every entry is used */
+      for (int i=0; i<graph.size(); ++i) {
+        if (std::find(used[i].begin(), used[i].end(), 0) == used[i].end()) {
+          used[i].clear();
+        }
+      }
+    }
+
+    void detect(const GraphType& graph) {
+      markUsed(graph);
+      deps.assign(graph.size(), DependencyType());
+      nonZeros_.assign(graph.size(), std::vector<char>());
+
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+        const int m = node.numRows;
+        const int n = node.numCols;
+
+        if (node.isLeaf()) {
+          if (node.isConst) {
+            /** Dependencies stay empty; record the known zeros */
+            nonZeros_[i].assign(m*n, 1);
+            for (int c=0; c<n; ++c) for (int r=0; r<m; ++r) {
+              if (entryIsZero(*node.matrixPtr, r, c)) nonZeros_[i][r+c*m] = 0;
+            }
+          } else {
+            deps[i].resize(m*n);
+            const int first = offsets[node.varIndex];
+            for (int e=0; e<m*n; ++e) deps[i][e].push_back(first + e);
+          }
+          continue;
+        }
+        /** Constant internal nodes have no dependencies */
+        if (node.isConst) continue;
+
+        deps[i].resize(m*n);
+        const DependencyType& L = deps[node.left];
+        const DependencyType* R = (-1 == node.right) ? NULL : &deps[node.right];
+        DependencyType& out = deps[i];
+
+        switch (node.opNum) {
+          case PLUS:
+          case MINUS:
+            for (int e=0; e<m*n; ++e) {
+              if (!L.empty()) merge(L[e], out[e]);
+              if (!R->empty()) merge((*R)[e], out[e]);
+            }
+            break;
+
+          case NEGATION:
+          case MTIMESS:
+          case STIMESM:
+            out = L;
+            break;
+
+          case TRANSPOSE:
+            for (int c=0; c<n; ++c) for (int r=0; r<m; ++r) {
+              out[r+c*m] = L[c+r*n];
+            }
+            break;
+
+          case DIAG:
+            nonZeros_[i].assign(m*n, 0);
+            for (int r=0; r<m; ++r) {
+              out[r+r*m] = L[r+r*m];
+              nonZeros_[i][r+r*m] = 1;
+            }
+            break;
+
+          case ELEWISE:
+            for (int e=0; e<m*n; ++e) {
+              if (!nonZero(node.left, e) || !nonZero(node.right, e)) continue;
+              if (!L.empty()) merge(L[e], out[e]);
+              if (!R->empty()) merge((*R)[e], out[e]);
+              if (!L.empty() && !R->empty() && isUsed(i, e)) {
+                couple(L[e], (*R)[e]);
+              }
+            }
+            break;
+
+          case TIMES:
+            {
+              /** C(r,c) = sum_k A(r,k)*B(k,c) couples A(r,k) and B(k,c) */
+              const int p = graph.node(node.left).numCols;
+              for (int k=0; k<p; ++k) {
+                for (int c=0; c<n; ++c) for (int r=0; r<m; ++r) {
+                  if (!nonZero(node.left, r+k*m) ||
+                      !nonZero(node.right, k+c*p)) continue;
+                  if (!L.empty()) merge(L[r+k*m], out[r+c*m]);
+                  if (!R->empty()) merge((*R)[k+c*p], out[r+c*m]);
+                  if (!L.empty() && !R->empty() && !used[i].empty() &&
+                      used[i][r+c*m]) {
+                    couple(L[r+k*m], (*R)[k+c*p]);
+                  }
+                }
+                if (L.empty() || R->empty() || !used[i].empty()) continue;
+
+                /** All of C is used: couple column k of A with row k of B
+                    at once */
+                IndexListType columnOfA, rowOfB;
+                for (int r=0; r<m; ++r) {
+                  if (nonZero(node.left, r+k*m)) merge(L[r+k*m], columnOfA);
+                }
+                for (int c=0; c<n; ++c) {
+                  if (nonZero(node.right, k+c*p)) merge((*R)[k+c*p], rowOfB);
+                }
+                couple(columnOfA, rowOfB);
+              }
+
+              /** An entry is zero if no k pairs two non-zeros */
+              nonZeros_[i].assign(m*n, 0);
+              for (int c=0; c<n; ++c) for (int r=0; r<m; ++r) {
+                for (int k=0; k<p; ++k) {
+                  if (nonZero(node.left, r+k*m) && nonZero(node.right, k+c*p)) {
+                    nonZeros_[i][r+c*m] = 1;
+                    break;
+                  }
+                }
+              }
+            }
+            break;
+
+          case INV:
+            {
+              /** Every entry of the inverse depends on every entry */
+              IndexListType all;
+              for (size_t e=0; e<L.size(); ++e) merge(L[e], all);
+              for (int e=0; e<m*n; ++e) out[e] = all;
+              bool anyUsed = false;
+              for (int e=0; e<m*n && !anyUsed; ++e) anyUsed = isUsed(i, e);
+              if (anyUsed) couple(all, all);
+            }
+            break;
+
+          default:
+            throw exception_generic_impl("AMD::HessianSparsity::detect",
+                                         "Unknown operation in the graph",
+                                         AMD_INVALID_OPERATION);
+        }
+
+        /** Release what no other node needs */
+        if (node.opNum != DIAG && node.opNum != TIMES) {
+          nonZeros_[i].clear();
+        }
+      }
+
+      if (kLogdetRoot == graph.rootOp()) {
+        /** logdet is non-linear in all the entries of its argument */
+        IndexListType all;
+        const DependencyType& root = deps[graph.root()];
+        for (size_t e=0; e<root.size(); ++e) merge(root[e], all);
+        couple(all, all);
+      }
+
+      deps.clear();
+      nonZeros_.clear();
+      used.clear();
+    }
+
+    void color() {
+      colors.assign(size(), -1);
+      numColorsVal = 0;
+
+      /** Greedy distance-2 coloring: column c may not share a color with
+          any column that has a non-zero in one of the rows of column c */
+      std::vector<int> forbidden;
+      for (int c=0; c<size(); ++c) {
+        if (rows[c].empty()) continue;
+        forbidden.assign(numColorsVal+1, -1);
+        for (size_t a=0; a<rows[c].size(); ++a) {
+          const IndexListType& neighbours = rows[rows[c][a]];
+          for (size_t b=0; b<neighbours.size(); ++b) {
+            const int used = colors[neighbours[b]];
+            if (-1 != used) forbidden[used] = c;
+          }
+        }
+        int chosen = 0;
+        while (c == forbidden[chosen]) ++chosen;
+        colors[c] = chosen;
+        numColorsVal = std::max(numColorsVal, chosen+1);
+      }
+    }
+
+    std::vector<int> offsets; /**< first entry of each variable */
+    std::vector<IndexListType> rows; /**< pattern, row by row */
+    std::vector<int> colors; /**< color of each column */
+    int numColorsVal; /**< number of colors used */
+    std::vector<DependencyType> deps; /**< used only during detect() */
+    std::vector<std::vector<char> > nonZeros_; /**< empty means all */
+    std::vector<std::vector<char> > used; /**< empty means all */
+  };
+
+#if AMD_HAVE_EIGEN==1
+
+  /**
+   * @brief Assemble the Hessian of trace/logdet of a graph of dense Eigen
+   * matrices, using one Hessian-vector product per color.
+   *
+   * @param[in]  graph    A graph whose root is kTraceRoot or kLogdetRoot.
+   * @param[in]  sparsity The pattern of the graph.
+   * @param[out] H        Overwritten with the N x N Hessian.
+   */
+  template <class T>
+  void sparseHessian(
+    const ComputationGraph<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>,
+                           T>& graph,
+    const HessianSparsity<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>,
+                          T>& sparsity,
+    Eigen::SparseMatrix<T>& H) {
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+
+    const int numVars = graph.numVariables();
+    std::vector<int> varOf(sparsity.size());
+    for (int v=0; v<numVars; ++v) {
+      for (int e=sparsity.offset(v); e<sparsity.offset(v+1); ++e) varOf[e] = v;
+    }
+
+    std::vector<std::vector<int> > columnsOf(sparsity.numColors());
+    for (int c=0; c<sparsity.size(); ++c) {
+      if (-1 != sparsity.color(c)) columnsOf[sparsity.color(c)].push_back(c);
+    }
+
+    HessianVectorEvaluator<MatrixType, T> hessian(graph);
+    std::vector<Eigen::Triplet<T> > triplets;
+    std::vector<MatrixType> direction(numVars), product;
+    for (int color=0; color<sparsity.numColors(); ++color) {
+      for (int v=0; v<numVars; ++v) {
+        const GraphNode<MatrixType, T>& leaf = graph.node(graph.variable(v));
+        direction[v].setZero(leaf.numRows, leaf.numCols);
+      }
+      const std::vector<int>& columns = columnsOf[color];
+      for (size_t j=0; j<columns.size(); ++j) {
+        const int v = varOf[columns[j]];
+        direction[v].data()[columns[j] - sparsity.offset(v)] = T(1);
+      }
+
+      hessian.apply(direction, product);
+
+      /** No two columns of a color share a row, so each non-zero of the
+          product belongs to exactly one of the columns */
+      for (size_t j=0; j<columns.size(); ++j) {
+        const std::vector<int>& rowsOfColumn = sparsity.row(columns[j]);
+        for (size_t k=0; k<rowsOfColumn.size(); ++k) {
+          const int r = rowsOfColumn[k];
+          const int v = varOf[r];
+          triplets.push_back(Eigen::Triplet<T>(
+            r, columns[j], product[v].data()[r - sparsity.offset(v)]));
+        }
+      }
+    }
+
+    H.resize(sparsity.size(), sparsity.size());
+    H.setFromTriplets(triplets.begin(), triplets.end());
+  }
+
+  /**
+   * @brief Assemble the Hessian of trace/logdet of a recorded matrix
+   * function of dense Eigen matrices.
+   *
+   * @param[in]  argument The matrix function.
+   * @param[in]  rootOp   kTraceRoot or kLogdetRoot.
+   * @param[out] H        Overwritten with the N x N Hessian.
+   * @return the number of Hessian-vector products used.
+   */
+  template <class T>
+  int sparseHessian(
+    const MatrixMatrixFunc<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>,
+                           T>& argument,
+    RootOpType rootOp,
+    Eigen::SparseMatrix<T>& H) {
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+
+    ComputationGraph<MatrixType, T> graph(argument, rootOp);
+    HessianSparsity<MatrixType, T> sparsity(graph);
+    sparseHessian(graph, sparsity, H);
+    return sparsity.numColors();
+  }
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+} /** namespace AMD */
+
+#endif /** AMD_SPARSE_HESSIAN_HPP */
@@ -0,0 +1,456 @@
+#ifndef AMD_TANGENT_EVALUATOR_HPP
+#define AMD_TANGENT_EVALUATOR_HPP
+
+/**
+ * @file TangentEvaluator.hpp
+ *
+ * @brief This file defines forward (tangent) mode differentiation over a
+ * ComputationGraph. Given a direction dX for each variable, the forward
+ * sweep propagates the directional derivative dF of every node alongside
+ * its value, so the derivative of the root along the direction is obtained
+ * without forming the gradient. Several directions are carried together as
+ * a block; the products with a common matrix in the TIMES and INV rules are
+ * then done for all the directions at once (a single GEMM for Eigen).
+ */
+
+#include <map>
+#include <vector>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Compute out[j] = A*B[j] for each matrix in a block.
+   */
+  template <class MT>
+  void multiplyEach(const MT& A, const std::vector<MT>& B, std::vector<MT>& out) {
+    out.resize(B.size());
+    for (size_t j=0; j<B.size(); ++j) {
+      MatrixAdaptor_t<MT>::multiply(A, B[j], out[j]);
+    }
+  }
+
+  /**
+   * @brief Compute out[j] = A[j]*B for each matrix in a block.
+   */
+  template <class MT>
+  void eachMultiply(const std::vector<MT>& A, const MT& B, std::vector<MT>& out) {
+    out.resize(A.size());
+    for (size_t j=0; j<A.size(); ++j) {
+      MatrixAdaptor_t<MT>::multiply(A[j], B, out[j]);
+    }
+  }
+
+#if AMD_HAVE_EIGEN==1
+
+  /**
+   * @brief For dense Eigen matrices, A*[B_1 ... B_k] is one GEMM.
+   */
+  template <class T>
+  void multiplyEach(
+    const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& A,
+    const std::vector<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> >& B,
+    std::vector<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> >& out) {
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+    out.resize(B.size());
+    if (B.empty()) return;
+
+    const int n = B[0].cols();
+    MatrixType stacked(B[0].rows(), n*B.size());
+    for (size_t j=0; j<B.size(); ++j) stacked.middleCols(j*n, n) = B[j];
+    MatrixType product = A*stacked;
+    for (size_t j=0; j<B.size(); ++j) out[j] = product.middleCols(j*n, n);
+  }
+
+  /**
+   * @brief For dense Eigen matrices, [A_1; ...; A_k]*B is one GEMM.
+   */
+  template <class T>
+  void eachMultiply(
+    const std::vector<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> >& A,
+    const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& B,
+    std::vector<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> >& out) {
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+    out.resize(A.size());
+    if (A.empty()) return;
+
+    const int m = A[0].rows();
+    MatrixType stacked(m*A.size(), A[0].cols());
+    for (size_t j=0; j<A.size(); ++j) stacked.middleRows(j*m, m) = A[j];
+    MatrixType product = stacked*B;
+    for (size_t j=0; j<A.size(); ++j) out[j] = product.middleRows(j*m, m);
+  }
+
+#endif /** AMD_HAVE_EIGEN==1 */
+
+  /**
+   * @brief Compute the tangents of an internal node from the values and the
+   * tangents of its children, for a block of directions. A NULL tangent
+   * stands for a child that does not depend on a variable (zero tangent);
+   * at least one of the children must have a tangent.
+   *
+   * @param[in]  node         The node to be evaluated.
+   * @param[in]  value        Value of the node.
+   * @param[in]  left         Value of the left child.
+   * @param[in]  right        Value of the right child (NULL if unary).
+   * @param[in]  leftTangent  Tangents of the left child, or NULL.
+   * @param[in]  rightTangent Tangents of the right child, or NULL.
+   * @param[out] result       Overwritten with the tangents of the node.
+   */
+  template <class MT, class ST>
+  void tangentNode(const GraphNode<MT, ST>& node,
+                   const MT& value,
+                   const MT* left,
+                   const MT* right,
+                   const std::vector<MT>* leftTangent,
+                   const std::vector<MT>* rightTangent,
+                   std::vector<MT>& result) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    const std::vector<MT>& some = (NULL != leftTangent) ?
+                                  *leftTangent : *rightTangent;
+    const size_t k = some.size();
+    result.resize(k);
+
+    switch (node.opNum) {
+      case PLUS:
+      case MINUS:
+        for (size_t j=0; j<k; ++j) {
+          if (NULL != leftTangent && NULL != rightTangent) {
+            if (PLUS == node.opNum) {
+              MatrixAdaptorType::add((*leftTangent)[j],
+                                     (*rightTangent)[j],
+                                     result[j]);
+            } else {
+              MatrixAdaptorType::minus((*leftTangent)[j],
+                                       (*rightTangent)[j],
+                                       result[j]);
+            }
+          } else if (NULL != leftTangent || PLUS == node.opNum) {
+            MatrixAdaptorType::copy(result[j], some[j]);
+          } else {
+            MatrixAdaptorType::negation(some[j], result[j]);
+          }
+        }
+        break;
+      case NEGATION:
+        for (size_t j=0; j<k; ++j) {
+          MatrixAdaptorType::negation(some[j], result[j]);
+        }
+        break;
+      case TIMES: {
+        /** d(L*R) = dL*R + L*dR */
+        std::vector<MT> other;
+        if (NULL != leftTangent) eachMultiply(*leftTangent, *right, result);
+        if (NULL != rightTangent) {
+          multiplyEach(*left, *rightTangent, (NULL == leftTangent) ?
+                                             result : other);
+        }
+        if (NULL != leftTangent && NULL != rightTangent) {
+          for (size_t j=0; j<k; ++j) {
+            MatrixAdaptorType::add(result[j], other[j], result[j]);
+          }
+        }
+      }
+        break;
+      case MTIMESS:
+      case STIMESM:
+        for (size_t j=0; j<k; ++j) {
+          MatrixAdaptorType::multiply(some[j], node.scalar, result[j]);
+        }
+        break;
+      case ELEWISE:
+        for (size_t j=0; j<k; ++j) {
+          MT tmp;
+          if (NULL != leftTangent) {
+            MatrixAdaptorType::elementwiseProduct((*leftTangent)[j],
+                                                  *right,
+                                                  result[j]);
+          }
+          if (NULL != rightTangent) {
+            MatrixAdaptorType::elementwiseProduct(*left,
+                                                  (*rightTangent)[j],
+                                                  (NULL == leftTangent) ?
+                                                  result[j] : tmp);
+          }
+          if (NULL != leftTangent && NULL != rightTangent) {
+            MatrixAdaptorType::add(result[j], tmp, result[j]);
+          }
+        }
+        break;
+      case TRANSPOSE:
+        for (size_t j=0; j<k; ++j) {
+          MatrixAdaptorType::transpose(some[j], result[j]);
+        }
+        break;
+      case INV: {
+        /** d(inv(L)) = -inv(L)*dL*inv(L) */
+        std::vector<MT> tmp1, tmp2;
+        multiplyEach(value, some, tmp1);
+        eachMultiply(tmp1, value, tmp2);
+        for (size_t j=0; j<k; ++j) {
+          MatrixAdaptorType::negation(tmp2[j], result[j]);
+        }
+      }
+        break;
+      case DIAG:
+        for (size_t j=0; j<k; ++j) {
+          MatrixAdaptorType::diag(some[j], result[j]);
+        }
+        break;
+      default:
+        throw exception_generic_impl("AMD::tangentNode",
+                                     "Node is not an internal node",
+                                     AMD_INVALID_OPERATION);
+    }
+  }
+
+  /**
+   * @brief Evaluate the directional derivatives of a graph for a block of
+   * directions with one forward sweep.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(inv(fA + fX), AMD::kLogdetRoot);
+   * AMD::TangentEvaluator<MT, ST> tangent(graph);
+   * std::vector<std::vector<MT> > directions(k, std::vector<MT>(1)); // dX_j
+   * tangent.evaluate(directions);
+   * double d0 = tangent.directionalDerivative(0); // d logdet along dX_0
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class TangentEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+    /** One direction per variable of the graph, in variable order */
+    typedef std::vector<MT> DirectionType;
+
+    /**
+     * @brief Create an evaluator. Nothing is computed until evaluate().
+     * @param[in] graph The graph to differentiate.
+     */
+    TangentEvaluator(const GraphType& graph) :
+      graph(graph),
+      tangents(graph.size()),
+      hasTangent(graph.size(), false),
+      numDirections(0) { }
+
+    /**
+     * @brief Get the graph that is differentiated.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Compute the values and the tangents of all the nodes.
+     *
+     * @param[in] directions directions[j][v] is the direction of variable v
+     *                       in the j'th direction.
+     */
+    void evaluate(const std::vector<DirectionType>& directions) {
+      AMD_START_TRY_BLOCK()
+
+      const size_t k = directions.size();
+      for (size_t j=0; j<k; ++j) checkDirection(directions[j]);
+
+      forwardSweep(graph, std::vector<const MT*>(), ws);
+
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+        hasTangent[i] = (false == node.isConst);
+        if (node.isConst) {
+          tangents[i].clear();
+          continue;
+        }
+
+        if (node.isLeaf()) {
+          tangents[i].resize(k);
+          for (size_t j=0; j<k; ++j) {
+            MatrixAdaptorType::copy(tangents[i][j],
+                                    directions[j][node.varIndex]);
+          }
+          continue;
+        }
+
+        tangentNode(node,
+                    *ws.values[i],
+                    ws.values[node.left],
+                    (-1 == node.right) ? NULL : ws.values[node.right],
+                    hasTangent[node.left] ? &tangents[node.left] : NULL,
+                    (-1 != node.right && hasTangent[node.right]) ?
+                      &tangents[node.right] : NULL,
+                    tangents[i]);
+      }
+      numDirections = k;
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, TangentEvaluator::evaluate)
+    }
+
+    /**
+     * @brief Get the value of the root computed by the last evaluate().
+     */
+    const MT& value() const { return *ws.values[graph.root()]; }
+
+    /**
+     * @brief Get the derivative of the (matrix valued) root along the j'th
+     * direction of the last evaluate().
+     *
+     * @param[in]  j      Index of the direction.
+     * @param[out] result Overwritten with the directional derivative.
+     */
+    void tangent(int j, MT& result) const {
+      const int root = graph.root();
+      if (hasTangent[root]) MatrixAdaptorType::copy(result, tangents[root][j]);
+      else result = MatrixAdaptorType::zeros(graph.node(root).numRows,
+                                             graph.node(root).numCols);
+    }
+
+    /**
+     * @brief Get the derivative of trace/logdet of the root along the j'th
+     * direction of the last evaluate().
+     *
+     * @param[in] j Index of the direction.
+     */
+    ST directionalDerivative(int j) const {
+      std::vector<ST> result;
+      directionalDerivatives(result);
+      return result[j];
+    }
+
+    /**
+     * @brief Get the derivatives of trace/logdet of the root along all the
+     * directions of the last evaluate().
+     *
+     * @param[out] result result[j] is the derivative along direction j.
+     */
+    void directionalDerivatives(std::vector<ST>& result) const {
+      AMD_START_TRY_BLOCK()
+
+      const int root = graph.root();
+      result.assign(numDirections, ST());
+      if (false == hasTangent[root]) return;
+
+      if (kTraceRoot == graph.rootOp()) {
+        for (size_t j=0; j<numDirections; ++j) {
+          result[j] = MatrixAdaptorType::trace(tangents[root][j]);
+        }
+      } else if (kLogdetRoot == graph.rootOp()) {
+        /** d(logdet(F)) = trace(inv(F)*dF) */
+        MT valueInv;
+        std::vector<MT> products;
+        MatrixAdaptorType::inv(value(), valueInv);
+        multiplyEach(valueInv, tangents[root], products);
+        for (size_t j=0; j<numDirections; ++j) {
+          result[j] = MatrixAdaptorType::trace(products[j]);
+        }
+      } else {
+        throw exception_generic_impl(
+          "AMD::TangentEvaluator::directionalDerivatives",
+          "The root of the graph is matrix valued",
+          AMD_INVALID_OPERATION);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, TangentEvaluator::directionalDerivatives)
+    }
+
+    private:
+    void checkDirection(const DirectionType& direction) const {
+      if (static_cast<int>(direction.size()) != graph.numVariables()) {
+        throw exception_generic_impl("AMD::TangentEvaluator::evaluate",
+                                     "Need one direction per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const NodeType& node = graph.node(graph.variable(v));
+        if (MatrixAdaptorType::getNumRows(direction[v]) != node.numRows ||
+            MatrixAdaptorType::getNumCols(direction[v]) != node.numCols) {
+          throw exception_generic_impl("AMD::TangentEvaluator::evaluate",
+                                       "Dimensions of a direction don't match",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+      }
+    }
+
+    GraphType graph; /**< the graph that is differentiated */
+    GraphWorkspace<MT, ST> ws; /**< values of the nodes */
+    std::vector<std::vector<MT> > tangents; /**< tangents of each node */
+    std::vector<bool> hasTangent; /**< false for constant nodes */
+    size_t numDirections; /**< number of directions of the last evaluate() */
+  };
+
+  /**
+   * @brief Turn a map of directions into one direction per variable.
+   */
+  template <class MT, class ST>
+  std::vector<MT> directionOf(const ComputationGraph<MT, ST>& graph,
+                              const std::map<boost::shared_ptr<MT>, MT>&
+                                directions) {
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    std::vector<MT> result(graph.numVariables());
+    for (int v=0; v<graph.numVariables(); ++v) {
+      const GraphNode<MT, ST>& node = graph.node(graph.variable(v));
+      typename std::map<boost::shared_ptr<MT>, MT>::const_iterator found =
+        directions.find(node.matrixPtr);
+      if (directions.end() == found) {
+        result[v] = MatrixAdaptorType::zeros(node.numRows, node.numCols);
+      } else {
+        MatrixAdaptorType::copy(result[v], found->second);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * @brief Compute the derivative of a recorded matrix function along a
+   * direction.
+   *
+   * @param[in]  root       The recorded matrix function.
+   * @param[in]  directions The direction of each variable, keyed by the
+   *                        matrixPtr of its VAR leaf; missing variables do
+   *                        not move.
+   * @param[out] result     Overwritten with the directional derivative.
+   */
+  template <class MT, class ST>
+  void tangent(const MatrixMatrixFunc<MT, ST>& root,
+               const std::map<boost::shared_ptr<MT>, MT>& directions,
+               MT& result) {
+    ComputationGraph<MT, ST> graph(root);
+    TangentEvaluator<MT, ST> eval(graph);
+    eval.evaluate(std::vector<std::vector<MT> >(1,
+                                                directionOf(graph, directions)));
+    eval.tangent(0, result);
+  }
+
+  /**
+   * @brief Compute the derivative of trace or logdet of a recorded matrix
+   * function along a direction.
+   *
+   * @param[in] root       The recorded matrix function.
+   * @param[in] rootOp     kTraceRoot or kLogdetRoot.
+   * @param[in] directions The direction of each variable, keyed by the
+   *                       matrixPtr of its VAR leaf; missing variables do
+   *                       not move.
+   */
+  template <class MT, class ST>
+  ST directionalDerivative(const MatrixMatrixFunc<MT, ST>& root,
+                           RootOpType rootOp,
+                           const std::map<boost::shared_ptr<MT>, MT>&
+                             directions) {
+    ComputationGraph<MT, ST> graph(root, rootOp);
+    TangentEvaluator<MT, ST> eval(graph);
+    eval.evaluate(std::vector<std::vector<MT> >(1,
+                                                directionOf(graph, directions)));
+    return eval.directionalDerivative(0);
+  }
+
+} /** namespace AMD */
+
+#endif /** AMD_TANGENT_EVALUATOR_HPP */
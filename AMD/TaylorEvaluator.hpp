@@ -0,0 +1,383 @@
+#ifndef AMD_TAYLOR_EVALUATOR_HPP
+#define AMD_TAYLOR_EVALUATOR_HPP
+
+/**
+ * @file TaylorEvaluator.hpp
+ *
+ * @brief This file defines univariate Taylor mode over a ComputationGraph:
+ * the higher directional derivatives of a function along one direction V,
+ * i.e. the derivatives of f(X + t*V) at t = 0. Every node carries the
+ * coefficients F_0 ... F_K of its truncated Taylor polynomial
+ * F(t) = F_0 + F_1*t + ... + F_K*t^K, and one forward sweep propagates
+ * them with the rules
+ *   - linear operators (+, -, negation, scalar, transpose, diag) act on each
+ *     coefficient;
+ *   - L*R and L.*R are Cauchy products, C_j = sum_i L_i*R_(j-i);
+ *   - B = inv(L) has B_0 = inv(L_0) and B_j = -B_0*sum_(i>0) L_i*B_(j-i);
+ *   - logdet(F) has g_(j+1) = trace(sum_i B_i*(j-i+1)*F_(j-i+1))/(j+1)
+ *     with B the series of inv(F), from g'(t) = trace(inv(F)*F');
+ *   - trace(F) has g_j = trace(F_j).
+ * This costs O(K^2) matrix operations per node, instead of the exponential
+ * growth of nesting derivativeFuncVal. Each node also tracks the degree of
+ * its polynomial, so coefficients that are known to be zero (those of the
+ * constants, and those above the degree of a product of polynomials) are
+ * neither computed nor stored. Only the operations of MatrixAdaptor_t are
+ * used, so symbolic matrices get the coefficients as expressions.
+ */
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "boost/shared_ptr.hpp"
+#include "MatrixAdaptor.hpp"
+#include "ComputationGraph.hpp"
+#include "GraphWorkspace.hpp"
+#include "TangentEvaluator.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Evaluate the Taylor coefficients of a graph along one direction
+   * up to a given order with one forward sweep.
+   *
+   * \code
+   * AMD::ComputationGraph<MT, ST> graph(fA + fX, AMD::kLogdetRoot);
+   * AMD::TaylorEvaluator<MT, ST> taylor(graph, 4);
+   * taylor.evaluate(std::vector<MT>(1, V));
+   * std::vector<ST> d;
+   * taylor.derivatives(d); // d[k] is the k'th derivative of
+   *                        // logdet(A + X + t*V) at t = 0
+   * \endcode
+   *
+   * @tparam MT Matrix type.
+   * @tparam ST Scalar type.
+   */
+  template <class MT, class ST>
+  class TaylorEvaluator {
+    public:
+    typedef MatrixAdaptor_t<MT> MatrixAdaptorType;
+    typedef ComputationGraph<MT, ST> GraphType;
+    typedef GraphNode<MT, ST> NodeType;
+    /** One direction per variable of the graph, in variable order */
+    typedef std::vector<MT> DirectionType;
+
+    /**
+     * @brief Create an evaluator. Nothing is computed until evaluate().
+     *
+     * @param[in] graph The graph to differentiate.
+     * @param[in] order The highest derivative K.
+     */
+    TaylorEvaluator(const GraphType& graph, int order) :
+      graph(graph),
+      order(order),
+      coefficients(graph.size()),
+      degrees(graph.size(), 0) {
+      if (0 > order) {
+        throw exception_generic_impl("AMD::TaylorEvaluator",
+                                     "The order has to be non-negative",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+    }
+
+    /**
+     * @brief Get the graph that is differentiated.
+     */
+    const GraphType& getGraph() const { return graph; }
+
+    /**
+     * @brief Get the highest derivative that is computed.
+     */
+    int getOrder() const { return order; }
+
+    /**
+     * @brief Compute the Taylor coefficients of all the nodes along a
+     * direction, at the values of the VAR leaves.
+     *
+     * @param[in] direction direction[v] is the direction of variable v.
+     */
+    void evaluate(const DirectionType& direction) {
+      AMD_START_TRY_BLOCK()
+
+      checkDirection(direction);
+      forwardSweep(graph, std::vector<const MT*>(), ws);
+
+      for (int i=0; i<graph.size(); ++i) {
+        const NodeType& node = graph.node(i);
+        coefficients[i].clear();
+        degrees[i] = 0;
+        if (node.isConst || 0 == order) continue;
+
+        if (node.isLeaf()) {
+          degrees[i] = 1;
+          coefficients[i].resize(2);
+          MatrixAdaptorType::copy(coefficients[i][1],
+                                  direction[node.varIndex]);
+          continue;
+        }
+
+        taylorNode(i);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, TaylorEvaluator::evaluate)
+    }
+
+    /**
+     * @brief Get the value of the root computed by the last evaluate().
+     */
+    const MT& value() const { return *ws.values[graph.root()]; }
+
+    /**
+     * @brief Get the j'th Taylor coefficient of the (matrix valued) root,
+     * i.e. its j'th derivative along the direction divided by j!.
+     *
+     * @param[in]  j      0 <= j <= getOrder().
+     * @param[out] result Overwritten with the coefficient.
+     */
+    void coefficient(int j, MT& result) const {
+      const int root = graph.root();
+      if (0 > j || j > order) {
+        throw exception_generic_impl("AMD::TaylorEvaluator::coefficient",
+                                     "The coefficient is out of range",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      if (j > degrees[root]) {
+        result = MatrixAdaptorType::zeros(graph.node(root).numRows,
+                                          graph.node(root).numCols);
+      } else MatrixAdaptorType::copy(result, coeff(root, j));
+    }
+
+    /**
+     * @brief Get the Taylor coefficients g_0 ... g_K of trace/logdet of the
+     * root along the direction of the last evaluate().
+     *
+     * @param[out] result result[j] is the j'th coefficient.
+     */
+    void scalarCoefficients(std::vector<ST>& result) const {
+      AMD_START_TRY_BLOCK()
+
+      const int root = graph.root();
+      const int degree = degrees[root];
+      result.assign(order+1, ST(0.0));
+      result[0] = rootValue<MT, ST>(graph.rootOp(), value());
+
+      if (kTraceRoot == graph.rootOp()) {
+        for (int j=1; j<=degree; ++j) {
+          result[j] = MatrixAdaptorType::trace(coeff(root, j));
+        }
+      } else if (kLogdetRoot == graph.rootOp() && 0 < degree) {
+        /** The series B of inv(F) up to order K-1, then
+            g_(j+1) = trace(sum_i (j-i+1)*B_i*F_(j-i+1))/(j+1) */
+        std::vector<MT> inverse(order);
+        MatrixAdaptorType::inv(value(), inverse[0]);
+        for (int j=1; j<order; ++j) {
+          inverseCoefficient(root, inverse, j, inverse[j]);
+        }
+
+        MT sum, term, scaled;
+        for (int j=0; j<order; ++j) {
+          bool first = true;
+          for (int i=std::max(0, j+1-degree); i<=j; ++i) {
+            if (j == i) {
+              MatrixAdaptorType::multiply(inverse[i], coeff(root, 1), term);
+            } else {
+              MatrixAdaptorType::multiply(coeff(root, j-i+1),
+                                          ST(static_cast<double>(j-i+1)),
+                                          scaled);
+              MatrixAdaptorType::multiply(inverse[i], scaled, term);
+            }
+            if (first) std::swap(sum, term);
+            else MatrixAdaptorType::add(sum, term, sum);
+            first = false;
+          }
+          result[j+1] = MatrixAdaptorType::trace(sum);
+          if (0 < j) result[j+1] = result[j+1] / ST(static_cast<double>(j+1));
+        }
+      } else if (kLogdetRoot != graph.rootOp()) {
+        throw exception_generic_impl(
+          "AMD::TaylorEvaluator::scalarCoefficients",
+          "The root of the graph is matrix valued",
+          AMD_INVALID_OPERATION);
+      }
+
+      AMD_END_TRY_BLOCK()
+      AMD_CATCH_AND_RETHROW(AMD, TaylorEvaluator::scalarCoefficients)
+    }
+
+    /**
+     * @brief Get the derivatives of trace/logdet of the root along the
+     * direction of the last evaluate(): k! times the coefficients.
+     *
+     * @param[out] result result[k] is the k'th derivative, 0 <= k <= K.
+     */
+    void derivatives(std::vector<ST>& result) const {
+      scalarCoefficients(result);
+      double factorial = 1.0;
+      for (int k=2; k<=order; ++k) {
+        factorial *= k;
+        result[k] = ST(factorial) * result[k];
+      }
+    }
+
+    private:
+    /** Coefficient j of node i; 0 is the value */
+    const MT& coeff(int i, int j) const {
+      return (0 == j) ? *ws.values[i] : coefficients[i][j];
+    }
+
+    /** Coefficient j of a node, or NULL if it is known to be zero */
+    const MT* coeffOrNull(int i, int j) const {
+      return (j > degrees[i]) ? NULL : &coeff(i, j);
+    }
+
+    /**
+     * B_j = -B_0*sum_(i>0) L_i*B_(j-i) for B = inv(L), with the lower
+     * coefficients of B already in inverse.
+     */
+    void inverseCoefficient(int left,
+                            const std::vector<MT>& inverse,
+                            int j,
+                            MT& result) const {
+      MT sum, term;
+      bool first = true;
+      for (int i=1; i<=std::min(j, degrees[left]); ++i) {
+        MatrixAdaptorType::multiply(coeff(left, i), inverse[j-i], term);
+        if (first) std::swap(sum, term);
+        else MatrixAdaptorType::add(sum, term, sum);
+        first = false;
+      }
+      MatrixAdaptorType::multiply(inverse[0], sum, term);
+      MatrixAdaptorType::negation(term, result);
+    }
+
+    /** Propagate the coefficients 1 ... degree of internal node i */
+    void taylorNode(int i) {
+      const NodeType& node = graph.node(i);
+      const int left = node.left;
+      const int right = node.right;
+      const int dl = degrees[left];
+      const int dr = (-1 == right) ? 0 : degrees[right];
+      std::vector<MT>& result = coefficients[i];
+
+      switch (node.opNum) {
+        case PLUS:
+        case MINUS: degrees[i] = std::max(dl, dr); break;
+        case TIMES:
+        case ELEWISE: degrees[i] = std::min(order, dl + dr); break;
+        case INV: degrees[i] = (0 == dl) ? 0 : order; break;
+        default: degrees[i] = dl; break;
+      }
+      result.resize(degrees[i] + 1);
+      /** inverseCoefficient() reads B_0 from result[0] */
+      if (INV == node.opNum && 0 < degrees[i]) {
+        MatrixAdaptorType::copy(result[0], *ws.values[i]);
+      }
+
+      for (int j=1; j<=degrees[i]; ++j) {
+        const MT* l = coeffOrNull(left, j);
+        const MT* r = (-1 == right) ? NULL : coeffOrNull(right, j);
+        switch (node.opNum) {
+          case PLUS:
+            if (NULL != l && NULL != r) MatrixAdaptorType::add(*l, *r,
+                                                               result[j]);
+            else MatrixAdaptorType::copy(result[j], (NULL != l) ? *l : *r);
+            break;
+          case MINUS:
+            if (NULL != l && NULL != r) MatrixAdaptorType::minus(*l, *r,
+                                                                 result[j]);
+            else if (NULL != l) MatrixAdaptorType::copy(result[j], *l);
+            else MatrixAdaptorType::negation(*r, result[j]);
+            break;
+          case NEGATION: MatrixAdaptorType::negation(*l, result[j]); break;
+          case MTIMESS:
+          case STIMESM:
+            MatrixAdaptorType::multiply(*l, node.scalar, result[j]); break;
+          case TRANSPOSE: MatrixAdaptorType::transpose(*l, result[j]); break;
+          case DIAG: MatrixAdaptorType::diag(*l, result[j]); break;
+          case TIMES:
+          case ELEWISE: cauchyProduct(node.opNum, left, right, j, result[j]);
+            break;
+          case INV: inverseCoefficient(left, result, j, result[j]); break;
+          default:
+            throw exception_generic_impl("AMD::TaylorEvaluator",
+                                         "Node is not an internal node",
+                                         AMD_INVALID_OPERATION);
+        }
+      }
+    }
+
+    /** C_j = sum_i L_i*R_(j-i) (or with .*) over the non-zero terms */
+    void cauchyProduct(OpType opNum, int left, int right, int j,
+                       MT& result) const {
+      MT term;
+      bool first = true;
+      const int last = std::min(j, degrees[left]);
+      for (int i=std::max(0, j - degrees[right]); i<=last; ++i) {
+        if (TIMES == opNum) {
+          MatrixAdaptorType::multiply(coeff(left, i), coeff(right, j-i),
+                                      term);
+        } else {
+          MatrixAdaptorType::elementwiseProduct(coeff(left, i),
+                                                coeff(right, j-i), term);
+        }
+        if (first) std::swap(result, term);
+        else MatrixAdaptorType::add(result, term, result);
+        first = false;
+      }
+    }
+
+    void checkDirection(const DirectionType& direction) const {
+      if (static_cast<int>(direction.size()) != graph.numVariables()) {
+        throw exception_generic_impl("AMD::TaylorEvaluator::evaluate",
+                                     "Need one direction per variable",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      for (int v=0; v<graph.numVariables(); ++v) {
+        const NodeType& node = graph.node(graph.variable(v));
+        if (MatrixAdaptorType::getNumRows(direction[v]) != node.numRows ||
+            MatrixAdaptorType::getNumCols(direction[v]) != node.numCols) {
+          throw exception_generic_impl("AMD::TaylorEvaluator::evaluate",
+                                       "Dimensions of a direction don't match",
+                                       AMD_MISMATCHED_DIMENSIONS);
+        }
+      }
+    }
+
+    GraphType graph; /**< the graph that is differentiated */
+    int order; /**< the highest derivative K */
+    GraphWorkspace<MT, ST> ws; /**< values of the nodes */
+    /** coefficients[i][j] is coefficient j > 0 of node i (and B_0 for
+        inverses) */
+    std::vector<std::vector<MT> > coefficients;
+    std::vector<int> degrees; /**< the coefficients above are zero */
+  };
+
+  /**
+   * @brief Compute the first K derivatives of trace or logdet of a recorded
+   * matrix function along a direction.
+   *
+   * @param[in]  root       The recorded matrix function.
+   * @param[in]  rootOp     kTraceRoot or kLogdetRoot.
+   * @param[in]  directions The direction of each variable, keyed by the
+   *                        matrixPtr of its VAR leaf; missing variables do
+   *                        not move.
+   * @param[in]  order      The highest derivative K.
+   * @param[out] result     result[k] is the k'th derivative, 0 <= k <= K.
+   */
+  template <class MT, class ST>
+  void taylorDerivatives(const MatrixMatrixFunc<MT, ST>& root,
+                         RootOpType rootOp,
+                         const std::map<boost::shared_ptr<MT>, MT>&
+                           directions,
+                         int order,
+                         std::vector<ST>& result) {
+    ComputationGraph<MT, ST> graph(root, rootOp);
+    TaylorEvaluator<MT, ST> eval(graph, order);
+    eval.evaluate(directionOf(graph, directions));
+    eval.derivatives(result);
+  }
+
+} /** namespace AMD */
+
+#endif /** AMD_TAYLOR_EVALUATOR_HPP */
@@ -0,0 +1,139 @@
+#ifndef AMD_THREAD_BUDGET_HPP
+#define AMD_THREAD_BUDGET_HPP
+
+/**
+ * @file ThreadBudget.hpp
+ *
+ * @brief This file defines ThreadBudget, the one place where the number of
+ * threads that AMD may use is decided. The budget is split between
+ * graph-level workers (the ThreadPool behind BatchEvaluator and
+ * AsyncEvaluator) and the threads that each worker gives to the kernels
+ * inside one node (Eigen's GEMM, and OpenMP in general, which is also what
+ * Elemental uses in its hybrid MPI/OpenMP mode). Without a budget both
+ * levels size themselves to the whole machine and a batch of n workers runs
+ * n*n threads.
+ *
+ * \code
+ * AMD::ThreadBudget budget(16);
+ * budget.setGraphThreads(4).setPinning(true); // 4 workers x 4 BLAS threads
+ * budget.apply();                             // for the calling thread
+ * AMD::ThreadPool pool(budget);               // the workers apply it too
+ * \endcode
+ */
+
+#include <thread>
+#include "AMD/config.h"
+
+#if AMD_HAVE_EIGEN==1
+  #include <Eigen/Core>
+#endif
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
+#if AMD_LINUX==1
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+namespace AMD {
+
+  /**
+   * @brief A number of threads split into graph-level workers, each of
+   * which runs its kernels with kernelThreads() threads.
+   */
+  class ThreadBudget {
+    public:
+    /**
+     * @brief All the threads go to graph-level workers and every kernel
+     * runs single-threaded.
+     *
+     * @param[in] totalThreads The budget (hardwareThreads() if <= 0).
+     */
+    explicit ThreadBudget(int totalThreads = 0) :
+      total((0 < totalThreads) ? totalThreads : hardwareThreads()),
+      graph(total),
+      pinned(false) {}
+
+    /**
+     * @brief Number of hardware threads, at least 1.
+     */
+    static int hardwareThreads() {
+      const int n = std::thread::hardware_concurrency();
+      return (0 < n) ? n : 1;
+    }
+
+    /**
+     * @brief Set the number of graph-level workers, clamped to [1, total];
+     * each of them gets totalThreads()/graphThreads() kernel threads.
+     */
+    ThreadBudget& setGraphThreads(int numThreads) {
+      graph = (1 > numThreads) ? 1 : (total < numThreads) ? total : numThreads;
+      return *this;
+    }
+
+    /**
+     * @brief Pin the workers to disjoint sets of kernelThreads() CPUs
+     * (only on Linux; elsewhere this is ignored).
+     */
+    ThreadBudget& setPinning(bool enable) {
+      pinned = enable;
+      return *this;
+    }
+
+    int totalThreads() const { return total; }
+
+    int graphThreads() const { return graph; }
+
+    int kernelThreads() const { return total/graph; }
+
+    bool pinning() const { return pinned; }
+
+    /**
+     * @brief Limit the kernels to kernelThreads() threads: Eigen's setting,
+     * which is process-wide, and OpenMP's for the calling thread.
+     */
+    void apply() const {
+#if AMD_HAVE_EIGEN==1
+      Eigen::setNbThreads(kernelThreads());
+#endif
+#ifdef _OPENMP
+      omp_set_num_threads(kernelThreads());
+#endif
+    }
+
+    /**
+     * @brief Set up the calling thread as graph-level worker number worker:
+     * OpenMP's setting is per thread, so limit it here too, and pin the
+     * thread to its CPUs if asked for.
+     */
+    void enterWorker(int worker) const {
+#ifdef _OPENMP
+      omp_set_num_threads(kernelThreads());
+#endif
+      if (pinned) pin(worker);
+    }
+
+    private:
+    void pin(int worker) const {
+#if AMD_LINUX==1 && defined(CPU_SET)
+      const int numCpus = hardwareThreads();
+      const int width = kernelThreads();
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      for (int c=0; c<width; ++c) CPU_SET((worker*width + c) % numCpus, &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+#else
+      (void) worker;
+#endif
+    }
+
+    int total; /**< all the threads */
+    int graph; /**< graph-level workers */
+    bool pinned; /**< pin the workers to their CPUs */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_THREAD_BUDGET_HPP */
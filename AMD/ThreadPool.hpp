@@ -0,0 +1,159 @@
+#ifndef AMD_THREAD_POOL_HPP
+#define AMD_THREAD_POOL_HPP
+
+/**
+ * @file ThreadPool.hpp
+ *
+ * @brief This file defines a fixed-size pool of worker threads that the
+ * evaluators use to run independent pieces of work in parallel.
+ */
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include "ThreadBudget.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief A fixed number of worker threads that execute tasks from a
+   * shared queue. Tasks must not wait for other tasks of the same pool.
+   */
+  class ThreadPool {
+    public:
+    typedef std::function<void()> TaskType;
+
+    /**
+     * @brief Start the worker threads.
+     * @param[in] numThreads Number of workers (defaultNumThreads() if <= 0).
+     */
+    explicit ThreadPool(int numThreads = 0) : stopping(false) {
+      if (0 >= numThreads) numThreads = defaultNumThreads();
+      for (int t=0; t<numThreads; ++t) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+      }
+    }
+
+    /**
+     * @brief Start budget.graphThreads() workers that each run their
+     * kernels with budget.kernelThreads() threads (see ThreadBudget).
+     * @param[in] budget The thread budget; it is applied right away.
+     */
+    explicit ThreadPool(const ThreadBudget& budget) : stopping(false) {
+      budget.apply();
+      for (int t=0; t<budget.graphThreads(); ++t) {
+        workers.push_back(std::thread([this, budget, t]() {
+          budget.enterWorker(t);
+          workerLoop();
+        }));
+      }
+    }
+
+    /**
+     * @brief Finish the tasks in the queue and join the workers.
+     */
+    ~ThreadPool() {
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        stopping = true;
+      }
+      taskReady.notify_all();
+      for (size_t t=0; t<workers.size(); ++t) workers[t].join();
+    }
+
+    /**
+     * @brief Get the number of worker threads.
+     */
+    int size() const { return workers.size(); }
+
+    /**
+     * @brief Number of hardware threads, at least 1.
+     */
+    static int defaultNumThreads() { return ThreadBudget::hardwareThreads(); }
+
+    /**
+     * @brief Queue a task. The task is responsible for its own exceptions.
+     * @param[in] task The task to run on one of the workers.
+     */
+    void submit(const TaskType& task) {
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        tasks.push_back(task);
+      }
+      taskReady.notify_one();
+    }
+
+    /**
+     * @brief Call func(i, slot) for each i in [0,n) and wait until all the
+     * calls are done. The indices are handed out dynamically to at most
+     * size() concurrent runners; slot in [0,size()) identifies the runner,
+     * so it can be used to index per-thread workspaces. The first exception
+     * thrown by func is rethrown in the calling thread once everything has
+     * stopped.
+     *
+     * @param[in] n    Number of indices.
+     * @param[in] func Callable as func(int index, int slot).
+     */
+    template <class FuncType>
+    void parallelFor(int n, FuncType func) {
+      const int numRunners = (n < size()) ? n : size();
+      if (0 >= numRunners) return;
+
+      std::atomic<int> next(0);
+      std::atomic<bool> failed(false);
+      std::exception_ptr error;
+      std::mutex doneMutex;
+      std::condition_variable doneCond;
+      int running = numRunners;
+
+      for (int slot=0; slot<numRunners; ++slot) {
+        submit([&, slot]() {
+          try {
+            for (int i=next++; i<n && false == failed; i=next++) func(i, slot);
+          } catch (...) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            if (false == failed.exchange(true)) error = std::current_exception();
+          }
+          std::unique_lock<std::mutex> lock(doneMutex);
+          if (0 == --running) doneCond.notify_one();
+        });
+      }
+
+      std::unique_lock<std::mutex> lock(doneMutex);
+      while (0 != running) doneCond.wait(lock);
+      if (error) std::rethrow_exception(error);
+    }
+
+    private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void workerLoop() {
+      while (true) {
+        TaskType task;
+        {
+          std::unique_lock<std::mutex> lock(queueMutex);
+          while (false == stopping && tasks.empty()) taskReady.wait(lock);
+          if (tasks.empty()) return;
+          task = tasks.front();
+          tasks.pop_front();
+        }
+        task();
+      }
+    }
+
+    std::vector<std::thread> workers; /**< the worker threads */
+    std::deque<TaskType> tasks; /**< tasks that have not started yet */
+    std::mutex queueMutex; /**< protects tasks and stopping */
+    std::condition_variable taskReady; /**< signalled when a task is queued */
+    bool stopping; /**< set by the destructor */
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_THREAD_POOL_HPP */
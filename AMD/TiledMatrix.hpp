@@ -0,0 +1,889 @@
+#ifndef AMD_TILED_MATRIX_HPP
+#define AMD_TILED_MATRIX_HPP
+
+/**
+ * @file TiledMatrix.hpp
+ *
+ * @brief This file defines TiledMatrix, a dense matrix that lives in a
+ * memory-mapped file on local disk instead of in RAM, and its
+ * MatrixAdaptor_t. Use it as the matrix type when the constant matrices are
+ * larger than the memory: the kernels (GEMM, sums, transposes, elementwise
+ * products, traces) work one tile at a time, and a process-wide TileCache
+ * keeps only the most recently used tiles resident, releasing the others
+ * with madvise(MADV_DONTNEED) and asking the kernel to read the next tiles
+ * of each loop ahead with madvise(MADV_WILLNEED).
+ *
+ * The file holds the matrix as a column-major grid of b x b tiles (b is the
+ * tile size), each stored column-major with leading dimension b in a slot
+ * of b*b entries rounded up to whole pages. Tiles on the last row or column
+ * of the grid are only partly used. TiledMatrix::save() writes this layout,
+ * and TiledMatrix::open() maps it back read-only.
+ *
+ * The results of the kernels go to unlinked scratch files in the
+ * TileSettings scratch directory, which disappear with the matrices. Tiles
+ * of a scratch file that were never written are known to be zero and are
+ * skipped, so products with eye() or zeros() cost no more than a copy.
+ * Copies of a TiledMatrix share the file; the kernels never write to the
+ * file of an operand. inv() and logdet() need the whole matrix in memory,
+ * so they only work on matrices of a single tile.
+ *
+ * \code
+ * typedef AMD::TiledMatrix<double> MT;
+ * MT A = MT::open("A.tiles", n, n);  // 100k x 100k, never loaded
+ * AMD::MatrixMatrixFunc<MT, double> fA(A, true), fX(X, false);
+ * AMD::ScalarMatrixFunc<MT, double> f = AMD::trace(fA*fX);
+ * \endcode
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/shared_ptr.hpp>
+#include <Eigen/Dense>
+#include "MatrixAdaptor.hpp"
+#include "MatrixPool.hpp"
+#include "Exception.hpp"
+
+namespace AMD {
+
+  /**
+   * @brief Settings shared by all tiled matrices: the tile size of new
+   * matrices, where their scratch files go, and how many tiles the kernels
+   * read ahead.
+   */
+  class TileSettings {
+    public:
+    /**
+     * @brief Get the tile size of new matrices (1024 by default).
+     */
+    static int tileSize() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      return data().tileSize;
+    }
+
+    static void setTileSize(int tileSize) {
+      if (0 >= tileSize) {
+        throw exception_generic_impl("AMD::TileSettings::setTileSize",
+                                     "The tile size has to be positive",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      std::lock_guard<std::mutex> lock(data().mutex);
+      data().tileSize = tileSize;
+    }
+
+    /**
+     * @brief Get the directory of the scratch files ($TMPDIR, or /tmp).
+     */
+    static std::string scratchDirectory() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      return data().scratchDirectory;
+    }
+
+    static void setScratchDirectory(const std::string& directory) {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      data().scratchDirectory = directory;
+    }
+
+    /**
+     * @brief Get the number of tiles read ahead (2 by default).
+     */
+    static int prefetchDepth() {
+      std::lock_guard<std::mutex> lock(data().mutex);
+      return data().prefetchDepth;
+    }
+
+    static void setPrefetchDepth(int depth) {
+      if (0 > depth) {
+        throw exception_generic_impl("AMD::TileSettings::setPrefetchDepth",
+                                     "The depth has to be non-negative",
+                                     AMD_INVALID_ARGUMENTS);
+      }
+      std::lock_guard<std::mutex> lock(data().mutex);
+      data().prefetchDepth = depth;
+    }
+
+    private:
+    struct Data {
+      Data() : tileSize(1024), prefetchDepth(2) {
+        const char* tmp = getenv("TMPDIR");
+        scratchDirectory = (NULL == tmp) ? "/tmp" : tmp;
+      }
+
+      std::mutex mutex;
+      int tileSize;
+      int prefetchDepth;
+      std::string scratchDirectory;
+    };
+
+    static Data& data() {
+      static Data settings;
+      return settings;
+    }
+  };
+
+  /**
+   * @brief The tiles of all tiled matrices that are kept in memory, in
+   * least recently used order. When they take more than the capacity, the
+   * oldest ones are released; the file keeps their values, so a released
+   * tile is simply read again when it is used next.
+   */
+  class TileCache {
+    public:
+    static TileCache& instance() {
+      static TileCache cache;
+      return cache;
+    }
+
+    /**
+     * @brief Set the bytes of tiles kept in memory (1 GiB by default).
+     */
+    void setCapacity(std::size_t bytes) {
+      std::lock_guard<std::mutex> lock(mutex);
+      capacityBytes = bytes;
+      evict();
+    }
+
+    std::size_t capacity() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return capacityBytes;
+    }
+
+    /**
+     * @brief Get the bytes of the tiles that are kept in memory.
+     */
+    std::size_t residentBytes() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return resident;
+    }
+
+    /**
+     * @brief Get the number of uses of tiles that were in memory.
+     */
+    std::size_t hits() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return hitCount;
+    }
+
+    /**
+     * @brief Get the number of uses of tiles that had to be read.
+     */
+    std::size_t misses() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return missCount;
+    }
+
+    /**
+     * @brief Record a use of a tile, and release the least recently used
+     * tiles beyond the capacity.
+     *
+     * @param[in] owner   The file that holds the tile.
+     * @param[in] tile    Index of the tile in the file.
+     * @param[in] address First byte of the tile, on a page boundary.
+     * @param[in] bytes   Size of the tile, in whole pages.
+     */
+    void touch(const void* owner,
+               std::size_t tile,
+               void* address,
+               std::size_t bytes) {
+      std::lock_guard<std::mutex> lock(mutex);
+      const KeyType key(owner, tile);
+      IndexType::iterator found = index.find(key);
+      if (index.end() != found) {
+        lru.splice(lru.begin(), lru, found->second);
+        ++hitCount;
+        return;
+      }
+
+      ++missCount;
+      const EntryType entry = {key, address, bytes};
+      lru.push_front(entry);
+      index[key] = lru.begin();
+      resident += bytes;
+      evict();
+    }
+
+    /**
+     * @brief Forget the tiles of a file that is going away.
+     */
+    void forget(const void* owner) {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (ListType::iterator entry = lru.begin(); entry != lru.end();) {
+        if (owner == entry->key.first) {
+          resident -= entry->bytes;
+          index.erase(entry->key);
+          entry = lru.erase(entry);
+        } else ++entry;
+      }
+    }
+
+    private:
+    typedef std::pair<const void*, std::size_t> KeyType;
+    struct EntryType {
+      KeyType key;
+      void* address;
+      std::size_t bytes;
+    };
+    typedef std::list<EntryType> ListType;
+    typedef std::map<KeyType, ListType::iterator> IndexType;
+
+    TileCache() : capacityBytes(std::size_t(1) << 30),
+                  resident(0),
+                  hitCount(0),
+                  missCount(0) {}
+    TileCache(const TileCache&);
+    TileCache& operator=(const TileCache&);
+
+    /** Release the oldest tiles, but never the one just used */
+    void evict() {
+      while (resident > capacityBytes && 1 < lru.size()) {
+        const EntryType& entry = lru.back();
+        madvise(entry.address, entry.bytes, MADV_DONTNEED);
+        resident -= entry.bytes;
+        index.erase(entry.key);
+        lru.pop_back();
+      }
+    }
+
+    mutable std::mutex mutex; /**< guards everything below */
+    std::size_t capacityBytes; /**< bytes of tiles kept in memory */
+    std::size_t resident; /**< bytes of tiles in lru */
+    std::size_t hitCount; /**< uses of tiles in lru */
+    std::size_t missCount; /**< uses of tiles not in lru */
+    ListType lru; /**< the tiles in memory, most recently used first */
+    IndexType index; /**< where each tile is in lru */
+  };
+
+  /**
+   * @brief A file of tiles mapped into memory: either an unlinked scratch
+   * file that starts out as zeros, or an existing file mapped read-only.
+   */
+  template <class T>
+  class TileStore {
+    public:
+    /**
+     * @brief A scratch file of zeros.
+     */
+    TileStore(int rows, int cols, int tileSize) :
+      numRows(rows), numCols(cols), size(tileSize), writable(true) {
+      layout();
+      std::string path = TileSettings::scratchDirectory() +
+                         "/amd-tiles-XXXXXX";
+      std::vector<char> name(path.begin(), path.end());
+      name.push_back('\0');
+      fd = mkstemp(&name[0]);
+      if (0 > fd) {
+        throw exception_generic_impl("AMD::TileStore",
+                                     "Could not create a scratch file",
+                                     AMD_IO_ERROR);
+      }
+      unlink(&name[0]);
+      if (0 != ftruncate(fd, totalBytes)) {
+        close(fd);
+        throw exception_generic_impl("AMD::TileStore",
+                                     "Could not size the scratch file",
+                                     AMD_IO_ERROR);
+      }
+      map(PROT_READ | PROT_WRITE);
+      zero.assign(numTileRows*numTileCols, 1);
+    }
+
+    /**
+     * @brief An existing file in the tiled layout, mapped read-only.
+     */
+    TileStore(const std::string& path, int rows, int cols, int tileSize) :
+      numRows(rows), numCols(cols), size(tileSize), writable(false) {
+      layout();
+      fd = open(path.c_str(), O_RDONLY);
+      if (0 > fd) {
+        throw exception_generic_impl("AMD::TileStore",
+                                     "Could not open the file",
+                                     AMD_IO_ERROR);
+      }
+      struct stat info;
+      if (0 != fstat(fd, &info) ||
+          static_cast<std::size_t>(info.st_size) < totalBytes) {
+        close(fd);
+        throw exception_generic_impl("AMD::TileStore",
+                                     "The file is smaller than the matrix",
+                                     AMD_IO_ERROR);
+      }
+      map(PROT_READ);
+      zero.assign(numTileRows*numTileCols, 0);
+    }
+
+    ~TileStore() {
+      TileCache::instance().forget(this);
+      if (NULL != base) munmap(base, totalBytes);
+      close(fd);
+    }
+
+    int rows() const { return numRows; }
+    int cols() const { return numCols; }
+    int tileSize() const { return size; }
+    int tileRows() const { return numTileRows; }
+    int tileCols() const { return numTileCols; }
+    std::size_t bytes() const { return totalBytes; }
+    std::size_t tileBytes() const { return slotBytes; }
+    bool isWritable() const { return writable; }
+
+    /**
+     * @brief Get the first entry of tile (ti,tj).
+     */
+    T* tileData(int ti, int tj) const {
+      return reinterpret_cast<T*>(base + slotBytes*tileIndex(ti, tj));
+    }
+
+    std::size_t tileIndex(int ti, int tj) const {
+      return ti + static_cast<std::size_t>(tj)*numTileRows;
+    }
+
+    /**
+     * @brief Is tile (ti,tj) known to be zero?
+     */
+    bool isZero(int ti, int tj) const { return zero[tileIndex(ti, tj)]; }
+
+    void setNonZero(int ti, int tj) { zero[tileIndex(ti, tj)] = 0; }
+
+    private:
+    TileStore(const TileStore&);
+    TileStore& operator=(const TileStore&);
+
+    void layout() {
+      if (0 > numRows || 0 > numCols) {
+        throw exception_generic_impl("AMD::TileStore",
+                                     "Invalid dimensions",
+                                     AMD_INVALID_DIMENSIONS);
+      }
+      const std::size_t page = sysconf(_SC_PAGESIZE);
+      numTileRows = (numRows + size - 1)/size;
+      numTileCols = (numCols + size - 1)/size;
+      slotBytes = static_cast<std::size_t>(size)*size*sizeof(T);
+      slotBytes = (slotBytes + page - 1)/page*page;
+      totalBytes = slotBytes*numTileRows*numTileCols;
+      base = NULL;
+    }
+
+    void map(int protection) {
+      if (0 == totalBytes) return;
+      void* address = mmap(NULL, totalBytes, protection, MAP_SHARED, fd, 0);
+      if (MAP_FAILED == address) {
+        close(fd);
+        throw exception_generic_impl("AMD::TileStore",
+                                     "Could not map the file",
+                                     AMD_IO_ERROR);
+      }
+      base = static_cast<char*>(address);
+    }
+
+    int numRows; /**< rows of the matrix */
+    int numCols; /**< columns of the matrix */
+    int size; /**< rows and columns of a tile */
+    int numTileRows; /**< rows of the grid of tiles */
+    int numTileCols; /**< columns of the grid of tiles */
+    std::size_t slotBytes; /**< bytes per tile, in whole pages */
+    std::size_t totalBytes; /**< bytes of the file */
+    bool writable; /**< is this a scratch file */
+    int fd; /**< the file */
+    char* base; /**< where the file is mapped */
+    std::vector<char> zero; /**< which tiles are known to be zero */
+  };
+
+  /**
+   * @brief A dense matrix of T stored tile by tile in a memory-mapped file.
+   */
+  template <class T>
+  class TiledMatrix {
+    public:
+    typedef T value_type;
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> PlainType;
+    typedef Eigen::Map<const PlainType, Eigen::Unaligned, Eigen::OuterStride<> >
+      ConstTileType;
+    typedef Eigen::Map<PlainType, Eigen::Unaligned, Eigen::OuterStride<> >
+      TileType;
+
+    /**
+     * @brief An empty matrix.
+     */
+    TiledMatrix() {}
+
+    /**
+     * @brief A rows x cols matrix of zeros in a scratch file.
+     *
+     * @param[in] tileSize The tile size, or 0 for TileSettings::tileSize().
+     */
+    TiledMatrix(int rows, int cols, int tileSize=0) :
+      store(new TileStore<T>(rows, cols, (0 >= tileSize) ?
+                                         TileSettings::tileSize() :
+                                         tileSize)) {}
+
+    /**
+     * @brief A matrix in a scratch file with the value of an Eigen
+     * expression, which has to fit in memory.
+     */
+    template <class Derived>
+    TiledMatrix(const Eigen::MatrixBase<Derived>& other) :
+      store(new TileStore<T>(other.rows(), other.cols(),
+                             TileSettings::tileSize())) {
+      const PlainType value(other);
+      for (int tj=0; tj<tileCols(); ++tj) {
+        for (int ti=0; ti<tileRows(); ++ti) {
+          writeTile(ti, tj, value.block(ti*tileSize(), tj*tileSize(),
+                                        tileHeight(ti), tileWidth(tj)));
+        }
+      }
+    }
+
+    /**
+     * @brief Map a file written in the tiled layout, read-only. The file
+     * is never loaded as a whole.
+     */
+    static TiledMatrix open(const std::string& path,
+                            int rows,
+                            int cols,
+                            int tileSize=0) {
+      TiledMatrix A;
+      A.store.reset(new TileStore<T>(path, rows, cols, (0 >= tileSize) ?
+                                     TileSettings::tileSize() : tileSize));
+      return A;
+    }
+
+    /**
+     * @brief Write the matrix to a file in the tiled layout; tiles that are
+     * known to be zero are left as holes.
+     */
+    void save(const std::string& path) const {
+      const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      bool written = (0 <= fd) && (!store ||
+                     0 == ftruncate(fd, store->bytes()));
+      for (int tj=0; written && tj<tileCols(); ++tj) {
+        for (int ti=0; written && ti<tileRows(); ++ti) {
+          if (isZeroTile(ti, tj)) continue;
+          const std::size_t bytes = store->tileBytes();
+          written = (static_cast<ssize_t>(bytes) ==
+                     pwrite(fd, store->tileData(ti, tj), bytes,
+                            store->tileIndex(ti, tj)*bytes));
+        }
+      }
+      if (0 <= fd) close(fd);
+      if (!written) {
+        throw exception_generic_impl("AMD::TiledMatrix::save",
+                                     "Could not write the file",
+                                     AMD_IO_ERROR);
+      }
+    }
+
+    int rows() const { return store ? store->rows() : 0; }
+    int cols() const { return store ? store->cols() : 0; }
+    int tileSize() const {
+      return store ? store->tileSize() : TileSettings::tileSize();
+    }
+
+    /**
+     * @brief Get the number of rows of tiles.
+     */
+    int tileRows() const { return store ? store->tileRows() : 0; }
+
+    /**
+     * @brief Get the number of columns of tiles.
+     */
+    int tileCols() const { return store ? store->tileCols() : 0; }
+
+    /**
+     * @brief Get the number of rows of the tiles on row ti of the grid.
+     */
+    int tileHeight(int ti) const {
+      return std::min(tileSize(), rows() - ti*tileSize());
+    }
+
+    /**
+     * @brief Get the number of columns of the tiles on column tj of the
+     * grid.
+     */
+    int tileWidth(int tj) const {
+      return std::min(tileSize(), cols() - tj*tileSize());
+    }
+
+    /**
+     * @brief Is tile (ti,tj) known to be zero? Such tiles need not be read.
+     */
+    bool isZeroTile(int ti, int tj) const { return store->isZero(ti, tj); }
+
+    /**
+     * @brief Get tile (ti,tj), and mark it as used in the TileCache.
+     */
+    ConstTileType tile(int ti, int tj) const {
+      touch(ti, tj);
+      return ConstTileType(store->tileData(ti, tj),
+                           tileHeight(ti), tileWidth(tj),
+                           Eigen::OuterStride<>(tileSize()));
+    }
+
+    /**
+     * @brief Ask the kernel to read tile (ti,tj) ahead; tiles outside the
+     * grid, or known to be zero, are ignored.
+     */
+    void prefetch(int ti, int tj) const {
+      if (0 > ti || ti >= tileRows() || 0 > tj || tj >= tileCols()) return;
+      if (isZeroTile(ti, tj)) return;
+      madvise(store->tileData(ti, tj), store->tileBytes(), MADV_WILLNEED);
+    }
+
+    /**
+     * @brief Set tile (ti,tj). This writes to the file that all the copies
+     * of this matrix share, so it is meant for filling a new matrix.
+     */
+    template <class Derived>
+    void writeTile(int ti, int tj, const Eigen::MatrixBase<Derived>& value) {
+      if (!store->isWritable()) {
+        throw exception_generic_impl("AMD::TiledMatrix::writeTile",
+                                     "The matrix is read-only",
+                                     AMD_INVALID_OPERATION);
+      }
+      touch(ti, tj);
+      TileType(store->tileData(ti, tj), tileHeight(ti), tileWidth(tj),
+               Eigen::OuterStride<>(tileSize())) = value;
+      store->setNonZero(ti, tj);
+    }
+
+    /**
+     * @brief Get the matrix as a plain Eigen matrix, which has to fit in
+     * memory.
+     */
+    PlainType toPlain() const {
+      PlainType value = PlainType::Zero(rows(), cols());
+      for (int tj=0; tj<tileCols(); ++tj) {
+        for (int ti=0; ti<tileRows(); ++ti) {
+          if (isZeroTile(ti, tj)) continue;
+          value.block(ti*tileSize(), tj*tileSize(),
+                      tileHeight(ti), tileWidth(tj)) = tile(ti, tj);
+        }
+      }
+      return value;
+    }
+
+    private:
+    void touch(int ti, int tj) const {
+      TileCache::instance().touch(store.get(), store->tileIndex(ti, tj),
+                                  store->tileData(ti, tj),
+                                  store->tileBytes());
+    }
+
+    boost::shared_ptr<TileStore<T> > store; /**< the file, shared by copies */
+  };
+
+  /**
+   * @brief Tiled matrices are files, so they are never pooled.
+   */
+  template <class T>
+  struct AllocationPolicy_t<TiledMatrix<T> > :
+    public HeapAllocationPolicy<TiledMatrix<T> > {};
+
+  template <typename T>
+  struct MatrixAdaptor_t<TiledMatrix<T> > {
+    typedef T value_type;
+    typedef TiledMatrix<T> matrix_type;
+    typedef typename matrix_type::PlainType plain_type;
+
+    static boost::shared_ptr<matrix_type> defaultConstructMatrix
+                  (int m, int n, std::string name="") {
+      return AllocationPolicy_t<matrix_type>::construct(m, n);
+    }
+
+    static boost::shared_ptr<matrix_type> copyConstructMatrix
+                          (const matrix_type& original) {
+      return AllocationPolicy_t<matrix_type>::copy(original);
+    }
+
+    /**
+     * 1.
+     * @brief Get the number of rows.
+     */
+    static int getNumRows (const matrix_type& A) { return A.rows(); }
+
+    /**
+     * 2.
+     * @brief Get the number of columns.
+     */
+    static int getNumCols (const matrix_type& A) { return A.cols(); }
+
+    /**
+     * 3.
+     * @brief C = A + B, tile by tile.
+     */
+    static void add (const matrix_type& A,
+                     const matrix_type& B,
+                     matrix_type& C) {
+      checkSameShape("AMD::MatrixAdaptor_t::add", A, B);
+      matrix_type result(A.rows(), A.cols(), A.tileSize());
+      for (int tj=0; tj<A.tileCols(); ++tj) {
+        for (int ti=0; ti<A.tileRows(); ++ti) {
+          prefetchAhead(A, ti, tj);
+          prefetchAhead(B, ti, tj);
+          const bool zeroA = A.isZeroTile(ti, tj);
+          const bool zeroB = B.isZeroTile(ti, tj);
+          if (zeroA && zeroB) continue;
+          else if (zeroA) result.writeTile(ti, tj, B.tile(ti, tj));
+          else if (zeroB) result.writeTile(ti, tj, A.tile(ti, tj));
+          else result.writeTile(ti, tj, A.tile(ti, tj) + B.tile(ti, tj));
+        }
+      }
+      C = result;
+    }
+
+    /**
+     * 4.
+     * @brief C = A - B, tile by tile.
+     */
+    static void minus (const matrix_type& A,
+                       const matrix_type& B,
+                       matrix_type& C) {
+      checkSameShape("AMD::MatrixAdaptor_t::minus", A, B);
+      matrix_type result(A.rows(), A.cols(), A.tileSize());
+      for (int tj=0; tj<A.tileCols(); ++tj) {
+        for (int ti=0; ti<A.tileRows(); ++ti) {
+          prefetchAhead(A, ti, tj);
+          prefetchAhead(B, ti, tj);
+          const bool zeroA = A.isZeroTile(ti, tj);
+          const bool zeroB = B.isZeroTile(ti, tj);
+          if (zeroA && zeroB) continue;
+          else if (zeroA) result.writeTile(ti, tj, -B.tile(ti, tj));
+          else if (zeroB) result.writeTile(ti, tj, A.tile(ti, tj));
+          else result.writeTile(ti, tj, A.tile(ti, tj) - B.tile(ti, tj));
+        }
+      }
+      C = result;
+    }
+
+    /**
+     * 5.
+     * @brief C = A * B: each tile of C accumulates the products of a row of
+     * tiles of A with a column of tiles of B in memory, reading the next
+     * tiles of both ahead and skipping the pairs with a zero tile.
+     */
+    static void multiply (const matrix_type& A,
+                          const matrix_type& B,
+                          matrix_type& C) {
+      if (A.cols() != B.rows() || A.tileSize() != B.tileSize()) {
+        throw exception_generic_impl("AMD::MatrixAdaptor_t::multiply",
+                                     "The matrices or tiles do not match",
+                                     AMD_MISMATCHED_DIMENSIONS);
+      }
+      const int depth = TileSettings::prefetchDepth();
+      matrix_type result(A.rows(), B.cols(), A.tileSize());
+      plain_type accumulator;
+      for (int tj=0; tj<B.tileCols(); ++tj) {
+        for (int ti=0; ti<A.tileRows(); ++ti) {
+          bool nonZero = false;
+          for (int tk=0; tk<A.tileCols(); ++tk) {
+            for (int d=(0 == tk) ? 1 : depth; d<=depth; ++d) {
+              A.prefetch(ti, tk+d);
+              B.prefetch(tk+d, tj);
+            }
+            if (A.isZeroTile(ti, tk) || B.isZeroTile(tk, tj)) continue;
+            if (!nonZero) {
+              accumulator.setZero(A.tileHeight(ti), B.tileWidth(tj));
+              nonZero = true;
+            }
+            accumulator.noalias() += A.tile(ti, tk) * B.tile(tk, tj);
+          }
+          if (nonZero) result.writeTile(ti, tj, accumulator);
+        }
+      }
+      C = result;
+    }
+
+    /**
+     * 6.
+     * @brief B = A^T, tile by tile.
+     */
+    static void transpose (const matrix_type& A,
+                           matrix_type& B) {
+      matrix_type result(A.cols(), A.rows(), A.tileSize());
+      for (int tj=0; tj<A.tileCols(); ++tj) {
+        for (int ti=0; ti<A.tileRows(); ++ti) {
+          prefetchAhead(A, ti, tj);
+          if (A.isZeroTile(ti, tj)) continue;
+          result.writeTile(tj, ti, A.tile(ti, tj).transpose());
+        }
+      }
+      B = result;
+    }
+
+    /**
+     * 7.
+     * @brief B = -A, tile by tile.
+     */
+    static void negation (const matrix_type& A,
+                          matrix_type& B) {
+      multiply(A, value_type(-1), B);
+    }
+
+    /**
+     * 8.
+     * @brief B = inv(A); A has to be a single tile.
+     */
+    static void inv (const matrix_type& A,
+                     matrix_type& B) {
+      B = plain_type(inMemory("AMD::MatrixAdaptor_t::inv", A).inverse());
+    }
+
+    /**
+     * 9.
+     * @brief Compute the trace from the diagonal tiles.
+     */
+    static value_type trace (const matrix_type& A) {
+      value_type trace_val = 0.0;
+      const int n = std::min(A.tileRows(), A.tileCols());
+      for (int t=0; t<n; ++t) {
+        A.prefetch(t+1, t+1);
+        if (!A.isZeroTile(t, t)) trace_val += A.tile(t, t).trace();
+      }
+      return trace_val;
+    }
+
+    /**
+     * 10.
+     * @brief Create an identity matrix; only its diagonal tiles are written.
+     */
+    static matrix_type eye (int n) {
+      matrix_type result(n, n);
+      for (int t=0; t<result.tileRows(); ++t) {
+        result.writeTile(t, t, plain_type::Identity(result.tileHeight(t),
+                                                    result.tileWidth(t)));
+      }
+      return result;
+    }
+
+    /**
+     * 11.
+     * @brief Create a zero matrix; no tile is written.
+     */
+    static matrix_type zeros (int m, int n) { return matrix_type(m, n); }
+
+    /**
+     * 12.
+     * @brief Compute the logdet; A has to be a single tile.
+     */
+    static value_type logdet (const matrix_type& A) {
+      const plain_type value = inMemory("AMD::MatrixAdaptor_t::logdet", A);
+      Eigen::LLT<plain_type> cholesky(value);
+      const plain_type& L = cholesky.matrixLLT();
+      value_type log_trace = 0.0;
+      for (int i=0; i<L.rows(); ++i) log_trace += std::log(L(i,i));
+      return 2.0*log_trace;
+    }
+
+    /**
+     * 13.
+     * @brief Copy B into A; both share the file.
+     */
+    static void copy (matrix_type& A, const matrix_type& B) { A = B; }
+
+    /**
+     * 14.
+     * @brief Print a matrix, which has to fit in memory.
+     */
+    static void print (const matrix_type& A,
+                       std::ostream& os=std::cout) {
+      os << A.toPlain();
+    }
+
+    /**
+     * 15.
+     * @brief B is the diagonal of A.
+     */
+    static void diag (const matrix_type& A,
+                      matrix_type& B) {
+      matrix_type result(A.rows(), A.cols(), A.tileSize());
+      const int n = std::min(A.tileRows(), A.tileCols());
+      for (int t=0; t<n; ++t) {
+        A.prefetch(t+1, t+1);
+        if (A.isZeroTile(t, t)) continue;
+        result.writeTile(t, t, plain_type(A.tile(t, t).diagonal().
+                                                       asDiagonal()));
+      }
+      B = result;
+    }
+
+    /**
+     * 16.
+     * @brief C = A .* B, tile by tile.
+     */
+    static void elementwiseProduct (const matrix_type& A,
+                                    const matrix_type& B,
+                                    matrix_type& C) {
+      checkSameShape("AMD::MatrixAdaptor_t::elementwiseProduct", A, B);
+      matrix_type result(A.rows(), A.cols(), A.tileSize());
+      for (int tj=0; tj<A.tileCols(); ++tj) {
+        for (int ti=0; ti<A.tileRows(); ++ti) {
+          prefetchAhead(A, ti, tj);
+          prefetchAhead(B, ti, tj);
+          if (A.isZeroTile(ti, tj) || B.isZeroTile(ti, tj)) continue;
+          result.writeTile(ti, tj, A.tile(ti, tj).cwiseProduct(B.tile(ti, tj)));
+        }
+      }
+      C = result;
+    }
+
+    /**
+     * 17.
+     * @brief B = a * A, tile by tile.
+     */
+    static void multiply (const matrix_type& A,
+                          const value_type& a,
+                          matrix_type& B) {
+      matrix_type result(A.rows(), A.cols(), A.tileSize());
+      for (int tj=0; tj<A.tileCols(); ++tj) {
+        for (int ti=0; ti<A.tileRows(); ++ti) {
+          prefetchAhead(A, ti, tj);
+          if (A.isZeroTile(ti, tj)) continue;
+          result.writeTile(ti, tj, a * A.tile(ti, tj));
+        }
+      }
+      B = result;
+    }
+
+    private:
+    static void checkSameShape (const char* function,
+                                const matrix_type& A,
+                                const matrix_type& B) {
+      if (A.rows() != B.rows() || A.cols() != B.cols() ||
+          A.tileSize() != B.tileSize()) {
+        throw exception_generic_impl(function,
+                                     "The matrices or tiles do not match",
+                                     AMD_MISMATCHED_DIMENSIONS);
+      }
+    }
+
+    /** Read the tile that a column-major walk reaches depth tiles later */
+    static void prefetchAhead (const matrix_type& A, int ti, int tj) {
+      const int depth = TileSettings::prefetchDepth();
+      if (0 == depth) return;
+      const int next = ti + depth;
+      A.prefetch(next % A.tileRows(), tj + next/A.tileRows());
+    }
+
+    static plain_type inMemory (const char* function,
+                                const matrix_type& A) {
+      if (1 < A.tileRows() || 1 < A.tileCols()) {
+        throw exception_generic_impl(function,
+                                     "Only supported for a single tile",
+                                     AMD_INVALID_OPERATION);
+      }
+      return A.toPlain();
+    }
+  };
+
+} /** namespace AMD */
+
+#endif /** AMD_TILED_MATRIX_HPP */
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <assert.h>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::BatchEvaluator<matrix_type, value_type> batch_type;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Evaluate logdet(A + X^T*X) and its gradient for N independent instances of
+ * X with 1, 2, 4, ... threads and report the throughput.
+ *
+ * Usage: BenchBatchEvaluator [n=64] [instances=512] [maxThreads=#cores]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  const int n = (1 < argc) ? atoi(argv[1]) : 64;
+  const int N = (2 < argc) ? atoi(argv[2]) : 512;
+  const int maxThreads = (3 < argc) ? atoi(argv[3]) :
+                                      AMD::ThreadPool::defaultNumThreads();
+
+  matrix_type A = matrix_type::Identity(n,n) * n;
+  MMFunc fA(A, true);
+  MMFunc fX(matrix_type::Random(n,n), false);
+  graph_type graph(fA + transpose(fX)*fX, AMD::kLogdetRoot);
+
+  std::vector<std::vector<matrix_type> > bindings(N);
+  for (int k=0; k<N; ++k) {
+    bindings[k].push_back(matrix_type::Random(n,n));
+  }
+
+  std::vector<value_type> reference;
+  double serialTime = 0.0;
+  for (int threads=1; threads<=maxThreads; threads*=2) {
+    AMD::ThreadPool pool(threads);
+    batch_type batch(graph, pool);
+    std::vector<value_type> values;
+    std::vector<std::vector<matrix_type> > grads;
+
+    /** Warm up the workspaces */
+    batch.evaluate(bindings, values, &grads);
+
+    clock_type::time_point start = clock_type::now();
+    batch.evaluate(bindings, values, &grads);
+    const double time = seconds(start);
+
+    if (1 == threads) {
+      serialTime = time;
+      reference = values;
+    }
+    for (int k=0; k<N; ++k) assert (values[k] == reference[k]);
+
+    std::cout << "threads=" << threads
+              << " time=" << time << " s"
+              << " instances/s=" << N/time
+              << " speedup=" << serialTime/time << std::endl;
+  }
+
+  return(0);
+}
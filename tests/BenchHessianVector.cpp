@@ -0,0 +1,79 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <assert.h>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Hessian-vector products of f(X) = logdet(A + X'*B*X) computed
+ *   (1) by differentiating the derivative graph: the gradient of
+ *       trace(V' * derivativeFuncVal) is H[V], and
+ *   (2) by ScalarMatrixFunc::hessianVectorProduct (forward-over-reverse).
+ * The time of one gradient (logdet()) is reported for reference.
+ *
+ * Usage: BenchHessianVector [n=50] [products=10]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  const int n = (1 < argc) ? atoi(argv[1]) : 50;
+  const int products = (2 < argc) ? atoi(argv[2]) : 10;
+
+  matrix_type A = matrix_type::Identity(n,n) * n;
+  matrix_type B = matrix_type::Random(n,n);
+  B = B*B.transpose();
+  MMFunc fA(A, true);
+  MMFunc fB(B, true);
+  MMFunc fX(matrix_type::Random(n,n), false);
+  matrix_type V = matrix_type::Random(n,n);
+  MMFunc fV(V, true);
+
+  /** One gradient, which also records the derivative graph */
+  clock_type::time_point start = clock_type::now();
+  SMFunc f = AMD::logdet(fA + transpose(fX)*fB*fX);
+  const double gradientTime = seconds(start);
+
+  matrix_type viaDerivative;
+  start = clock_type::now();
+  for (int p=0; p<products; ++p) {
+    viaDerivative = AMD::trace(transpose(fV) * (*f.derivativeFuncVal))
+                      .derivativeVal;
+  }
+  const double derivativeTime = seconds(start)/products;
+
+  matrix_type viaForwardOverReverse;
+  start = clock_type::now();
+  for (int p=0; p<products; ++p) {
+    f.hessianVectorProduct(V, viaForwardOverReverse);
+  }
+  const double forwardOverReverseTime = seconds(start)/products;
+
+  const double difference = (viaDerivative - viaForwardOverReverse).norm() /
+                            viaForwardOverReverse.norm();
+
+  std::cout << "n=" << n << std::endl;
+  std::cout << "gradient (logdet):           " << gradientTime << " s"
+            << std::endl;
+  std::cout << "H[V] via derivativeFuncVal:  " << derivativeTime << " s"
+            << std::endl;
+  std::cout << "H[V] via forward-over-reverse: " << forwardOverReverseTime
+            << " s (" << forwardOverReverseTime/gradientTime
+            << " gradients)" << std::endl;
+  std::cout << "relative difference: " << difference << std::endl;
+  assert (difference < 1e-8);
+
+  return(0);
+}
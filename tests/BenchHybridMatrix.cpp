@@ -0,0 +1,90 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+typedef Eigen::MatrixXd dense_type;
+typedef Eigen::SparseMatrix<double> sparse_type;
+typedef AMD::HybridMatrix<double> hybrid_type;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Sweep the density of the sparse constants S and T, and evaluate
+ * trace(S*T*X) and its gradient with dense matrices, with hybrid matrices
+ * that keep every sparse-sparse result sparse, and with hybrid matrices
+ * that choose the representation of each node by its density. S*T fills
+ * in, so the sparse representation stops paying somewhere in the sweep.
+ *
+ * Usage: BenchHybridMatrix [n=400] [repeats=5]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/** A random n x n matrix with about density*n*n non-zeros */
+sparse_type randomSparse (int n, double density) {
+  dense_type A = dense_type::Random(n,n);
+  for (int j=0; j<n; ++j)
+    for (int i=0; i<n; ++i)
+      if (std::abs(A(i,j)) > density) A(i,j) = 0.0;
+  return A.sparseView();
+}
+
+/** Time the evaluations at X of one matrix type */
+template <class MT>
+double timeMode (const MT& S, const MT& T, const MT& X, int repeats) {
+  AMD::MatrixMatrixFunc<MT, double> fS(S, true);
+  AMD::MatrixMatrixFunc<MT, double> fT(T, true);
+  AMD::MatrixMatrixFunc<MT, double> fX(X, false);
+  AMD::ComputationGraph<MT, double> graph(fS*fT*fX, AMD::kTraceRoot);
+  const AMD::SharedEvaluator<MT, double> shared(graph);
+  AMD::GraphWorkspace<MT, double> ws;
+  std::vector<MT> point(1, X);
+  std::vector<MT> gradient;
+
+  /** Warm up the workspace */
+  shared.evaluate(point, ws, &gradient);
+
+  clock_type::time_point start = clock_type::now();
+  for (int r=0; r<repeats; ++r) shared.evaluate(point, ws, &gradient);
+  return seconds(start)/repeats;
+}
+
+int main(int argc, char** argv) {
+  const int n = (1 < argc) ? atoi(argv[1]) : 400;
+  const int repeats = (2 < argc) ? atoi(argv[2]) : 5;
+  const double densities[] = {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1,
+                              0.2, 0.5};
+  const double threshold = AMD::DensityThreshold::get();
+
+  const dense_type X = dense_type::Random(n,n);
+  for (int d=0; d<9; ++d) {
+    const sparse_type S = randomSparse(n, densities[d]);
+    const sparse_type T = randomSparse(n, densities[d]);
+
+    const double denseTime = timeMode(dense_type(S), dense_type(T), X,
+                                      repeats);
+
+    AMD::DensityThreshold::set(1.0);
+    const double sparseTime = timeMode(hybrid_type(S), hybrid_type(T),
+                                       hybrid_type(X), repeats);
+
+    AMD::DensityThreshold::set(threshold);
+    const double autoTime = timeMode(hybrid_type(S), hybrid_type(T),
+                                     hybrid_type(X), repeats);
+
+    std::cout << "density=" << densities[d]
+              << " dense=" << denseTime << " s"
+              << " sparse=" << sparseTime << " s"
+              << " auto=" << autoTime << " s"
+              << std::endl;
+  }
+
+  return(0);
+}
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <assert.h>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::IncrementalEvaluator<matrix_type, value_type> evaluator_type;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Block-coordinate descent on f = trace(sum_j inv(A_j + X_j)*C_j), where
+ * only one X_j changes per step. We compare re-recording the tree and
+ * calling trace() for each step against an IncrementalEvaluator that only
+ * recomputes the branch of the block that changed.
+ *
+ * Usage: BenchIncrementalEvaluator [n=100] [blocks=8] [steps=32]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+matrix_type random_matrix (int n) {
+  matrix_type A = matrix_type::Random(n,n);
+  A += n * matrix_type::Identity(n,n);
+  return A;
+}
+
+/** Record sum_{i>=j} inv(A_i + X_i)*C_i */
+MMFunc build (const std::vector<MMFunc*>& A,
+              const std::vector<MMFunc*>& X,
+              const std::vector<MMFunc*>& C,
+              size_t j) {
+  if (A.size() == j+1) return inv(*A[j] + *X[j]) * (*C[j]);
+  return inv(*A[j] + *X[j]) * (*C[j]) + build(A, X, C, j+1);
+}
+
+int main(int argc, char** argv) {
+  const int n = (1 < argc) ? atoi(argv[1]) : 100;
+  const int k = (2 < argc) ? atoi(argv[2]) : 8;
+  const int steps = (3 < argc) ? atoi(argv[3]) : 32;
+
+  std::vector<MMFunc*> A, X, C;
+  for (int j=0; j<k; ++j) {
+    A.push_back(new MMFunc(random_matrix(n), true));
+    X.push_back(new MMFunc(random_matrix(n), false));
+    C.push_back(new MMFunc(random_matrix(n), true));
+  }
+
+  std::vector<matrix_type> updates;
+  for (int s=0; s<steps; ++s) updates.push_back(random_matrix(n));
+
+  std::vector<matrix_type> initial;
+  for (int j=0; j<k; ++j) initial.push_back(*X[j]->matrixPtr);
+
+  /** 1. Record the tree again and run the full sweep for each step */
+  matrix_type fullGrad;
+  clock_type::time_point start = clock_type::now();
+  for (int s=0; s<steps; ++s) {
+    X[s%k]->updateValue(updates[s]);
+    fullGrad = AMD::trace(build(A, X, C, 0)).derivativeVal;
+  }
+  const double fullTime = seconds(start);
+
+  /** 2. Record once from the same starting point, then re-evaluate */
+  for (int j=0; j<k; ++j) X[j]->updateValue(initial[j]);
+  graph_type graph(build(A, X, C, 0), AMD::kTraceRoot);
+  evaluator_type eval(graph);
+  matrix_type incGrad;
+  eval.gradient(incGrad);
+
+  long nodes = 0, adjoints = 0;
+  start = clock_type::now();
+  for (int s=0; s<steps; ++s) {
+    X[s%k]->updateValue(updates[s]);
+    eval.gradient(incGrad);
+    nodes += eval.numNodesEvaluated();
+    adjoints += eval.numAdjointsEvaluated();
+  }
+  const double incTime = seconds(start);
+
+  /** Both runs end at the same point */
+  const double error = (incGrad - fullGrad).norm() / fullGrad.norm();
+  assert (error < 1e-9);
+
+  std::cout << "n=" << n << " blocks=" << k << " steps=" << steps
+            << " graph nodes=" << graph.size() << std::endl;
+  std::cout << "full re-recording: " << fullTime << " s" << std::endl;
+  std::cout << "incremental:       " << incTime << " s ("
+            << (double)nodes/steps << " nodes and "
+            << (double)adjoints/steps << " partial adjoints per step)"
+            << std::endl;
+  std::cout << "speedup:           " << fullTime/incTime << std::endl;
+  std::cout << "relative gradient difference: " << error << std::endl;
+
+  for (int j=0; j<k; ++j) { delete A[j]; delete X[j]; delete C[j]; }
+
+  return(0);
+}
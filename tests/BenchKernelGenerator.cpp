@@ -0,0 +1,86 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::MatrixXd matrix_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, double> MMFunc;
+typedef AMD::ComputationGraph<matrix_type, double> graph_type;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Evaluate logdet(A + X^T*X) and trace(A*inv(X)*B + X*X) and their
+ * gradients with the interpreted graph (SharedEvaluator) and with the
+ * compiled kernel, for small and medium sizes, and report the time per
+ * evaluation, the time to build the kernel and the relative error of the
+ * gradient.
+ *
+ * Usage: BenchKernelGenerator [repeats=10000]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+void bench (const char* name, const graph_type& graph, int repeats) {
+  const matrix_type& X = *graph.node(graph.variable(0)).matrixPtr;
+  std::vector<matrix_type> point(1, X);
+  std::vector<matrix_type> interpretedGradient, compiledGradient;
+
+  const AMD::SharedEvaluator<matrix_type, double> shared(graph);
+  AMD::GraphWorkspace<matrix_type, double> ws;
+  shared.evaluate(point, ws, &interpretedGradient);
+  clock_type::time_point start = clock_type::now();
+  for (int r=0; r<repeats; ++r) {
+    shared.evaluate(point, ws, &interpretedGradient);
+  }
+  const double interpretedTime = seconds(start)/repeats;
+
+  start = clock_type::now();
+  const AMD::CompiledKernel<matrix_type, double> kernel(graph);
+  const double buildTime = seconds(start);
+  kernel.evaluate(point, &compiledGradient);
+  start = clock_type::now();
+  for (int r=0; r<repeats; ++r) kernel.evaluate(point, &compiledGradient);
+  const double compiledTime = seconds(start)/repeats;
+
+  std::cout << name << " n=" << X.rows()
+            << " interpreted=" << interpretedTime << " s"
+            << " compiled=" << compiledTime << " s"
+            << " speedup=" << interpretedTime/compiledTime
+            << " build=" << buildTime << " s"
+            << " gradient error="
+            << (compiledGradient[0] - interpretedGradient[0]).norm() /
+               interpretedGradient[0].norm()
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  const int repeats = (1 < argc) ? atoi(argv[1]) : 10000;
+  const int sizes[] = {3, 4, 16, 64};
+
+  for (int s=0; s<4; ++s) {
+    const int n = sizes[s];
+    const matrix_type A = *(AMD::rand_psd_t<matrix_type>::apply(n, 1));
+    const matrix_type B = matrix_type::Random(n,n);
+    const matrix_type X = matrix_type::Random(n,n) +
+                          n*matrix_type::Identity(n,n);
+    MMFunc fA(A, true);
+    MMFunc fB(B, true);
+    MMFunc fX(X, false);
+
+    /** Fewer repeats as the matrices grow */
+    const int scaled = std::max(1, repeats/(n*n/9 + 1));
+    bench("logdet", graph_type(fA + transpose(fX)*fX, AMD::kLogdetRoot),
+          scaled);
+    bench("trace ", graph_type(fA*inv(fX)*fB + fX*fX, AMD::kTraceRoot),
+          scaled);
+  }
+
+  return(0);
+}
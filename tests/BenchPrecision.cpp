@@ -0,0 +1,104 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::MatrixXd double_matrix_type;
+typedef Eigen::MatrixXf float_matrix_type;
+typedef AMD::MixedPrecisionMatrix<double, float> mixed_matrix_type;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Evaluate logdet(A + X^T*X) and its gradient with double, float and mixed
+ * (double storage, float GEMMs) matrices, and report the time per
+ * evaluation and the relative errors of the value and of the gradient
+ * against double.
+ *
+ * Usage: BenchPrecision [n=256] [repeats=10]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/** Time the evaluations at X of one matrix type */
+template <class MT, class ST>
+double timeMode (const MT& A,
+                 const MT& X,
+                 int repeats,
+                 ST& value,
+                 MT& gradient) {
+  AMD::MatrixMatrixFunc<MT, ST> fA(A, true);
+  AMD::MatrixMatrixFunc<MT, ST> fX(X, false);
+  AMD::ComputationGraph<MT, ST> graph(fA + transpose(fX)*fX,
+                                      AMD::kLogdetRoot);
+  const AMD::SharedEvaluator<MT, ST> shared(graph);
+  AMD::GraphWorkspace<MT, ST> ws;
+  std::vector<MT> point(1, X);
+  std::vector<MT> grads;
+
+  /** Warm up the workspace */
+  value = shared.evaluate(point, ws, &grads);
+
+  clock_type::time_point start = clock_type::now();
+  for (int r=0; r<repeats; ++r) value = shared.evaluate(point, ws, &grads);
+  const double time = seconds(start)/repeats;
+  gradient = grads[0];
+  return time;
+}
+
+void report (const char* mode,
+             double time,
+             double referenceTime,
+             double value,
+             double referenceValue,
+             const double_matrix_type& gradient,
+             const double_matrix_type& referenceGradient) {
+  std::cout << mode
+            << " time=" << time << " s"
+            << " speedup=" << referenceTime/time
+            << " value error=" << std::abs(value - referenceValue) /
+                                  std::abs(referenceValue)
+            << " gradient error=" << (gradient - referenceGradient).norm() /
+                                     referenceGradient.norm()
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  const int n = (1 < argc) ? atoi(argv[1]) : 256;
+  const int repeats = (2 < argc) ? atoi(argv[2]) : 10;
+
+  const double_matrix_type A =
+    *(AMD::rand_psd_t<double_matrix_type>::apply(n, 1));
+  const double_matrix_type X = double_matrix_type::Random(n,n);
+
+  double doubleValue;
+  double_matrix_type doubleGradient;
+  const double doubleTime = timeMode(A, X, repeats,
+                                     doubleValue, doubleGradient);
+  report("double", doubleTime, doubleTime,
+         doubleValue, doubleValue, doubleGradient, doubleGradient);
+
+  float floatValue;
+  float_matrix_type floatGradient;
+  const double floatTime = timeMode(float_matrix_type(A.cast<float>()),
+                                    float_matrix_type(X.cast<float>()),
+                                    repeats, floatValue, floatGradient);
+  report("float ", floatTime, doubleTime,
+         floatValue, doubleValue, floatGradient.cast<double>(),
+         doubleGradient);
+
+  double mixedValue;
+  mixed_matrix_type mixedGradient;
+  const double mixedTime = timeMode(mixed_matrix_type(A),
+                                    mixed_matrix_type(X),
+                                    repeats, mixedValue, mixedGradient);
+  report("mixed ", mixedTime, doubleTime,
+         mixedValue, doubleValue, mixedGradient, doubleGradient);
+
+  return(0);
+}
@@ -0,0 +1,113 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <assert.h>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::BatchEvaluator<matrix_type, value_type> batch_type;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Evaluate logdet(A + X^T*X) and its gradient for N instances of X under
+ * every split of a thread budget between graph-level workers and kernel
+ * threads, and compare with the oversubscribed setup where every worker
+ * also runs its kernels on all the threads. Kernels only use more than one
+ * thread when Eigen is built with OpenMP (-fopenmp).
+ *
+ * Usage: BenchThreadBudget [n=128] [instances=128] [threads=#cores] [pin=0]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/** Time one batch; the first run warms up the workspaces */
+double timeBatch (const graph_type& graph,
+                  AMD::ThreadPool& pool,
+                  const std::vector<std::vector<matrix_type> >& bindings,
+                  std::vector<value_type>& values) {
+  batch_type batch(graph, pool);
+  std::vector<std::vector<matrix_type> > grads;
+  batch.evaluate(bindings, values, &grads);
+
+  clock_type::time_point start = clock_type::now();
+  batch.evaluate(bindings, values, &grads);
+  return seconds(start);
+}
+
+int main(int argc, char** argv) {
+  const int n = (1 < argc) ? atoi(argv[1]) : 128;
+  const int N = (2 < argc) ? atoi(argv[2]) : 128;
+  const int total = (3 < argc) ? atoi(argv[3]) :
+                                 AMD::ThreadBudget::hardwareThreads();
+  const bool pin = (4 < argc) ? (0 != atoi(argv[4])) : false;
+
+  matrix_type A = matrix_type::Identity(n,n) * n;
+  MMFunc fA(A, true);
+  MMFunc fX(matrix_type::Random(n,n), false);
+  graph_type graph(fA + transpose(fX)*fX, AMD::kLogdetRoot);
+
+  std::vector<std::vector<matrix_type> > bindings(N);
+  for (int k=0; k<N; ++k) {
+    bindings[k].push_back(matrix_type::Random(n,n));
+  }
+
+#ifdef _OPENMP
+  std::cout << "OpenMP kernels: on" << std::endl;
+#else
+  std::cout << "OpenMP kernels: off (kernel threads have no effect)"
+            << std::endl;
+#endif
+
+  /** Every worker also gets all the kernel threads */
+  std::vector<value_type> reference;
+  double oversubscribed = 0.0;
+  {
+    AMD::ThreadBudget all(total);
+    all.setGraphThreads(1).apply();
+    AMD::ThreadPool pool(total);
+    oversubscribed = timeBatch(graph, pool, bindings, reference);
+    std::cout << "oversubscribed graph=" << total
+              << " kernel=" << total
+              << " threads=" << total*total
+              << " time=" << oversubscribed << " s"
+              << " instances/s=" << N/oversubscribed << std::endl;
+  }
+
+  double worst = 0.0;
+  for (int graphThreads=1; graphThreads<=total; graphThreads*=2) {
+    AMD::ThreadBudget budget(total);
+    budget.setGraphThreads(graphThreads).setPinning(pin);
+    assert (budget.graphThreads()*budget.kernelThreads() <= total);
+
+    AMD::ThreadPool pool(budget);
+    std::vector<value_type> values;
+    const double time = timeBatch(graph, pool, bindings, values);
+    for (int k=0; k<N; ++k) {
+      assert (std::abs(values[k] - reference[k]) <=
+              1e-10 * (1.0 + std::abs(reference[k])));
+    }
+    if (time > worst) worst = time;
+
+    std::cout << "budget graph=" << budget.graphThreads()
+              << " kernel=" << budget.kernelThreads()
+              << " threads=" << budget.graphThreads()*budget.kernelThreads()
+              << " time=" << time << " s"
+              << " instances/s=" << N/time
+              << " vs oversubscribed=" << oversubscribed/time << std::endl;
+  }
+
+  std::cout << "worst budgeted split vs oversubscribed="
+            << oversubscribed/worst << std::endl;
+
+  return(0);
+}
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::MatrixXd plain_type;
+typedef AMD::TiledMatrix<double> tiled_type;
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Evaluate trace(A*X) and its gradient with in-memory Eigen matrices and
+ * with tiled matrices, A being mapped from a file, and report the time per
+ * evaluation, the GEMM throughput and the tile cache statistics. The cache
+ * capacity is kept well below the size of A so that tiles are released and
+ * read again.
+ *
+ * Usage: BenchTiledMatrix [n=2048] [tile=256] [cacheMiB=16] [repeats=3]
+ */
+
+double seconds (clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/** Time the evaluations at X of one matrix type */
+template <class MT>
+double timeMode (const MT& A, const MT& X, int repeats) {
+  AMD::MatrixMatrixFunc<MT, double> fA(A, true);
+  AMD::MatrixMatrixFunc<MT, double> fX(X, false);
+  AMD::ComputationGraph<MT, double> graph(fA*fX, AMD::kTraceRoot);
+  const AMD::SharedEvaluator<MT, double> shared(graph);
+  std::vector<MT> point(1, X);
+  std::vector<MT> gradient;
+
+  clock_type::time_point start = clock_type::now();
+  for (int r=0; r<repeats; ++r) shared.evaluate(point, &gradient);
+  return seconds(start)/repeats;
+}
+
+int main(int argc, char** argv) {
+  const int n = (1 < argc) ? atoi(argv[1]) : 2048;
+  const int tile = (2 < argc) ? atoi(argv[2]) : 256;
+  const std::size_t cacheMiB = (3 < argc) ? atoi(argv[3]) : 16;
+  const int repeats = (4 < argc) ? atoi(argv[4]) : 3;
+
+  AMD::TileSettings::setTileSize(tile);
+  AMD::TileCache& cache = AMD::TileCache::instance();
+  cache.setCapacity(cacheMiB << 20);
+
+  const plain_type A = plain_type::Random(n,n);
+  const plain_type X = plain_type::Random(n,n);
+  const std::string path = AMD::TileSettings::scratchDirectory() +
+                           "/BenchTiledMatrix.tiles";
+  tiled_type(A).save(path);
+  const tiled_type tiledA = tiled_type::open(path, n, n);
+  const tiled_type tiledX(X);
+
+  /** Count the GEMM of the value only: the gradient A^T*I is a second GEMM
+      in memory, but tiled matrices skip the zero tiles of the identity */
+  const double flops = 2.0*n*n*n;
+
+  const double memoryTime = timeMode(A, X, repeats);
+  std::cout << "eigen time=" << memoryTime << " s"
+            << " GFLOP/s=" << flops/memoryTime*1e-9 << std::endl;
+
+  const std::size_t misses = cache.misses();
+  const std::size_t hits = cache.hits();
+  const double tiledTime = timeMode(tiledA, tiledX, repeats);
+  std::cout << "tiled time=" << tiledTime << " s"
+            << " GFLOP/s=" << flops/tiledTime*1e-9
+            << " relative=" << memoryTime/tiledTime
+            << " tile misses=" << cache.misses() - misses
+            << " hits=" << cache.hits() - hits
+            << " resident=" << (cache.residentBytes() >> 20) << " MiB"
+            << " (A is " << ((sizeof(double)*n*n) >> 20) << " MiB)"
+            << std::endl;
+
+  std::remove(path.c_str());
+  return(0);
+}
@@ -63,10 +63,34 @@ void taylorSample() {
 
 }
 
+/** The same expansion in Taylor mode: one sweep along Delta gives all the
+    coefficients of logdet(X0 + t*Delta). */
+void taylorModeSample() {
+
+  symbolic_matrix_type X0("X0", ROW, COL);
+  symbolic_matrix_type Delta("(X-X0)", ROW, COL);
+  SymbolicMMFunc fX0(X0, false);
+
+  AMD::ComputationGraph<symbolic_matrix_type,
+                        symbolic_value_type> graph(fX0, AMD::kLogdetRoot);
+  AMD::TaylorEvaluator<symbolic_matrix_type,
+                       symbolic_value_type> taylor(graph, 3);
+  taylor.evaluate(std::vector<symbolic_matrix_type>(1, Delta));
+  std::vector<symbolic_value_type> coefficients;
+  taylor.scalarCoefficients(coefficients);
+
+  std::cout<<"The same terms in Taylor mode are:" << std::endl;
+  for (size_t k=0; k<coefficients.size(); ++k) {
+    std::cout << "t^" << k << ": " << coefficients[k].getString() << std::endl;
+  }
+
+}
+
 
 
 int main(int argc, char** argv) {
   // Test taylor expansion.
   taylorSample();
+  taylorModeSample();
   return(0);
 }
@@ -0,0 +1,1209 @@
+#include <iostream>
+#include <string>
+#include <map>
+#include <vector>
+#include <assert.h>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::IncrementalEvaluator<matrix_type, value_type> evaluator_type;
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+void assert_close (const matrix_type& A, const matrix_type& B) {
+  assert (A.rows() == B.rows() && A.cols() == B.cols());
+  assert ((A-B).norm() <= 1e-9 * (1.0 + B.norm()));
+}
+
+/** Random matrix that is safe to invert: A + n*I */
+matrix_type random_matrix (int n) {
+  matrix_type A = matrix_type::Random(n,n);
+  A += n * matrix_type::Identity(n,n);
+  return A;
+}
+
+void testGraphStructure () {
+  matrix_type A = random_matrix(4);
+  matrix_type X = random_matrix(4);
+  MMFunc fA(A, true);
+  MMFunc fX(X, false);
+
+  /** Z is copied into both operands of Z*Z, but it is one node */
+  MMFunc Z = fA*fX;
+  graph_type graph(Z*Z, AMD::kTraceRoot);
+
+  assert (4 == graph.size());
+  assert (3 == graph.root());
+  assert (AMD::TIMES == graph.node(graph.root()).opNum);
+  assert (graph.node(3).left == graph.node(3).right);
+  assert (1 == graph.numVariables());
+  assert (AMD::VAR == graph.node(graph.variable(0)).opNum);
+
+  const int z = graph.node(3).left;
+  assert (2 == graph.parents(z).size());
+  assert (0 == graph.parents(z)[0].second);
+  assert (1 == graph.parents(z)[1].second);
+
+  /** The leaves share the matrices with the recorded tree */
+  const int a = graph.node(z).left;
+  assert (graph.node(a).isConst);
+  assert (graph.node(a).matrixPtr == fA.matrixPtr);
+}
+
+/** Compare the evaluator against trace() and logdet() on the same tree */
+void checkAgainstRecorded (const MMFunc& root, bool useLogdet) {
+  SMFunc recorded = useLogdet ? AMD::logdet(root) : AMD::trace(root);
+  graph_type graph(root, useLogdet ? AMD::kLogdetRoot : AMD::kTraceRoot);
+  evaluator_type eval(graph);
+
+  matrix_type G;
+  eval.gradient(G);
+  assert_close (eval.functionValue(), recorded.functionVal);
+  assert_close (G, recorded.derivativeVal);
+  assert_close (eval.value(), *root.matrixPtr);
+}
+
+void testAgainstRecorded () {
+  const int n = 5;
+  matrix_type A = random_matrix(n);
+  matrix_type B = random_matrix(n);
+  matrix_type X = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fB(B, true);
+  MMFunc fX(X, false);
+  SMFunc two(2.0, n, n);
+  checkAgainstRecorded (fX, false);
+  checkAgainstRecorded (fA*fX, false);
+  checkAgainstRecorded (fA*fX*fB + fX, false);
+  checkAgainstRecorded (transpose(fX)*fA - fB*fX, false);
+  checkAgainstRecorded (-(fX*fX), false);
+  checkAgainstRecorded (inv(fX + fA)*fB, false);
+  checkAgainstRecorded (elementwiseProduct(fA, fX)*fB, false);
+  checkAgainstRecorded (diag(fX)*fA, false);
+  checkAgainstRecorded (fX, true);
+  checkAgainstRecorded (fA + fX*transpose(fX), true);
+  checkAgainstRecorded (inv(fX)*fA, true);
+
+  /** trace() needs derivativeFuncVal on scalar children, so scale by hand */
+  graph_type graph(two*fX*fA + fX*two, AMD::kTraceRoot);
+  evaluator_type eval(graph);
+  matrix_type G;
+  eval.gradient(G);
+  assert_close (G, 2.0 * (A.transpose() + matrix_type::Identity(n,n)));
+  assert_close (eval.functionValue(), 2.0 * ((X*A).trace() + X.trace()));
+}
+
+void testIncremental () {
+  const int n = 6;
+  matrix_type A1 = random_matrix(n);
+  matrix_type A2 = random_matrix(n);
+  matrix_type X1 = random_matrix(n);
+  matrix_type X2 = random_matrix(n);
+  MMFunc fA1(A1, true);
+  MMFunc fA2(A2, true);
+  MMFunc fX1(X1, false);
+  MMFunc fX2(X2, false);
+
+  /** Two separate branches, one for each variable */
+  MMFunc root = inv(fA1 + fX1) + fA2*fX2;
+  graph_type graph(root, AMD::kLogdetRoot);
+  evaluator_type eval(graph);
+
+  matrix_type G;
+  eval.gradient(G);
+  assert (4 == eval.numNodesEvaluated());
+
+  /** Nothing changed, nothing is recomputed */
+  eval.gradient(G);
+  assert (0 == eval.numNodesEvaluated());
+  assert (0 == eval.numAdjointsEvaluated());
+
+  /** Only the second branch and the root are recomputed */
+  matrix_type newX2 = random_matrix(n);
+  fX2.updateValue(newX2);
+  eval.gradient(G);
+  assert (2 == eval.numNodesEvaluated());
+
+  {
+    MMFunc gX1(fX1.matrixPtr, false);
+    MMFunc gX2(newX2, false);
+    MMFunc gA1(A1, true);
+    MMFunc gA2(A2, true);
+    SMFunc fresh = AMD::logdet(inv(gA1 + gX1) + gA2*gX2);
+    assert_close (eval.functionValue(), fresh.functionVal);
+    assert_close (G, fresh.derivativeVal);
+  }
+
+  /** With trace, the adjoints do not depend on the root value */
+  graph_type traceGraph(root, AMD::kTraceRoot);
+  evaluator_type traceEval(traceGraph);
+  traceEval.gradient(G);
+
+  matrix_type newX1 = random_matrix(n);
+  fX1.updateValue(newX1);
+  traceEval.gradient(G);
+  assert (3 == traceEval.numNodesEvaluated());
+  /** The edge below inv() uses its new value, the edge below that gets a
+   * new adjoint; the edges of the other branch are reused */
+  assert (2 == traceEval.numAdjointsEvaluated());
+
+  {
+    MMFunc gX1(newX1, false);
+    MMFunc gX2(newX2, false);
+    MMFunc gA1(A1, true);
+    MMFunc gA2(A2, true);
+    SMFunc fresh = AMD::trace(inv(gA1 + gX1) + gA2*gX2);
+    assert_close (traceEval.functionValue(), fresh.functionVal);
+    assert_close (G, fresh.derivativeVal);
+  }
+
+  /** In-place modification followed by touch() */
+  (*fX2.matrixPtr)(0,0) += 1.0;
+  fX2.touch();
+  matrix_type expected = (A1 + newX1).inverse() + A2*(*fX2.matrixPtr);
+  assert_close (traceEval.functionValue(), adaptor_type::trace(expected));
+}
+
+void testPerVariableGradients () {
+  matrix_type A = random_matrix(3);
+  matrix_type X = matrix_type::Random(3,4);
+  matrix_type Y = matrix_type::Random(4,3);
+  matrix_type Z = random_matrix(3);
+  MMFunc fA(A, true);
+  MMFunc fX(X, false);
+  MMFunc fY(Y, false);
+  MMFunc fZ(Z, false);
+
+  /** Variables of different shapes, Z is used twice */
+  std::map<boost::shared_ptr<matrix_type>, matrix_type> grads;
+  const double f = AMD::logdetGradients(fX*fY + fA*fZ + fZ, grads);
+  assert (3 == grads.size());
+
+  /** Compare with recordings where all the other variables are constant */
+  MMFunc cX(X, true);
+  MMFunc cY(Y, true);
+  MMFunc cZ(Z, true);
+  SMFunc dX = AMD::logdet(fX*cY + fA*cZ + cZ);
+  SMFunc dY = AMD::logdet(cX*fY + fA*cZ + cZ);
+  SMFunc dZ = AMD::logdet(cX*cY + fA*fZ + fZ);
+  assert_close (f, dX.functionVal);
+  assert_close (grads[fX.matrixPtr], dX.derivativeVal);
+  assert_close (grads[fY.matrixPtr], dY.derivativeVal);
+  assert_close (grads[fZ.matrixPtr], dZ.derivativeVal);
+
+  /** The same from an evaluator, one variable at a time */
+  graph_type graph(fX*fY + fA*fZ + fZ, AMD::kLogdetRoot);
+  evaluator_type eval(graph);
+  matrix_type G;
+  eval.gradient(fY, G);
+  assert_close (G, dY.derivativeVal);
+  assert (-1 == graph.variableIndex(fA));
+}
+
+void testBatchEvaluator () {
+  const int n = 4;
+  const int N = 25;
+  matrix_type A = random_matrix(n);
+  matrix_type B = matrix_type::Random(n,2);
+  MMFunc fA(A, true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc fY(matrix_type::Random(2,n), false);
+
+  MMFunc fB(B, true);
+  MMFunc root = inv(fA + fX) + fB*fY;
+  graph_type graph(root, AMD::kTraceRoot);
+  const int x = graph.variableIndex(fX);
+  const int y = graph.variableIndex(fY);
+
+  std::vector<std::vector<matrix_type> > bindings(N);
+  for (int k=0; k<N; ++k) {
+    bindings[k].resize(2);
+    bindings[k][x] = random_matrix(n);
+    bindings[k][y] = matrix_type::Random(2,n);
+  }
+
+  AMD::ThreadPool pool(3);
+  AMD::BatchEvaluator<matrix_type, value_type> batch(graph, pool);
+  std::vector<value_type> values;
+  std::vector<std::vector<matrix_type> > grads;
+  batch.evaluate(bindings, values, &grads);
+  assert (N == values.size() && N == grads.size());
+
+  /** Compare with binding the leaves one instance at a time */
+  evaluator_type eval(graph);
+  std::map<boost::shared_ptr<matrix_type>, matrix_type> expected;
+  for (int k=0; k<N; ++k) {
+    fX.updateValue(bindings[k][x]);
+    fY.updateValue(bindings[k][y]);
+    eval.gradients(expected);
+    assert_close (values[k], eval.functionValue());
+    assert_close (grads[k][x], expected[fX.matrixPtr]);
+    assert_close (grads[k][y], expected[fY.matrixPtr]);
+  }
+
+  /** Values only, and a binding with the wrong shape */
+  std::vector<value_type> valuesOnly;
+  batch.evaluate(bindings, valuesOnly);
+  assert_close (valuesOnly[N-1], values[N-1]);
+
+  bindings[3][y] = matrix_type::Random(n,n);
+  bool caught = false;
+  try { batch.evaluate(bindings, values); }
+  catch (const AMD::exception& error) { caught = true; }
+  assert (caught);
+}
+
+/** Threads sharing one evaluator, each with its own workspace */
+void testSharedEvaluator () {
+  const int n = 4;
+  const int numThreads = 4;
+  const int numPoints = 8;
+  const int numRepeats = 20;
+  matrix_type A = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc fY(random_matrix(n), false);
+  MMFunc root = inv(fA + fX)*fY + fX*fY;
+  graph_type graph(root, AMD::kTraceRoot);
+  const int x = graph.variableIndex(fX);
+  const int y = graph.variableIndex(fY);
+
+  std::vector<std::vector<matrix_type> > points(numPoints);
+  for (int k=0; k<numPoints; ++k) {
+    points[k].resize(2);
+    points[k][x] = random_matrix(n);
+    points[k][y] = random_matrix(n);
+  }
+
+  const AMD::SharedEvaluator<matrix_type, value_type> shared(graph);
+  std::vector<value_type> expected(numPoints);
+  std::vector<std::vector<matrix_type> > expectedGrads(numPoints);
+  for (int k=0; k<numPoints; ++k) {
+    expected[k] = shared.evaluate(points[k], &expectedGrads[k]);
+  }
+
+  /** Compare the sequential results with binding the leaves */
+  evaluator_type eval(graph);
+  std::map<boost::shared_ptr<matrix_type>, matrix_type> grads;
+  for (int k=0; k<numPoints; ++k) {
+    fX.updateValue(points[k][x]);
+    fY.updateValue(points[k][y]);
+    eval.gradients(grads);
+    assert_close (expected[k], eval.functionValue());
+    assert_close (expectedGrads[k][x], grads[fX.matrixPtr]);
+    assert_close (expectedGrads[k][y], grads[fY.matrixPtr]);
+  }
+
+  /** Each thread walks the points in its own order, reusing its workspace */
+  std::vector<int> mismatches(numThreads, 0);
+  std::vector<std::thread> threads;
+  for (int t=0; t<numThreads; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      AMD::GraphWorkspace<matrix_type, value_type> ws;
+      std::vector<matrix_type> gradient;
+      for (int r=0; r<numRepeats; ++r) {
+        const int k = (t + r*(t+1)) % numPoints;
+        const value_type value = shared.evaluate(points[k], ws, &gradient);
+        if (value != expected[k] ||
+            gradient[x] != expectedGrads[k][x] ||
+            gradient[y] != expectedGrads[k][y]) ++mismatches[t];
+      }
+    }));
+  }
+  for (int t=0; t<numThreads; ++t) threads[t].join();
+  for (int t=0; t<numThreads; ++t) assert (0 == mismatches[t]);
+
+  /** A matrix valued root cannot be shared */
+  bool caught = false;
+  try {
+    graph_type matrixGraph(root, AMD::kMatrixRoot);
+    AMD::SharedEvaluator<matrix_type, value_type> bad(matrixGraph);
+  } catch (const AMD::exception& error) { caught = true; }
+  assert (caught);
+}
+
+/** Several objectives that share subexpressions, swept together */
+void testMultiRoot () {
+  const int n = 5;
+  matrix_type A = random_matrix(n);
+  matrix_type S = A * A.transpose();
+  MMFunc fA(A, true);
+  MMFunc fS(S, true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc fY(random_matrix(n), false);
+
+  /** X*Y and X*transpose(X) are shared; the last one only uses Y */
+  MMFunc XY = fX*fY;
+  MMFunc XXt = fX*transpose(fX);
+  std::vector<SMFunc> objectives;
+  objectives.push_back(AMD::logdet(fS + XXt));
+  objectives.push_back(AMD::trace(XY*fA + XXt));
+  objectives.push_back(AMD::trace(inv(fS + XXt)*XY));
+  objectives.push_back(AMD::trace(fY*fA));
+
+  AMD::MultiRootEvaluator<matrix_type, value_type> eval(objectives);
+  const graph_type& graph = eval.getGraph();
+  assert (4 == eval.numObjectives() && 4 == graph.numOutputs());
+  int separateSize = 0;
+  for (int k=0; k<4; ++k) {
+    separateSize += graph_type(*objectives[k].argumentFuncVal).size();
+  }
+  assert (graph.size() < separateSize);
+
+  const int x = graph.variableIndex(fX);
+  const int y = graph.variableIndex(fY);
+  std::vector<matrix_type> point(2);
+  point[x] = random_matrix(n);
+  point[y] = random_matrix(n);
+
+  /** Compare each objective with its own graph */
+  std::vector<value_type> values;
+  std::vector<std::vector<matrix_type> > gradients;
+  eval.evaluate(point, values, gradients);
+  assert (4 == values.size() && 4 == gradients.size());
+  for (int k=0; k<4; ++k) {
+    graph_type single(*objectives[k].argumentFuncVal,
+                      objectives[k].argumentOp);
+    AMD::SharedEvaluator<matrix_type, value_type> shared(single);
+    std::vector<matrix_type> singlePoint(single.numVariables()), gradient;
+    for (int v=0; v<single.numVariables(); ++v) {
+      singlePoint[v] = (single.node(single.variable(v)).matrixPtr ==
+                        fX.matrixPtr) ? point[x] : point[y];
+    }
+    assert_close (values[k], shared.evaluate(singlePoint, &gradient));
+    for (int v=0; v<single.numVariables(); ++v) {
+      const int w = (single.node(single.variable(v)).matrixPtr ==
+                     fX.matrixPtr) ? x : y;
+      assert_close (gradients[k][w], gradient[v]);
+    }
+  }
+  /** Objective 3 does not depend on X */
+  assert (0.0 == gradients[3][x].norm());
+
+  /** The weighted sum with one adjoint per node */
+  std::vector<value_type> weights(4), weighted;
+  weights[0] = 1.0; weights[1] = -0.5; weights[2] = 2.0; weights[3] = 0.25;
+  std::vector<matrix_type> gradient;
+  const value_type sum = eval.evaluate(point, weights, weighted, gradient);
+  value_type expected = 0.0;
+  matrix_type gx = matrix_type::Zero(n,n), gy = matrix_type::Zero(n,n);
+  for (int k=0; k<4; ++k) {
+    assert_close (weighted[k], values[k]);
+    expected += weights[k]*values[k];
+    gx += weights[k]*gradients[k][x];
+    gy += weights[k]*gradients[k][y];
+  }
+  assert_close (sum, expected);
+  assert_close (gradient[x], gx);
+  assert_close (gradient[y], gy);
+
+  /** The values of the leaves, and the same root twice */
+  std::vector<SMFunc> twice(2, objectives[1]);
+  AMD::MultiRootEvaluator<matrix_type, value_type> same(twice);
+  std::vector<value_type> twiceValues;
+  std::vector<matrix_type> twiceGradient;
+  same.evaluate(std::vector<matrix_type>(), std::vector<value_type>(2, 1.0),
+                twiceValues, twiceGradient);
+  graph_type single(*objectives[1].argumentFuncVal, AMD::kTraceRoot);
+  AMD::SharedEvaluator<matrix_type, value_type> leaves(single);
+  std::vector<matrix_type> leafPoint, once;
+  for (int v=0; v<single.numVariables(); ++v) {
+    leafPoint.push_back(*single.node(single.variable(v)).matrixPtr);
+  }
+  assert_close (twiceValues[1], leaves.evaluate(leafPoint, &once));
+  for (int v=0; v<single.numVariables(); ++v) {
+    assert_close (twiceGradient[v], 2.0 * once[v]);
+  }
+
+  /** Constants (like sums of objectives) have no single argument */
+  bool caught = false;
+  try {
+    std::vector<SMFunc> bad(1, SMFunc(2.0, n, n));
+    AMD::MultiRootEvaluator<matrix_type, value_type> eval(bad);
+  } catch (const AMD::exception& error) { caught = true; }
+  assert (caught);
+  caught = false;
+  try { eval.evaluate(point, std::vector<value_type>(3), values, gradient); }
+  catch (const AMD::exception& error) { caught = true; }
+  assert (caught);
+}
+
+/** Futures, callbacks, progress and cancellation */
+void testAsyncEvaluator () {
+  typedef AMD::AsyncEvaluator<matrix_type, value_type> async_type;
+  const int n = 4;
+  matrix_type A = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc root = inv(fA + fX)*fX + fA*fX;
+  graph_type graph(root, AMD::kLogdetRoot);
+
+  std::vector<matrix_type> point(1, random_matrix(n));
+  const AMD::SharedEvaluator<matrix_type, value_type> shared(graph);
+  std::vector<matrix_type> expectedGrad;
+  const value_type expected = shared.evaluate(point, &expectedGrad);
+
+  AMD::ThreadPool pool(2);
+  async_type async(graph, pool);
+
+  /** Futures, with and without the gradient */
+  std::future<async_type::ResultType> full = async.evaluate(point, true);
+  std::future<async_type::ResultType> valueOnly = async.evaluate(point, false);
+  const async_type::ResultType result = full.get();
+  assert_close (expected, result.value);
+  assert (1 == result.gradient.size());
+  assert_close (expectedGrad[0], result.gradient[0]);
+  assert (valueOnly.get().gradient.empty());
+
+  /** A callback on an inline executor, with the progress of every node */
+  async_type inlined(graph, [](const async_type::TaskType& task) { task(); });
+  int calls = 0;
+  int lastDone = 0;
+  int total = 0;
+  value_type value = 0;
+  inlined.evaluate(point,
+                   true,
+                   [&](const async_type::ResultType& result,
+                       std::exception_ptr error) {
+                     assert (!error);
+                     value = result.value;
+                     ++calls;
+                   },
+                   AMD::CancellationToken(),
+                   [&](int done, int all) {
+                     assert (done == lastDone + 1);
+                     lastDone = done;
+                     total = all;
+                   });
+  assert (1 == calls && 2*graph.size() == total && total == lastDone);
+  assert_close (expected, value);
+
+  /** Cancelled before it starts, and part of the way through */
+  AMD::CancellationToken cancelled;
+  cancelled.cancel();
+  bool caught = false;
+  try { async.evaluate(point, true, cancelled).get(); }
+  catch (const AMD::exception& error) {
+    caught = (AMD_CANCELLED == error.code());
+  }
+  assert (caught);
+
+  AMD::CancellationToken token;
+  int seen = 0;
+  caught = false;
+  try {
+    inlined.evaluate(point, true, token, [&](int done, int) {
+      seen = done;
+      if (3 == done) token.cancel();
+    }).get();
+  } catch (const AMD::exception& error) {
+    caught = (AMD_CANCELLED == error.code());
+  }
+  assert (caught && 3 == seen);
+
+  /** Bad bindings come back through the future */
+  caught = false;
+  std::vector<matrix_type> bad(1, matrix_type::Random(n, n+1));
+  try { async.evaluate(bad, false).get(); }
+  catch (const AMD::exception& error) { caught = true; }
+  assert (caught);
+}
+
+/** Split a thread budget between the workers and the kernels */
+void testThreadBudget () {
+  AMD::ThreadBudget budget(8);
+  assert (8 == budget.graphThreads() && 1 == budget.kernelThreads());
+  budget.setGraphThreads(3);
+  assert (3 == budget.graphThreads() && 2 == budget.kernelThreads());
+  budget.setGraphThreads(20);
+  assert (8 == budget.graphThreads() && 1 == budget.kernelThreads());
+  budget.setGraphThreads(0);
+  assert (1 == budget.graphThreads() && 8 == budget.kernelThreads());
+
+  /** Pinned workers give the same results as plain ones */
+  const int n = 4;
+  matrix_type A = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fX(random_matrix(n), false);
+  graph_type graph(inv(fA + fX)*fX, AMD::kTraceRoot);
+  std::vector<std::vector<matrix_type> > bindings(10);
+  for (size_t k=0; k<bindings.size(); ++k) {
+    bindings[k].push_back(random_matrix(n));
+  }
+
+  AMD::ThreadBudget split(2);
+  split.setGraphThreads(2).setPinning(true);
+  AMD::ThreadPool pinnedPool(split);
+  assert (2 == pinnedPool.size());
+  AMD::ThreadPool plainPool(2);
+  AMD::BatchEvaluator<matrix_type, value_type> pinned(graph, pinnedPool);
+  AMD::BatchEvaluator<matrix_type, value_type> plain(graph, plainPool);
+  std::vector<value_type> pinnedValues, plainValues;
+  pinned.evaluate(bindings, pinnedValues);
+  plain.evaluate(bindings, plainValues);
+  for (size_t k=0; k<bindings.size(); ++k) {
+    assert (pinnedValues[k] == plainValues[k]);
+  }
+}
+
+/** Compare a block of directional derivatives with <gradient, direction> */
+void checkTangent (const MMFunc& root, bool useLogdet) {
+  graph_type graph(root, useLogdet ? AMD::kLogdetRoot : AMD::kTraceRoot);
+  evaluator_type eval(graph);
+  std::map<boost::shared_ptr<matrix_type>, matrix_type> grads;
+  eval.gradients(grads);
+
+  const int k = 3;
+  std::vector<std::vector<matrix_type> > directions(k);
+  for (int j=0; j<k; ++j) {
+    for (int v=0; v<graph.numVariables(); ++v) {
+      const AMD::GraphNode<matrix_type, value_type>& node =
+        graph.node(graph.variable(v));
+      directions[j].push_back(matrix_type::Random(node.numRows, node.numCols));
+    }
+  }
+
+  AMD::TangentEvaluator<matrix_type, value_type> tangent(graph);
+  tangent.evaluate(directions);
+  std::vector<value_type> derivatives;
+  tangent.directionalDerivatives(derivatives);
+
+  for (int j=0; j<k; ++j) {
+    double expected = 0.0;
+    for (int v=0; v<graph.numVariables(); ++v) {
+      const matrix_type& G = grads[graph.node(graph.variable(v)).matrixPtr];
+      expected += G.cwiseProduct(directions[j][v]).sum();
+    }
+    assert_close (derivatives[j], expected);
+    assert_close (tangent.directionalDerivative(j), expected);
+  }
+}
+
+void testTangent () {
+  const int n = 5;
+  matrix_type A = random_matrix(n);
+  matrix_type X = random_matrix(n);
+  matrix_type Y = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fX(X, false);
+  MMFunc fY(Y, false);
+  SMFunc two(2.0, n, n);
+  checkTangent (fA*fX*fY - fX, false);
+  checkTangent (transpose(fX)*fA + (-fY), false);
+  checkTangent (inv(fX + fA)*fY, false);
+  checkTangent (elementwiseProduct(fX, fY)*fA, false);
+  checkTangent (diag(fX)*fY + fX*two, false);
+  checkTangent (fA + fX*transpose(fX), true);
+  checkTangent (inv(fX)*fY, true);
+
+  /** A matrix valued function against central differences */
+  MMFunc root = inv(fA + fX*fY);
+  matrix_type dX = matrix_type::Random(n,n);
+  std::map<boost::shared_ptr<matrix_type>, matrix_type> directions;
+  directions[fX.matrixPtr] = dX;
+  matrix_type T;
+  AMD::tangent(root, directions, T);
+
+  const double h = 1e-6;
+  matrix_type plus = (A + (X + h*dX)*Y).inverse();
+  matrix_type minus = (A + (X - h*dX)*Y).inverse();
+  matrix_type fd = (plus - minus) / (2*h);
+  assert ((T - fd).norm() <= 1e-6 * (1.0 + fd.norm()));
+
+  /** The direction of Y is zero */
+  const double d = AMD::directionalDerivative(root, AMD::kTraceRoot,
+                                              directions);
+  assert_close (d, T.trace());
+}
+
+/** Check the VJPs of root against its tangents: trace(W^T*dF) has to be the
+    sum of <vjp_v, dX_v> over the variables */
+void checkJacobian (const MMFunc& root, const std::vector<MMFunc*>& vars) {
+  typedef std::map<boost::shared_ptr<matrix_type>, matrix_type> map_type;
+  const graph_type graph(root);
+  AMD::JacobianEvaluator<matrix_type, value_type> eval(graph);
+  const int m = root.getNumRows(), n = root.getNumCols();
+  assert_close (eval.evaluate(), *root.matrixPtr);
+
+  map_type directions;
+  for (size_t v=0; v<vars.size(); ++v) {
+    directions[vars[v]->matrixPtr] =
+      matrix_type::Random(vars[v]->getNumRows(), vars[v]->getNumCols());
+  }
+  matrix_type T;
+  AMD::tangent(root, directions, T);
+
+  const matrix_type W = matrix_type::Random(m, n);
+  std::vector<matrix_type> vjp;
+  eval.vjp(W, vjp);
+  map_type vjpMap;
+  AMD::vectorJacobianProduct(root, W, vjpMap);
+  double inner = 0.0;
+  for (int v=0; v<graph.numVariables(); ++v) {
+    const boost::shared_ptr<matrix_type> leaf =
+      graph.node(graph.variable(v)).matrixPtr;
+    inner += vjp[v].cwiseProduct(directions[leaf]).sum();
+    assert_close (vjpMap[leaf], vjp[v]);
+  }
+  assert_close (inner, W.cwiseProduct(T).sum());
+
+  /** A stacked block of seeds gives the same products as one at a time */
+  std::vector<matrix_type> seeds(3, W);
+  seeds[1] = matrix_type::Random(m, n);
+  seeds[2] = matrix_type::Identity(m, n);
+  std::vector<std::vector<matrix_type> > stacked;
+  eval.vjp(seeds, stacked);
+  assert (3 == stacked.size());
+  for (int s=0; s<3; ++s) {
+    eval.vjp(seeds[s], vjp);
+    for (int v=0; v<graph.numVariables(); ++v) {
+      assert_close (stacked[s][v], vjp[v]);
+    }
+  }
+
+  /** Jacobians in blocks of any size; column f is the tangent along the
+      f-th unit direction */
+  std::vector<matrix_type> J, J3;
+  eval.jacobian(J, 0);
+  eval.jacobian(J3, 3);
+  for (int v=0; v<graph.numVariables(); ++v) {
+    const AMD::GraphNode<matrix_type, value_type>& node =
+      graph.node(graph.variable(v));
+    assert (m*n == J[v].rows() && node.numRows*node.numCols == J[v].cols());
+    assert_close (J3[v], J[v]);
+    for (int f=0; f<J[v].cols(); ++f) {
+      map_type unit;
+      unit[node.matrixPtr] = matrix_type::Zero(node.numRows, node.numCols);
+      unit[node.matrixPtr](f % node.numRows, f / node.numRows) = 1.0;
+      AMD::tangent(root, unit, T);
+      assert_close (J[v].col(f), matrix_type(Eigen::Map<const matrix_type>(
+                                                   T.data(), m*n, 1)));
+    }
+  }
+}
+
+void testJacobian () {
+  const int n = 4, p = 3;
+  matrix_type A = random_matrix(n);
+  matrix_type X = random_matrix(n);
+  matrix_type Y = random_matrix(n);
+  matrix_type Z = matrix_type::Random(n, p);
+  MMFunc fA(A, true);
+  MMFunc fX(X, false);
+  MMFunc fY(Y, false);
+  MMFunc fZ(Z, false);
+  SMFunc two(2.0, n, n);
+
+  std::vector<MMFunc*> vars;
+  vars.push_back(&fX);
+  vars.push_back(&fY);
+  checkJacobian (inv(fA + fX*fY)*transpose(fX) +
+                 elementwiseProduct(fX, fY) - diag(fY)*fX*two + (-fY),
+                 vars);
+  std::vector<MMFunc*> rectangular(1, &fZ);
+  checkJacobian (transpose(fZ)*fA*fZ, rectangular);
+  checkJacobian (fA*fZ, rectangular);
+
+  /** Evaluate at another point */
+  const graph_type graph(fA + fX*fY);
+  AMD::JacobianEvaluator<matrix_type, value_type> eval(graph);
+  std::vector<matrix_type> point(2);
+  point[graph.node(graph.variable(0)).matrixPtr == fX.matrixPtr ? 0 : 1] =
+    2.0*X;
+  point[graph.node(graph.variable(0)).matrixPtr == fX.matrixPtr ? 1 : 0] = Y;
+  assert_close (eval.evaluate(point), A + 2.0*X*Y);
+
+  bool thrown = false;
+  std::vector<matrix_type> vjp;
+  try { eval.vjp(matrix_type::Zero(n, p), vjp); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+}
+
+/** Taylor coefficients of polynomials, inverses and logdet along a line */
+void testTaylor () {
+  const int n = 4;
+  const int K = 5;
+  matrix_type A = random_matrix(n);
+  matrix_type X = random_matrix(n);
+  matrix_type Y = random_matrix(n);
+  matrix_type V = matrix_type::Random(n,n) / n;
+  matrix_type W = matrix_type::Random(n,n) / n;
+  MMFunc fA(A, true);
+  MMFunc fX(X, false);
+  MMFunc fY(Y, false);
+  SMFunc two(2.0, n, n);
+
+  /** logdet(S+Z+tU) has g_k = (-1)^(k+1)/k * trace((inv(S+Z)*U)^k);
+      logdet() needs symmetric positive definite matrices */
+  const matrix_type S = A * A.transpose();
+  const matrix_type Z = X * X.transpose();
+  const matrix_type U = V + V.transpose();
+  MMFunc fS(S, true);
+  MMFunc fZ(Z, false);
+  graph_type logdetGraph(fS + fZ, AMD::kLogdetRoot);
+  AMD::TaylorEvaluator<matrix_type, value_type> logdet(logdetGraph, K);
+  assert (K == logdet.getOrder());
+  logdet.evaluate(std::vector<matrix_type>(1, U));
+  std::vector<value_type> g;
+  logdet.scalarCoefficients(g);
+  assert (K+1 == static_cast<int>(g.size()));
+  const matrix_type M = (S + Z).inverse() * U;
+  matrix_type power = matrix_type::Identity(n,n);
+  assert_close (g[0], std::log((S + Z).determinant()));
+  for (int k=1; k<=K; ++k) {
+    power = power * M;
+    assert_close (g[k], ((k % 2) ? 1.0 : -1.0) * power.trace() / k);
+  }
+
+  /** The derivatives are k! times the coefficients */
+  std::map<boost::shared_ptr<matrix_type>, matrix_type> directions;
+  directions[fZ.matrixPtr] = U;
+  std::vector<value_type> d;
+  AMD::taylorDerivatives(fS + fZ, AMD::kLogdetRoot, directions, K, d);
+  double factorial = 1.0;
+  for (int k=0; k<=K; ++k) {
+    factorial *= (0 == k) ? 1.0 : k;
+    assert_close (d[k], factorial * g[k]);
+  }
+
+  /** logdet(S+X*X^T) along V: P(t) = P + t*dP + t^2*ddP */
+  graph_type quadraticGraph(fS + fX*transpose(fX), AMD::kLogdetRoot);
+  AMD::TaylorEvaluator<matrix_type, value_type> quadratic(quadraticGraph, 2);
+  quadratic.evaluate(std::vector<matrix_type>(1, V));
+  quadratic.scalarCoefficients(g);
+  const matrix_type Pinv = (S + Z).inverse();
+  const matrix_type dP = V*X.transpose() + X*V.transpose();
+  const matrix_type ddP = V*V.transpose();
+  assert_close (g[1], (Pinv*dP).trace());
+  assert_close (g[2], (Pinv*ddP).trace() - 0.5*(Pinv*dP*Pinv*dP).trace());
+
+  /** inv(A+X+tV) has the coefficients (-B*V)^j*B with B = inv(A+X) */
+  graph_type invGraph(inv(fA + fX));
+  AMD::TaylorEvaluator<matrix_type, value_type> inverse(invGraph, K);
+  inverse.evaluate(std::vector<matrix_type>(1, V));
+  const matrix_type B = (A + X).inverse();
+  power = B;
+  matrix_type C;
+  for (int j=0; j<=K; ++j) {
+    inverse.coefficient(j, C);
+    assert_close (C, power);
+    power = -B * V * power;
+  }
+
+  /** X*X*X is a cubic: the coefficients beyond 3 are zero */
+  graph_type cubicGraph(fX*fX*fX);
+  AMD::TaylorEvaluator<matrix_type, value_type> cubic(cubicGraph, K);
+  cubic.evaluate(std::vector<matrix_type>(1, V));
+  cubic.coefficient(1, C);
+  assert_close (C, V*X*X + X*V*X + X*X*V);
+  cubic.coefficient(2, C);
+  assert_close (C, V*V*X + V*X*V + X*V*V);
+  cubic.coefficient(3, C);
+  assert_close (C, V*V*V);
+  cubic.coefficient(4, C);
+  assert (0.0 == C.norm() && n == C.rows() && n == C.cols());
+
+  /** A polynomial in two variables: its Taylor series is exact, so the sum
+      of the coefficients at t is the value at X+tV, Y+tW */
+  MMFunc poly = transpose(fX)*elementwiseProduct(fY, fX)*two -
+                diag(fY)*fA*fY + (-fX*fX);
+  graph_type polyGraph(poly);
+  AMD::TaylorEvaluator<matrix_type, value_type> series(polyGraph, K);
+  std::map<boost::shared_ptr<matrix_type>, matrix_type> both;
+  both[fX.matrixPtr] = V;
+  both[fY.matrixPtr] = W;
+  const std::vector<matrix_type> direction = AMD::directionOf(polyGraph, both);
+  series.evaluate(direction);
+  const double t = 0.5;
+  matrix_type sum = matrix_type::Zero(n,n);
+  for (int j=K; j>=0; --j) {
+    series.coefficient(j, C);
+    sum = sum * t + C;
+  }
+  const matrix_type Xt = X + t*V, Yt = Y + t*W;
+  const matrix_type Dt = matrix_type(Yt.diagonal().asDiagonal());
+  assert_close (sum, 2.0 * Xt.transpose() * Yt.cwiseProduct(Xt) -
+                     Dt * A * Yt - Xt * Xt);
+
+  /** The first coefficient is the tangent */
+  AMD::TangentEvaluator<matrix_type, value_type> tangent(polyGraph);
+  tangent.evaluate(std::vector<std::vector<matrix_type> >(1, direction));
+  matrix_type T;
+  tangent.tangent(0, T);
+  series.coefficient(1, C);
+  assert_close (C, T);
+
+  /** Only the value for order zero; wrong directions are rejected */
+  AMD::TaylorEvaluator<matrix_type, value_type> zero(logdetGraph, 0);
+  zero.evaluate(std::vector<matrix_type>(1, U));
+  zero.derivatives(d);
+  assert (1 == d.size());
+  assert_close (d[0], std::log((S + Z).determinant()));
+  bool thrown = false;
+  try { logdet.evaluate(std::vector<matrix_type>()); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+  thrown = false;
+  try { inverse.coefficient(K+1, C); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+}
+
+/** Compare H[V] with central differences of the gradient */
+void checkHessianVector (MMFunc& fX, const MMFunc& root, bool useLogdet) {
+  const int n = fX.getNumRows();
+  const matrix_type X = *fX.matrixPtr;
+  const matrix_type V = matrix_type::Random(n,n);
+  SMFunc f = useLogdet ? AMD::logdet(root) : AMD::trace(root);
+  matrix_type HV;
+  f.hessianVectorProduct(V, HV);
+
+  /** The recorded tree shares the leaf, so move the leaf and re-evaluate */
+  const double h = 1e-5;
+  graph_type graph(root, useLogdet ? AMD::kLogdetRoot : AMD::kTraceRoot);
+  evaluator_type eval(graph);
+  matrix_type Gplus, Gminus;
+  fX.updateValue(X + h*V);
+  eval.gradient(Gplus);
+  fX.updateValue(X - h*V);
+  eval.gradient(Gminus);
+  fX.updateValue(X);
+
+  matrix_type fd = (Gplus - Gminus) / (2*h);
+  assert ((HV - fd).norm() <= 1e-6 * (1.0 + fd.norm()));
+}
+
+void testHessianVector () {
+  const int n = 4;
+  matrix_type A = random_matrix(n);
+  matrix_type B = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fB(B, true);
+  MMFunc fX(random_matrix(n), false);
+
+  checkHessianVector (fX, fA*fX*fX, false);
+  checkHessianVector (fX, fA*transpose(fX)*fB*fX - fX, false);
+  checkHessianVector (fX, inv(fA + fX)*fB, false);
+  checkHessianVector (fX, elementwiseProduct(fX, fX)*fA, false);
+  checkHessianVector (fX, diag(fX*fA)*fX, false);
+  checkHessianVector (fX, -(fX*fB), false);
+  checkHessianVector (fX, fA + fX*transpose(fX), true);
+  checkHessianVector (fX, inv(fX), true);
+
+  /** Linear functions have a zero Hessian */
+  SMFunc linear = AMD::trace(fA*fX);
+  matrix_type HV;
+  linear.hessianVectorProduct(A, HV);
+  assert (0.0 == HV.norm());
+}
+
+/** Compare the assembled Hessian with one Hessian-vector product per entry */
+int checkSparseHessian (const MMFunc& f, bool isLogdet) {
+  graph_type graph(f, isLogdet ? AMD::kLogdetRoot : AMD::kTraceRoot);
+  AMD::HessianSparsity<matrix_type, value_type> sparsity(graph);
+  Eigen::SparseMatrix<value_type> H;
+  AMD::sparseHessian(graph, sparsity, H);
+
+  const int N = sparsity.size();
+  assert (N == H.rows() && N == H.cols());
+  matrix_type dense(N, N);
+  AMD::HessianVectorEvaluator<matrix_type, value_type> hessian(graph);
+  std::vector<matrix_type> direction(graph.numVariables()), product;
+  for (int c=0; c<N; ++c) {
+    for (int v=0; v<graph.numVariables(); ++v) {
+      const AMD::GraphNode<matrix_type, value_type>& leaf =
+        graph.node(graph.variable(v));
+      direction[v].setZero(leaf.numRows, leaf.numCols);
+      for (int e=0; e<leaf.numRows*leaf.numCols; ++e) {
+        if (sparsity.offset(v) + e == c) direction[v].data()[e] = 1.0;
+      }
+    }
+    hessian.apply(direction, product);
+    for (int v=0; v<graph.numVariables(); ++v) {
+      for (int e=0; e<product[v].size(); ++e) {
+        dense(sparsity.offset(v) + e, c) = product[v].data()[e];
+      }
+    }
+  }
+  assert_close (matrix_type(H), dense);
+  assert (sparsity.nonZeros() == H.nonZeros());
+  return sparsity.numColors();
+}
+
+void testSparseHessian () {
+  const int n = 4;
+  matrix_type A = random_matrix(n);
+  matrix_type D = matrix_type::Zero(n,n);
+  D.diagonal() = random_matrix(n).diagonal();
+  MMFunc fA(A, true);
+  MMFunc fD(D, true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc fY(random_matrix(n), false);
+
+  /** Elementwise and diagonal terms give a diagonal Hessian */
+  assert (1 == checkSparseHessian (elementwiseProduct(fX, fX)*fA, false));
+  assert (1 == checkSparseHessian (diag(fX)*diag(fX)*fA, false));
+  /** The trace of X*D*X with diagonal D only couples X(r,k) and X(k,r) */
+  assert (1 == checkSparseHessian (fX*fD*fX, false));
+  assert (1 == checkSparseHessian (fD*transpose(fX)*fD*fX, false));
+  assert (n*n == checkSparseHessian (fX*fA*fX, false));
+
+  checkSparseHessian (inv(fA + fX)*fD, false);
+  checkSparseHessian (fA + fX*transpose(fX), true);
+  checkSparseHessian (elementwiseProduct(fX, fY) + fY*fA*fX, false);
+  assert (1 == checkSparseHessian (elementwiseProduct(fX, fY), false));
+
+  /** The pattern of a linear function is empty */
+  Eigen::SparseMatrix<value_type> H;
+  assert (0 == AMD::sparseHessian(fA*fX, AMD::kTraceRoot, H));
+  assert (0 == H.nonZeros());
+}
+
+/** B*(B*(...(A*X + A)...) + A) with depth nested products */
+MMFunc chain (const MMFunc& fA, const MMFunc& fX, const MMFunc& fB, int depth) {
+  if (0 == depth) return fA*fX;
+  return fB*(chain(fA, fX, fB, depth-1) + fA);
+}
+
+void testMemoryPlan () {
+  const int n = 4;
+  matrix_type A = random_matrix(n);
+  matrix_type B = random_matrix(n);
+  matrix_type X = random_matrix(n);
+  matrix_type Y = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fB(B, true);
+  MMFunc fX(X, false);
+  MMFunc fY(Y, false);
+
+  /** The reverse sweep of this chain needs no intermediate values, so a
+      few slots are enough however long it is */
+  graph_type graph(chain(fA, fX, fB, 20), AMD::kTraceRoot);
+  AMD::PlannedEvaluator<matrix_type, value_type> planned(graph);
+  assert (planned.plan().numSlots() <= 4);
+  assert (planned.plan().peakBytes() < planned.plan().unplannedBytes());
+
+  evaluator_type eval(graph);
+  matrix_type G;
+  eval.gradient(G);
+  assert_close (planned.evaluate(), eval.functionValue());
+  assert_close (planned.gradient(0), G);
+
+  /** Reuse for a second evaluation */
+  assert_close (planned.evaluate(), eval.functionValue());
+  assert_close (planned.gradient(0), G);
+
+  /** Values used by the reverse sweep stay alive long enough */
+  const MMFunc fs[] = { inv(fA + fX)*elementwiseProduct(fX, fY),
+                        transpose(fX)*fY*diag(fX) - fB*fY,
+                        fA + fX*transpose(fY) };
+  for (int k=0; k<3; ++k) {
+    graph_type g(fs[k], (2 == k) ? AMD::kLogdetRoot : AMD::kTraceRoot);
+    AMD::PlannedEvaluator<matrix_type, value_type> p(g);
+    evaluator_type e(g);
+    evaluator_type::GradientMapType gradients;
+    e.gradients(gradients);
+    assert_close (p.evaluate(), e.functionValue());
+    for (int v=0; v<g.numVariables(); ++v) {
+      assert_close (p.gradient(v), gradients[g.node(g.variable(v)).matrixPtr]);
+    }
+  }
+
+  /** Without the gradient only the root value is kept */
+  graph_type matrixGraph(fA*fX*fY + fB, AMD::kMatrixRoot);
+  AMD::PlannedEvaluator<matrix_type, value_type> values(matrixGraph, false);
+  values.evaluate();
+  assert_close (values.value(), matrix_type(A*X*Y + B));
+}
+
+void testCheckpoint () {
+  const int n = 4;
+  matrix_type A = random_matrix(n);
+  matrix_type B = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fB(B, true);
+  MMFunc fX(random_matrix(n), false);
+
+  /** X*(...) needs the values of the chain in the reverse sweep */
+  graph_type graph(fX*chain(fA, fX, fB, 30)*fX, AMD::kTraceRoot);
+  evaluator_type eval(graph);
+  matrix_type G;
+  eval.gradient(G);
+
+  AMD::CheckpointEvaluator<matrix_type, value_type> all(graph, 1UL << 30);
+  assert (1 == all.numSegments());
+  assert (0.0 == all.recomputeOverhead());
+  assert_close (all.evaluate(), eval.functionValue());
+  assert_close (all.gradient(0), G);
+
+  /** Half the memory of keeping everything */
+  const std::size_t budget = all.storeAllBytes()/2;
+  AMD::CheckpointEvaluator<matrix_type, value_type> some(graph, budget);
+  assert (1 < some.numSegments());
+  assert (some.peakBytes() <= budget);
+  assert (0.0 < some.recomputeOverhead() && some.recomputeOverhead() <= 1.0);
+  assert_close (some.evaluate(), eval.functionValue());
+  assert_close (some.gradient(0), G);
+  assert_close (some.evaluate(), eval.functionValue());
+  assert_close (some.gradient(0), G);
+
+  /** An impossible budget gives the smallest peak */
+  AMD::CheckpointEvaluator<matrix_type, value_type> least(graph, 0);
+  assert (least.peakBytes() <= some.peakBytes());
+  assert_close (least.evaluate(), eval.functionValue());
+  assert_close (least.gradient(0), G);
+
+  /** Values used across segments by non-linear nodes */
+  graph_type dag(inv(fA + fX)*elementwiseProduct(fX, fB*fX) +
+                 transpose(fX)*fX*inv(fB + fX), AMD::kLogdetRoot);
+  evaluator_type dagEval(dag);
+  dagEval.gradient(G);
+  AMD::CheckpointEvaluator<matrix_type, value_type> dagSome(dag, 0);
+  assert (1 < dagSome.numSegments());
+  assert_close (dagSome.evaluate(), dagEval.functionValue());
+  assert_close (dagSome.gradient(0), G);
+}
+
+/** Tune the association of products and the inverses, then reload */
+void testAutotuner () {
+  const int n = 128;
+  matrix_type A = random_matrix(n);
+  matrix_type S = random_matrix(n);
+  S = S*S.transpose();
+  MMFunc fA(A, true);
+  MMFunc fS(S, true);
+  MMFunc fV(matrix_type::Random(n,1), true);
+  MMFunc fW(matrix_type::Random(1,n), true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc root = ((fA*fX)*fV)*fW + inv(fS + fX*transpose(fX));
+  graph_type graph(root, AMD::kTraceRoot);
+
+  std::vector<matrix_type> point(1, random_matrix(n));
+  std::vector<matrix_type> expectedGrad;
+  const value_type expected =
+    AMD::SharedEvaluator<matrix_type, value_type>(graph).evaluate(point,
+                                                          &expectedGrad);
+
+  AMD::TuningProfile profile;
+  AMD::TunedEvaluator<matrix_type, value_type> tuned(graph, profile);
+  std::vector<matrix_type> grad;
+  assert_close (expected, tuned.evaluate(point, &grad));
+  assert_close (expectedGrad[0], grad[0]);
+
+  /** (A*X)*v is much slower than A*(X*v) */
+  std::string choice;
+  assert (profile.find("times 128 128 128 1", choice) && "right" == choice);
+  assert (1 <= tuned.numRewrites() && 0 < tuned.numTimed());
+  assert (profile.find("inv 128", choice));
+  assert (graph.size() == tuned.getGraph().size());
+
+  /** Later evaluations and runs reuse the choices */
+  point[0] = random_matrix(n);
+  const value_type next =
+    AMD::SharedEvaluator<matrix_type, value_type>(graph).evaluate(point);
+  assert_close (next, tuned.evaluate(point));
+
+  const char* path = "TestComputationGraph.profile";
+  profile.save(path);
+  AMD::TuningProfile loaded;
+  assert (loaded.load(path));
+  std::remove(path);
+  assert (loaded.getChoices() == profile.getChoices());
+
+  AMD::TunedEvaluator<matrix_type, value_type> reloaded(graph, loaded);
+  assert_close (next, reloaded.evaluate(point));
+  assert (0 == reloaded.numTimed());
+  assert (tuned.numRewrites() == reloaded.numRewrites());
+  assert (!loaded.load("no/such/profile"));
+}
+
+int main(int argc, char** argv) {
+
+  std::cout << "Testing ComputationGraph structure .... ";
+  testGraphStructure();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing IncrementalEvaluator against trace()/logdet() .... ";
+  testAgainstRecorded();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing incremental re-evaluation .... ";
+  testIncremental();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing per-variable gradients .... ";
+  testPerVariableGradients();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing batched evaluation .... ";
+  testBatchEvaluator();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing shared evaluation across threads .... ";
+  testSharedEvaluator();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing objectives that share one graph .... ";
+  testMultiRoot();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing asynchronous evaluation .... ";
+  testAsyncEvaluator();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing thread budgets .... ";
+  testThreadBudget();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing forward (tangent) mode .... ";
+  testTangent();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing vector-Jacobian products and Jacobians .... ";
+  testJacobian();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing Taylor-mode derivatives .... ";
+  testTaylor();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing Hessian-vector products .... ";
+  testHessianVector();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing sparse Hessian assembly .... ";
+  testSparseHessian();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing planned memory .... ";
+  testMemoryPlan();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing checkpointed gradients .... ";
+  testCheckpoint();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing autotuning .... ";
+  testAutotuner();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
@@ -173,6 +173,71 @@ void testTraceLogdet () {
   assert_close (logdet ,logdet_manual);
 }
 
+void testSinglePrecision () {
+  typedef Eigen::MatrixXf float_matrix_type;
+  typedef AMD::MatrixAdaptor_t<float_matrix_type> float_adaptor_type;
+  typedef AMD::MatrixMatrixFunc<float_matrix_type, float> FloatMMFunc;
+
+  /** The adaptor keeps everything in float */
+  float_matrix_type A = *(AMD::rand_psd_t<float_matrix_type>::apply(6));
+  float_matrix_type B;
+  float_adaptor_type::negation (A, B);
+  assert ((A + B).isZero());
+  const float logdet = float_adaptor_type::logdet (A);
+  assert (std::abs(logdet - std::log(A.cast<double>().determinant())) <=
+          1e-4 * std::abs(logdet));
+
+  /** Same function and gradient as in double, up to float rounding */
+  float_matrix_type X = float_matrix_type::Random(6,6);
+  FloatMMFunc fA(A, true);
+  FloatMMFunc fX(X, false);
+  AMD::ScalarMatrixFunc<float_matrix_type, float> f =
+                                          AMD::logdet(fA + transpose(fX)*fX);
+
+  matrix_type Ad = A.cast<double>();
+  MMFunc gA(Ad, true);
+  MMFunc gX(matrix_type(X.cast<double>()), false);
+  SMFunc g = AMD::logdet(gA + transpose(gX)*gX);
+
+  assert (std::abs(f.functionVal - g.functionVal) <=
+          1e-5 * std::abs(g.functionVal));
+  assert ((f.derivativeVal.cast<double>() - g.derivativeVal).norm() <=
+          1e-4 * g.derivativeVal.norm());
+}
+
+void testMixedPrecision () {
+  typedef AMD::MixedPrecisionMatrix<double, float> mixed_matrix_type;
+  typedef AMD::MatrixAdaptor_t<mixed_matrix_type> mixed_adaptor_type;
+  typedef AMD::MatrixMatrixFunc<mixed_matrix_type, double> MixedMMFunc;
+
+  /** Products are rounded to float, the rest is exact */
+  mixed_matrix_type A = *(AMD::rand_psd_t<matrix_type>::apply(6));
+  mixed_matrix_type X = matrix_type::Random(6,6);
+  mixed_matrix_type C;
+  mixed_adaptor_type::multiply (A, X, C);
+  const matrix_type exact = A*X;
+  assert (!C.isApprox(exact, 1e-12) && C.isApprox(exact, 1e-5));
+  mixed_adaptor_type::add (A, X, C);
+  assert (C == matrix_type(A + X));
+  assert_close (mixed_adaptor_type::logdet (A),
+                adaptor_type::logdet (matrix_type(A)));
+
+  MixedMMFunc fA(A, true);
+  MixedMMFunc fX(X, false);
+  AMD::ScalarMatrixFunc<mixed_matrix_type, double> f =
+                                          AMD::logdet(fA + transpose(fX)*fX);
+
+  matrix_type Ad = A;
+  MMFunc gA(Ad, true);
+  MMFunc gX(matrix_type(X), false);
+  SMFunc g = AMD::logdet(gA + transpose(gX)*gX);
+
+  assert (std::abs(f.functionVal - g.functionVal) <=
+          1e-5 * std::abs(g.functionVal));
+  assert ((f.derivativeVal - g.derivativeVal).norm() <=
+          1e-4 * g.derivativeVal.norm());
+}
+
 int main(int argc, char** argv) {
 
   std::cout << "Testing getNumRows() and getNumCols() .... ";
@@ -195,6 +260,14 @@ int main(int argc, char** argv) {
   testTraceLogdet();
   std::cout << "DONE" << std::endl;
 
+  std::cout << "Testing single precision .... ";
+  testSinglePrecision();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing mixed precision .... ";
+  testMixedPrecision();
+  std::cout << "DONE" << std::endl;
+
   std::cout << "All tests passed." << std::endl;
 
   return(0);
@@ -0,0 +1,220 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <assert.h>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::MappedMatrix<double> mapped_type;
+typedef AMD::ComputationGraph<mapped_type, value_type> mapped_graph_type;
+
+void assert_close (const matrix_type& A, const matrix_type& B) {
+  assert (A.rows() == B.rows() && A.cols() == B.cols());
+  assert ((A-B).norm() <= 1e-9 * (1.0 + B.norm()));
+}
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+/** Random matrix that is safe to invert: A + n*I */
+matrix_type random_matrix (int n) {
+  matrix_type A = matrix_type::Random(n,n);
+  A += n * matrix_type::Identity(n,n);
+  return A;
+}
+
+std::string scratch_file (const char* name) {
+  return std::string("/tmp/amd-") + name + "-" +
+         std::to_string(static_cast<long>(getpid())) + ".graph";
+}
+
+/** Evaluate a recorded graph and a loaded one at the same point */
+void checkSameFunction (const graph_type& graph,
+                        const mapped_graph_type& loaded) {
+  assert (graph.size() == loaded.size());
+  assert (graph.rootOp() == loaded.rootOp());
+  assert (graph.numVariables() == loaded.numVariables());
+
+  std::vector<matrix_type> point, gradient;
+  std::vector<mapped_type> mappedPoint, mappedGradient;
+  for (int v=0; v<graph.numVariables(); ++v) {
+    const AMD::GraphNode<matrix_type, value_type>& node =
+      graph.node(graph.variable(v));
+    point.push_back(random_matrix(node.numRows));
+    mappedPoint.push_back(mapped_type(point.back()));
+  }
+  AMD::SharedEvaluator<matrix_type, value_type> eval(graph);
+  AMD::SharedEvaluator<mapped_type, value_type> mappedEval(loaded);
+  assert_close (mappedEval.evaluate(mappedPoint, &mappedGradient),
+                eval.evaluate(point, &gradient));
+  for (int v=0; v<graph.numVariables(); ++v) {
+    assert_close (mappedGradient[v].toPlain(), gradient[v]);
+  }
+}
+
+void testRoundTrip () {
+  const int n = 6;
+  matrix_type A = random_matrix(n);
+  matrix_type S = A * A.transpose();
+  matrix_type B = matrix_type::Random(n,3);
+  MMFunc fA(A, true);
+  MMFunc fS(S, true);
+  MMFunc fB(B, true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc fY(random_matrix(n), false);
+  SMFunc two(2.0, n, n);
+
+  /** Every operator, with shared subexpressions and constant scalars */
+  MMFunc XY = fX*fY;
+  MMFunc root = inv(fA + XY)*fS - transpose(XY)*two +
+                elementwiseProduct(fX, fA) + diag(-fY) +
+                fB*transpose(fB);
+  graph_type graph(root, AMD::kTraceRoot);
+  const std::string path = scratch_file("roundtrip");
+  AMD::saveGraph(graph, path);
+
+  mapped_graph_type loaded = AMD::loadGraph<double>(path);
+  checkSameFunction (graph, loaded);
+
+  /** The constants borrow the mapped file, aligned; the variables do not */
+  for (int i=0; i<loaded.size(); ++i) {
+    const AMD::GraphNode<mapped_type, value_type>& node = loaded.node(i);
+    assert (node.opNum == graph.node(i).opNum);
+    if (!node.isLeaf()) continue;
+    assert (node.isConst == node.matrixPtr->isBorrowed());
+    if (node.isConst) {
+      assert (0 == reinterpret_cast<size_t>(node.matrixPtr->data()) % 64);
+      assert_close (node.matrixPtr->toPlain(), *graph.node(i).matrixPtr);
+    }
+  }
+
+  /** The mapping outlives the file and the graph it was loaded into */
+  boost::shared_ptr<mapped_type> leaf = loaded.node(0).matrixPtr;
+  const matrix_type value = leaf->toPlain();
+  std::remove(path.c_str());
+  loaded = mapped_graph_type();
+  assert_close (leaf->toPlain(), value);
+
+  /** logdet of a ScalarMatrixFunc */
+  SMFunc f = AMD::logdet(fS + fX*transpose(fX));
+  AMD::saveGraph(f, path);
+  checkSameFunction (graph_type(*f.argumentFuncVal, AMD::kLogdetRoot),
+                     AMD::loadGraph<double>(path));
+  std::remove(path.c_str());
+}
+
+void testSeparateConstants () {
+  const int n = 5;
+  matrix_type A = random_matrix(n);
+  matrix_type C = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fC(C, true);
+  MMFunc fX(random_matrix(n), false);
+  graph_type graph(fA*fX*fC, AMD::kTraceRoot);
+  const std::string path = scratch_file("separate");
+  AMD::saveGraph(graph, path, false);
+
+  /** The file has no room for the constants */
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  assert (static_cast<size_t>(file.tellg()) ==
+          sizeof(AMD::GraphFileHeader) +
+          graph.size()*sizeof(AMD::GraphFileNode));
+  file.close();
+
+  std::vector<mapped_type> constants;
+  constants.push_back(mapped_type(A.data(), n, n));
+  constants.push_back(mapped_type(C.data(), n, n));
+  mapped_graph_type loaded = AMD::loadGraph<double>(path, constants);
+  checkSameFunction (graph, loaded);
+
+  bool thrown = false;
+  try { AMD::loadGraph<double>(path); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+  std::remove(path.c_str());
+}
+
+/** Overwrite some bytes of a file */
+void patch_file (const std::string& path, long offset, const void* bytes,
+                 size_t size) {
+  std::fstream file(path.c_str(),
+                    std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(offset);
+  file.write(static_cast<const char*>(bytes), size);
+}
+
+bool load_fails (const std::string& path) {
+  try { AMD::loadGraph<double>(path); }
+  catch (const AMD::exception_generic_impl&) { return true; }
+  return false;
+}
+
+void testInvalidFiles () {
+  const int n = 3;
+  MMFunc fA(random_matrix(n), true);
+  MMFunc fX(random_matrix(n), false);
+  graph_type graph(fA*fX, AMD::kTraceRoot);
+  const std::string path = scratch_file("invalid");
+
+  assert (load_fails(path));
+
+  /** Another version */
+  AMD::saveGraph(graph, path);
+  const uint32_t version = AMD::kGraphFileVersion + 1;
+  patch_file (path, 8, &version, sizeof(version));
+  assert (load_fails(path));
+
+  /** Another scalar type */
+  AMD::saveGraph(graph, path);
+  assert (load_fails(path) == false);
+  bool thrown = false;
+  try { AMD::loadGraph<float>(path); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+
+  /** A child after its parent */
+  const int32_t child = 2;
+  patch_file (path, sizeof(AMD::GraphFileHeader) +
+                    2*sizeof(AMD::GraphFileNode) + 4, &child, sizeof(child));
+  assert (load_fails(path));
+
+  /** A truncated file */
+  AMD::saveGraph(graph, path);
+  assert (0 == truncate(path.c_str(), sizeof(AMD::GraphFileHeader) + 8));
+  assert (load_fails(path));
+  std::remove(path.c_str());
+}
+
+int main(int argc, char** argv) {
+
+  std::cout << "Testing saving and mapping graphs .... ";
+  testRoundTrip();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing constants that are not embedded .... ";
+  testSeparateConstants();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing invalid graph files .... ";
+  testInvalidFiles();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
@@ -0,0 +1,237 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <assert.h>
+#include <cmath>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> dense_type;
+typedef Eigen::SparseMatrix<double> sparse_type;
+typedef AMD::HybridMatrix<double> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::MatrixMatrixFunc<dense_type, value_type> DenseMMFunc;
+typedef AMD::ScalarMatrixFunc<dense_type, value_type> DenseSMFunc;
+
+void assert_close (const dense_type& A, const dense_type& B) {
+  assert (A.rows() == B.rows() && A.cols() == B.cols());
+  assert ((A-B).norm() <= 1e-9 * (1.0 + B.norm()));
+}
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+/** A sparse symmetric positive definite n x n matrix */
+sparse_type sparse_psd (int n) {
+  return *(AMD::rand_psd_t<sparse_type>::apply(n, 3*n));
+}
+
+/** A sparse n x n matrix with the entries (i,j) where (i+k*j)%3 == r */
+sparse_type sparse_stripes (int n, int k, int r) {
+  dense_type A = dense_type::Zero(n,n);
+  for (int j=0; j<n; ++j)
+    for (int i=0; i<n; ++i)
+      if (r == (i+k*j)%3) A(i,j) = 1.0 + i + 2.0*j;
+  return A.sparseView();
+}
+
+/** The representations follow the operands when the selection is off */
+void testPromotion () {
+  AMD::DensityThreshold::set(1.0);
+  const int n = 6;
+  const matrix_type S = sparse_psd(n);
+  const matrix_type T = sparse_psd(n);
+  const matrix_type X = dense_type(dense_type::Random(n,n));
+  assert (S.isSparse() && !X.isSparse());
+  assert (S.density() < 1.0 && 1.0 == X.density());
+
+  matrix_type C;
+  adaptor_type::add(S, T, C);
+  assert (C.isSparse());
+  assert_close (C.toDense(), S.toDense() + T.toDense());
+  adaptor_type::add(S, X, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense(), S.toDense() + X.getDense());
+  adaptor_type::minus(X, S, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense(), X.getDense() - S.toDense());
+
+  adaptor_type::multiply(S, T, C);
+  assert (C.isSparse());
+  assert_close (C.toDense(), S.toDense() * T.toDense());
+  adaptor_type::multiply(S, X, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense(), S.toDense() * X.getDense());
+  adaptor_type::multiply(X, S, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense(), X.getDense() * S.toDense());
+
+  adaptor_type::elementwiseProduct(X, S, C);
+  assert (C.isSparse());
+  assert_close (C.toDense(), X.getDense().cwiseProduct(S.toDense()));
+  adaptor_type::transpose(S, C);
+  assert (C.isSparse());
+  assert_close (C.toDense(), S.toDense().transpose());
+  adaptor_type::diag(X, C);
+  assert (C.isSparse() && n == C.getSparse().nonZeros());
+  adaptor_type::negation(S, C);
+  assert (C.isSparse());
+  adaptor_type::multiply(S, 2.0, C);
+  assert (C.isSparse());
+  assert_close (C.toDense(), 2.0 * S.toDense());
+
+  /** Inverses and identities are dense, zeros are sparse */
+  adaptor_type::inv(S, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense() * S.toDense(), dense_type::Identity(n,n));
+  assert (!adaptor_type::eye(n).isSparse());
+  assert (adaptor_type::zeros(n,n).isSparse());
+
+  assert_close (adaptor_type::trace(S), S.toDense().trace());
+  assert_close (adaptor_type::logdet(S),
+                std::log(S.toDense().determinant()));
+
+  /** Results may overwrite an operand */
+  matrix_type D = S;
+  adaptor_type::add(D, X, D);
+  assert_close (D.getDense(), S.toDense() + X.getDense());
+  D = S;
+  adaptor_type::add(D, T, D);
+  assert_close (D.toDense(), S.toDense() + T.toDense());
+  AMD::DensityThreshold::set(0.1);
+}
+
+/** Sparse sums and products become dense above the threshold */
+void testSelection () {
+  const int n = 90;
+  assert (0.1 == AMD::DensityThreshold::get());
+
+  /** A diagonal times a diagonal is estimated and measured sparse */
+  const matrix_type D = sparse_type(dense_type(
+                          dense_type::Random(n,1)).asDiagonal());
+  matrix_type C;
+  adaptor_type::multiply(D, D, C);
+  assert (C.isSparse());
+  assert_close (C.toDense(), D.toDense() * D.toDense());
+
+  /** A column times a row is estimated sparse, but measured dense */
+  dense_type column = dense_type::Zero(n,n), row = dense_type::Zero(n,n);
+  column.col(0).setRandom();
+  row.row(0).setRandom();
+  const matrix_type L = sparse_type(column.sparseView());
+  const matrix_type R = sparse_type(row.sparseView());
+  adaptor_type::multiply(L, R, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense(), column * row);
+  adaptor_type::multiply(R, L, C);
+  assert (C.isSparse() && 1 == C.getSparse().nonZeros());
+  assert_close (C.toDense(), row * column);
+
+  /** Stripes with a third of the entries each: the product is dense */
+  const matrix_type S = sparse_stripes(n, 1, 0);
+  const matrix_type T = sparse_stripes(n, 2, 1);
+  adaptor_type::multiply(S, T, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense(), S.toDense() * T.toDense());
+
+  /** Their sum is estimated at 5/9 of the entries */
+  AMD::DensityThreshold::set(0.5);
+  adaptor_type::add(S, T, C);
+  assert (!C.isSparse());
+  assert_close (C.getDense(), S.toDense() + T.toDense());
+  AMD::DensityThreshold::set(0.6);
+  adaptor_type::minus(S, T, C);
+  assert (C.isSparse());
+  assert_close (C.toDense(), S.toDense() - T.toDense());
+
+  /** Results may overwrite an operand */
+  AMD::DensityThreshold::set(0.0);
+  matrix_type E = S;
+  adaptor_type::add(E, T, E);
+  assert (!E.isSparse());
+  assert_close (E.getDense(), S.toDense() + T.toDense());
+  E = T;
+  adaptor_type::multiply(S, E, E);
+  assert (!E.isSparse());
+  assert_close (E.getDense(), S.toDense() * T.toDense());
+
+  bool thrown = false;
+  try { AMD::DensityThreshold::set(1.5); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown && 0.0 == AMD::DensityThreshold::get());
+  AMD::DensityThreshold::set(0.1);
+}
+
+/** Sparse constants and dense variables in one function */
+void testMixedFunction () {
+  const int n = 8;
+  const sparse_type S = sparse_psd(n);
+  const sparse_type T = sparse_psd(n);
+  const dense_type X = dense_type::Random(n,n);
+
+  MMFunc fS(S, true);
+  MMFunc fT(T, true);
+  MMFunc fX(X, false);
+  SMFunc f = AMD::trace(fS*fX*fT);
+  SMFunc g = AMD::logdet(fS + transpose(fX)*fT*fX);
+
+  dense_type Sd = S, Td = T;
+  DenseMMFunc dS(Sd, true);
+  DenseMMFunc dT(Td, true);
+  DenseMMFunc dX(X, false);
+  DenseSMFunc df = AMD::trace(dS*dX*dT);
+  DenseSMFunc dg = AMD::logdet(dS + transpose(dX)*dT*dX);
+
+  /** The gradient of trace(S*X*T) is S^T*T^T, which stays sparse */
+  assert_close (f.functionVal, df.functionVal);
+  assert_close (f.derivativeVal.toDense(), df.derivativeVal);
+  assert_close (g.functionVal, dg.functionVal);
+  assert_close (g.derivativeVal.toDense(), dg.derivativeVal);
+
+  /** The graph evaluators seed the adjoints with the dense identity */
+  graph_type graph(fS + transpose(fX)*fT*fX, AMD::kLogdetRoot);
+  AMD::SharedEvaluator<matrix_type, value_type> shared(graph);
+  std::vector<matrix_type> point(1, matrix_type(X)), gradient;
+  assert_close (shared.evaluate(point, &gradient), dg.functionVal);
+  assert (!gradient[0].isSparse());
+  assert_close (gradient[0].getDense(), dg.derivativeVal);
+
+  /** The values do not depend on the representations */
+  const double thresholds[] = {0.0, 0.1, 1.0};
+  for (int t=0; t<3; ++t) {
+    AMD::DensityThreshold::set(thresholds[t]);
+    assert_close (shared.evaluate(point, &gradient), dg.functionVal);
+    assert_close (gradient[0].toDense(), dg.derivativeVal);
+  }
+  AMD::DensityThreshold::set(0.1);
+}
+
+int main(int argc, char** argv) {
+
+  std::cout << "Testing promotion between sparse and dense .... ";
+  testPromotion();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing the selection of representations .... ";
+  testSelection();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing functions of sparse and dense matrices .... ";
+  testMixedFunction();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
@@ -0,0 +1,216 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <cmath>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::KernelGenerator<matrix_type, value_type> generator_type;
+typedef AMD::CompiledKernel<matrix_type, value_type> kernel_type;
+
+void assert_close (const matrix_type& A, const matrix_type& B) {
+  assert (A.rows() == B.rows() && A.cols() == B.cols());
+  assert ((A-B).norm() <= 1e-9 * (1.0 + B.norm()));
+}
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+/** Random matrix that is safe to invert: A + n*I */
+matrix_type random_matrix (int n) {
+  matrix_type A = matrix_type::Random(n,n);
+  A += n * matrix_type::Identity(n,n);
+  return A;
+}
+
+/** Compare the compiled kernel of a tree with one variable against
+    trace() and logdet() on the same tree */
+void checkAgainstRecorded (const MMFunc& root, bool useLogdet) {
+  SMFunc recorded = useLogdet ? AMD::logdet(root) : AMD::trace(root);
+  kernel_type kernel(recorded);
+  assert (1 == kernel.getGraph().numVariables());
+
+  std::vector<matrix_type> gradient;
+  assert_close (kernel.evaluate(std::vector<matrix_type>(), &gradient),
+                recorded.functionVal);
+  assert_close (gradient[0], recorded.derivativeVal);
+  assert_close (kernel.evaluate(std::vector<matrix_type>()),
+                recorded.functionVal);
+}
+
+/** Compare the compiled kernel of a graph against the interpreted one at a
+    new point */
+void checkAgainstShared (const graph_type& graph) {
+  std::vector<matrix_type> point, gradient, expected;
+  for (int v=0; v<graph.numVariables(); ++v) {
+    const AMD::GraphNode<matrix_type, value_type>& node =
+      graph.node(graph.variable(v));
+    matrix_type value = matrix_type::Random(node.numRows, node.numCols);
+    if (node.numRows == node.numCols) {
+      value += node.numRows * matrix_type::Identity(node.numRows,
+                                                    node.numCols);
+    }
+    point.push_back(value);
+  }
+  kernel_type kernel(graph);
+  AMD::SharedEvaluator<matrix_type, value_type> shared(graph);
+  assert_close (kernel.evaluate(point, &gradient),
+                shared.evaluate(point, &expected));
+  for (int v=0; v<graph.numVariables(); ++v) {
+    assert_close (gradient[v], expected[v]);
+  }
+}
+
+void testOperators () {
+  /** 3x3 nodes are fixed-size in the kernel, 6x6 nodes are not */
+  const int sizes[] = {3, 6};
+  for (int s=0; s<2; ++s) {
+    const int n = sizes[s];
+    matrix_type A = random_matrix(n);
+    matrix_type B = random_matrix(n);
+    MMFunc fA(A, true);
+    MMFunc fB(B, true);
+    MMFunc fX(random_matrix(n), false);
+    SMFunc two(2.0, n, n);
+
+    checkAgainstRecorded (fA*fX*fB + transpose(fX) - (-fX), false);
+    checkAgainstRecorded (inv(fX + fA)*fB + elementwiseProduct(fA, fX) +
+                          diag(fX)*fA, false);
+    checkAgainstRecorded (fA*transpose(fA) + fX*transpose(fX), true);
+
+    /** trace() needs derivativeFuncVal on scalar children, so scale here */
+    checkAgainstShared (graph_type(fA*(fX*two) + two*fX, AMD::kTraceRoot));
+  }
+
+  /** Several variables, shared subexpressions and rectangular nodes */
+  const int n = 5;
+  MMFunc fS(random_matrix(n), true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc fY(random_matrix(n), false);
+  MMFunc fR(matrix_type::Random(n,2), false);
+  MMFunc XY = fX*fY;
+  checkAgainstShared (graph_type(XY*inv(XY + fS) - fR*transpose(fR),
+                                 AMD::kTraceRoot));
+  checkAgainstShared (graph_type(fS*transpose(fS) + fR*transpose(fR),
+                                 AMD::kLogdetRoot));
+}
+
+void testStructure () {
+  const int n = 4;
+  matrix_type A = random_matrix(n);
+  matrix_type B = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fB(B, true);
+  MMFunc fI(matrix_type::Identity(n,n), true, AMD::kIdentity);
+  MMFunc fZ(matrix_type::Zero(n,n), true, AMD::kZero);
+  MMFunc fX(random_matrix(n), false);
+
+  /** Identities and zeros are neither stored nor multiplied */
+  MMFunc root = fI*fX*fA + fZ*fX + (fX - fZ) + elementwiseProduct(fI, fX);
+  generator_type generator(graph_type(root, AMD::kTraceRoot));
+  assert (1 == generator.numConstants());
+  assert_close (generator.constant(0), A);
+  const std::string source = generator.generate("kernel");
+  assert (std::string::npos != source.find("extern \"C\" T kernel("));
+  assert (std::string::npos != source.find("typedef Eigen::Matrix<T, 4, 4>"));
+  assert (std::string::npos == source.find("Zero"));
+  assert (std::string::npos == source.find("MX"));
+  checkAgainstRecorded (root, false);
+
+  /** Constant subexpressions are folded */
+  generator_type folded(graph_type(inv(fA*fB)*fX + fI + transpose(fI),
+                                   AMD::kTraceRoot));
+  assert (1 == folded.numConstants());
+  assert_close (folded.constant(0), matrix_type((A*B).inverse()));
+  checkAgainstShared (folded.getGraph());
+
+  /** A function that does not depend on its variable */
+  checkAgainstShared (graph_type(fA*fB + fZ*fX, AMD::kTraceRoot));
+}
+
+void testFloat () {
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> float_type;
+  const int n = 3;
+  float_type A = float_type::Random(n,n) + n*float_type::Identity(n,n);
+  float_type X = float_type::Random(n,n) + n*float_type::Identity(n,n);
+  AMD::MatrixMatrixFunc<float_type, float> fA(A, true);
+  AMD::MatrixMatrixFunc<float_type, float> fX(X, false);
+  AMD::CompiledKernel<float_type, float> kernel(AMD::trace(fA*inv(fX)));
+
+  std::vector<float_type> gradient;
+  const float value = kernel.evaluate(std::vector<float_type>(1, X),
+                                      &gradient);
+  const float_type Xinv = X.inverse();
+  assert (std::fabs(value - (A*Xinv).trace()) <= 1e-4f * std::fabs(value));
+  assert ((gradient[0] + (Xinv*A*Xinv).transpose()).norm() <=
+          1e-4f * gradient[0].norm());
+}
+
+void testErrors () {
+  const int n = 3;
+  MMFunc fA(random_matrix(n), true);
+  MMFunc fX(random_matrix(n), false);
+  MMFunc fR(matrix_type::Random(n,2), false);
+
+  bool thrown = false;
+  try { generator_type generator(graph_type(fA*fX)); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+
+  thrown = false;
+  try { generator_type generator(graph_type(fR, AMD::kTraceRoot)); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+
+  kernel_type kernel(graph_type(fA*fX, AMD::kTraceRoot));
+  thrown = false;
+  try { kernel.evaluate(std::vector<matrix_type>(1, random_matrix(n+1))); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+
+  /** A compiler that does not exist */
+  const std::string compiler = AMD::KernelSettings::compiler();
+  AMD::KernelSettings::setCompiler("/nonexistent/c++");
+  thrown = false;
+  try { kernel_type broken(graph_type(fA*fX, AMD::kTraceRoot)); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+  AMD::KernelSettings::setCompiler(compiler);
+}
+
+int main(int argc, char** argv) {
+  /** The kernels are small; build them quickly */
+  AMD::KernelSettings::setFlags("-O1 -std=c++11 -shared -fPIC");
+
+  std::cout << "Testing compiled kernels of each operator .... ";
+  testOperators();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing structure tags and folded constants .... ";
+  testStructure();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing single precision kernels .... ";
+  testFloat();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing invalid graphs and bindings .... ";
+  testErrors();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
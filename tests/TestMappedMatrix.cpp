@@ -0,0 +1,130 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <cmath>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> plain_type;
+typedef AMD::MappedMatrix<double> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+
+void assert_close (const plain_type& A, const plain_type& B) {
+  assert (A.rows() == B.rows() && A.cols() == B.cols());
+  assert ((A-B).norm() <= 1e-9 * (1.0 + B.norm()));
+}
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+/** A column-major symmetric positive definite n x n matrix stored with
+    leading dimension ld > n */
+std::vector<double> external_buffer (int n, int ld) {
+  std::vector<double> buffer(ld*n, -1.0);
+  plain_type R = plain_type::Random(n, n);
+  plain_type A = R*R.transpose() + n*plain_type::Identity(n, n);
+  for (int j=0; j<n; ++j) for (int i=0; i<n; ++i) buffer[i + j*ld] = A(i,j);
+  return buffer;
+}
+
+void testBorrow () {
+  const int n = 4, ld = 6;
+  std::vector<double> buffer = external_buffer(n, ld);
+  const std::vector<double> original = buffer;
+
+  matrix_type A(&buffer[0], n, n, ld);
+  assert (A.isBorrowed());
+  assert (&buffer[0] == A.data());
+  assert (buffer[1 + 2*ld] == A(1, 2));
+
+  /** Copies are views of the same memory */
+  matrix_type B(A);
+  assert (B.isBorrowed() && &buffer[0] == B.data());
+  boost::shared_ptr<matrix_type> C = adaptor_type::copyConstructMatrix(A);
+  assert (&buffer[0] == C->data());
+
+  /** Assigning detaches instead of writing to the buffer */
+  B = plain_type::Zero(n, n);
+  assert (!B.isBorrowed() && 0.0 == B.norm());
+  adaptor_type::add(A, A, *C);
+  assert (!C->isBorrowed());
+  assert_close (C->toPlain(), 2.0*A.toPlain());
+  assert (original == buffer);
+
+  /** Borrow through an Eigen::Map */
+  Eigen::Map<const plain_type, 0, Eigen::OuterStride<> >
+    map(&buffer[0], n, n, Eigen::OuterStride<>(ld));
+  matrix_type D(map);
+  assert (D.isBorrowed() && &buffer[0] == D.data());
+  assert_close (D.toPlain(), A.toPlain());
+}
+
+void testGradients () {
+  const int n = 4, ld = 5;
+  std::vector<double> bufferA = external_buffer(n, ld);
+  std::vector<double> bufferX = external_buffer(n, ld);
+  const std::vector<double> originalA = bufferA;
+  const std::vector<double> originalX = bufferX;
+  matrix_type A(&bufferA[0], n, n, ld);
+  matrix_type X(&bufferX[0], n, n, ld);
+  const plain_type pA = A.toPlain();
+  const plain_type pX = X.toPlain();
+
+  /** The leaves wrap the buffers */
+  MMFunc fA(A, true);
+  MMFunc fX(X, false);
+  assert (&bufferA[0] == fA.matrixPtr->data());
+  assert (&bufferX[0] == fX.matrixPtr->data());
+
+  SMFunc f = AMD::trace(fA*fX*fX);
+  assert_close (f.functionVal, (pA*pX*pX).trace());
+  assert_close (f.derivativeVal.toPlain(),
+                plain_type((pA*pX + pX*pA).transpose()));
+
+  SMFunc g = AMD::logdet(fA + fX*transpose(fX));
+  plain_type S = pA + pX*pX.transpose();
+  assert_close (g.functionVal, std::log(S.determinant()));
+  assert_close (g.derivativeVal.toPlain(),
+                plain_type(2.0*S.inverse().transpose()*pX));
+
+  /** Graph evaluation reads the leaves in place as well */
+  graph_type graph(inv(fA + fX)*fA, AMD::kTraceRoot);
+  AMD::IncrementalEvaluator<matrix_type, value_type> eval(graph);
+  matrix_type G;
+  eval.gradient(G);
+  plain_type Y = (pA + pX).inverse();
+  assert_close (eval.functionValue(), (Y*pA).trace());
+  assert_close (G.toPlain(), plain_type(-(Y*pA*Y).transpose()));
+
+  /** Updating a borrowed variable detaches it */
+  fX.updateValue(matrix_type(plain_type::Identity(n, n)));
+  assert (!fX.matrixPtr->isBorrowed());
+
+  assert (originalA == bufferA);
+  assert (originalX == bufferX);
+}
+
+int main(int argc, char** argv) {
+
+  std::cout << "Testing borrowed matrices .... ";
+  testBorrow();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing gradients with borrowed leaves .... ";
+  testGradients();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
@@ -574,6 +574,49 @@ void testAdvancedSymbolicMatrixMatrixFunc () {
   AMD_CATCH_AND_PRINT()
 }
 
+/**
+ * @brief Test that no-grad mode computes values without recording the tree.
+ */
+void testNoGradSymbolicMatrixMatrixFunc() {
+  AMD_START_TRY_BLOCK()
+  symbolic_matrix_type X("X",ROW,COL);
+  symbolic_matrix_type A("A",ROW,COL);
+  SymbolicMMFunc fX(X,false);
+  SymbolicMMFunc fA(A,true);
+  SymbolicSMFunc func;
+
+  {
+    AMD::NoGradGuard noGrad;
+    assert(false == AMD::GradMode::isEnabled());
+
+    /** 1. Operators create constant leaves that only hold the value */
+    SymbolicMMFunc fAX = fA*fX;
+    assert(NULL == fAX.leftChild && NULL == fAX.rightChild);
+    assert(AMD::CONST == fAX.opNum && true == fAX.isConst);
+    assert(fAX.matrixPtr->getString() == "(A*X)");
+
+    SymbolicMMFunc fInv = inv(transpose(fX) + fA);
+    assert(NULL == fInv.leftChild && AMD::CONST == fInv.opNum);
+    assert(fInv.matrixPtr->getString() == "inv(X'+A)");
+
+    /** 2. trace and logdet only return the function value */
+    func = trace(fAX);
+    assert(func.functionVal.getString() == "trace(A*X)");
+    assert(true == func.isConst && !func.derivativeFuncVal);
+
+    func = logdet(fA + fX);
+    assert(func.functionVal.getString() == "log(det(A+X))");
+    assert(true == func.isConst && !func.derivativeFuncVal);
+  }
+
+  /** 3. Recording resumes once the guard goes out of scope */
+  assert(true == AMD::GradMode::isEnabled());
+  func = trace(fA*fX);
+  assert(func.derivativeVal.getString() == "A'");
+  AMD_END_TRY_BLOCK()
+  AMD_CATCH_AND_PRINT()
+}
+
 void testTaylorExp() {
 
   std::string ans;
@@ -645,6 +688,10 @@ std::cout << std::endl;
   testAdvancedSymbolicMatrixMatrixFunc();
   std::cout << "DONE" << std::endl;
 
+  std::cout << "Testing no-grad matrix-matrix functions .... ";
+  testNoGradSymbolicMatrixMatrixFunc();
+  std::cout << "DONE" << std::endl;
+
 #if AMD_HAVE_ELEMENTAL
   std::cout << "Testing elemetal matrix-matrix functions .... ";
   testElementalMatrixMatrixFunc();
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <string>
+#include <assert.h>
+#include <cmath>
+#include <thread>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::MatrixPool<matrix_type> pool_type;
+
+/** Recycle the dense matrices of this test through the pool */
+namespace AMD {
+  template <> struct AllocationPolicy_t<matrix_type> :
+    public PoolAllocationPolicy<matrix_type> {};
+}
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+void testHitsAndMisses () {
+  pool_type::clear();
+  pool_type::resetCounters();
+
+  const double* data;
+  {
+    boost::shared_ptr<matrix_type> A = pool_type::acquire(4, 4);
+    assert (0 == pool_type::hits() && 1 == pool_type::misses());
+    data = A->data();
+#if EIGEN_MAX_ALIGN_BYTES >= 64
+    assert (0 == reinterpret_cast<size_t>(data) % 64);
+#endif
+  }
+  assert (1 == pool_type::numCached());
+
+  /** Same shape: the same storage comes back */
+  boost::shared_ptr<matrix_type> B = pool_type::acquire(4, 4);
+  assert (1 == pool_type::hits() && 1 == pool_type::misses());
+  assert (data == B->data());
+
+  /** Other shapes are kept apart */
+  boost::shared_ptr<matrix_type> C = pool_type::acquire(4, 5);
+  assert (1 == pool_type::hits() && 2 == pool_type::misses());
+  assert (4 == C->rows() && 5 == C->cols());
+
+  /** Only so many matrices of one shape are kept */
+  pool_type::setMaxCachedPerShape(1);
+  boost::shared_ptr<matrix_type> D = pool_type::acquire(4, 5);
+  C.reset();
+  D.reset();
+  assert (1 == pool_type::numCached());
+  pool_type::setMaxCachedPerShape(16);
+
+  pool_type::clear();
+  assert (0 == pool_type::numCached());
+}
+
+void testAdaptorAllocations () {
+  pool_type::clear();
+  pool_type::resetCounters();
+
+  boost::shared_ptr<matrix_type> A = adaptor_type::defaultConstructMatrix(3, 3);
+  A->setIdentity();
+  boost::shared_ptr<matrix_type> B = adaptor_type::copyConstructMatrix(*A);
+  assert (2 == pool_type::misses());
+  assert (3.0 == B->trace());
+}
+
+void testRepeatedEvaluation () {
+  const int n = 8;
+  matrix_type A = matrix_type::Random(n, n) + n*matrix_type::Identity(n, n);
+  matrix_type X = matrix_type::Random(n, n) + n*matrix_type::Identity(n, n);
+  const double expected = (A*X*X.transpose()).trace();
+
+  pool_type::clear();
+  pool_type::resetCounters();
+  std::size_t missesAfterFirst = 0;
+  for (int iteration=0; iteration<5; ++iteration) {
+    MMFunc fA(A, true);
+    MMFunc fX(X, false);
+    SMFunc f = AMD::trace(fA*fX*transpose(fX));
+    assert_close (f.functionVal, expected);
+    if (0 == iteration) missesAfterFirst = pool_type::misses();
+  }
+  /** Every later iteration is served from the pool */
+  assert (missesAfterFirst == pool_type::misses());
+  assert (0 < pool_type::hits());
+}
+
+void testThreadLocal () {
+  pool_type::clear();
+  boost::shared_ptr<matrix_type> A = pool_type::acquire(2, 2);
+
+  std::size_t otherHits = 1;
+  std::thread other([&otherHits] () {
+    boost::shared_ptr<matrix_type> B = pool_type::acquire(2, 2);
+    B.reset();
+    B = pool_type::acquire(2, 2);
+    otherHits = pool_type::hits() + pool_type::misses();
+  });
+  other.join();
+
+  /** The other thread had its own counters and free list */
+  assert (2 == otherHits);
+  assert (0 == pool_type::numCached());
+}
+
+int main(int argc, char** argv) {
+
+  std::cout << "Testing pool hits and misses .... ";
+  testHitsAndMisses();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing pooled adaptor allocations .... ";
+  testAdaptorAllocations();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing repeated evaluations .... ";
+  testRepeatedEvaluation();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing thread-local pools .... ";
+  testThreadLocal();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
@@ -0,0 +1,208 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <assert.h>
+#include <cmath>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrix_type;
+typedef Eigen::SparseMatrix<double> sparse_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+typedef AMD::PatternGradientEvaluator<value_type> evaluator_type;
+typedef std::map<boost::shared_ptr<matrix_type>, sparse_type> pattern_map;
+
+void assert_close (const matrix_type& A, const matrix_type& B) {
+  assert (A.rows() == B.rows() && A.cols() == B.cols());
+  assert ((A-B).norm() <= 1e-9 * (1.0 + B.norm()));
+}
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+/** Random matrix that is safe to invert: A + n*I */
+matrix_type random_matrix (int n) {
+  matrix_type A = matrix_type::Random(n,n);
+  A += n * matrix_type::Identity(n,n);
+  return A;
+}
+
+/** A pattern with the diagonal and the entries (i,j) where (i+2*j)%5 == 0 */
+sparse_type stripes (int m, int n) {
+  matrix_type A = matrix_type::Zero(m,n);
+  for (int j=0; j<n; ++j)
+    for (int i=0; i<m; ++i)
+      if (i == j || 0 == (i+2*j)%5) A(i,j) = 1.0;
+  return A.sparseView();
+}
+
+/** The entries of A on the pattern of P, as a dense matrix */
+matrix_type restrict_to (const matrix_type& A, const sparse_type& P) {
+  matrix_type result = matrix_type::Zero(A.rows(), A.cols());
+  for (int j=0; j<P.outerSize(); ++j)
+    for (sparse_type::InnerIterator it(P,j); it; ++it)
+      result(it.row(), j) = A(it.row(), j);
+  return result;
+}
+
+/** Compare the restricted gradients with the full ones on the pattern */
+void checkPattern (const MMFunc& root,
+                   bool useLogdet,
+                   const pattern_map& patterns) {
+  graph_type graph(root, useLogdet ? AMD::kLogdetRoot : AMD::kTraceRoot);
+  AMD::SharedEvaluator<matrix_type, value_type> full(graph);
+  std::vector<matrix_type> point, gradient;
+  for (int v=0; v<graph.numVariables(); ++v) {
+    point.push_back(*graph.node(graph.variable(v)).matrixPtr);
+  }
+  const double expected = full.evaluate(point, &gradient);
+
+  evaluator_type eval(graph, patterns);
+  std::vector<sparse_type> restricted;
+  assert_close (eval.evaluate(&restricted), expected);
+  assert_close (eval.evaluate(point, &restricted), expected);
+  assert (graph.numVariables() == static_cast<int>(restricted.size()));
+
+  for (int v=0; v<graph.numVariables(); ++v) {
+    const pattern_map::const_iterator found =
+      patterns.find(graph.node(graph.variable(v)).matrixPtr);
+    if (patterns.end() == found) {
+      assert (!eval.hasPattern(v));
+      assert_close (matrix_type(restricted[v]), gradient[v]);
+    } else {
+      assert (eval.hasPattern(v));
+      assert (found->second.nonZeros() == restricted[v].nonZeros());
+      assert_close (matrix_type(restricted[v]),
+                    restrict_to(gradient[v], found->second));
+    }
+  }
+}
+
+void testOperators () {
+  const int n = 7;
+  matrix_type A = random_matrix(n);
+  matrix_type B = random_matrix(n);
+  matrix_type X = random_matrix(n);
+  matrix_type Y = random_matrix(n);
+  MMFunc fA(A, true);
+  MMFunc fB(B, true);
+  MMFunc fX(X, false);
+  MMFunc fY(Y, false);
+  SMFunc two(2.0, n, n);
+
+  pattern_map patterns;
+  patterns[fX.matrixPtr] = stripes(n,n);
+
+  /** Each operator with X as one of its operands */
+  checkPattern (fA*fX, false, patterns);
+  checkPattern (fX*fA, false, patterns);
+  checkPattern (fA*fX*fB + fX, false, patterns);
+  checkPattern (fA - fX, false, patterns);
+  checkPattern (fA*(-fX), false, patterns);
+  checkPattern (fA*transpose(fX), false, patterns);
+  checkPattern (fA*elementwiseProduct(fX, fB), false, patterns);
+  checkPattern (fA*diag(fX), false, patterns);
+  checkPattern (fA*(fX*two) + two*fX, false, patterns);
+  checkPattern (inv(fX)*fA, false, patterns);
+  checkPattern (fX, false, patterns);
+  checkPattern (fX, true, patterns);
+
+  /** X used several times, and next to an unrestricted variable */
+  checkPattern (fA + fX*transpose(fX), true, patterns);
+  checkPattern (fA*fX*fY*fX + inv(fY), false, patterns);
+  patterns[fY.matrixPtr] = stripes(n,n).transpose();
+  checkPattern (fA*fX*fY*fX + inv(fY), false, patterns);
+
+  /** Rectangular variables */
+  matrix_type R = matrix_type::Random(n,3);
+  MMFunc fR(R, false);
+  pattern_map rectangular;
+  rectangular[fR.matrixPtr] = stripes(n,3);
+  checkPattern (fR*transpose(fR)*fA, false, rectangular);
+  checkPattern (fA + fR*transpose(fR), true, rectangular);
+}
+
+/** The gradient of the graphical lasso objective logdet(X) - trace(S*X) on
+    the pattern of the precision matrix X */
+void testGraphicalLasso () {
+  const int n = 40;
+  const sparse_type pattern = stripes(n,n) +
+                              sparse_type(stripes(n,n).transpose());
+  matrix_type X = matrix_type(pattern) * 0.1 + n*matrix_type::Identity(n,n);
+  X = restrict_to(X, pattern);
+  const matrix_type C = matrix_type::Random(n,n);
+  const matrix_type S = C * C.transpose();
+
+  MMFunc fX(X, false);
+  MMFunc fS(S, true);
+  pattern_map patterns;
+  patterns[fX.matrixPtr] = pattern;
+
+  graph_type logdetGraph(fX, AMD::kLogdetRoot);
+  graph_type traceGraph(fS*fX, AMD::kTraceRoot);
+  evaluator_type logdet(logdetGraph, patterns);
+  evaluator_type trace(traceGraph, patterns);
+  std::vector<sparse_type> g1, g2;
+  const double value = logdet.evaluate(&g1) - trace.evaluate(&g2);
+  assert_close (value, std::log(X.determinant()) - (S*X).trace());
+
+  const sparse_type gradient = g1[0] - g2[0];
+  assert_close (matrix_type(gradient),
+                restrict_to(matrix_type(X.inverse().transpose() - S.transpose()),
+                            pattern));
+}
+
+void testErrors () {
+  const int n = 4;
+  matrix_type X = random_matrix(n);
+  MMFunc fX(X, false);
+  pattern_map patterns;
+  patterns[fX.matrixPtr] = stripes(n+1,n);
+
+  bool thrown = false;
+  try { evaluator_type eval(graph_type(fX, AMD::kTraceRoot), patterns); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+
+  thrown = false;
+  patterns[fX.matrixPtr] = stripes(n,n);
+  try { evaluator_type eval(graph_type(fX), patterns); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+
+  thrown = false;
+  evaluator_type eval(graph_type(fX, AMD::kTraceRoot), patterns);
+  try { eval.evaluate(std::vector<matrix_type>(2, X)); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+}
+
+int main(int argc, char** argv) {
+
+  std::cout << "Testing restricted gradients of each operator .... ";
+  testOperators();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing the graphical lasso gradient .... ";
+  testGraphicalLasso();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing invalid patterns and bindings .... ";
+  testErrors();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
@@ -1,76 +1,97 @@
-#include <iostream>
-#include <string>
-#include <cstdio>
-#include <assert.h>
-#include <AMD/AMD.hpp>
-#include "boost/shared_ptr.hpp"
-
-/**
- * TODO: Add more extensize tests and ensure that the results are correct.
- */ 
-void testSymbolicScalarMatlab() {
-  AMD::SymbolicScalarMatlab a("a");
-  AMD::SymbolicScalarMatlab b("b");
-  AMD::SymbolicScalarMatlab c("c");
-  AMD::SymbolicScalarMatlab d = AMD::sqrt(a+b*a/c-c);
-  std::string ans = std::string("sqrt((a+((b*a)/c))-c)");
-  assert( d.getString() == ans );
-  AMD::SymbolicScalarMatlab e(1.2);
-  ans = std::string("1.2");
-  assert(e.getString() == ans);
-}
-
-/**
- * TODO: Add more extensive tests and ensure that the results are correct.
- */ 
-void testSymbolicMatrixMatlab() {
-  AMD::SymbolicMatrixMatlab a("A");
-  AMD::SymbolicMatrixMatlab b("B");
-  AMD::SymbolicMatrixMatlab c("C");
-  AMD::SymbolicMatrixMatlab d = AMD::inv(a+b*(AMD::transpose(a)-c));
-  std::string ans = std::string("inv(A+(B*(A'-C)))");
-  assert(d.getString() == ans);
-
-  AMD::SymbolicScalarMatlab e = AMD::trace(AMD::transpose(a+b));
-  ans = "trace((A+B)')";
-  assert(e.getString() == ans);
-
-  e = AMD::logdet(a-b*c);
-  ans = "log(det(A-(B*C)))";
-  assert(e.getString() == ans);
-
-  e = AMD::fnorm(a+AMD::elementwiseProduct(b,c));
-  ans = "norm(A+(B.*C),'fro')";
-  assert( e.getString() == ans );
-
-  AMD::SymbolicScalarMatlab f("f");
-  b = f*a+a/f;
-  ans = "((f.*A)+(A./f))";
-  assert(b.getString() == ans);
-
-  b = a*f;
-  ans = "(f.*A)";
-  assert(b.getString() == ans);
-
-  // check sizes
-  AMD::SymbolicMatrixMatlab x("X",2,3);
-  AMD::SymbolicMatrixMatlab y("B",3,5);
-  AMD::SymbolicMatrixMatlab z("C",2,5);
-  AMD::SymbolicMatrixMatlab u = transpose(x*y+z);
-  assert(u.getNumRows()==5 && u.getNumCols()==2);
-}
-
-
-int main() {
-  std::cout << "Testing SymbolicScalarMatlab .... ";
-  testSymbolicScalarMatlab();
-  std::cout << "DONE" << std::endl;
-
-  std::cout << "Testing SymbolicScalarMatlab .... ";
-  testSymbolicMatrixMatlab();
-  std::cout << "DONE" << std::endl;
-
-  std::cout << "All tests passed." << std::endl;
-
-  return(0);
-}
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <assert.h>
+#include <AMD/AMD.hpp>
+#include "boost/shared_ptr.hpp"
+
+/**
+ * TODO: Add more extensize tests and ensure that the results are correct.
+ */ 
+void testSymbolicScalarMatlab() {
+  AMD::SymbolicScalarMatlab a("a");
+  AMD::SymbolicScalarMatlab b("b");
+  AMD::SymbolicScalarMatlab c("c");
+  AMD::SymbolicScalarMatlab d = AMD::sqrt(a+b*a/c-c);
+  std::string ans = std::string("sqrt((a+((b*a)/c))-c)");
+  assert( d.getString() == ans );
+  AMD::SymbolicScalarMatlab e(1.2);
+  ans = std::string("1.2");
+  assert(e.getString() == ans);
+}
+
+/**
+ * TODO: Add more extensive tests and ensure that the results are correct.
+ */ 
+void testSymbolicMatrixMatlab() {
+  AMD::SymbolicMatrixMatlab a("A");
+  AMD::SymbolicMatrixMatlab b("B");
+  AMD::SymbolicMatrixMatlab c("C");
+  AMD::SymbolicMatrixMatlab d = AMD::inv(a+b*(AMD::transpose(a)-c));
+  std::string ans = std::string("inv(A+(B*(A'-C)))");
+  assert(d.getString() == ans);
+
+  AMD::SymbolicScalarMatlab e = AMD::trace(AMD::transpose(a+b));
+  ans = "trace((A+B)')";
+  assert(e.getString() == ans);
+
+  e = AMD::logdet(a-b*c);
+  ans = "log(det(A-(B*C)))";
+  assert(e.getString() == ans);
+
+  e = AMD::fnorm(a+AMD::elementwiseProduct(b,c));
+  ans = "norm(A+(B.*C),'fro')";
+  assert( e.getString() == ans );
+
+  AMD::SymbolicScalarMatlab f("f");
+  b = f*a+a/f;
+  ans = "((f.*A)+(A./f))";
+  assert(b.getString() == ans);
+
+  b = a*f;
+  ans = "(f.*A)";
+  assert(b.getString() == ans);
+
+  // check sizes
+  AMD::SymbolicMatrixMatlab x("X",2,3);
+  AMD::SymbolicMatrixMatlab y("B",3,5);
+  AMD::SymbolicMatrixMatlab z("C",2,5);
+  AMD::SymbolicMatrixMatlab u = transpose(x*y+z);
+  assert(u.getNumRows()==5 && u.getNumCols()==2);
+}
+
+/** Taylor coefficients of logdet(X0 + t*D) as expressions */
+void testSymbolicTaylor() {
+  typedef AMD::SymbolicMatrixMatlab MT;
+  typedef AMD::SymbolicScalarMatlab ST;
+  MT x0("X0", 3, 3);
+  MT delta("D", 3, 3);
+  AMD::MatrixMatrixFunc<MT, ST> fX0(x0, false);
+  AMD::ComputationGraph<MT, ST> graph(fX0, AMD::kLogdetRoot);
+  AMD::TaylorEvaluator<MT, ST> taylor(graph, 2);
+  taylor.evaluate(std::vector<MT>(1, delta));
+  std::vector<ST> g;
+  taylor.scalarCoefficients(g);
+  assert(3 == g.size());
+  assert(g[0].getString() == "log(det(X0))");
+  assert(g[1].getString() == "trace(inv(X0)*D)");
+  assert(g[2].getString() == "(trace((-(inv(X0)*(D*inv(X0))))*D)/2)");
+}
+
+int main() {
+  std::cout << "Testing SymbolicScalarMatlab .... ";
+  testSymbolicScalarMatlab();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing SymbolicScalarMatlab .... ";
+  testSymbolicMatrixMatlab();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing symbolic Taylor coefficients .... ";
+  testSymbolicTaylor();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}
@@ -0,0 +1,200 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+#include <boost/shared_ptr.hpp>
+
+#include <AMD/AMD.hpp>
+#include <Eigen/Dense>
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> plain_type;
+typedef AMD::TiledMatrix<double> matrix_type;
+typedef AMD::MatrixAdaptor_t<matrix_type> adaptor_type;
+typedef adaptor_type::value_type value_type;
+typedef AMD::MatrixMatrixFunc<matrix_type, value_type> MMFunc;
+typedef AMD::ScalarMatrixFunc<matrix_type, value_type> SMFunc;
+typedef AMD::ComputationGraph<matrix_type, value_type> graph_type;
+
+void assert_close (const plain_type& A, const plain_type& B) {
+  assert (A.rows() == B.rows() && A.cols() == B.cols());
+  assert ((A-B).norm() <= 1e-9 * (1.0 + B.norm()));
+}
+
+void assert_close (double a, double b) {
+  double error = a-b;
+  error = (0.0 > error) ? -error: error;
+  assert (error <= 1e-9 * (1.0 + std::fabs(b)));
+}
+
+/** Tiles of 4 x 4, so that 10 x 10 matrices have partial edge tiles */
+void testKernels () {
+  const int n = 10, k = 7;
+  const plain_type pA = plain_type::Random(n, k);
+  const plain_type pB = plain_type::Random(k, n);
+  const plain_type pC = plain_type::Random(n, k);
+  const matrix_type A(pA), B(pB), C(pC);
+  assert (3 == A.tileRows() && 2 == A.tileCols());
+  assert (2 == A.tileHeight(2) && 3 == A.tileWidth(1));
+  assert_close (A.toPlain(), pA);
+
+  matrix_type D;
+  adaptor_type::multiply(A, B, D);
+  assert_close (D.toPlain(), pA*pB);
+  adaptor_type::add(A, C, D);
+  assert_close (D.toPlain(), pA + pC);
+  adaptor_type::minus(A, C, D);
+  assert_close (D.toPlain(), pA - pC);
+  adaptor_type::elementwiseProduct(A, C, D);
+  assert_close (D.toPlain(), pA.cwiseProduct(pC));
+  adaptor_type::transpose(A, D);
+  assert_close (D.toPlain(), pA.transpose());
+  adaptor_type::negation(A, D);
+  assert_close (D.toPlain(), -pA);
+  adaptor_type::multiply(A, 3.0, D);
+  assert_close (D.toPlain(), 3.0*pA);
+
+  const plain_type pS = pA*pB;
+  const matrix_type S(pS);
+  assert_close (adaptor_type::trace(S), pS.trace());
+  adaptor_type::diag(S, D);
+  assert_close (D.toPlain(), plain_type(pS.diagonal().asDiagonal()));
+
+  /** Results may overwrite an operand */
+  D = A;
+  adaptor_type::add(D, C, D);
+  assert_close (D.toPlain(), pA + pC);
+  assert_close (A.toPlain(), pA);
+
+  /** Only the diagonal tiles of eye() are written, so a product with it
+      skips the others */
+  const matrix_type I = adaptor_type::eye(n);
+  assert (!I.isZeroTile(1, 1) && I.isZeroTile(0, 1) && I.isZeroTile(2, 0));
+  assert_close (I.toPlain(), plain_type::Identity(n, n));
+  adaptor_type::multiply(S, I, D);
+  assert_close (D.toPlain(), pS);
+  const matrix_type Z = adaptor_type::zeros(n, k);
+  assert (Z.isZeroTile(0, 0));
+  adaptor_type::multiply(Z, B, D);
+  assert (D.isZeroTile(1, 1) && 0.0 == D.toPlain().norm());
+  adaptor_type::minus(Z, A, D);
+  assert_close (D.toPlain(), -pA);
+
+  /** inv and logdet need a single tile */
+  const plain_type R = plain_type::Random(3, 3);
+  const plain_type pP = R*R.transpose() + 3.0*plain_type::Identity(3, 3);
+  const matrix_type P(pP);
+  adaptor_type::inv(P, D);
+  assert_close (D.toPlain(), pP.inverse());
+  assert_close (adaptor_type::logdet(P), std::log(pP.determinant()));
+  bool thrown = false;
+  try { adaptor_type::inv(S, D); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+}
+
+void testFiles () {
+  const int n = 10;
+  const std::string path = AMD::TileSettings::scratchDirectory() +
+                           "/TestTiledMatrix.tiles";
+  const plain_type pA = plain_type::Random(n, n);
+  matrix_type(pA).save(path);
+
+  const matrix_type A = matrix_type::open(path, n, n);
+  assert_close (A.toPlain(), pA);
+
+  /** Zero tiles are saved as holes and read back as zeros */
+  adaptor_type::eye(n).save(path);
+  assert_close (matrix_type::open(path, n, n).toPlain(),
+                plain_type::Identity(n, n));
+
+  /** Opened files are read-only */
+  bool thrown = false;
+  try { matrix_type B = A; B.writeTile(0, 0, plain_type::Zero(4, 4)); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+
+  /** The file has to hold the whole matrix */
+  thrown = false;
+  try { matrix_type::open(path, 2*n, n); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+  std::remove(path.c_str());
+
+  thrown = false;
+  try { matrix_type::open(path, n, n); }
+  catch (const AMD::exception_generic_impl&) { thrown = true; }
+  assert (thrown);
+}
+
+/** The cache keeps no more tiles than its capacity */
+void testCache () {
+  const int n = 16;
+  AMD::TileCache& cache = AMD::TileCache::instance();
+  const std::size_t capacity = cache.capacity();
+  const plain_type pA = plain_type::Random(n, n);
+  const matrix_type A(pA);
+  const std::size_t tileBytes = sysconf(_SC_PAGESIZE);
+
+  cache.setCapacity(3*tileBytes);
+  assert (cache.residentBytes() <= 3*tileBytes);
+  const std::size_t misses = cache.misses();
+  matrix_type B;
+  adaptor_type::multiply(A, A, B);
+  assert (cache.residentBytes() <= 3*tileBytes);
+  assert (cache.misses() > misses);
+  assert_close (B.toPlain(), pA*pA);
+
+  cache.setCapacity(capacity);
+}
+
+/** trace(A*X) with A in a file; its gradient is A^T */
+void testGradient () {
+  const int n = 10;
+  const std::string path = AMD::TileSettings::scratchDirectory() +
+                           "/TestTiledMatrixGradient.tiles";
+  const plain_type pA = plain_type::Random(n, n);
+  const plain_type pX = plain_type::Random(n, n);
+  matrix_type(pA).save(path);
+  const matrix_type A = matrix_type::open(path, n, n);
+
+  MMFunc fA(A, true);
+  MMFunc fX(matrix_type(pX), false);
+  SMFunc f = AMD::trace(fA*fX);
+  assert_close (f.functionVal, (pA*pX).trace());
+  assert_close (f.derivativeVal.toPlain(), pA.transpose());
+
+  graph_type graph(fA*fX, AMD::kTraceRoot);
+  AMD::SharedEvaluator<matrix_type, value_type> shared(graph);
+  std::vector<matrix_type> point(1, matrix_type(pX)), gradient;
+  assert_close (shared.evaluate(point, &gradient), (pA*pX).trace());
+  assert_close (gradient[0].toPlain(), pA.transpose());
+  std::remove(path.c_str());
+}
+
+int main(int argc, char** argv) {
+
+  AMD::TileSettings::setTileSize(4);
+
+  std::cout << "Testing tiled kernels .... ";
+  testKernels();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing tiled files .... ";
+  testFiles();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing the tile cache .... ";
+  testCache();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "Testing out-of-core gradients .... ";
+  testGradient();
+  std::cout << "DONE" << std::endl;
+
+  std::cout << "All tests passed." << std::endl;
+
+  return(0);
+}